@@ -7,9 +7,26 @@
 #include <string.h>
 
 #include <initializer_list>
+#include <type_traits>
 
 namespace mn
 {
+	// the kinds of containers which are recorded by the growth tracking mode, see mn/Growth.h
+	enum GROWTH_KIND: uint8_t
+	{
+		GROWTH_KIND_BUF,
+		GROWTH_KIND_STR,
+		GROWTH_KIND_SET,
+		GROWTH_KIND_MAP,
+	};
+
+#if MN_GROWTH_TRACKING
+	// records a growth of a container storage at the current callstack, it's called by the containers only when mn is
+	// built with the MN_GROWTH_TRACKING flag
+	MN_EXPORT void
+	_growth_track(GROWTH_KIND kind, size_t element_size, size_t new_cap, size_t copied_bytes);
+#endif
+
 	// Buf is the workhorse of the containers, it's a dynamic array
 	template<typename T>
 	struct Buf
@@ -195,6 +212,12 @@ namespace mn
 		if (self.allocator == nullptr)
 			self.allocator = allocator_top();
 
+#if MN_GROWTH_TRACKING
+		// the first allocation isn't a growth since nothing gets copied
+		if (self.cap)
+			_growth_track(std::is_same_v<T, char> ? GROWTH_KIND_STR : GROWTH_KIND_BUF, sizeof(T), new_count, self.count * sizeof(T));
+#endif
+
 		Block new_block = alloc_from(self.allocator,
 									 new_count * sizeof(T),
 									 alignof(T));
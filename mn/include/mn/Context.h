@@ -112,6 +112,10 @@ namespace mn
 	MN_EXPORT Log_Interface
 	log_interface_set(Log_Interface self);
 
+	// returns the current logger hooks
+	MN_EXPORT Log_Interface
+	_log_interface();
+
 	MN_EXPORT void
 	_log_debug_str(const char* msg);
 
@@ -133,6 +137,8 @@ namespace mn
 	typedef struct IMutex_RW* Mutex_RW;
 
 	// multi-threading profiling hooks
+	// mn mutexes call these hooks and they're created and locked inside the allocators, so the library code which runs
+	// from inside the hooks or the allocators protects its state with a std::mutex instead
 	struct Thread_Profile_Interface
 	{
 		// Thread hooks functions
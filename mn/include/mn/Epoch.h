@@ -0,0 +1,80 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/Memory.h"
+#include "mn/Task.h"
+
+#include <utility>
+
+namespace mn
+{
+	// epoch based reclamation
+	// it's used to share read mostly data (like a routing table snapshot) between threads without locking the
+	// readers, the writer builds a new snapshot, publishes it by swapping an atomic pointer, then retires the old
+	// snapshot, readers load the atomic pointer and use the snapshot without any locks, the retired snapshot is
+	// freed only after all the reader threads pass a quiescent point, which is a point where the thread doesn't hold
+	// any snapshot pointer it loaded before
+	//
+	// fabric workers take part automatically, each worker passes a quiescent point after each job and it's offline
+	// while it waits for jobs, so snapshot pointers must not be kept across jobs, other threads which read snapshots
+	// must call epoch_thread_online before reading, and epoch_quiescent/epoch_thread_offline once they're done
+	//
+	//	static std::atomic<Routing_Table*> TABLE;
+	//	// reader (inside a fabric job)
+	//	auto table = TABLE.load(std::memory_order_acquire);
+	//	// writer
+	//	auto old_table = TABLE.exchange(new_table);
+	//	mn::epoch_retire(old_table);
+
+	// marks the calling thread as a reader which might hold snapshot pointers until its next quiescent point or until
+	// it goes offline, it registers the thread on the first call
+	MN_EXPORT void
+	epoch_thread_online();
+
+	// marks the calling thread as offline, an offline thread doesn't hold any snapshot pointers so it doesn't delay
+	// the reclamation while it's doing something else (like sleeping or waiting for jobs)
+	MN_EXPORT void
+	epoch_thread_offline();
+
+	// announces that the calling thread doesn't hold any snapshot pointer which it loaded before this call, it's a
+	// no-op for threads which are offline
+	MN_EXPORT void
+	epoch_quiescent();
+
+	// schedules the given task to run once all the online threads pass a quiescent point, it should be called after
+	// the retired data is unpublished
+	MN_EXPORT void
+	epoch_task_defer(Task<void()> task);
+
+	// schedules any callable to run once all the online threads pass a quiescent point
+	template<typename TFunc>
+	inline static void
+	epoch_defer(TFunc&& fn)
+	{
+		epoch_task_defer(Task<void()>::make(std::forward<TFunc>(fn)));
+	}
+
+	// destructs and frees the given pointer once all the online threads pass a quiescent point
+	template<typename T>
+	inline static void
+	epoch_retire(T* ptr, Allocator allocator = allocator_top())
+	{
+		epoch_defer([ptr, allocator] {
+			free_destruct_from(allocator, ptr);
+		});
+	}
+
+	// runs the deferred tasks which are safe to run now, and returns their count, it's called periodically by the
+	// fabric sysmon thread, and by epoch_task_defer when the deferred tasks pile up
+	MN_EXPORT size_t
+	epoch_reclaim();
+
+	// blocks until all the tasks which were deferred before this call have run, it waits for every online thread to
+	// pass a quiescent point, so it must not be called while the calling thread holds a snapshot pointer
+	MN_EXPORT void
+	epoch_synchronize();
+
+	// returns the number of deferred tasks which didn't run yet
+	MN_EXPORT size_t
+	epoch_pending_count();
+}
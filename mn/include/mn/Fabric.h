@@ -9,6 +9,9 @@
 #include "mn/OS.h"
 #include "mn/Stream.h"
 #include "mn/Assert.h"
+#include "mn/Trace.h"
+#include "mn/Histogram.h"
+#include "mn/Buf.h"
 
 #include <atomic>
 #include <chrono>
@@ -72,6 +75,9 @@ namespace mn
 				Waitgroup wg;
 			} as_compute;
 		};
+		// the time when the task was pushed into a worker queue in nanoseconds, it's set by the worker and used to
+		// measure the time the task waited in the queue
+		uint64_t queued_time_in_ns;
 	};
 
 	// runs the given fabric task instance
@@ -283,6 +289,63 @@ namespace mn
 	MN_EXPORT size_t
 	fabric_workers_count(Fabric self);
 
+	// runtime statistics of a single fabric worker
+	struct Fabric_Worker_Stats
+	{
+		// the index of the worker within the fabric
+		size_t index;
+		// the number of tasks which are waiting in the worker queue
+		size_t queue_depth;
+		// the number of tasks which the worker executed
+		uint64_t tasks_executed;
+		// the number of tasks which sysmon moved to the worker queue from the queue of a busier worker
+		uint64_t tasks_stolen;
+		// the time the worker spent running tasks
+		uint64_t busy_time_in_ns;
+		// the time the worker spent waiting for tasks
+		uint64_t idle_time_in_ns;
+	};
+
+	// runtime statistics of a fabric, the counters and histograms accumulate since the fabric was created
+	struct Fabric_Stats
+	{
+		// the workers which currently serve the fabric, one per fabric index
+		Buf<Fabric_Worker_Stats> workers;
+		// the totals of all the workers which ever served the fabric, including the replaced ones
+		uint64_t tasks_executed;
+		uint64_t tasks_stolen;
+		// the number of tasks which were scheduled and didn't finish yet
+		size_t available_jobs;
+		// the number of workers which sysmon replaced because they exceeded the coop blocking threshold
+		uint64_t blocking_replacements;
+		// the number of workers which sysmon replaced because they exceeded the external blocking threshold
+		uint64_t long_running_replacements;
+		// replaced workers which are still running their blocking task
+		size_t sleepy_side_workers_count;
+		// replaced workers which finished their blocking task and are ready to replace other workers
+		size_t ready_side_workers_count;
+		// the time the tasks waited in the worker queues in nanoseconds
+		Histogram queue_wait_time_in_ns;
+		// the time the tasks took to execute in nanoseconds
+		Histogram execution_time_in_ns;
+	};
+
+	// returns the runtime statistics of the given fabric, every worker updates its own counters so collecting them
+	// doesn't add any contention to the workers
+	MN_EXPORT Fabric_Stats
+	fabric_stats(Fabric self, Allocator allocator = allocator_top());
+
+	// frees the given fabric statistics
+	MN_EXPORT void
+	fabric_stats_free(Fabric_Stats& self);
+
+	// destruct overload of fabric_stats_free
+	inline static void
+	destruct(Fabric_Stats& self)
+	{
+		fabric_stats_free(self);
+	}
+
 	// schedules the given callable into the given fabric
 	template<typename TFunc>
 	inline static void
@@ -774,10 +837,16 @@ namespace mn
 		mn_defer{chan_unref(self);};
 
 		mutex_lock(self->mtx);
-		cond_var_wait(self->write_cv, self->mtx, [self] {
+		auto can_send = [self] {
 			return (self->r.count < size_t(self->atomic_limit.load()) ||
 					chan_closed(self));
-		});
+		};
+		if (can_send() == false)
+		{
+			auto block_start = trace_now();
+			cond_var_wait(self->write_cv, self->mtx, can_send);
+			trace_complete("chan send blocked", "chan", block_start);
+		}
 
 		if (chan_closed(self))
 			panic("cannot send in a closed channel");
@@ -835,9 +904,15 @@ namespace mn
 		mn_defer{chan_unref(self);};
 
 		mutex_lock(self->mtx);
-		cond_var_wait(self->read_cv, self->mtx, [self] {
+		auto can_recv = [self] {
 			return self->r.count > 0 || chan_closed(self);
-		});
+		};
+		if (can_recv() == false)
+		{
+			auto block_start = trace_now();
+			cond_var_wait(self->read_cv, self->mtx, can_recv);
+			trace_complete("chan recv blocked", "chan", block_start);
+		}
 
 		if(self->r.count > 0)
 		{
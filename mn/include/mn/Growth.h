@@ -0,0 +1,58 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/Base.h"
+#include "mn/Buf.h"
+#include "mn/Stream.h"
+
+namespace mn
+{
+	// growth tracking
+	// when mn is built with the MN_GROWTH_TRACKING flag every reallocation of a Buf, Str, Set or Map storage is
+	// recorded with the callstack which caused it, the growths are grouped by their call site so you can find the
+	// hot loops which would benefit from a buf_reserve/map_reserve call, the first allocation of a container isn't
+	// a growth, only reallocations of an existing storage are recorded, when the flag is off the report is empty
+	//
+	// note: the values of a set/map live in a Buf so their reallocations are reported as buf growths (with the key
+	// value pair as the element) while the set/map growths are the rehashes of the slots table
+
+	// the maximum number of callstack frames which identify a call site
+	constexpr size_t GROWTH_MAX_FRAMES = 16;
+
+	// the recorded growths of a single call site
+	struct Growth_Site
+	{
+		GROWTH_KIND kind;
+		// the size of a single element of the container, it's the hash slot size for sets and maps
+		size_t element_size;
+		// the number of reallocations at this call site
+		size_t growths_count;
+		// the bytes which were copied from the old storage to the new one in all the reallocations
+		size_t copied_bytes;
+		// the biggest capacity (in elements) a container reached at this call site
+		size_t peak_capacity;
+		void* frames[GROWTH_MAX_FRAMES];
+		size_t frames_count;
+	};
+
+	// returns whether mn is built with the MN_GROWTH_TRACKING flag
+	MN_EXPORT bool
+	growth_tracking_enabled();
+
+	// returns the name of the given growth kind
+	MN_EXPORT const char*
+	growth_kind_name(GROWTH_KIND kind);
+
+	// returns the recorded call sites sorted by the copied bytes, the most expensive call site comes first
+	MN_EXPORT Buf<Growth_Site>
+	growth_report(Allocator allocator = allocator_top());
+
+	// prints the most expensive call sites with their callstacks to the given stream, if max_sites is 0 all the call
+	// sites are printed, note that callstacks are only symbolized in debug builds
+	MN_EXPORT void
+	growth_report_print(Stream out, size_t max_sites = 0);
+
+	// clears all the recorded call sites
+	MN_EXPORT void
+	growth_reset();
+}
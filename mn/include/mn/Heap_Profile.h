@@ -0,0 +1,87 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/Base.h"
+#include "mn/Stream.h"
+#include "mn/Result.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mn
+{
+	// heap profiler
+	// a low overhead heap profiler which is built on top of the memory profiling hooks, every allocation updates
+	// per thread counters which only the owning thread writes to, and a callstack is only captured for sampled
+	// allocations, allocations are sampled on average once every sample period bytes (poisson sampling) so big
+	// allocations are more likely to be sampled, the sampled allocations are scaled back to estimate the whole
+	// heap when the profile is dumped in pprof format
+
+	// the count of allocation size classes, size class i contains sizes in range [2^(i-1), 2^i), size class 0
+	// contains empty allocations and the last size class contains all the bigger sizes
+	constexpr size_t HEAP_PROFILE_SIZE_CLASSES_COUNT = 32;
+
+	// heap profiler settings
+	struct Heap_Profile_Settings
+	{
+		// the average number of allocated bytes between samples
+		// default: 512KB
+		size_t sample_period;
+		// the maximum number of callstack frames which are captured per sample
+		// default: 32, max: 64
+		size_t max_frames;
+	};
+
+	// allocation counters of a single size class
+	struct Heap_Profile_Counters
+	{
+		uint64_t alloc_count;
+		uint64_t alloc_bytes;
+		uint64_t free_count;
+		uint64_t free_bytes;
+	};
+
+	// heap profiler statistics since the profiler was started
+	struct Heap_Profile_Stats
+	{
+		Heap_Profile_Counters total;
+		Heap_Profile_Counters size_classes[HEAP_PROFILE_SIZE_CLASSES_COUNT];
+		// the number of sampled allocations
+		uint64_t samples_count;
+		// the number of sampled allocations which are still alive
+		uint64_t live_samples_count;
+	};
+
+	// returns the size class of the given allocation size
+	inline static size_t
+	heap_profile_size_class(size_t size)
+	{
+		size_t res = 0;
+		while (size > 0 && res < HEAP_PROFILE_SIZE_CLASSES_COUNT - 1)
+		{
+			size >>= 1;
+			++res;
+		}
+		return res;
+	}
+
+	// starts the heap profiler by installing it as the memory profile interface, the previous memory profile
+	// interface is still called for every allocation and free, it resets the statistics and the samples
+	MN_EXPORT void
+	heap_profile_start(const Heap_Profile_Settings& settings = {});
+
+	// stops the heap profiler and restores the previous memory profile interface, the statistics and samples are
+	// kept until the next start so they can still be queried and dumped
+	MN_EXPORT void
+	heap_profile_stop();
+
+	// returns the current statistics of the heap profiler
+	MN_EXPORT Heap_Profile_Stats
+	heap_profile_stats();
+
+	// writes the heap profile in pprof protobuf format (uncompressed) to the given stream, the profile contains the
+	// alloc_objects, alloc_space, inuse_objects and inuse_space sample types, it can be viewed using
+	// `pprof -http=:8080 <binary> <profile>`
+	MN_EXPORT Err
+	heap_profile_dump(Stream out);
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <atomic>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if MN_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+namespace mn
+{
+	// log-linear histogram
+	// values below HISTOGRAM_SUB_BUCKETS get a bucket each, and every power of 2 range above that is split into
+	// HISTOGRAM_SUB_BUCKETS buckets of equal width, so the percentiles are within 12.5% of the real value for the
+	// whole uint64_t range while the histogram has a fixed size (like HdrHistogram with 1 significant digit)
+
+	constexpr uint64_t HISTOGRAM_SUB_BUCKETS_BITS = 3;
+	constexpr uint64_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKETS_BITS;
+	constexpr size_t HISTOGRAM_BUCKETS_COUNT = HISTOGRAM_SUB_BUCKETS * (64 - HISTOGRAM_SUB_BUCKETS_BITS + 1);
+
+	struct Histogram
+	{
+		uint64_t count;
+		uint64_t sum;
+		// min and max are only valid when count > 0
+		uint64_t min;
+		uint64_t max;
+		uint64_t buckets[HISTOGRAM_BUCKETS_COUNT];
+	};
+
+	// histogram which is written by a single thread and can be read by other threads at the same time, the writer
+	// doesn't need atomic read-modify-write operations so it's as cheap as the plain histogram, the readers might see
+	// a histogram which is in the middle of an update
+	struct Atomic_Histogram
+	{
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> min;
+		std::atomic<uint64_t> max;
+		std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS_COUNT];
+	};
+
+	// returns the index of the highest set bit of the given non zero value
+	inline static uint64_t
+	_histogram_log2(uint64_t v)
+	{
+		#if MN_COMPILER_GNU || MN_COMPILER_CLANG
+			return 63 - __builtin_clzll(v);
+		#elif MN_COMPILER_MSVC && defined(_M_X64)
+			unsigned long index = 0;
+			_BitScanReverse64(&index, v);
+			return index;
+		#else
+			uint64_t res = 0;
+			while (v >>= 1)
+				++res;
+			return res;
+		#endif
+	}
+
+	// returns the index of the bucket which the given value falls in
+	inline static size_t
+	histogram_bucket(uint64_t value)
+	{
+		if (value < HISTOGRAM_SUB_BUCKETS)
+			return size_t(value);
+		auto exponent = _histogram_log2(value);
+		auto sub_bucket = (value >> (exponent - HISTOGRAM_SUB_BUCKETS_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+		return size_t((exponent - HISTOGRAM_SUB_BUCKETS_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket);
+	}
+
+	// returns the biggest value which falls in the given bucket
+	inline static uint64_t
+	histogram_bucket_max(size_t bucket)
+	{
+		if (bucket < HISTOGRAM_SUB_BUCKETS)
+			return bucket;
+		auto exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS_BITS - 1;
+		auto sub_bucket = bucket % HISTOGRAM_SUB_BUCKETS;
+		auto width = uint64_t(1) << (exponent - HISTOGRAM_SUB_BUCKETS_BITS);
+		return ((HISTOGRAM_SUB_BUCKETS + sub_bucket) << (exponent - HISTOGRAM_SUB_BUCKETS_BITS)) + (width - 1);
+	}
+
+	// adds a value to the histogram
+	inline static void
+	histogram_record(Histogram& self, uint64_t value)
+	{
+		if (self.count == 0 || value < self.min)
+			self.min = value;
+		if (value > self.max)
+			self.max = value;
+		++self.count;
+		self.sum += value;
+		++self.buckets[histogram_bucket(value)];
+	}
+
+	// adds the values of the other histogram to the histogram
+	inline static void
+	histogram_merge(Histogram& self, const Histogram& other)
+	{
+		if (other.count == 0)
+			return;
+		if (self.count == 0 || other.min < self.min)
+			self.min = other.min;
+		if (other.max > self.max)
+			self.max = other.max;
+		self.count += other.count;
+		self.sum += other.sum;
+		for (size_t i = 0; i < HISTOGRAM_BUCKETS_COUNT; ++i)
+			self.buckets[i] += other.buckets[i];
+	}
+
+	// adds the values of the atomic histogram to the histogram
+	inline static void
+	histogram_merge(Histogram& self, const Atomic_Histogram& other)
+	{
+		auto count = other.count.load(std::memory_order_relaxed);
+		if (count == 0)
+			return;
+		auto min = other.min.load(std::memory_order_relaxed);
+		auto max = other.max.load(std::memory_order_relaxed);
+		if (self.count == 0 || min < self.min)
+			self.min = min;
+		if (max > self.max)
+			self.max = max;
+		self.count += count;
+		self.sum += other.sum.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < HISTOGRAM_BUCKETS_COUNT; ++i)
+			self.buckets[i] += other.buckets[i].load(std::memory_order_relaxed);
+	}
+
+	// adds a value to the atomic histogram, only a single thread can write to the histogram
+	inline static void
+	atomic_histogram_record(Atomic_Histogram& self, uint64_t value)
+	{
+		auto count = self.count.load(std::memory_order_relaxed);
+		if (count == 0 || value < self.min.load(std::memory_order_relaxed))
+			self.min.store(value, std::memory_order_relaxed);
+		if (value > self.max.load(std::memory_order_relaxed))
+			self.max.store(value, std::memory_order_relaxed);
+		self.sum.store(self.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		auto& bucket = self.buckets[histogram_bucket(value)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		self.count.store(count + 1, std::memory_order_relaxed);
+	}
+
+	// clears the atomic histogram, it must be called by the thread which writes to the histogram
+	inline static void
+	atomic_histogram_clear(Atomic_Histogram& self)
+	{
+		self.count.store(0, std::memory_order_relaxed);
+		self.sum.store(0, std::memory_order_relaxed);
+		self.min.store(0, std::memory_order_relaxed);
+		self.max.store(0, std::memory_order_relaxed);
+		for (auto& bucket: self.buckets)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+
+	// returns the estimated value at the given percentile (in range [0, 100]), or 0 if the histogram is empty
+	inline static uint64_t
+	histogram_percentile(const Histogram& self, double percentile)
+	{
+		if (self.count == 0)
+			return 0;
+
+		auto rank = uint64_t(double(self.count) * percentile / 100.0 + 0.5);
+		if (rank == 0)
+			rank = 1;
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < HISTOGRAM_BUCKETS_COUNT; ++i)
+		{
+			seen += self.buckets[i];
+			if (seen >= rank)
+			{
+				auto res = histogram_bucket_max(i);
+				if (res > self.max)
+					res = self.max;
+				if (res < self.min)
+					res = self.min;
+				return res;
+			}
+		}
+		return self.max;
+	}
+
+	// returns the mean of the values, or 0 if the histogram is empty
+	inline static uint64_t
+	histogram_mean(const Histogram& self)
+	{
+		if (self.count == 0)
+			return 0;
+		return self.sum / self.count;
+	}
+}
@@ -49,6 +49,8 @@ namespace mn::ipc
 	// sputnik is an inter-process communicateion protocol
 	typedef struct ISputnik* Sputnik;
 
+	struct Sputnik_Shm;
+
 	struct ISputnik final : IStream
 	{
 		union
@@ -58,6 +60,10 @@ namespace mn::ipc
 		};
 		Str name;
 		uint64_t read_msg_size;
+		// the shared memory transport, it's null while the data goes through the OS primitive
+		Sputnik_Shm* shm;
+		// whether the instance was created by sputnik_connect, the connecting side creates the shared memory
+		bool connected;
 
 		MN_EXPORT void
 		dispose() override;
@@ -127,6 +133,29 @@ namespace mn::ipc
 	MN_EXPORT bool
 	sputnik_disconnect(Sputnik self);
 
+	// sputnik shared memory transport
+	// moves the data of a connected sputnik pair into two shared memory ring buffers (one for each direction), so
+	// reading and writing doesn't make any system calls unless the other side is sleeping while it waits for data or
+	// for space in the ring buffer, the transport is negotiated over the existing connection and the sputnik read,
+	// write and message functions keep working the same way, it's only supported on linux
+
+	// shared memory transport settings
+	struct Sputnik_Shm_Settings
+	{
+		// the size of each ring buffer in bytes, it's rounded up to a power of 2 which is at least the page size, it's
+		// decided by the connecting side
+		// default: 1MB
+		size_t ring_size;
+	};
+
+	// switches the given connected sputnik instance to the shared memory transport, both sides should call it at the
+	// same point in the stream (when there's no unread data), it returns false if the transport isn't supported or the
+	// negotiation failed within the given timeout window, if the accepting side rejects the shared memory both sides
+	// keep using the connection as is, but if the connecting side gives up while waiting for the answer (the timeout
+	// expired) the connection is closed for both sides, because the accepting side might have already switched
+	MN_EXPORT bool
+	sputnik_shm_enable(Sputnik self, const Sputnik_Shm_Settings& settings = {}, Timeout timeout = INFINITE_TIMEOUT);
+
 	// sputnik message protocol
 	// a message is an encapsulated binary blob of data which is transimetted over the sputnik stream
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/Base.h"
+#include "mn/Str.h"
+#include "mn/Result.h"
+#include "mn/Fabric.h"
+#include "mn/Json.h"
+#include "mn/memory/Arena.h"
+
+namespace mn
+{
+	// record ingestion
+	// an ingest maps the input file into memory, splits it into newline aligned chunks, parses the chunks in
+	// parallel on a fabric and delivers the parsed records in batches (one batch per chunk) through a channel,
+	// the number of batches in flight is bounded so memory usage doesn't depend on the input size
+
+	// the format of the ingested records
+	enum INGEST_FORMAT
+	{
+		// newline delimited json values, one value per line
+		INGEST_FORMAT_JSON_LINES,
+		// comma separated values (rfc 4180), quoted fields can contain separators, new lines and "" escapes
+		INGEST_FORMAT_CSV,
+	};
+
+	// ingest construction settings
+	struct Ingest_Settings
+	{
+		INGEST_FORMAT format;
+		// the approximate size of every chunk, chunks are extended to the end of the line
+		// default: 4MB
+		size_t chunk_size;
+		// the maximum number of batches which are being parsed or waiting to be consumed
+		// default: 2 * fabric workers count
+		size_t max_batches_in_flight;
+		// by default batches are delivered in the input order, unordered batches are delivered as soon as they
+		// are parsed
+		bool unordered;
+		// the field separator of csv files
+		// default: ','
+		char csv_separator;
+	};
+
+	// a single parsed record
+	struct Ingest_Record
+	{
+		// the offset of the record in the input file
+		size_t offset;
+		// the parsed value of json lines records
+		json::Node json;
+		// the fields of csv records, the fields are views into the mapped file or into the batch arena
+		Str* fields;
+		size_t fields_count;
+	};
+
+	// a batch of records parsed from a single chunk, all of its memory is owned by the ingest and is reused
+	// once the batch is freed
+	struct Ingest_Batch
+	{
+		// the index of the chunk in the input, chunks are numbered in the input order
+		size_t index;
+		// the offset of the chunk in the input file
+		size_t offset;
+		Ingest_Record* records;
+		size_t records_count;
+		// parse error of this chunk, if any, the records before the error are still delivered
+		Err err;
+		// the arena which the records are allocated from
+		memory::Arena* arena;
+	};
+
+	// an ingest handle
+	typedef struct IIngest* Ingest;
+
+	// maps the given file and starts parsing it on the given fabric, if fabric is nullptr it will use the local
+	// fabric
+	MN_EXPORT Result<Ingest>
+	ingest_new(const Str& filename, Fabric fabric, const Ingest_Settings& settings);
+
+	// maps the given file and starts parsing it on the given fabric, if fabric is nullptr it will use the local
+	// fabric
+	inline static Result<Ingest>
+	ingest_new(const char* filename, Fabric fabric, const Ingest_Settings& settings)
+	{
+		return ingest_new(str_lit(filename), fabric, settings);
+	}
+
+	// stops the ingestion and frees the given ingest, all the received batches should be freed before this call
+	MN_EXPORT void
+	ingest_free(Ingest self);
+
+	// destruct overload for ingest free
+	inline static void
+	destruct(Ingest self)
+	{
+		ingest_free(self);
+	}
+
+	// returns the channel which the parsed batches are delivered through, the channel is closed after the last batch
+	// example usage:
+	// for (auto batch: ingest_batches(ingest))
+	// {
+	// 	for (size_t i = 0; i < batch->records_count; ++i)
+	// 		process(batch->records[i]);
+	// 	ingest_batch_free(ingest, batch);
+	// }
+	MN_EXPORT Chan<Ingest_Batch*>
+	ingest_batches(Ingest self);
+
+	// returns the given batch to the ingest so its memory can be reused for the next chunks
+	MN_EXPORT void
+	ingest_batch_free(Ingest self, Ingest_Batch* batch);
+}
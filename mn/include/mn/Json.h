@@ -7,6 +7,12 @@
 #include "mn/Result.h"
 #include "mn/Fmt.h"
 #include "mn/Assert.h"
+#include "mn/Reader.h"
+#include "mn/memory/Arena.h"
+
+#include <tuple>
+#include <limits>
+#include <type_traits>
 
 namespace mn::json
 {
@@ -290,6 +296,342 @@ namespace mn::json
 		return value_clone(other);
 	}
 
+	// json document
+	// a document is an alternative representation of json values which is optimized for parsing speed, all the
+	// nodes, keys and strings of the document are allocated from a single arena so the whole document is freed at
+	// once, numbers are stored as int64 if they are integers that fit in int64 or as double otherwise, strings are
+	// unescaped and null terminated, and object members are stored in a flat array in the same order they appear
+	// in the input with a hash index for large objects
+	struct Node_Object;
+
+	// represents a json node inside a document
+	struct Node
+	{
+		enum KIND: uint8_t
+		{
+			KIND_NULL,
+			KIND_BOOL,
+			KIND_INT,
+			KIND_DOUBLE,
+			KIND_STRING,
+			KIND_ARRAY,
+			KIND_OBJECT,
+		};
+
+		KIND kind;
+		// string: the size in bytes, array: the count of elements, object: the count of members
+		uint32_t count;
+		union
+		{
+			bool as_bool;
+			int64_t as_int;
+			double as_double;
+			const char* as_string;
+			Node* as_array;
+			Node_Object* as_object;
+		};
+	};
+
+	// a key value pair inside a json object node, the key is a view into the document arena
+	struct Node_Member
+	{
+		Str key;
+		Node value;
+	};
+
+	// objects with at least this count of members have a hash index which makes the lookup O(1) instead of
+	// a linear scan over the members
+	constexpr uint32_t NODE_OBJECT_INDEX_THRESHOLD = 16;
+
+	struct Node_Object
+	{
+		Node_Member* members;
+		// open addressing hash table of member indices (index + 1, 0 means an empty slot), it's nullptr
+		// for small objects
+		uint32_t* index;
+		uint32_t index_capacity;
+	};
+
+	// a parsed json document
+	struct Document
+	{
+		Allocator allocator;
+		memory::Arena* arena;
+		Node root;
+	};
+
+	// tries to parse a json document from the encoded string, the nodes are allocated from an arena which uses the
+	// given allocator as its meta allocator
+	MN_EXPORT Result<Document>
+	document_parse(const Str& content, Allocator allocator = allocator_top());
+
+	// tries to parse a json document from the encoded string, the nodes are allocated from an arena which uses the
+	// given allocator as its meta allocator
+	inline static Result<Document>
+	document_parse(const char* content, Allocator allocator = allocator_top())
+	{
+		return document_parse(str_lit(content), allocator);
+	}
+
+	// tries to parse a sequence of json values separated by whitespace (like json lines files) from the encoded
+	// string, the nodes are allocated from the given arena, the root node of every value is appended to values
+	// and its offset in the content is appended to offsets
+	MN_EXPORT Err
+	node_parse_lines(const Str& content, memory::Arena* arena, Buf<Node>& values, Buf<size_t>& offsets);
+
+	// frees the given document and all of its nodes
+	MN_EXPORT void
+	document_free(Document& self);
+
+	// destruct overload for document free
+	inline static void
+	destruct(Document& self)
+	{
+		document_free(self);
+	}
+
+	// returns whether the given node is a number (int or double)
+	inline static bool
+	node_is_number(const Node& self)
+	{
+		return self.kind == Node::KIND_INT || self.kind == Node::KIND_DOUBLE;
+	}
+
+	// returns the number value of the given node as double
+	inline static double
+	node_as_double(const Node& self)
+	{
+		mn_assert(node_is_number(self));
+		return self.kind == Node::KIND_INT ? double(self.as_int) : self.as_double;
+	}
+
+	// returns the number value of the given node as int64, doubles are truncated
+	inline static int64_t
+	node_as_int(const Node& self)
+	{
+		mn_assert(node_is_number(self));
+		return self.kind == Node::KIND_INT ? self.as_int : int64_t(self.as_double);
+	}
+
+	// returns a view of the given string node, the view points into the document arena
+	inline static Str
+	node_as_str(const Node& self)
+	{
+		mn_assert(self.kind == Node::KIND_STRING);
+		Str res{};
+		res.ptr = (char*)self.as_string;
+		res.count = self.count;
+		res.cap = self.count;
+		return res;
+	}
+
+	// returns the json node in the given array at the given index
+	inline static const Node&
+	node_array_at(const Node& self, size_t index)
+	{
+		mn_assert(self.kind == Node::KIND_ARRAY && index < self.count);
+		return self.as_array[index];
+	}
+
+	// returns the json member in the given object at the given index, members are in the input order
+	inline static const Node_Member&
+	node_object_at(const Node& self, size_t index)
+	{
+		mn_assert(self.kind == Node::KIND_OBJECT && index < self.count);
+		return self.as_object->members[index];
+	}
+
+	// searches for a key inside the given json object node, returns nullptr if the key doesn't exist, in case
+	// of duplicate keys the last one is returned
+	MN_EXPORT const Node*
+	node_object_lookup(const Node& self, const Str& key);
+
+	// searches for a key inside the given json object node, returns nullptr if the key doesn't exist, in case
+	// of duplicate keys the last one is returned
+	inline static const Node*
+	node_object_lookup(const Node& self, const char* key)
+	{
+		return node_object_lookup(self, str_lit(key));
+	}
+
+	// json pull reader
+	// a pull reader parses the json input incrementally and returns it as a sequence of events, it only keeps a
+	// fixed size window of the input and the current nesting path in memory so it can process inputs which are
+	// much larger than the available memory, the input can contain multiple root values separated by whitespace
+	// like json lines files
+
+	// represents a single event in the json input
+	struct Json_Event
+	{
+		enum KIND: uint8_t
+		{
+			// the input has ended
+			KIND_END,
+			KIND_BEGIN_OBJECT,
+			KIND_END_OBJECT,
+			KIND_BEGIN_ARRAY,
+			KIND_END_ARRAY,
+			// an object key, the next event is the value of this key
+			KIND_KEY,
+			KIND_NULL,
+			KIND_BOOL,
+			KIND_INT,
+			KIND_DOUBLE,
+			KIND_STRING,
+		};
+
+		KIND kind;
+		// the nesting depth of the event, root values and their begin/end events have depth 0
+		uint32_t depth;
+		union
+		{
+			bool as_bool;
+			int64_t as_int;
+			double as_double;
+		};
+		// the unescaped key or string, it's a view into the reader which is valid until the next call
+		Str as_string;
+	};
+
+	// a json pull reader handle
+	typedef struct IJson_Reader* Json_Reader;
+
+	// creates a new json pull reader which reads its input from the given reader
+	MN_EXPORT Json_Reader
+	json_reader_new(Reader reader, Allocator allocator = allocator_top());
+
+	// creates a new json pull reader which reads its input from the given stream
+	MN_EXPORT Json_Reader
+	json_reader_new(Stream stream, Allocator allocator = allocator_top());
+
+	// creates a new json pull reader which reads its input from the given string without copying it, the string
+	// should outlive the reader
+	MN_EXPORT Json_Reader
+	json_reader_new(const Str& content, Allocator allocator = allocator_top());
+
+	// creates a new json pull reader which reads its input from the given string without copying it, the string
+	// should outlive the reader
+	inline static Json_Reader
+	json_reader_new(const char* content, Allocator allocator = allocator_top())
+	{
+		return json_reader_new(str_lit(content), allocator);
+	}
+
+	// frees the given json pull reader, the underlying reader/stream is not freed
+	MN_EXPORT void
+	json_reader_free(Json_Reader self);
+
+	// destruct overload for json reader free
+	inline static void
+	destruct(Json_Reader self)
+	{
+		json_reader_free(self);
+	}
+
+	// reads the next event from the input, returns an error if the input is not valid json, after an error
+	// all the subsequent calls return the same error
+	MN_EXPORT Err
+	json_reader_next(Json_Reader self, Json_Event& event);
+
+	// skips the value of the last returned event without decoding it, if the last event is a begin object/array
+	// it skips until after the matching end event, if it's a key it skips the key's value, and it does nothing
+	// otherwise, the skipped content is only checked for balanced brackets and terminated strings
+	MN_EXPORT Err
+	json_reader_skip(Json_Reader self);
+
+	// json writer
+	// a writer emits json directly into a string or a stream without building a json value first, strings are
+	// escaped and doubles are written in their shortest form which parses back to the same value, the writer
+	// takes care of the commas between the values and asserts that the begin/end and key/value calls are balanced
+
+	// a json writer handle
+	typedef struct IJson_Writer* Json_Writer;
+
+	// creates a new json writer which appends its output to the given string
+	MN_EXPORT Json_Writer
+	json_writer_new(Str* out, Allocator allocator = allocator_top());
+
+	// creates a new json writer which buffers its output and writes it to the given stream
+	MN_EXPORT Json_Writer
+	json_writer_new(Stream stream, Allocator allocator = allocator_top());
+
+	// flushes and frees the given json writer, the underlying string/stream is not freed
+	MN_EXPORT void
+	json_writer_free(Json_Writer self);
+
+	// destruct overload for json writer free
+	inline static void
+	destruct(Json_Writer self)
+	{
+		json_writer_free(self);
+	}
+
+	// writes the buffered output to the underlying stream, it does nothing for string writers
+	MN_EXPORT void
+	json_writer_flush(Json_Writer self);
+
+	// begins a new json object
+	MN_EXPORT void
+	json_writer_begin_object(Json_Writer self);
+
+	// ends the current json object
+	MN_EXPORT void
+	json_writer_end_object(Json_Writer self);
+
+	// begins a new json array
+	MN_EXPORT void
+	json_writer_begin_array(Json_Writer self);
+
+	// ends the current json array
+	MN_EXPORT void
+	json_writer_end_array(Json_Writer self);
+
+	// writes a key inside the current json object, it should be followed by a value
+	MN_EXPORT void
+	json_writer_key(Json_Writer self, const Str& key);
+
+	// writes a key inside the current json object, it should be followed by a value
+	inline static void
+	json_writer_key(Json_Writer self, const char* key)
+	{
+		json_writer_key(self, str_lit(key));
+	}
+
+	// writes a null value
+	MN_EXPORT void
+	json_writer_null(Json_Writer self);
+
+	// writes a boolean value
+	MN_EXPORT void
+	json_writer_bool(Json_Writer self, bool value);
+
+	// writes an integer value
+	MN_EXPORT void
+	json_writer_int(Json_Writer self, int64_t value);
+
+	// writes a double value, nan and infinity are written as null because json can't represent them
+	MN_EXPORT void
+	json_writer_double(Json_Writer self, double value);
+
+	// writes an escaped string value
+	MN_EXPORT void
+	json_writer_string(Json_Writer self, const Str& value);
+
+	// writes an escaped string value
+	inline static void
+	json_writer_string(Json_Writer self, const char* value)
+	{
+		json_writer_string(self, str_lit(value));
+	}
+
+	// writes the given json value, strings are written as is because json::parse keeps them escaped
+	MN_EXPORT void
+	json_writer_value(Json_Writer self, const Value& value);
+
+	// writes the given document node, strings are escaped
+	MN_EXPORT void
+	json_writer_node(Json_Writer self, const Node& node);
+
 	template<typename T>
 	inline static Err
 	unpack(Value v, T* self, Value::KIND kind);
@@ -545,6 +887,331 @@ namespace mn::json
 
 		return Err{};
 	}
+	// json reflection
+	// reflection maps structs to json objects at compile time, it decodes directly from the pull reader events
+	// and encodes directly into a writer so there's no intermediate json value, to reflect a struct define a
+	// json_fields function in the struct's namespace which lists its fields
+	// example usage:
+	// struct Point { int x, y; Str name; Buf<float> weights; };
+	// inline static auto
+	// json_fields(const Point*)
+	// {
+	// 	return mn::json::reflect_fields(
+	// 		mn_json_field(Point, x),
+	// 		mn_json_field(Point, y),
+	// 		mn::json::reflect_field("label", &Point::name),
+	// 		mn_json_field(Point, weights)
+	// 	);
+	// }
+	// Point p{};
+	// auto err = mn::json::reflect_decode(R"({"x": 1, "y": 2, "label": "origin"})", p);
+	// auto json = mn::json::reflect_encode(p);
+	// supported field types are bool, integers, floats, Str, Buf<T> of supported types and reflected structs
+
+	// a reflected field, the json key name and the member pointer
+	template<typename T, typename TMember>
+	struct Reflect_Field
+	{
+		const char* name;
+		TMember T::* member;
+	};
+
+	// creates a reflected field with the given json key name
+	template<typename T, typename TMember>
+	inline static constexpr Reflect_Field<T, TMember>
+	reflect_field(const char* name, TMember T::* member)
+	{
+		return Reflect_Field<T, TMember>{name, member};
+	}
+
+	// creates the list of the reflected fields of a struct
+	template<typename ... TFields>
+	inline static constexpr std::tuple<TFields...>
+	reflect_fields(TFields ... fields)
+	{
+		return std::tuple<TFields...>{fields...};
+	}
+
+	// creates a reflected field whose json key name is the same as the member name
+	#define mn_json_field(type, member) mn::json::reflect_field(#member, &type::member)
+
+	template<typename T, typename = void>
+	struct _Is_Reflected: std::false_type {};
+
+	template<typename T>
+	struct _Is_Reflected<T, std::void_t<decltype(json_fields((const T*)nullptr))>>: std::true_type {};
+
+	inline static const char*
+	_reflect_event_name(Json_Event::KIND kind)
+	{
+		switch (kind)
+		{
+		case Json_Event::KIND_END: return "end of input";
+		case Json_Event::KIND_BEGIN_OBJECT: return "object";
+		case Json_Event::KIND_END_OBJECT: return "end of object";
+		case Json_Event::KIND_BEGIN_ARRAY: return "array";
+		case Json_Event::KIND_END_ARRAY: return "end of array";
+		case Json_Event::KIND_KEY: return "key";
+		case Json_Event::KIND_NULL: return "null";
+		case Json_Event::KIND_BOOL: return "bool";
+		case Json_Event::KIND_INT: return "integer";
+		case Json_Event::KIND_DOUBLE: return "number";
+		case Json_Event::KIND_STRING: return "string";
+		default: return "<UNKNOWN>";
+		}
+	}
+
+	template<typename T>
+	inline static Err
+	_reflect_decode_event(Json_Reader reader, const Json_Event& event, T& self);
+
+	template<typename T>
+	inline static Err
+	_reflect_decode_next(Json_Reader reader, T& self)
+	{
+		Json_Event event{};
+		if (auto err = json_reader_next(reader, event))
+			return err;
+		return _reflect_decode_event(reader, event, self);
+	}
+
+	template<typename T>
+	inline static Err
+	_reflect_decode_buf(Json_Reader reader, const Json_Event& event, Buf<T>& self)
+	{
+		if (event.kind != Json_Event::KIND_BEGIN_ARRAY)
+			return Err{"expected array but found {}", _reflect_event_name(event.kind)};
+
+		// the old elements are destructed before refilling, so Buf<Str> and the like don't leak them, json::destruct
+		// hides the mn overloads here so they're brought back in
+		using mn::destruct;
+		for (auto& element: self)
+			destruct(element);
+		buf_clear(self);
+		while (true)
+		{
+			Json_Event element{};
+			if (auto err = json_reader_next(reader, element))
+				return err;
+			if (element.kind == Json_Event::KIND_END_ARRAY)
+				break;
+
+			buf_push(self, T{});
+			if (auto err = _reflect_decode_event(reader, element, buf_top(self)))
+				return Err{"array element #{}: {}", self.count - 1, err};
+		}
+		return Err{};
+	}
+
+	template<typename T>
+	inline static Err
+	_reflect_decode_struct(Json_Reader reader, const Json_Event& event, T& self)
+	{
+		if (event.kind != Json_Event::KIND_BEGIN_OBJECT)
+			return Err{"expected object but found {}", _reflect_event_name(event.kind)};
+
+		auto fields = json_fields((const T*)nullptr);
+		while (true)
+		{
+			Json_Event key{};
+			if (auto err = json_reader_next(reader, key))
+				return err;
+			if (key.kind == Json_Event::KIND_END_OBJECT)
+				break;
+
+			// the key is a view into the reader so it should be matched before reading the value
+			Err err{};
+			auto decode_field = [&](const auto& field) {
+				if (key.as_string != field.name)
+					return false;
+				if (auto field_err = _reflect_decode_next(reader, self.*field.member))
+					err = Err{"field '{}': {}", field.name, field_err};
+				return true;
+			};
+			auto found = std::apply([&](const auto& ... field) { return (decode_field(field) || ...); }, fields);
+
+			// missing fields keep their values and unknown keys are skipped
+			if (found == false)
+				err = json_reader_skip(reader);
+			if (err)
+				return err;
+		}
+		return Err{};
+	}
+
+	template<typename T>
+	inline static Err
+	_reflect_decode_event(Json_Reader reader, const Json_Event& event, T& self)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			if (event.kind != Json_Event::KIND_BOOL)
+				return Err{"expected bool but found {}", _reflect_event_name(event.kind)};
+			self = event.as_bool;
+			return Err{};
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			if (event.kind == Json_Event::KIND_INT)
+			{
+				auto value = event.as_int;
+				bool in_range = false;
+				if constexpr (std::is_signed_v<T>)
+					in_range = value >= int64_t(std::numeric_limits<T>::min()) && value <= int64_t(std::numeric_limits<T>::max());
+				else
+					in_range = value >= 0 && uint64_t(value) <= uint64_t(std::numeric_limits<T>::max());
+				if (in_range == false)
+					return Err{"integer {} is out of range", value};
+				self = T(value);
+				return Err{};
+			}
+			else if (event.kind == Json_Event::KIND_DOUBLE)
+			{
+				// integers which don't fit in int64 are parsed as doubles, they're accepted if they're integral
+				auto value = event.as_double;
+				if (value >= double(std::numeric_limits<T>::min()) && value < double(std::numeric_limits<T>::max()) + 1.0)
+				{
+					auto integer = T(value);
+					if (double(integer) == value)
+					{
+						self = integer;
+						return Err{};
+					}
+				}
+				return Err{"number {} is not an integer in range", value};
+			}
+			return Err{"expected integer but found {}", _reflect_event_name(event.kind)};
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			if (event.kind == Json_Event::KIND_INT)
+				self = T(event.as_int);
+			else if (event.kind == Json_Event::KIND_DOUBLE)
+				self = T(event.as_double);
+			else
+				return Err{"expected number but found {}", _reflect_event_name(event.kind)};
+			return Err{};
+		}
+		else if constexpr (std::is_same_v<T, Str>)
+		{
+			if (event.kind != Json_Event::KIND_STRING)
+				return Err{"expected string but found {}", _reflect_event_name(event.kind)};
+			str_clear(self);
+			str_push(self, event.as_string);
+			return Err{};
+		}
+		else if constexpr (_is_buf((T*)nullptr))
+		{
+			return _reflect_decode_buf(reader, event, self);
+		}
+		else if constexpr (_Is_Reflected<T>::value)
+		{
+			return _reflect_decode_struct(reader, event, self);
+		}
+		else
+		{
+			static_assert(sizeof(T) == 0, "unsupported reflection type, define json_fields for it");
+			return Err{};
+		}
+	}
+
+	// decodes the next json value of the given reader into the given value
+	template<typename T>
+	inline static Err
+	reflect_decode(Json_Reader reader, T& self)
+	{
+		return _reflect_decode_next(reader, self);
+	}
+
+	// decodes the given json string into the given value, the string should contain a single json value
+	template<typename T>
+	inline static Err
+	reflect_decode(const Str& content, T& self)
+	{
+		auto reader = json_reader_new(content, memory::tmp());
+		auto err = _reflect_decode_next(reader, self);
+		if (!err)
+		{
+			Json_Event event{};
+			err = json_reader_next(reader, event);
+			if (!err && event.kind != Json_Event::KIND_END)
+				err = Err{"unexpected trailing {} after the json value", _reflect_event_name(event.kind)};
+		}
+		json_reader_free(reader);
+		return err;
+	}
+
+	// decodes the given json string into the given value, the string should contain a single json value
+	template<typename T>
+	inline static Err
+	reflect_decode(const char* content, T& self)
+	{
+		return reflect_decode(str_lit(content), self);
+	}
+
+	// encodes the given value as json into the given writer
+	template<typename T>
+	inline static void
+	reflect_encode(Json_Writer writer, const T& self)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			json_writer_bool(writer, self);
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			// unsigned values which don't fit in int64 are written as doubles which is how they're parsed back
+			if constexpr (std::is_unsigned_v<T> && sizeof(T) >= sizeof(int64_t))
+			{
+				if (self > uint64_t(std::numeric_limits<int64_t>::max()))
+				{
+					json_writer_double(writer, double(self));
+					return;
+				}
+			}
+			json_writer_int(writer, int64_t(self));
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			json_writer_double(writer, double(self));
+		}
+		else if constexpr (std::is_same_v<T, Str>)
+		{
+			json_writer_string(writer, self);
+		}
+		else if constexpr (_is_buf((T*)nullptr))
+		{
+			json_writer_begin_array(writer);
+			for (const auto& element: self)
+				reflect_encode(writer, element);
+			json_writer_end_array(writer);
+		}
+		else if constexpr (_Is_Reflected<T>::value)
+		{
+			json_writer_begin_object(writer);
+			std::apply([&](const auto& ... field) {
+				((json_writer_key(writer, field.name), reflect_encode(writer, self.*field.member)), ...);
+			}, json_fields((const T*)nullptr));
+			json_writer_end_object(writer);
+		}
+		else
+		{
+			static_assert(sizeof(T) == 0, "unsupported reflection type, define json_fields for it");
+		}
+	}
+
+	// encodes the given value as a json string
+	template<typename T>
+	inline static Str
+	reflect_encode(const T& self, Allocator allocator = allocator_top())
+	{
+		auto out = str_with_allocator(allocator);
+		auto writer = json_writer_new(&out, memory::tmp());
+		reflect_encode(writer, self);
+		json_writer_free(writer);
+		return out;
+	}
+
 }
 
 namespace fmt
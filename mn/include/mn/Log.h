@@ -1,53 +1,383 @@
 #pragma once
 
+#include "mn/Exports.h"
 #include "mn/Context.h"
 #include "mn/Fmt.h"
 
+#include <atomic>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <stdint.h>
+#include <string.h>
+
 namespace mn
 {
-	// logs a message with debug level, it will be disabled in release mode
+	enum LOG_LEVEL: uint8_t
+	{
+		LOG_LEVEL_DEBUG,
+		LOG_LEVEL_INFO,
+		LOG_LEVEL_WARNING,
+		LOG_LEVEL_ERROR,
+		LOG_LEVEL_CRITICAL,
+	};
+
+	// the minimum level of the log calls which are compiled, the calls below it are removed along with their
+	// formatting code, it can be set to a LOG_LEVEL value using the MN_LOG_LEVEL_MIN cmake option
+	// default: LOG_LEVEL_DEBUG in debug builds and LOG_LEVEL_INFO otherwise
+	#if defined(MN_LOG_LEVEL_MIN)
+	constexpr LOG_LEVEL LOG_LEVEL_MIN = LOG_LEVEL(MN_LOG_LEVEL_MIN);
+	#elif defined(DEBUG)
+	constexpr LOG_LEVEL LOG_LEVEL_MIN = LOG_LEVEL_DEBUG;
+	#else
+	constexpr LOG_LEVEL LOG_LEVEL_MIN = LOG_LEVEL_INFO;
+	#endif
+
+	// log category
+	// a named group of log calls (usually a module) which can have its own minimum level, the categories without a
+	// level use the global one
+	//
+	//	static auto PHYSICS_LOG = mn::log_category("physics");
+	//	mn::log_category_level_set(PHYSICS_LOG, mn::LOG_LEVEL_WARNING);
+	//	mn::log_info(PHYSICS_LOG, "step took {}ms", ms); // filtered out before it's formatted
+	struct Log_Category
+	{
+		const char* name;
+		// the minimum level of the category, LOG_CATEGORY_LEVEL_GLOBAL means the global level is used
+		std::atomic<uint8_t> level;
+	};
+
+	constexpr uint8_t LOG_CATEGORY_LEVEL_GLOBAL = UINT8_MAX;
+
+	// sets the global minimum level at runtime, the messages below it are discarded before they're formatted
+	// default: LOG_LEVEL_DEBUG
+	MN_EXPORT void
+	log_level_set(LOG_LEVEL level);
+
+	// returns the global minimum level
+	MN_EXPORT LOG_LEVEL
+	log_level();
+
+	// returns the category with the given name, it's created the first time it's requested, the returned pointer is
+	// valid until the program exits
+	MN_EXPORT Log_Category*
+	log_category(const char* name);
+
+	// sets the minimum level of the given category, it overrides the global level
+	MN_EXPORT void
+	log_category_level_set(Log_Category* category, LOG_LEVEL level);
+
+	// makes the given category use the global level again
+	MN_EXPORT void
+	log_category_level_reset(Log_Category* category);
+
+	// returns whether a message with the given level and category would be logged, the category can be null, critical
+	// messages are always logged
+	MN_EXPORT bool
+	log_level_enabled(LOG_LEVEL level, const Log_Category* category = nullptr);
+
+	// async logging
+	// when the async logger is running the log functions don't format their messages, they push the format string
+	// pointer and a binary copy of the arguments into a lock free ring buffer which belongs to the calling thread, and
+	// a background thread formats the messages and writes them in batches, numbers, pointers and strings are copied as
+	// is, a message with other arguments is formatted on the calling thread since they might point to memory which
+	// doesn't outlive the call, the format string must be a string literal (or live until the message is written)
+	//
+	// the pending messages are written when the logger stops, when log_async_flush is called, before a critical
+	// message, at exit, and when the program crashes
+
+	// what to do when the ring buffer of the calling thread is full
+	enum LOG_ASYNC_FULL_POLICY: uint8_t
+	{
+		// the message is dropped and counted in log_async_dropped_count
+		LOG_ASYNC_FULL_POLICY_DROP,
+		// the calling thread waits until the background thread makes room for the message
+		LOG_ASYNC_FULL_POLICY_BLOCK,
+	};
+
+	// async logger settings
+	struct Log_Async_Settings
+	{
+		// the size of each thread ring buffer in bytes, it's rounded up to a power of 2, it only applies to the threads
+		// which didn't log anything before
+		// default: 64KB
+		size_t ring_size;
+		// default: LOG_ASYNC_FULL_POLICY_DROP
+		LOG_ASYNC_FULL_POLICY full_policy;
+		// the longest time a message waits in the ring buffer before the background thread writes it, the background
+		// thread also wakes up when a ring buffer is half full
+		// default: 10
+		uint32_t flush_interval_in_ms;
+	};
+
+	// formats the arguments which were serialized by _log_async_message
+	typedef void (*_Log_Async_Format)(const char* fmt, const char* args, fmt::memory_buffer& out);
+
+	// starts the async logger
+	MN_EXPORT void
+	log_async_start(const Log_Async_Settings& settings = {});
+
+	// writes all the pending messages and stops the async logger
+	MN_EXPORT void
+	log_async_stop();
+
+	// writes all the pending messages on the calling thread
+	MN_EXPORT void
+	log_async_flush();
+
+	// returns the number of messages which were dropped because their ring buffer was full
+	MN_EXPORT uint64_t
+	log_async_dropped_count();
+
+	MN_EXPORT bool
+	_log_async_enabled();
+
+	// pushes a message into the ring buffer of the calling thread, it returns false if the message should be logged
+	// synchronously instead
+	MN_EXPORT bool
+	_log_async_push(LOG_LEVEL level, const char* fmt, _Log_Async_Format format, const void* args, size_t args_size);
+
+	// strings are copied without formatting
+	struct _Log_Arg_String
+	{
+		static constexpr bool deferred = true;
+
+		static void
+		encode_string(fmt::memory_buffer& out, const char* ptr, size_t count)
+		{
+			auto size = uint32_t(count);
+			out.append((const char*)&size, (const char*)&size + sizeof(size));
+			out.append(ptr, ptr + count);
+		}
+
+		static std::string_view
+		decode(const char*& it)
+		{
+			uint32_t size = 0;
+			::memcpy(&size, it, sizeof(size));
+			std::string_view res{it + sizeof(size), size};
+			it += sizeof(size) + size;
+			return res;
+		}
+	};
+
+	// arguments which can't be copied to be formatted later, a message which has any of them is formatted on the
+	// calling thread, formatting them alone would lose their format spec
+	template<typename T, typename Enable = void>
+	struct _Log_Arg
+	{
+		static constexpr bool deferred = false;
+	};
+
+	// arguments which are copied as is
+	template<typename T>
+	struct _Log_Arg<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, const void*> || std::is_same_v<T, void*>>>
+	{
+		static constexpr bool deferred = true;
+
+		static void
+		encode(fmt::memory_buffer& out, const T& value)
+		{
+			out.append((const char*)&value, (const char*)&value + sizeof(value));
+		}
+
+		static T
+		decode(const char*& it)
+		{
+			T res{};
+			::memcpy(&res, it, sizeof(res));
+			it += sizeof(res);
+			return res;
+		}
+	};
+
+	template<>
+	struct _Log_Arg<const char*>: _Log_Arg_String
+	{
+		static void
+		encode(fmt::memory_buffer& out, const char* value)
+		{
+			if (value == nullptr)
+				value = "";
+			encode_string(out, value, ::strlen(value));
+		}
+	};
+
+	template<>
+	struct _Log_Arg<char*>: _Log_Arg<const char*>
+	{};
+
+	template<>
+	struct _Log_Arg<Str>: _Log_Arg_String
+	{
+		static void
+		encode(fmt::memory_buffer& out, const Str& value)
+		{
+			encode_string(out, value.ptr, value.count);
+		}
+	};
+
+	template<>
+	struct _Log_Arg<std::string_view>: _Log_Arg_String
+	{
+		static void
+		encode(fmt::memory_buffer& out, std::string_view value)
+		{
+			encode_string(out, value.data(), value.size());
+		}
+	};
+
 	template<typename... TArgs>
 	inline static void
-	log_debug([[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
+	_log_async_format(const char* fmt, const char* args, fmt::memory_buffer& out)
+	{
+		[[maybe_unused]] auto it = args;
+		// the braced initializer list decodes the arguments in order
+		std::tuple<decltype(_Log_Arg<std::decay_t<TArgs>>::decode(it))...> values{_Log_Arg<std::decay_t<TArgs>>::decode(it)...};
+		std::apply([&](const auto&... values) {
+			fmt::format_to(std::back_inserter(out), fmt, values...);
+		}, values);
+	}
+
+	template<typename... TArgs>
+	inline static bool
+	_log_async_message(LOG_LEVEL level, const char* fmt, const TArgs&... args)
+	{
+		fmt::memory_buffer buf;
+		if constexpr ((_Log_Arg<std::decay_t<TArgs>>::deferred && ...))
+		{
+			(_Log_Arg<std::decay_t<TArgs>>::encode(buf, args), ...);
+			return _log_async_push(level, fmt, _log_async_format<TArgs...>, buf.data(), buf.size());
+		}
+		else
+		{
+			// only the write is deferred, and format errors are reported the same way the logger thread reports them
+			fmt::memory_buffer msg;
+			try
+			{
+				fmt::format_to(std::back_inserter(msg), fmt, args...);
+			}
+			catch (const fmt::format_error& e)
+			{
+				msg.clear();
+				fmt::format_to(std::back_inserter(msg), "[format error: {}]", e.what());
+			}
+			_Log_Arg<std::string_view>::encode(buf, std::string_view{msg.data(), msg.size()});
+			return _log_async_push(level, "{}", _log_async_format<std::string_view>, buf.data(), buf.size());
+		}
+	}
+
+	template<typename... TArgs>
+	inline static void
+	_log_message(LOG_LEVEL level, const Log_Category* category, const char* fmt, const TArgs&... args)
 	{
-		#ifdef DEBUG
+		if (log_level_enabled(level, category) == false)
+			return;
+		if (_log_async_enabled() && _log_async_message(level, fmt, args...))
+			return;
+
 		auto msg = mn::str_tmpf(fmt, args...);
-		_log_debug_str(msg.ptr);
-		#endif
+		switch (level)
+		{
+		case LOG_LEVEL_DEBUG:
+			_log_debug_str(msg.ptr);
+			break;
+		case LOG_LEVEL_INFO:
+			_log_info_str(msg.ptr);
+			break;
+		case LOG_LEVEL_WARNING:
+			_log_warning_str(msg.ptr);
+			break;
+		case LOG_LEVEL_ERROR:
+			_log_error_str(msg.ptr);
+			break;
+		case LOG_LEVEL_CRITICAL:
+			_log_critical_str(msg.ptr);
+			break;
+		}
+	}
+
+	// logs a message with debug level, it's removed in release mode by default (check LOG_LEVEL_MIN)
+	template<typename... TArgs>
+	inline static void
+	log_debug([[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
+	{
+		if constexpr (LOG_LEVEL_DEBUG >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_DEBUG, nullptr, fmt, args...);
+	}
+
+	// logs a message with debug level in the given category
+	template<typename... TArgs>
+	inline static void
+	log_debug([[maybe_unused]] const Log_Category* category, [[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
+	{
+		if constexpr (LOG_LEVEL_DEBUG >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_DEBUG, category, fmt, args...);
 	}
 
 	// logs a message with info level
 	template<typename... TArgs>
 	inline static void
-	log_info(const char* fmt, TArgs&&... args)
+	log_info([[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
 	{
-		auto msg = mn::str_tmpf(fmt, args...);
-		_log_info_str(msg.ptr);
+		if constexpr (LOG_LEVEL_INFO >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_INFO, nullptr, fmt, args...);
+	}
+
+	// logs a message with info level in the given category
+	template<typename... TArgs>
+	inline static void
+	log_info([[maybe_unused]] const Log_Category* category, [[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
+	{
+		if constexpr (LOG_LEVEL_INFO >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_INFO, category, fmt, args...);
 	}
 
 	// logs a message with warning level
 	template<typename... TArgs>
 	inline static void
-	log_warning(const char* fmt, TArgs&&... args)
+	log_warning([[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
 	{
-		auto msg = mn::str_tmpf(fmt, args...);
-		_log_warning_str(msg.ptr);
+		if constexpr (LOG_LEVEL_WARNING >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_WARNING, nullptr, fmt, args...);
+	}
+
+	// logs a message with warning level in the given category
+	template<typename... TArgs>
+	inline static void
+	log_warning([[maybe_unused]] const Log_Category* category, [[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
+	{
+		if constexpr (LOG_LEVEL_WARNING >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_WARNING, category, fmt, args...);
 	}
 
 	// logs a message with error level
 	template<typename... TArgs>
 	inline static void
-	log_error(const char* fmt, TArgs&&... args)
+	log_error([[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
 	{
-		auto msg = mn::str_tmpf(fmt, args...);
-		_log_error_str(msg.ptr);
+		if constexpr (LOG_LEVEL_ERROR >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_ERROR, nullptr, fmt, args...);
+	}
+
+	// logs a message with error level in the given category
+	template<typename... TArgs>
+	inline static void
+	log_error([[maybe_unused]] const Log_Category* category, [[maybe_unused]] const char* fmt, [[maybe_unused]] TArgs&&... args)
+	{
+		if constexpr (LOG_LEVEL_ERROR >= LOG_LEVEL_MIN)
+			_log_message(LOG_LEVEL_ERROR, category, fmt, args...);
 	}
 
-	// logs a message with critical level, and terminates the program
+	// logs a message with critical level, and terminates the program, the pending async messages are written before it,
+	// critical messages are never filtered
 	template<typename... TArgs>
 	[[noreturn]] inline static void
 	log_critical(const char* fmt, TArgs&&... args)
 	{
+		if (_log_async_enabled())
+			log_async_flush();
 		auto msg = mn::str_tmpf(fmt, args...);
 		_log_critical_str(msg.ptr);
 		::abort();
@@ -61,4 +391,4 @@ namespace mn
 		if (expr == false)
 			log_critical(fmt, args...);
 	}
-}
\ No newline at end of file
+}
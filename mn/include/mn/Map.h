@@ -27,6 +27,15 @@ namespace mn
 		}
 	};
 
+#if MN_GROWTH_TRACKING
+	// used by the growth tracking mode to tell maps apart from sets
+	template<typename T>
+	struct _Is_Key_Value: std::false_type {};
+
+	template<typename TKey, typename TValue>
+	struct _Is_Key_Value<Key_Value<TKey, TValue>>: std::true_type {};
+#endif
+
 	// destruct overload for the key value pair
 	template<typename TKey, typename TValue>
 	inline static void
@@ -558,6 +567,12 @@ namespace mn
 	inline static void
 	_set_reserve_exact(Set<T, THash>& self, size_t new_count)
 	{
+#if MN_GROWTH_TRACKING
+		// only growths of an existing table are recorded, shrinks and rebuilds because of deleted values are not
+		if (self._slots.count > 0 && new_count > self._slots.count)
+			_growth_track(_Is_Key_Value<T>::value ? GROWTH_KIND_MAP : GROWTH_KIND_SET, sizeof(Hash_Slot), new_count, self.count * sizeof(Hash_Slot));
+#endif
+
 		auto new_slots = buf_with_allocator<Hash_Slot>(self._slots.allocator);
 		buf_resize_fill(new_slots, new_count, Hash_Slot{});
 
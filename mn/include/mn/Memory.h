@@ -23,7 +23,17 @@ namespace mn
 	inline static Block
 	alloc_from(Allocator self, size_t size, uint8_t alignment)
 	{
-		return self->alloc(size, alignment);
+		// bump allocators are allocated from inline without going through the virtual call, arena and stack are final
+		// so their alloc can't be overridden and the inline bump is the same as calling it
+		switch (self->kind)
+		{
+		case memory::Interface::KIND_ARENA:
+			return static_cast<memory::Arena*>(self)->bump(size, alignment);
+		case memory::Interface::KIND_STACK:
+			return static_cast<memory::Stack*>(self)->bump(size, alignment);
+		default:
+			return self->alloc(size, alignment);
+		}
 	}
 
 	// frees a block using the given allocator
@@ -159,6 +169,15 @@ namespace mn
 		return alloc_construct<memory::Arena>(block_size, meta);
 	}
 
+	// creates a new arena allocator with the given block size which allocates its blocks from OS virtual memory
+	// using the given virtual memory options, for example huge pages or numa binding
+	// read more about arena allocator in Arena.h
+	inline static memory::Arena*
+	allocator_arena_new(size_t block_size, const memory::Virtual& virtual_meta)
+	{
+		return alloc_construct<memory::Arena>(block_size, virtual_meta);
+	}
+
 	// creates a new buddy allocator with the given heap size and meta allocator
 	// read more about buddy allocator in Buddy.h
 	inline static memory::Buddy*
@@ -167,6 +186,15 @@ namespace mn
 		return alloc_construct<memory::Buddy>(heap_size, meta);
 	}
 
+	// creates a new buddy allocator with the given heap size which allocates its heap from OS virtual memory
+	// using the given virtual memory options, for example reserve then commit, huge pages or numa binding
+	// read more about buddy allocator in Buddy.h
+	inline static memory::Buddy*
+	allocator_buddy_new(size_t heap_size, const memory::Virtual& virtual_meta)
+	{
+		return alloc_construct<memory::Buddy>(heap_size, virtual_meta);
+	}
+
 	// frees the given allocator
 	inline static void
 	allocator_free(Allocator self)
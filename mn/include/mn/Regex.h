@@ -4,6 +4,7 @@
 #include "mn/Buf.h"
 #include "mn/Str.h"
 #include "mn/Result.h"
+#include "mn/Reader.h"
 
 namespace mn
 {
@@ -41,10 +42,21 @@ namespace mn
 		RGX_OP_MATCH2,
 	};
 
+	// a lazy DFA built over the regex program, the DFA states are computed on demand while matching and cached
+	// so that later matches of the same program only follow the cached transitions, which makes matching linear
+	// in the size of the input, it uses leftmost-first semantics (greedy/non greedy operators are respected)
+	// search is a single pass over the input, it doesn't restart the match at every offset, and it uses the literals
+	// which every match must contain to skip the parts of the input which can't match
+	// note: a Regex_DFA is not thread safe, use a Regex_DFA per thread
+	typedef struct IRegex_DFA* Regex_DFA;
+
 	// a compiled regex
 	struct Regex
 	{
 		Buf<uint8_t> bytes;
+		// DFA which regex_match and regex_search build on the first long input and reuse afterwards, it's owned
+		// by the program and freed in regex_free
+		mutable Regex_DFA dfa;
 	};
 
 	// creates a new empty regex program
@@ -55,11 +67,8 @@ namespace mn
 	}
 
 	// frees a regex program
-	inline static void
-	regex_free(Regex& self)
-	{
-		buf_free(self.bytes);
-	}
+	MN_EXPORT void
+	regex_free(Regex& self);
 
 	// destruct overload for regex_free
 	inline static void
@@ -72,7 +81,7 @@ namespace mn
 	inline static Regex
 	regex_clone(const Regex& other, Allocator allocator = allocator_top())
 	{
-		return Regex{ buf_memcpy_clone(other.bytes, allocator) };
+		return Regex{ buf_memcpy_clone(other.bytes, allocator), nullptr };
 	}
 
 	// clone overload for regex_clone
@@ -151,10 +160,216 @@ namespace mn
 	};
 
 	// tries to match the compiled regex program to the given string
+	// note: short inputs are matched by simulating the program directly, longer inputs build a DFA which is cached
+	// in the program, so the program shouldn't be freed while another thread is matching with it
 	MN_EXPORT Match_Result
 	regex_match(const Regex& program, const char* str);
 
+	// tries to match the compiled regex program to the given range of the string, the string doesn't need to be
+	// null terminated
+	MN_EXPORT Match_Result
+	regex_match(const Regex& program, const char* begin, const char* end);
+
+	// tries to match the compiled regex program to the given string
+	inline static Match_Result
+	regex_match(const Regex& program, const Str& str)
+	{
+		return regex_match(program, begin(str), end(str));
+	}
+
 	// search for the first match of the regex program in the given string
+	// note: short inputs are searched by simulating the program directly, longer inputs build a DFA which is cached
+	// in the program, so the program shouldn't be freed while another thread is searching with it
 	MN_EXPORT Match_Result
 	regex_search(const Regex& program, const char* str);
-}
\ No newline at end of file
+
+	// search for the first match of the regex program in the given range of the string, the string doesn't need
+	// to be null terminated
+	MN_EXPORT Match_Result
+	regex_search(const Regex& program, const char* begin, const char* end);
+
+	// search for the first match of the regex program in the given string
+	inline static Match_Result
+	regex_search(const Regex& program, const Str& str)
+	{
+		return regex_search(program, begin(str), end(str));
+	}
+
+	// creates a new DFA for the given regex program, the program is copied so it can be freed afterwards
+	MN_EXPORT Regex_DFA
+	regex_dfa_new(const Regex& program, Allocator allocator = allocator_top());
+
+	// frees the given DFA
+	MN_EXPORT void
+	regex_dfa_free(Regex_DFA self);
+
+	// destruct overload for regex_dfa_free
+	inline static void
+	destruct(Regex_DFA self)
+	{
+		regex_dfa_free(self);
+	}
+
+	// tries to match the DFA to the given string
+	MN_EXPORT Match_Result
+	regex_dfa_match(Regex_DFA self, const char* str);
+
+	// tries to match the DFA to the given range of the string, the string doesn't need to be null terminated
+	MN_EXPORT Match_Result
+	regex_dfa_match(Regex_DFA self, const char* begin, const char* end);
+
+	// tries to match the DFA to the given string
+	inline static Match_Result
+	regex_dfa_match(Regex_DFA self, const Str& str)
+	{
+		return regex_dfa_match(self, begin(str), end(str));
+	}
+
+	// search for the first match of the DFA in the given string
+	MN_EXPORT Match_Result
+	regex_dfa_search(Regex_DFA self, const char* str);
+
+	// search for the first match of the DFA in the given range of the string, the string doesn't need to be null
+	// terminated
+	MN_EXPORT Match_Result
+	regex_dfa_search(Regex_DFA self, const char* begin, const char* end);
+
+	// search for the first match of the DFA in the given string
+	inline static Match_Result
+	regex_dfa_search(Regex_DFA self, const Str& str)
+	{
+		return regex_dfa_search(self, begin(str), end(str));
+	}
+
+	// returns the count of the cached DFA states, this is useful for debugging and tuning
+	MN_EXPORT size_t
+	regex_dfa_states_count(Regex_DFA self);
+
+	// a set of regex patterns which are matched together in a single pass over the input, each pattern has a payload
+	// which is reported when the pattern matches, this is useful when you want to classify the input using a lot of
+	// rules instead of searching using each rule separately
+	// note: a Regex_Set is not thread safe, use a Regex_Set per thread
+	typedef struct IRegex_Set* Regex_Set;
+
+	// creates a new empty regex set
+	MN_EXPORT Regex_Set
+	regex_set_new(Allocator allocator = allocator_top());
+
+	// frees the given regex set
+	MN_EXPORT void
+	regex_set_free(Regex_Set self);
+
+	// destruct overload for regex_set_free
+	inline static void
+	destruct(Regex_Set self)
+	{
+		regex_set_free(self);
+	}
+
+	// compiles and adds the given pattern to the set with the given payload, and returns the index of the pattern
+	// in the set, patterns are prioritized in the order they were added
+	MN_EXPORT Result<size_t>
+	regex_set_add(Regex_Set self, const Str& pattern, int32_t payload);
+
+	// compiles and adds the given pattern to the set with the given payload, and returns the index of the pattern
+	// in the set, patterns are prioritized in the order they were added
+	inline static Result<size_t>
+	regex_set_add(Regex_Set self, const char* pattern, int32_t payload)
+	{
+		return regex_set_add(self, str_lit(pattern), payload);
+	}
+
+	// returns the count of the patterns in the set
+	MN_EXPORT size_t
+	regex_set_count(Regex_Set self);
+
+	// searches for all the patterns in the given string in a single pass, the payloads of the matching patterns are
+	// written into the given buffer (after clearing it) in the order the patterns were added, and returns whether any
+	// of the patterns did match
+	MN_EXPORT bool
+	regex_set_search_all(Regex_Set self, const char* str, Buf<int32_t>& payloads);
+
+	// searches for all the patterns in the given range of the string in a single pass, the string doesn't need to
+	// be null terminated
+	MN_EXPORT bool
+	regex_set_search_all(Regex_Set self, const char* begin, const char* end, Buf<int32_t>& payloads);
+
+	// searches for all the patterns in the given string in a single pass
+	inline static bool
+	regex_set_search_all(Regex_Set self, const Str& str, Buf<int32_t>& payloads)
+	{
+		return regex_set_search_all(self, begin(str), end(str), payloads);
+	}
+
+	// searches for the first match of any of the patterns in the given string, the first match is the match which
+	// ends first in the input, if multiple patterns match at the same end then the pattern that was added first wins
+	// and its payload is reported in the result
+	MN_EXPORT Match_Result
+	regex_set_search_first(Regex_Set self, const char* str);
+
+	// searches for the first match of any of the patterns in the given range of the string, the string doesn't need
+	// to be null terminated
+	MN_EXPORT Match_Result
+	regex_set_search_first(Regex_Set self, const char* begin, const char* end);
+
+	// searches for the first match of any of the patterns in the given string
+	inline static Match_Result
+	regex_set_search_first(Regex_Set self, const Str& str)
+	{
+		return regex_set_search_first(self, begin(str), end(str));
+	}
+
+	// a match which is found by the streaming matcher, the offsets are relative to the start of the input
+	struct Regex_Stream_Match
+	{
+		size_t begin;
+		size_t end;
+		bool with_payload;
+		int32_t payload;
+	};
+
+	// a streaming matcher finds all the non overlapping matches of a regex program in input which comes in chunks,
+	// the DFA state is carried between the chunks so matches which span chunk boundaries are found, and only the input
+	// which might be part of an unfinished match is copied internally (usually a few bytes at the end of each chunk)
+	// note: patterns like 'a.*b' can keep a large part of the input alive until the match is finished
+	typedef struct IRegex_Matcher* Regex_Matcher;
+
+	// creates a new streaming matcher for the given regex program
+	MN_EXPORT Regex_Matcher
+	regex_matcher_new(const Regex& program, Allocator allocator = allocator_top());
+
+	// frees the given streaming matcher
+	MN_EXPORT void
+	regex_matcher_free(Regex_Matcher self);
+
+	// destruct overload for regex_matcher_free
+	inline static void
+	destruct(Regex_Matcher self)
+	{
+		regex_matcher_free(self);
+	}
+
+	// feeds the next chunk of the input to the matcher, the chunk isn't needed after this call returns
+	MN_EXPORT void
+	regex_matcher_feed(Regex_Matcher self, const char* begin, const char* end);
+
+	// feeds the next chunk of the input to the matcher, the chunk isn't needed after this call returns
+	inline static void
+	regex_matcher_feed(Regex_Matcher self, const Str& chunk)
+	{
+		regex_matcher_feed(self, begin(chunk), end(chunk));
+	}
+
+	// marks the end of the input, which reports the matches that were waiting for more input
+	MN_EXPORT void
+	regex_matcher_finish(Regex_Matcher self);
+
+	// pops the next reported match, returns false if there are no reported matches until more input is fed
+	MN_EXPORT bool
+	regex_matcher_next(Regex_Matcher self, Regex_Stream_Match& match);
+
+	// reads the given reader in chunks until the next match is found, returns false if the reader is exhausted
+	// without finding any more matches
+	MN_EXPORT bool
+	regex_matcher_next(Regex_Matcher self, Reader reader, Regex_Stream_Match& match);
+}
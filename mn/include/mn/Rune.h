@@ -15,6 +15,19 @@ namespace mn
 	MN_EXPORT size_t
 	rune_count(const char* str);
 
+	// returns the count of runes in the given range of bytes, it doesn't stop at null terminator
+	MN_EXPORT size_t
+	rune_count(const char* str, size_t count);
+
+	// returns whether the given range of bytes is a valid utf-8 string, it rejects overlong encodings, surrogates
+	// and runes outside the unicode range
+	MN_EXPORT bool
+	rune_utf8_valid(const char* str, size_t count);
+
+	// returns whether all the bytes in the given range are ascii
+	MN_EXPORT bool
+	rune_is_ascii(const char* str, size_t count);
+
 	// converts a rune to lower case
 	MN_EXPORT Rune
 	rune_lower(Rune c);
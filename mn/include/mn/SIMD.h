@@ -3,6 +3,20 @@
 #include "mn/Exports.h"
 
 #include <stdbool.h>
+#include <stdint.h>
+
+// SSE2 is part of the x86_64 baseline so we can use its intrinsics without runtime dispatch, other
+// architectures fallback to the scalar code paths
+#if ARCH_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define MN_SIMD_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define MN_SIMD_SSE2 0
+#endif
+
+#if MN_COMPILER_MSVC
+	#include <intrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,6 +39,33 @@ typedef struct mn_simd_support
 MN_EXPORT mn_simd_support
 mn_simd_support_check();
 
+// returns the number of set bits in the given mask
+static inline int
+mn_simd_popcount(uint32_t mask)
+{
+#if MN_COMPILER_MSVC
+	// __popcnt requires the popcnt instruction which we don't check for, so we go with the bit twiddling version
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (int)((((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+// returns the index of the lowest set bit in the given mask, mask must not be 0
+static inline int
+mn_simd_ctz(uint32_t mask)
+{
+#if MN_COMPILER_MSVC
+	unsigned long index = 0;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -60,10 +60,24 @@ namespace mn
 	str_rune_count(const Str& self)
 	{
 		if(self.count)
-			return rune_count(self.ptr);
+			return rune_count(self.ptr, self.count);
 		return 0;
 	}
 
+	// returns whether the given string is a valid utf-8 string
+	inline static bool
+	str_utf8_valid(const Str& self)
+	{
+		return rune_utf8_valid(self.ptr, self.count);
+	}
+
+	// returns whether the given string contains only ascii characters
+	inline static bool
+	str_is_ascii(const Str& self)
+	{
+		return rune_is_ascii(self.ptr, self.count);
+	}
+
 	// pushes the given block of bytes into the string
 	MN_EXPORT void
 	str_block_push(Str& self, Block block);
@@ -426,11 +440,13 @@ namespace mn
 		return self.count == 0;
 	}
 
-	// converts the given string to lower case
+	// converts the given string to lower case, the conversion happens in place and only reallocates if a rune changes
+	// its encoded size (which is rare and doesn't happen for ascii), string literals will be cloned first
 	MN_EXPORT void
 	str_lower(Str& self);
 
-	// converts the given string to upper case
+	// converts the given string to upper case, the conversion happens in place and only reallocates if a rune changes
+	// its encoded size (which is rare and doesn't happen for ascii), string literals will be cloned first
 	MN_EXPORT void
 	str_upper(Str& self);
 
@@ -6,14 +6,79 @@
 
 #include <stdint.h>
 
+#include <atomic>
+
 #define mn_mutex_new_with_srcloc(name) mn::mutex_new_with_srcloc([&](const char* func_name) -> const mn::Source_Location* { const static mn::Source_Location srcloc { name, func_name, __FILE__, __LINE__, 0 }; return &srcloc; }(__FUNCTION__))
 #define mn_mutex_rw_new_with_srcloc(name) mn::mutex_rw_new_with_srcloc([&](const char* func_name) -> const mn::Source_Location* { const static mn::Source_Location srcloc { name, func_name, __FILE__, __LINE__, 0 }; return &srcloc; }(__FUNCTION__))
+#define mn_mutex_rw_distributed_new_with_srcloc(name) mn::mutex_rw_distributed_new_with_srcloc([&](const char* func_name) -> const mn::Source_Location* { const static mn::Source_Location srcloc { name, func_name, __FILE__, __LINE__, 0 }; return &srcloc; }(__FUNCTION__))
 
 namespace mn
 {
 	// mutex handle
 	typedef struct IMutex* Mutex;
 
+	// mutexes spin with exponential backoff for a while before parking the thread when they're contended, the spin
+	// limit adapts to how long it took to get the mutex in the previous contended locks so mutexes which are held for
+	// long don't waste cpu time spinning
+
+	// the contention statistics of a mutex
+	struct Mutex_Stats
+	{
+		// the number of times the mutex was locked
+		uint64_t acquisitions;
+		// the number of times the mutex was already locked so the locking thread had to wait
+		uint64_t contended_acquisitions;
+		// the number of contended acquisitions which got the mutex while spinning, without parking the thread
+		uint64_t spin_acquisitions;
+		// the total time in nanoseconds which the threads spent waiting for the mutex
+		uint64_t wait_time_ns;
+	};
+
+	// the contention statistics of all the mutexes which were created at the same source location
+	struct Mutex_Location_Stats
+	{
+		const Source_Location* srcloc;
+		// the number of mutexes which were created at this location (including the freed ones)
+		size_t mutexes_count;
+		Mutex_Stats stats;
+	};
+
+	// contention state of a single mutex, it's embedded in the platform mutex, the counters are only written while
+	// the mutex is held
+	struct _Mutex_Contention
+	{
+		std::atomic<uint64_t> acquisitions;
+		std::atomic<uint64_t> contended_acquisitions;
+		std::atomic<uint64_t> spin_acquisitions;
+		std::atomic<uint64_t> wait_time_ns;
+		// the estimated number of spins which it takes to get the mutex when it's contended
+		std::atomic<uint32_t> spin_estimate;
+	};
+
+	// counts an uncontended acquisition of a mutex, it should be called after the mutex is locked
+	inline static void
+	_mutex_contention_acquired(_Mutex_Contention& self)
+	{
+		self.acquisitions.store(self.acquisitions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// locks a contended mutex, it spins with backoff using the given try_lock function then parks the thread using
+	// the given lock function, and it updates the contention statistics
+	MN_EXPORT void
+	_mutex_contention_lock(_Mutex_Contention& self, bool (*try_lock)(void*), void (*lock)(void*), void* mutex);
+
+	// initializes the contention state of a mutex and registers it with the given source location (if any)
+	MN_EXPORT void
+	_mutex_contention_init(_Mutex_Contention& self, const Source_Location* srcloc);
+
+	// unregisters the contention state of a mutex, its statistics are accumulated in its source location
+	MN_EXPORT void
+	_mutex_contention_dispose(_Mutex_Contention& self, const Source_Location* srcloc);
+
+	// returns a snapshot of the contention statistics of a mutex
+	MN_EXPORT Mutex_Stats
+	_mutex_contention_stats(const _Mutex_Contention& self);
+
 	MN_EXPORT Mutex
 	_leak_allocator_mutex();
 
@@ -42,6 +107,16 @@ namespace mn
 	MN_EXPORT const Source_Location*
 	mutex_source_location(Mutex mutex);
 
+	// returns the contention statistics of the given mutex
+	MN_EXPORT Mutex_Stats
+	mutex_stats(Mutex mutex);
+
+	// writes the contention statistics of the mutexes grouped by the source location they were created at (only the
+	// mutexes which were created with a source location are tracked), it writes at most stats_count entries sorted by
+	// the wait time and returns the number of source locations
+	MN_EXPORT size_t
+	mutex_stats_by_location(Mutex_Location_Stats* stats, size_t stats_count);
+
 	// destruct overload for mutex free
 	inline static void
 	destruct(Mutex mutex)
@@ -61,6 +136,18 @@ namespace mn
 	MN_EXPORT Mutex_RW
 	mutex_rw_new(const char* name = "Mutex_RW");
 
+	// creates a new reader biased read-write mutex with the given source location info, readers are counted in per
+	// thread slots which live in separate cache lines so read locks don't contend with each other, while writers
+	// have to wait for the readers in all the slots, it's meant for read mostly data which is read by many cores,
+	// it uses more memory than a regular read-write mutex, and it must be unlocked by the thread which locked it, read
+	// locks are reentrant as long as the thread doesn't hold more than 8 distributed mutexes in read mode at once
+	MN_EXPORT Mutex_RW
+	mutex_rw_distributed_new_with_srcloc(const Source_Location* srcloc);
+
+	// creates a new reader biased read-write mutex with the given name, see mutex_rw_distributed_new_with_srcloc
+	MN_EXPORT Mutex_RW
+	mutex_rw_distributed_new(const char* name = "Mutex_RW");
+
 	// frees the mutex
 	MN_EXPORT void
 	mutex_rw_free(Mutex_RW mutex);
@@ -92,6 +179,43 @@ namespace mn
 	MN_EXPORT const Source_Location*
 	mutex_rw_source_location(Mutex_RW mutex);
 
+	// reader biased read-write lock state, the platform read-write mutexes which are created by mutex_rw_distributed_new
+	// point to it and forward their locks to it after calling the profiling and deadlock detector hooks
+	struct _Mutex_RW_Distributed;
+
+	MN_EXPORT _Mutex_RW_Distributed*
+	_mutex_rw_distributed_new();
+
+	MN_EXPORT void
+	_mutex_rw_distributed_free(_Mutex_RW_Distributed* self);
+
+	MN_EXPORT void
+	_mutex_rw_distributed_read_lock(_Mutex_RW_Distributed* self);
+
+	MN_EXPORT void
+	_mutex_rw_distributed_read_unlock(_Mutex_RW_Distributed* self);
+
+	MN_EXPORT void
+	_mutex_rw_distributed_write_lock(_Mutex_RW_Distributed* self);
+
+	MN_EXPORT void
+	_mutex_rw_distributed_write_unlock(_Mutex_RW_Distributed* self);
+
+	// deadlock detector hooks, the mutexes call them only when mn is built with the MN_DEADLOCK flag, see
+	// mn/src/mn/Deadlock.cpp for the details
+
+	// called before the given lock is acquired by the calling thread
+	MN_EXPORT void
+	_deadlock_detector_lock(void* mtx, const char* name, bool shared);
+
+	// called before the given lock is released by the calling thread
+	MN_EXPORT void
+	_deadlock_detector_unlock(void* mtx);
+
+	// called when the given lock is freed
+	MN_EXPORT void
+	_deadlock_detector_free(void* mtx);
+
 
 	//Thread API
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "mn/Buf.h"
+#include "mn/memory/CLib.h"
+
+#include <mutex>
+
+namespace mn
+{
+	// per thread state registry
+	// gives each thread its own instance of a state type which the thread updates without locks while other threads
+	// read all the instances through the registry, a thread gets its state the first time it asks for it, and when
+	// the thread exits its state is marked as dead (the alive member of the state) and it's reused by the next
+	// thread which asks for a state, so the states are never freed
+	//
+	// the registry doesn't need a constructor and its mutex can be used by the owner to protect its other data too,
+	// the thread local bookkeeping is per state type so each state type should only be used by one registry
+	template<typename T>
+	struct Thread_State_Registry
+	{
+		// protects the states list and the alive flags
+		std::mutex mtx;
+		Buf<T*> states;
+	};
+
+	template<typename T>
+	struct _Thread_State_Local
+	{
+		struct Guard
+		{
+			~Guard();
+		};
+
+		inline static thread_local T* state;
+		inline static thread_local Thread_State_Registry<T>* registry;
+		inline static thread_local bool exited;
+		// the guard has a destructor so it's only touched when the thread gets its state, which keeps the fast path
+		// a plain thread local load
+		inline static thread_local Guard guard;
+	};
+
+	template<typename T>
+	_Thread_State_Local<T>::Guard::~Guard()
+	{
+		using Local = _Thread_State_Local<T>;
+		if (Local::state)
+		{
+			std::lock_guard<std::mutex> lock(Local::registry->mtx);
+			Local::state->alive = false;
+		}
+		Local::state = nullptr;
+		Local::exited = true;
+	}
+
+	// returns the state of the calling thread without making one, or nullptr if the thread doesn't have a state
+	template<typename T>
+	inline static T*
+	thread_state_current(const Thread_State_Registry<T>&)
+	{
+		return _Thread_State_Local<T>::state;
+	}
+
+	// returns the state of the calling thread, or nullptr if the thread is exiting, a thread which doesn't have a state
+	// reuses the first dead state which the reusable function accepts (reusable(T*) -> bool), or it makes a new one
+	// using the create function (create() -> T*), both functions are called while the registry mutex is held
+	template<typename T, typename TReusable, typename TCreate>
+	inline static T*
+	thread_state_get(Thread_State_Registry<T>& self, TReusable&& reusable, TCreate&& create)
+	{
+		using Local = _Thread_State_Local<T>;
+		if (auto state = Local::state)
+			return state;
+		if (Local::exited)
+			return nullptr;
+
+		// touching the guard registers its destructor which releases the state when the thread exits
+		(void)&Local::guard;
+
+		std::lock_guard<std::mutex> lock(self.mtx);
+		if (self.states.allocator == nullptr)
+			self.states = buf_with_allocator<T*>(memory::clib());
+
+		T* state = nullptr;
+		for (auto it: self.states)
+		{
+			if (it->alive == false && reusable(it))
+			{
+				state = it;
+				break;
+			}
+		}
+		if (state == nullptr)
+		{
+			state = create();
+			buf_push(self.states, state);
+		}
+		state->alive = true;
+		Local::state = state;
+		Local::registry = &self;
+		return state;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/Base.h"
+#include "mn/Stream.h"
+#include "mn/Result.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mn
+{
+	// tracer
+	// records a timeline of per thread events which can be viewed in chrome://tracing or https://ui.perfetto.dev,
+	// every thread writes its events into its own ring buffer without any locks, when the ring buffer is full the
+	// oldest events are overwritten so the trace always contains the last moments before the capture, the tracer
+	// records the fabric jobs, the sysmon worker replacements, the blocked channel operations, and the mutex waits
+	// (through the thread profile interface, which it chains to the previous one), and you can add your own events
+	//
+	// event names and categories are not copied, they must be string literals (or live until the trace is written)
+
+	// tracer settings
+	struct Trace_Settings
+	{
+		// the number of events each thread ring buffer holds, it's rounded up to a power of 2
+		// default: 16384
+		size_t events_per_thread;
+		// mutex locks which wait less than this are not recorded
+		// default: 1000 (1us)
+		uint64_t mutex_wait_threshold_ns;
+	};
+
+	// starts the tracer, it discards the events of the previous trace
+	MN_EXPORT void
+	trace_start(const Trace_Settings& settings = {});
+
+	// stops the tracer and restores the previous thread profile interface, the recorded events are kept until the next
+	// start so they can still be written
+	MN_EXPORT void
+	trace_stop();
+
+	// returns whether the tracer is running
+	MN_EXPORT bool
+	trace_enabled();
+
+	// returns the time since the trace start in nanoseconds, it's used as the start time of trace_complete events
+	MN_EXPORT uint64_t
+	trace_now();
+
+	// sets the name of the calling thread in the trace, the name is copied
+	MN_EXPORT void
+	trace_thread_name(const char* name);
+
+	// records the beginning of a duration event on the calling thread
+	MN_EXPORT void
+	trace_begin(const char* name, const char* category = "user");
+
+	// records the end of the last duration event which began on the calling thread
+	MN_EXPORT void
+	trace_end();
+
+	// records a duration event which started at the given trace_now() time and ends now
+	MN_EXPORT void
+	trace_complete(const char* name, const char* category, uint64_t start_ns);
+
+	// records an instant event on the calling thread
+	MN_EXPORT void
+	trace_instant(const char* name, const char* category = "user");
+
+	// writes the recorded events of all the threads in chrome trace event json format to the given stream, it can be
+	// called while the tracer is running
+	MN_EXPORT Err
+	trace_write_chrome_json(Stream out);
+}
@@ -3,13 +3,50 @@
 #include "mn/Exports.h"
 #include "mn/Base.h"
 
+#include <stdint.h>
+
 namespace mn
 {
-	// allocates a block of memory using OS virtual memory, it will commit it as well
+	// virtual memory allocation flags, they can be combined using bitwise or
+	enum VIRTUAL_FLAG: uint32_t
+	{
+		VIRTUAL_FLAG_NONE = 0,
+		// only reserves the address range without committing it, the memory should be committed using virtual_commit
+		// before it's accessed
+		VIRTUAL_FLAG_RESERVE = 1 << 0,
+		// asks the OS to back the memory with transparent huge pages (MADV_HUGEPAGE on linux), allocations which are
+		// at least a huge page in size are aligned to the huge page size so they can be fully backed by huge pages
+		VIRTUAL_FLAG_HUGE_PAGES = 1 << 1,
+		// allocates the memory from the explicitly reserved huge pages (MAP_HUGETLB on linux, MEM_LARGE_PAGES on
+		// windows), the size is rounded up to the huge page size, and it falls back to VIRTUAL_FLAG_HUGE_PAGES if
+		// there are no available huge pages
+		VIRTUAL_FLAG_EXPLICIT_HUGE_PAGES = 1 << 2,
+		// pre-faults the committed memory so the first access to it doesn't page fault (MAP_POPULATE on linux)
+		VIRTUAL_FLAG_POPULATE = 1 << 3,
+		// binds the memory to the given numa node, it's ignored on platforms which don't support numa
+		VIRTUAL_FLAG_NUMA_NODE = 1 << 4,
+	};
+
+	// the size of huge pages which huge page allocations are aligned and rounded to
+	constexpr size_t VIRTUAL_HUGE_PAGE_SIZE = 2ULL * 1024ULL * 1024ULL;
+
+	// allocates a block of memory using OS virtual memory, it will commit it as well unless VIRTUAL_FLAG_RESERVE is
+	// used, the numa node is only used with VIRTUAL_FLAG_NUMA_NODE, the returned block size could be bigger than
+	// the requested size (in case of explicit huge pages), it returns an empty block in case of failure
 	MN_EXPORT Block
-	virtual_alloc(void* address_hint, size_t size);
+	virtual_alloc(void* address_hint, size_t size, uint32_t flags = VIRTUAL_FLAG_NONE, uint32_t numa_node = 0);
 
 	// frees a block from OS virtual memory
 	MN_EXPORT void
 	virtual_free(Block block);
+
+	// commits the given page aligned block of reserved memory, the flags and numa node should be the same as the ones
+	// used to reserve the memory, returns false in case of failure
+	MN_EXPORT bool
+	virtual_commit(Block block, uint32_t flags = VIRTUAL_FLAG_NONE, uint32_t numa_node = 0);
+
+	// decommits the given page aligned block and returns its physical memory back to the OS, the address range stays
+	// reserved and can be committed again
+	MN_EXPORT void
+	virtual_decommit(Block block);
 }
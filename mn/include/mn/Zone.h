@@ -0,0 +1,119 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/Base.h"
+#include "mn/Buf.h"
+#include "mn/Defer.h"
+#include "mn/Trace.h"
+
+#include <atomic>
+#include <chrono>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if MN_COMPILER_MSVC && ARCH_X86
+#include <intrin.h>
+#endif
+
+// times the rest of the current scope as a zone with the given name, the name must be a string literal
+#define mn_zone(name) mn::Zone_Scope mn_DEFER_3(_zone_)([](const char* func_name) -> mn::Zone_Site* { static mn::Zone_Site site { { name, func_name, __FILE__, __LINE__, 0 }, {} }; return &site; }(__FUNCTION__))
+
+namespace mn
+{
+	// zone profiler
+	// times named regions of code (zones) in production binaries, each mn_zone site has static metadata which is
+	// registered the first time it runs, and each thread accumulates the durations of its zones into its own counters
+	// without any locks, the durations are measured in cpu timestamp counter ticks and converted to nanoseconds when
+	// the report is generated, every fabric job runs inside a zone, and the zones are also recorded as trace events
+	// while the tracer is running
+	//
+	//	void update_physics() {
+	//		mn_zone("update physics");
+	//		...
+	//	}
+
+	// the maximum number of zone sites, the zones of the sites after that are not recorded
+	constexpr size_t ZONE_SITES_MAX = 1024;
+
+	// the static metadata of a zone site
+	struct Zone_Site
+	{
+		Source_Location srcloc;
+		// the index of the site + 1, it's 0 until the site is registered
+		std::atomic<uint32_t> id;
+	};
+
+	// the aggregated statistics of a zone site across all the threads
+	struct Zone_Stats
+	{
+		const Source_Location* srcloc;
+		uint64_t count;
+		uint64_t total_ns;
+		uint64_t min_ns;
+		uint64_t max_ns;
+		// the percentiles are estimated from a histogram so they're within 12.5% of the real value
+		uint64_t p50_ns;
+		uint64_t p90_ns;
+		uint64_t p99_ns;
+	};
+
+	// returns the current timestamp in ticks, it reads the cpu timestamp counter when it's available and falls back to
+	// the steady clock in nanoseconds
+	inline static uint64_t
+	zone_ticks()
+	{
+		#if MN_COMPILER_MSVC && ARCH_X86
+			return __rdtsc();
+		#elif (MN_COMPILER_GNU || MN_COMPILER_CLANG) && (defined(__x86_64__) || defined(__i386__))
+			return __builtin_ia32_rdtsc();
+		#elif (MN_COMPILER_GNU || MN_COMPILER_CLANG) && defined(__aarch64__)
+			uint64_t res = 0;
+			asm volatile("mrs %0, cntvct_el0" : "=r"(res));
+			return res;
+		#else
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		#endif
+	}
+
+	// adds a zone duration to the counters of the calling thread
+	MN_EXPORT void
+	_zone_record(Zone_Site* site, uint64_t ticks);
+
+	// scope object which is created by mn_zone
+	struct Zone_Scope
+	{
+		Zone_Site* site;
+		uint64_t start;
+		bool traced;
+
+		Zone_Scope(Zone_Site* zone_site)
+		{
+			site = zone_site;
+			traced = trace_enabled();
+			if (traced)
+				trace_begin(site->srcloc.name, "zone");
+			start = zone_ticks();
+		}
+
+		~Zone_Scope()
+		{
+			_zone_record(site, zone_ticks() - start);
+			if (traced)
+				trace_end();
+		}
+
+		Zone_Scope(const Zone_Scope&) = delete;
+		Zone_Scope& operator=(const Zone_Scope&) = delete;
+	};
+
+	// returns the aggregated statistics of all the zone sites which ran since the last reset, sorted by their total
+	// time in descending order
+	MN_EXPORT Buf<Zone_Stats>
+	zone_report(Allocator allocator = allocator_top());
+
+	// clears the statistics of all the zone sites, every thread clears its own counters the next time it records a
+	// zone and the counters of the threads which didn't record anything since the reset are ignored by the report
+	MN_EXPORT void
+	zone_reset();
+}
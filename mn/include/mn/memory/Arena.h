@@ -3,6 +3,7 @@
 #include "mn/Exports.h"
 #include "mn/memory/Interface.h"
 #include "mn/memory/CLib.h"
+#include "mn/memory/Virtual.h"
 #include "mn/Base.h"
 
 #include <stdint.h>
@@ -15,7 +16,7 @@ namespace mn::memory
 	// we noticed that most of the time we free the entire arena at once, that's why arena doesn't free
 	// individual elements, which simplifies internal book keeping a lot, also this is symmetric to
 	// the way it does allocation. in short arena is a bulk allocator, it allocates in bulk and frees in bulk
-	struct Arena : Interface
+	struct Arena final : Interface
 	{
 		struct Node
 		{
@@ -34,6 +35,9 @@ namespace mn::memory
 		};
 
 		Interface* meta;
+		// the virtual memory allocator which is used as the meta allocator for arenas created with virtual memory
+		// options
+		Virtual virtual_meta;
 		State state;
 		Node* head;
 		// contains the block size in bytes, this is the granularity of allocation/free
@@ -54,6 +58,14 @@ namespace mn::memory
 		MN_EXPORT
 		Arena(size_t block_size, Interface* meta = clib());
 
+		// creates a new arena allocator with the given block size (in bytes) which allocates its blocks directly from
+		// OS virtual memory using the given virtual memory allocator options (flags and numa node), with huge pages
+		// the blocks are rounded up to the huge page size, VIRTUAL_FLAG_RESERVE is not supported and is ignored
+		// example usage:
+		// memory::Arena arena(64ULL * 1024ULL * 1024ULL, memory::Virtual{VIRTUAL_FLAG_HUGE_PAGES});
+		MN_EXPORT
+		Arena(size_t block_size, const Virtual& virtual_meta);
+
 		// frees the given arena
 		MN_EXPORT
 		~Arena() override;
@@ -62,6 +74,33 @@ namespace mn::memory
 		MN_EXPORT Block
 		alloc(size_t size, uint8_t alignment) override;
 
+		// the inline allocation fast path, it bumps the allocation head of the current node and only falls back to
+		// the out of line alloc_slow when the node doesn't have enough free memory
+		inline Block
+		bump(size_t size, uint8_t alignment)
+		{
+			if (this->head != nullptr)
+			{
+				auto ptr = align_up(this->head->alloc_head, alignment);
+				auto end = (uint8_t*)this->head->mem.ptr + this->head->mem.size;
+				if (ptr <= end && size <= size_t(end - ptr))
+				{
+					this->head->alloc_head = ptr + size;
+					this->used_mem += size;
+					if (this->used_mem > this->highwater_mem)
+						this->highwater_mem = this->used_mem;
+					if (this->used_mem > this->clear_all_current_highwater)
+						this->clear_all_current_highwater = this->used_mem;
+					return Block{ ptr, size };
+				}
+			}
+			return alloc_slow(size, alignment);
+		}
+
+		// grows the arena to fit the given allocation then allocates it
+		MN_EXPORT Block
+		alloc_slow(size_t size, uint8_t alignment);
+
 		// does nothing, arena doesn't support individual frees
 		MN_EXPORT void
 		free(Block block) override;
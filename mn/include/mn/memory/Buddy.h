@@ -17,7 +17,14 @@ namespace mn::memory
 		};
 
 		Interface* meta;
+		// the virtual memory allocator which is used as the meta allocator for buddy allocators created with
+		// virtual memory options
+		Virtual virtual_meta;
 		Block memory;
+		// with VIRTUAL_FLAG_RESERVE the heap is only reserved and it's committed in steps of commit_granularity as
+		// max_ptr grows, committed_ptr is the end of the committed part of the heap
+		uint8_t* committed_ptr;
+		size_t commit_granularity;
 
 		// maximum allocation size is set to (2**max_alloc_log2)
 		size_t max_alloc_log2;
@@ -85,6 +92,14 @@ namespace mn::memory
 		MN_EXPORT
 		Buddy(size_t heap_size, Interface* meta = virtual_mem());
 
+		// creates a new instance of buddy allocator which allocates its heap directly from OS virtual memory using the
+		// given virtual memory allocator options (flags and numa node), with VIRTUAL_FLAG_RESERVE the heap is reserved
+		// upfront and committed gradually as it's used
+		// example usage:
+		// memory::Buddy buddy(1ULL * 1024ULL * 1024ULL * 1024ULL, memory::Virtual{VIRTUAL_FLAG_RESERVE|VIRTUAL_FLAG_HUGE_PAGES});
+		MN_EXPORT
+		Buddy(size_t heap_size, const Virtual& virtual_meta);
+
 		// frees the given instance of the allocator
 		MN_EXPORT
 		~Buddy();
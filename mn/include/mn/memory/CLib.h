@@ -12,7 +12,7 @@ namespace mn::memory
 	// a wrapper around system's libc allocator
 	struct CLib : Interface
 	{
-		// uses malloc to allocate the given block
+		// uses malloc to allocate the given block, alignments bigger than malloc's are respected too
 		MN_EXPORT Block
 		alloc(size_t size, uint8_t alignment) override;
 
@@ -10,8 +10,30 @@ namespace mn::memory
 	// memory allocators interface, all memory allocators should implement this interface
 	struct Interface
 	{
+		// the kind of the allocator, bump allocators (arena and stack) have an inline non-virtual allocation fast path
+		// which alloc_from uses to skip the virtual call, so a kind other than KIND_GENERIC promises that alloc is
+		// exactly the bump function of that type, that's why arena and stack are final and custom allocators should
+		// keep KIND_GENERIC
+		enum KIND: uint8_t
+		{
+			KIND_GENERIC,
+			KIND_ARENA,
+			KIND_STACK,
+		};
+
+		KIND kind = KIND_GENERIC;
+
 		virtual ~Interface() = default;
 		virtual Block alloc(size_t size, uint8_t alignment) = 0;
 		virtual void free(Block block) = 0;
 	};
+
+	// returns the given pointer rounded up to the given alignment, alignment should be a power of 2 (or 0 which is
+	// treated as 1)
+	inline static uint8_t*
+	align_up(uint8_t* ptr, uint8_t alignment)
+	{
+		auto mask = uintptr_t(alignment > 0 ? alignment - 1 : 0);
+		return (uint8_t*)((uintptr_t(ptr) + mask) & ~mask);
+	}
 }
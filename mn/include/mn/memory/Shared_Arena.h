@@ -0,0 +1,141 @@
+#pragma once
+
+#include "mn/Exports.h"
+#include "mn/memory/Interface.h"
+#include "mn/memory/CLib.h"
+#include "mn/Base.h"
+#include "mn/Thread.h"
+#include "mn/Memory.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mn::memory
+{
+	// shared arena is a thread safe arena allocator, it allocates big blocks from the meta allocator and every thread
+	// carves private chunks out of the current block using an atomic cursor, then it bump allocates from its own chunk
+	// without any synchronization, only the allocation of new blocks takes a lock. this makes it suitable for
+	// building a single result from many threads like parallel parsing where every worker allocates into the same
+	// arena and the whole arena is reset or freed at once
+	struct Shared_Arena : Interface
+	{
+		struct Node
+		{
+			Block mem;
+			// the offset of the next free byte in this block, chunks are carved by atomically incrementing it
+			std::atomic<size_t> cursor;
+			Node* next;
+		};
+
+		struct State
+		{
+			Node* head;
+			size_t cursor;
+			size_t total_mem;
+			size_t used_mem;
+		};
+
+		Interface* meta;
+		Mutex mtx;
+		std::atomic<Node*> head;
+		// identifies the current allocation epoch of this arena, every reset of the arena takes a new globally unique
+		// generation which invalidates all the thread chunks
+		std::atomic<uint64_t> generation;
+		// contains the block size in bytes, this is the granularity of allocation from the meta allocator
+		size_t block_size;
+		// contains the chunk size in bytes, this is the granularity of allocation per thread
+		size_t chunk_size;
+		// total amount of memory allocated from the meta allocator in bytes
+		std::atomic<size_t> total_mem;
+		// memory handed out to threads in bytes, it's counted in chunks (and big allocations which bypass the
+		// chunks) so threads don't contend on it for every allocation
+		std::atomic<size_t> used_mem;
+
+		// creates a new shared arena with the given block and chunk sizes (in bytes), and the meta allocator (defaults
+		// to system malloc)
+		MN_EXPORT
+		Shared_Arena(size_t block_size, size_t chunk_size, Interface* meta = clib());
+
+		// frees the given arena
+		MN_EXPORT
+		~Shared_Arena() override;
+
+		// allocates a block with the given size and alignment from the calling thread's chunk, it's thread safe
+		MN_EXPORT Block
+		alloc(size_t size, uint8_t alignment) override;
+
+		// does nothing, arena doesn't support individual frees
+		MN_EXPORT void
+		free(Block block) override;
+
+		// frees the entire arena to the meta allocator, it's not thread safe and no other thread should be
+		// allocating from the arena while it's freed
+		MN_EXPORT void
+		free_all();
+
+		// resets the allocation state back but keeps the oldest block for reuse, it's not thread safe and no other
+		// thread should be allocating from the arena while it's cleared
+		MN_EXPORT void
+		clear_all();
+
+		// checks whether this arena owns this pointer, which is useful for debugging and various assertions
+		MN_EXPORT bool
+		owns(void* ptr) const;
+
+		// saves the state of the arena, it's not thread safe and no other thread should be allocating from the arena
+		// while taking the checkpoint
+		MN_EXPORT State
+		checkpoint() const;
+
+		// restores the arena back to the saved checkpoint, all the thread chunks are discarded, it's not thread safe
+		// and no other thread should be allocating from the arena while it's restored
+		MN_EXPORT void
+		restore(State state);
+	};
+}
+
+namespace mn
+{
+	// creates a new shared arena allocator with the given block size and per thread chunk size
+	inline static memory::Shared_Arena*
+	allocator_shared_arena_new(size_t block_size = 4ULL * 1024ULL * 1024ULL, size_t chunk_size = 64ULL * 1024ULL, Allocator meta = memory::clib())
+	{
+		return alloc_construct<memory::Shared_Arena>(block_size, chunk_size, meta);
+	}
+
+	// frees the entire shared arena back to the meta allocator
+	inline static void
+	allocator_shared_arena_free_all(memory::Shared_Arena* self)
+	{
+		self->free_all();
+	}
+
+	// resets the allocation state back but doesn't free the memory to the meta allocator, which is useful for memory reuse
+	inline static void
+	allocator_shared_arena_clear_all(memory::Shared_Arena* self)
+	{
+		self->clear_all();
+	}
+
+	// checks whether this shared arena owns this pointer, which is useful for debugging and various assertions
+	inline static bool
+	allocator_shared_arena_owns(const memory::Shared_Arena* self, void* ptr)
+	{
+		return self->owns(ptr);
+	}
+
+	// saves the state of shared arena allocator to be used in a restore function later
+	inline static memory::Shared_Arena::State
+	allocator_shared_arena_checkpoint(const memory::Shared_Arena* self)
+	{
+		return self->checkpoint();
+	}
+
+	// restores the shared arena back to the saved checkpoint
+	inline static void
+	allocator_shared_arena_restore(memory::Shared_Arena* self, memory::Shared_Arena::State state)
+	{
+		self->restore(state);
+	}
+}
@@ -11,7 +11,7 @@
 namespace mn::memory
 {
 	// a stack like memory allocator, which allocates and frees memory from its top
-	struct Stack : Interface
+	struct Stack final : Interface
 	{
 		Interface* meta;
 		Block memory;
@@ -30,6 +30,25 @@ namespace mn::memory
 		MN_EXPORT Block
 		alloc(size_t size, uint8_t alignment) override;
 
+		// the inline allocation fast path, it bumps the allocation head and only calls the out of line
+		// out_of_memory when the stack is full
+		inline Block
+		bump(size_t size, uint8_t alignment)
+		{
+			auto ptr = align_up(this->alloc_head, alignment);
+			auto end = (uint8_t*)this->memory.ptr + this->memory.size;
+			if (ptr > end || size > size_t(end - ptr))
+				out_of_memory();
+
+			this->alloc_head = ptr + size;
+			this->allocations_count++;
+			return Block{ ptr, size };
+		}
+
+		// panics with an out of memory message
+		[[noreturn]] MN_EXPORT void
+		out_of_memory();
+
 		// frees the given block if and only if it's the most recently allocated block (top of stack), if the block
 		// is empty it does nothing
 		MN_EXPORT void
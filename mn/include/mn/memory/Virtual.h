@@ -3,6 +3,7 @@
 #include "mn/Exports.h"
 #include "mn/memory/Interface.h"
 #include "mn/Base.h"
+#include "mn/Virtual_Memory.h"
 
 #include <stdint.h>
 #include <stddef.h>
@@ -12,6 +13,17 @@ namespace mn::memory
 	// virtual memory allocator which allocates memory directly from the OS's virtual table
 	struct Virtual : Interface
 	{
+		// the virtual memory flags (VIRTUAL_FLAG) which are used for every allocation
+		uint32_t flags;
+		// the numa node which the memory is bound to if VIRTUAL_FLAG_NUMA_NODE is used
+		uint32_t numa_node;
+
+		// creates a new virtual memory allocator with the given virtual memory flags
+		explicit Virtual(uint32_t virtual_flags = VIRTUAL_FLAG_NONE, uint32_t virtual_numa_node = 0)
+			: flags(virtual_flags), numa_node(virtual_numa_node)
+		{
+		}
+
 		~Virtual() = default;
 
 		// allocates and commits a new memory block with the given size and alignment
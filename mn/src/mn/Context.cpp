@@ -162,6 +162,12 @@ namespace mn
 		return res;
 	}
 
+	Log_Interface
+	_log_interface()
+	{
+		return LOG;
+	}
+
 	void
 	_log_debug_str(const char* msg)
 	{
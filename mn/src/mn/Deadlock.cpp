@@ -0,0 +1,347 @@
+#include "mn/Thread.h"
+#include "mn/Buf.h"
+#include "mn/Map.h"
+#include "mn/Debug.h"
+#include "mn/Log.h"
+#include "mn/IO.h"
+#include "mn/Thread_State.h"
+
+#include <atomic>
+#include <mutex>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace mn
+{
+	// Deadlock detector
+	// a lockdep style detector, instead of tracking the owners of every lock and walking the wait graph on every
+	// contended lock, it validates the order in which the locks are acquired, every thread keeps a stack of the
+	// locks it holds, and acquiring a lock while holding others records the edges (held -> acquired) in a global
+	// lock order graph, an edge is only recorded on its first occurrence, and it's the only time the global state is
+	// touched and the graph is searched for cycles, a cycle means the locks are acquired in inconsistent orders by
+	// different code paths which will deadlock given the right interleaving, so it's reported even if the deadlock
+	// didn't happen in this run
+	//
+	// after warm up the lock path is a scan of the few held locks and a lookup in a per thread cache of the seen
+	// edges, read and write locks of the same mutex are ordered the same way
+
+	constexpr size_t DEADLOCK_MAX_HELD_LOCKS = 32;
+	constexpr size_t DEADLOCK_EDGE_CACHE_SIZE = 256;
+	constexpr size_t DEADLOCK_MAX_FRAMES = 20;
+
+	struct Deadlock_Held_Lock
+	{
+		void* mtx;
+		const char* name;
+		bool shared;
+	};
+
+	struct Deadlock_Cached_Edge
+	{
+		void* from;
+		void* to;
+	};
+
+	struct Deadlock_Thread
+	{
+		// set while the thread is inside the detector to ignore the locks which are taken by the detector itself
+		bool busy;
+		Deadlock_Held_Lock held[DEADLOCK_MAX_HELD_LOCKS];
+		size_t held_count;
+		// the graph generation which the edge cache belongs to
+		uint64_t generation;
+		// a direct mapped cache of the edges which are already in the graph
+		Deadlock_Cached_Edge edges_cache[DEADLOCK_EDGE_CACHE_SIZE];
+		bool alive;
+	};
+
+	struct Deadlock_Edge
+	{
+		void* to;
+		// the callstack which recorded this edge for the first time
+		void* callstack[DEADLOCK_MAX_FRAMES];
+		size_t callstack_count;
+	};
+
+	struct Deadlock_Lock_Node
+	{
+		const char* name;
+		Buf<Deadlock_Edge> edges;
+	};
+
+	struct Deadlock_Path_Step
+	{
+		void* from;
+		const Deadlock_Edge* edge;
+	};
+
+	struct Deadlock_Graph
+	{
+		std::mutex mtx;
+		Thread_State_Registry<Deadlock_Thread> threads;
+		bool initialized;
+		Map<void*, Deadlock_Lock_Node> nodes;
+		// it changes whenever a lock is removed from the graph, which invalidates the per thread edge caches because
+		// the address of the freed lock might be reused by another lock
+		std::atomic<uint64_t> generation;
+		std::atomic<size_t> nodes_count;
+	};
+
+	// the library's global state is kept in plain globals without constructors like this one, static storage is zero
+	// initialized before any dynamic initialization so they can be used by the code which runs during static
+	// initialization (the mutexes here)
+	static Deadlock_Graph DEADLOCK_GRAPH;
+
+	// returns the state of the calling thread, or nullptr if the thread is exiting
+	inline static Deadlock_Thread*
+	_deadlock_thread_get()
+	{
+		return thread_state_get(DEADLOCK_GRAPH.threads,
+			[](Deadlock_Thread* thread) {
+				// the edge cache of the exited thread is still valid, only the held locks are dropped
+				thread->busy = false;
+				thread->held_count = 0;
+				return true;
+			},
+			[] { return alloc_zerod_from<Deadlock_Thread>(memory::clib()); }
+		);
+	}
+
+	inline static size_t
+	_deadlock_edge_cache_index(void* from, void* to)
+	{
+		auto h = (uint64_t)(uintptr_t)from * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)to * 0xC2B2AE3D27D4EB4FULL;
+		return (h >> 32) & (DEADLOCK_EDGE_CACHE_SIZE - 1);
+	}
+
+	inline static Deadlock_Lock_Node*
+	_deadlock_graph_node(Deadlock_Graph* self, void* mtx, const char* name)
+	{
+		if (self->initialized == false)
+		{
+			self->nodes = map_with_allocator<void*, Deadlock_Lock_Node>(memory::clib());
+			self->initialized = true;
+		}
+
+		if (auto it = map_lookup(self->nodes, mtx))
+			return &it->value;
+
+		Deadlock_Lock_Node node{};
+		node.name = name;
+		node.edges = buf_with_allocator<Deadlock_Edge>(memory::clib());
+		self->nodes_count.fetch_add(1, std::memory_order_relaxed);
+		return &map_insert(self->nodes, mtx, node)->value;
+	}
+
+	// searches the graph for a path of lock order edges which leads from the given lock to the target lock
+	inline static bool
+	_deadlock_graph_find_path(Deadlock_Graph* self, void* from, void* target, Set<void*>& visited, Buf<Deadlock_Path_Step>& path)
+	{
+		if (set_lookup(visited, from))
+			return false;
+		set_insert(visited, from);
+
+		auto it = map_lookup(self->nodes, from);
+		if (it == nullptr)
+			return false;
+
+		for (const auto& edge: it->value.edges)
+		{
+			if (edge.to == target || _deadlock_graph_find_path(self, edge.to, target, visited, path))
+			{
+				buf_push(path, Deadlock_Path_Step{from, &edge});
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline static const char*
+	_deadlock_graph_lock_name(Deadlock_Graph* self, void* mtx)
+	{
+		if (auto it = map_lookup(self->nodes, mtx))
+			return it->value.name;
+		return "<unknown>";
+	}
+
+	// the slow path, it's called when the edge isn't in the calling thread edge cache
+	inline static void
+	_deadlock_graph_add_edge(Deadlock_Graph* self, const Deadlock_Held_Lock& held, void* mtx, const char* name)
+	{
+		std::lock_guard<std::mutex> lock(self->mtx);
+
+		auto from = _deadlock_graph_node(self, held.mtx, held.name);
+		for (const auto& edge: from->edges)
+			if (edge.to == mtx)
+				return;
+		_deadlock_graph_node(self, mtx, name);
+
+		// a path from the acquired lock back to the held lock means that this edge closes a cycle
+		auto visited = set_with_allocator<void*>(memory::clib());
+		auto path = buf_with_allocator<Deadlock_Path_Step>(memory::clib());
+		if (_deadlock_graph_find_path(self, mtx, held.mtx, visited, path))
+		{
+			log_error(
+				"potential deadlock: thread #{} acquires lock '{}' ({}) while holding lock '{}' ({}), which inverts the lock order that was recorded before, the callstack is listed below:",
+				thread_id(),
+				name,
+				mtx,
+				held.name,
+				held.mtx
+			);
+			void* callstack[DEADLOCK_MAX_FRAMES];
+			auto callstack_count = callstack_capture(callstack, DEADLOCK_MAX_FRAMES);
+			callstack_print_to(callstack, callstack_count, file_stderr());
+			printerr("\n");
+
+			// the path is collected in reverse order
+			for (size_t i = 0; i < path.count; ++i)
+			{
+				auto step = path[path.count - i - 1];
+				log_error(
+					"order #{}: lock '{}' ({}) was acquired while holding lock '{}' ({}) at the callstack listed below:",
+					i + 1,
+					_deadlock_graph_lock_name(self, step.edge->to),
+					step.edge->to,
+					_deadlock_graph_lock_name(self, step.from),
+					step.from
+				);
+				callstack_print_to((void**)step.edge->callstack, step.edge->callstack_count, file_stderr());
+				printerr("\n");
+			}
+		}
+		set_free(visited);
+		buf_free(path);
+
+		// the edge is recorded even if it closes a cycle so that each inversion is reported once
+		Deadlock_Edge edge{};
+		edge.to = mtx;
+		edge.callstack_count = callstack_capture(edge.callstack, DEADLOCK_MAX_FRAMES);
+		// the node might have moved when the acquired lock node was inserted
+		buf_push(map_lookup(self->nodes, held.mtx)->value.edges, edge);
+	}
+
+	[[noreturn]] static void
+	_deadlock_report_relock(void* mtx, const char* name)
+	{
+		log_error("deadlock: thread #{} locks '{}' ({}) which it already holds, the callstack is listed below:", thread_id(), name, mtx);
+		void* callstack[DEADLOCK_MAX_FRAMES];
+		auto callstack_count = callstack_capture(callstack, DEADLOCK_MAX_FRAMES);
+		callstack_print_to(callstack, callstack_count, file_stderr());
+		printerr("\n");
+		::exit(-1);
+	}
+
+	// API
+	void
+	_deadlock_detector_lock(void* mtx, const char* name, bool shared)
+	{
+		auto thread = _deadlock_thread_get();
+		if (thread == nullptr || thread->busy)
+			return;
+		thread->busy = true;
+
+		auto self = &DEADLOCK_GRAPH;
+
+		auto generation = self->generation.load(std::memory_order_acquire);
+		if (thread->generation != generation)
+		{
+			::memset(thread->edges_cache, 0, sizeof(thread->edges_cache));
+			thread->generation = generation;
+		}
+
+		for (size_t i = 0; i < thread->held_count && i < DEADLOCK_MAX_HELD_LOCKS; ++i)
+		{
+			const auto& held = thread->held[i];
+			if (held.mtx == mtx)
+			{
+				// recursive read locks are fine, everything else blocks forever
+				if (held.shared && shared)
+					continue;
+
+				_deadlock_report_relock(mtx, name);
+			}
+
+			auto& cached = thread->edges_cache[_deadlock_edge_cache_index(held.mtx, mtx)];
+			if (cached.from == held.mtx && cached.to == mtx)
+				continue;
+
+			_deadlock_graph_add_edge(self, held, mtx, name);
+			cached.from = held.mtx;
+			cached.to = mtx;
+		}
+
+		// locks which don't fit in the held stack are counted but their order isn't validated
+		if (thread->held_count < DEADLOCK_MAX_HELD_LOCKS)
+			thread->held[thread->held_count] = Deadlock_Held_Lock{mtx, name, shared};
+		++thread->held_count;
+
+		thread->busy = false;
+	}
+
+	void
+	_deadlock_detector_unlock(void* mtx)
+	{
+		auto thread = _deadlock_thread_get();
+		if (thread == nullptr || thread->busy || thread->held_count == 0)
+			return;
+
+		if (thread->held_count > DEADLOCK_MAX_HELD_LOCKS)
+		{
+			--thread->held_count;
+			return;
+		}
+
+		// locks are usually released in reverse order so the search starts from the top of the stack
+		for (size_t i = thread->held_count; i > 0; --i)
+		{
+			if (thread->held[i - 1].mtx == mtx)
+			{
+				for (size_t j = i; j < thread->held_count; ++j)
+					thread->held[j - 1] = thread->held[j];
+				--thread->held_count;
+				return;
+			}
+		}
+	}
+
+	void
+	_deadlock_detector_free(void* mtx)
+	{
+		auto thread = _deadlock_thread_get();
+		if (thread == nullptr || thread->busy)
+			return;
+
+		auto self = &DEADLOCK_GRAPH;
+		// most locks are never nested so they never enter the graph
+		if (self->nodes_count.load(std::memory_order_relaxed) == 0)
+			return;
+
+		thread->busy = true;
+		{
+			std::lock_guard<std::mutex> lock(self->mtx);
+			if (auto it = map_lookup(self->nodes, mtx))
+			{
+				buf_free(it->value.edges);
+				map_remove(self->nodes, mtx);
+				self->nodes_count.fetch_sub(1, std::memory_order_relaxed);
+
+				for (auto& node: self->nodes)
+				{
+					auto& edges = node.value.edges;
+					for (size_t i = 0; i < edges.count; ++i)
+					{
+						if (edges[i].to == mtx)
+						{
+							buf_remove(edges, i);
+							break;
+						}
+					}
+				}
+				self->generation.fetch_add(1, std::memory_order_release);
+			}
+		}
+		thread->busy = false;
+	}
+}
@@ -0,0 +1,206 @@
+#include "mn/Epoch.h"
+#include "mn/Buf.h"
+#include "mn/Fabric.h"
+#include "mn/Thread.h"
+#include "mn/Defer.h"
+#include "mn/Thread_State.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace mn
+{
+	// the epoch of the offline threads, it's bigger than any global epoch so they never delay the reclamation
+	constexpr uint64_t EPOCH_OFFLINE = UINT64_MAX;
+	// the number of pending deferred tasks which triggers a reclamation from epoch_task_defer
+	constexpr size_t EPOCH_RECLAIM_THRESHOLD = 64;
+	constexpr size_t EPOCH_CACHE_LINE = 64;
+
+	struct alignas(EPOCH_CACHE_LINE) Epoch_Thread
+	{
+		// the global epoch which the thread observed at its last quiescent point, or EPOCH_OFFLINE, every fabric worker
+		// writes it after each job so it's given its own cache line
+		std::atomic<uint64_t> epoch;
+		bool alive;
+	};
+
+	struct Epoch_Deferred
+	{
+		// the task can run once every thread observes this epoch
+		uint64_t epoch;
+		Task<void()> task;
+	};
+
+	// the global epoch only moves forward when a task is deferred, a deferred task is tagged with the new epoch, and a
+	// thread which observes the new epoch at a quiescent point can't hold a pointer to the unpublished data anymore
+	struct Epoch_Domain
+	{
+		std::atomic<uint64_t> epoch;
+		std::atomic<size_t> deferred_count;
+		// its mutex protects the deferred tasks too, reclamation runs them after releasing it
+		Thread_State_Registry<Epoch_Thread> threads;
+		bool initialized;
+		Buf<Epoch_Deferred> deferred;
+	};
+
+	static Epoch_Domain EPOCH_DOMAIN;
+
+	inline static void
+	_epoch_domain_init(Epoch_Domain* self)
+	{
+		if (self->initialized)
+			return;
+		self->deferred = buf_with_allocator<Epoch_Deferred>(memory::clib());
+		self->initialized = true;
+	}
+
+	// returns the state of the calling thread, or nullptr if the thread is exiting
+	inline static Epoch_Thread*
+	_epoch_thread_get()
+	{
+		return thread_state_get(EPOCH_DOMAIN.threads,
+			[](Epoch_Thread* thread) {
+				thread->epoch.store(EPOCH_OFFLINE, std::memory_order_relaxed);
+				return true;
+			},
+			[] {
+				auto thread = alloc_zerod_from<Epoch_Thread>(memory::clib());
+				thread->epoch.store(EPOCH_OFFLINE, std::memory_order_relaxed);
+				return thread;
+			}
+		);
+	}
+
+	// runs the deferred tasks which every thread is done with, and returns the smallest epoch of the threads
+	inline static size_t
+	_epoch_reclaim(Epoch_Domain* self, uint64_t& min_epoch)
+	{
+		min_epoch = EPOCH_OFFLINE;
+
+		// pairs with the fence in epoch_thread_online, either we see the thread online or it sees the unpublished data
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// the sysmon thread never clears its tmp allocator so the ready tasks are collected in a clib buf
+		auto ready = buf_with_allocator<Epoch_Deferred>(memory::clib());
+		mn_defer{buf_free(ready);};
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			if (self->initialized == false)
+				return 0;
+
+			for (auto thread: self->threads.states)
+			{
+				// the exited threads are skipped, their states wait to be reused
+				if (thread->alive == false)
+					continue;
+				auto epoch = thread->epoch.load(std::memory_order_acquire);
+				if (epoch < min_epoch)
+					min_epoch = epoch;
+			}
+
+			size_t j = 0;
+			for (size_t i = 0; i < self->deferred.count; ++i)
+			{
+				if (self->deferred[i].epoch <= min_epoch)
+					buf_push(ready, self->deferred[i]);
+				else
+					self->deferred[j++] = self->deferred[i];
+			}
+			buf_resize(self->deferred, j);
+			self->deferred_count.store(j, std::memory_order_relaxed);
+		}
+
+		for (auto& deferred: ready)
+		{
+			deferred.task();
+			task_free(deferred.task);
+		}
+		return ready.count;
+	}
+
+	// API
+	void
+	epoch_thread_online()
+	{
+		auto thread = _epoch_thread_get();
+		if (thread == nullptr)
+			return;
+
+		thread->epoch.store(EPOCH_DOMAIN.epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+		// the thread must be visible as online before it loads any snapshot pointer
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	void
+	epoch_thread_offline()
+	{
+		if (auto thread = thread_state_current(EPOCH_DOMAIN.threads))
+			thread->epoch.store(EPOCH_OFFLINE, std::memory_order_release);
+	}
+
+	void
+	epoch_quiescent()
+	{
+		auto thread = thread_state_current(EPOCH_DOMAIN.threads);
+		if (thread == nullptr || thread->epoch.load(std::memory_order_relaxed) == EPOCH_OFFLINE)
+			return;
+
+		// the release store orders the thread's previous loads of the snapshot pointers before it
+		thread->epoch.store(EPOCH_DOMAIN.epoch.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	void
+	epoch_task_defer(Task<void()> task)
+	{
+		auto self = &EPOCH_DOMAIN;
+		size_t deferred_count = 0;
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			_epoch_domain_init(self);
+			auto epoch = self->epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+			buf_push(self->deferred, Epoch_Deferred{epoch, task});
+			deferred_count = self->deferred.count;
+			self->deferred_count.store(deferred_count, std::memory_order_relaxed);
+		}
+
+		if (deferred_count >= EPOCH_RECLAIM_THRESHOLD)
+			epoch_reclaim();
+	}
+
+	size_t
+	epoch_reclaim()
+	{
+		uint64_t min_epoch = 0;
+		return _epoch_reclaim(&EPOCH_DOMAIN, min_epoch);
+	}
+
+	void
+	epoch_synchronize()
+	{
+		auto self = &EPOCH_DOMAIN;
+
+		// the calling thread doesn't hold any snapshot pointers so it shouldn't wait for itself
+		epoch_quiescent();
+
+		auto target = self->epoch.load(std::memory_order_acquire);
+		uint64_t min_epoch = 0;
+		_epoch_reclaim(self, min_epoch);
+		if (min_epoch >= target)
+			return;
+
+		worker_block_ahead();
+		while (min_epoch < target)
+		{
+			thread_sleep(1);
+			epoch_quiescent();
+			_epoch_reclaim(self, min_epoch);
+		}
+		worker_block_clear();
+	}
+
+	size_t
+	epoch_pending_count()
+	{
+		return EPOCH_DOMAIN.deferred_count.load(std::memory_order_relaxed);
+	}
+}
@@ -1,4 +1,7 @@
 #include "mn/Fabric.h"
+#include "mn/Epoch.h"
+#include "mn/Trace.h"
+#include "mn/Zone.h"
 #include "mn/Memory.h"
 #include "mn/Pool.h"
 #include "mn/Buf.h"
@@ -14,6 +17,34 @@ namespace mn
 	constexpr static auto DEFAULT_COOP_BLOCKING_THRESHOLD = 10;
 	constexpr static auto DEFAULT_EXTR_BLOCKING_THRESHOLD = 1000;
 
+	inline static uint64_t
+	_fabric_now_in_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// statistics of a single worker, only the worker writes to them (except tasks_stolen which sysmon adds to) so
+	// they don't add any contention, they're owned by the fabric so they outlive the replaced workers
+	struct Fabric_Worker_Counters
+	{
+		std::atomic<uint64_t> tasks_executed;
+		std::atomic<uint64_t> tasks_stolen;
+		std::atomic<uint64_t> busy_time_in_ns;
+		std::atomic<uint64_t> idle_time_in_ns;
+		Atomic_Histogram queue_wait_time_in_ns;
+		Atomic_Histogram execution_time_in_ns;
+		// the count of the tasks in the worker queue, it's updated with the worker mutex held whenever the queue changes
+		std::atomic<size_t> queue_depth;
+		// the next counters in the fabric list of counters
+		Fabric_Worker_Counters* next;
+	};
+
+	inline static void
+	_fabric_counter_add(std::atomic<uint64_t>& counter, uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
 	// Worker
 	struct IWorker
 	{
@@ -33,6 +64,8 @@ namespace mn
 		Thread thread;
 		// index within a fabric
 		size_t fabric_index;
+		// statistics of the worker, it's null for the workers which don't belong to a fabric
+		Fabric_Worker_Counters* counters;
 		std::atomic<Fabric_Task::KIND> atomic_current_job_kind;
 		std::atomic<uint64_t> atomic_job_start_time_in_ms;
 		std::atomic<uint64_t> atomic_block_start_time_in_ms;
@@ -41,6 +74,14 @@ namespace mn
 	};
 	thread_local Worker LOCAL_WORKER = nullptr;
 
+	// publishes the queue depth for fabric_stats, it should be called with the worker mutex held after changing the queue
+	inline static void
+	_worker_queue_depth_publish(Worker self)
+	{
+		if (self->counters)
+			self->counters->queue_depth.store(self->job_q.count, std::memory_order_relaxed);
+	}
+
 	struct IFabric
 	{
 		Fabric_Settings settings;
@@ -58,6 +99,18 @@ namespace mn
 		size_t next_worker;
 		size_t worker_id_generator;
 
+		// the counters of all the workers which were created by this fabric, it's a list which is only pushed to (with
+		// the fabric mutex held) and freed with the fabric so fabric_stats walks it without locking
+		std::atomic<Fabric_Worker_Counters*> atomic_worker_counters;
+		// the counters of the worker which serves each fabric index, they're published when a worker is replaced so
+		// fabric_stats doesn't need to lock the fabric to read the workers
+		std::atomic<Fabric_Worker_Counters*>* atomic_index_counters;
+		// sysmon statistics, only sysmon writes to them
+		std::atomic<uint64_t> atomic_blocking_replacements;
+		std::atomic<uint64_t> atomic_long_running_replacements;
+		std::atomic<size_t> atomic_sleepy_side_workers_count;
+		std::atomic<size_t> atomic_ready_side_workers_count;
+
 		Thread sysmon;
 	};
 
@@ -66,6 +119,8 @@ namespace mn
 	{
 		auto self = (Worker)worker;
 		LOCAL_WORKER = self;
+		epoch_thread_online();
+		trace_thread_name(self->name.ptr);
 
 		if (self->fabric)
 			if (self->fabric->settings.on_worker_start)
@@ -83,10 +138,16 @@ namespace mn
 
 					if (self->job_q.count == 0)
 					{
+						auto idle_start = _fabric_now_in_ns();
+						// idle workers don't hold up the reclamation of the epoch deferred tasks
+						epoch_thread_offline();
 						cond_var_wait(self->cv, self->mtx, [&]{
 							return self->job_q.count > 0 ||
 								self->atomic_state.load() != IWorker::STATE_RUNNING;
 						});
+						epoch_thread_online();
+						if (self->counters)
+							_fabric_counter_add(self->counters->idle_time_in_ns, _fabric_now_in_ns() - idle_start);
 						state = self->atomic_state.load();
 					}
 
@@ -95,17 +156,40 @@ namespace mn
 
 					job = ring_front(self->job_q);
 					ring_pop_front(self->job_q);
+					_worker_queue_depth_publish(self);
 				}
 
+				auto job_start = _fabric_now_in_ns();
+				if (self->counters && job.queued_time_in_ns != 0 && job_start > job.queued_time_in_ns)
+					atomic_histogram_record(self->counters->queue_wait_time_in_ns, job_start - job.queued_time_in_ns);
+
 				self->atomic_job_start_time_in_ms.store(time_in_millis());
 				self->atomic_disable_block_timing = false;
 				self->atomic_current_job_kind.store(job.kind);
-				fabric_task_run(job);
+				// every job runs in a zone which is also recorded as a trace event while the tracer is running
+				if (job.kind == Fabric_Task::KIND_COMPUTE)
+				{
+					mn_zone("compute job");
+					fabric_task_run(job);
+				}
+				else
+				{
+					mn_zone("oneshot job");
+					fabric_task_run(job);
+				}
+				if (self->counters)
+				{
+					auto job_time = _fabric_now_in_ns() - job_start;
+					atomic_histogram_record(self->counters->execution_time_in_ns, job_time);
+					_fabric_counter_add(self->counters->busy_time_in_ns, job_time);
+					_fabric_counter_add(self->counters->tasks_executed, 1);
+				}
 				self->atomic_disable_block_timing = true;
 				self->atomic_job_start_time_in_ms.store(0);
 				self->atomic_current_job_kind.store(Fabric_Task::KIND_ONESHOT);
 				fabric_task_free(job);
 				memory::tmp()->clear_all();
+				epoch_quiescent();
 				if (self->fabric)
 				{
 					if (self->fabric->settings.after_each_job)
@@ -120,9 +204,11 @@ namespace mn
 
 				if (self->atomic_state.load() == IWorker::STATE_PAUSED)
 				{
+					epoch_thread_offline();
 					cond_var_wait(self->cv, self->mtx, [&]{
 						return self->atomic_state.load() != IWorker::STATE_PAUSED;
 					});
+					epoch_thread_online();
 				}
 			}
 			else if (state == IWorker::STATE_STOP_REQUEST)
@@ -137,6 +223,7 @@ namespace mn
 
 		[[maybe_unused]] auto old_state = self->atomic_state.exchange(IWorker::STATE_STOP_ACKNOWLEDGED);
 		mn_assert(old_state == IWorker::STATE_STOP_REQUEST);
+		epoch_thread_offline();
 		LOCAL_WORKER = nullptr;
 	}
 
@@ -179,11 +266,19 @@ namespace mn
 	{
 		auto self = alloc_zerod<IWorker>();
 		self->name = name;
-		self->mtx = mn_mutex_new_with_srcloc(self->name.ptr);
+		self->mtx = mn_mutex_new_with_srcloc("fabric worker mutex");
 		self->cv = cond_var_new();
 		self->fabric = fabric;
 		self->job_q = stolen_jobs;
 		self->fabric_index = fabric_index;
+		if (fabric)
+		{
+			// the fabric mutex is held by the caller (or the fabric is being created)
+			self->counters = alloc_zerod_from<Fabric_Worker_Counters>(memory::clib());
+			self->counters->next = fabric->atomic_worker_counters.load(std::memory_order_relaxed);
+			fabric->atomic_worker_counters.store(self->counters, std::memory_order_release);
+			_worker_queue_depth_publish(self);
+		}
 		self->atomic_state = IWorker::STATE_RUNNING;
 		self->atomic_disable_block_timing = true;
 		self->thread = thread_new(_worker_main, self, self->name.ptr);
@@ -209,6 +304,14 @@ namespace mn
 	}
 
 	// Fabric
+	// sets the worker which serves the given fabric index and publishes its counters for fabric_stats
+	inline static void
+	_fabric_worker_set(Fabric self, size_t index, Worker worker)
+	{
+		self->workers[index] = worker;
+		self->atomic_index_counters[index].store(worker->counters, std::memory_order_release);
+	}
+
 	inline static void
 	_sysmon_detect_blocking_workers(Fabric self, Buf<Worker>& blocking_workers)
 	{
@@ -239,6 +342,8 @@ namespace mn
 		// move the blocking workers out
 		for (auto blocking_worker: blocking_workers)
 		{
+			trace_instant("blocking worker replaced", "fabric");
+			self->atomic_blocking_replacements.fetch_add(1, std::memory_order_relaxed);
 			Ring<Fabric_Task> job_q{};
 			{
 				mutex_lock(blocking_worker->mtx);
@@ -246,6 +351,7 @@ namespace mn
 
 				job_q = blocking_worker->job_q;
 				blocking_worker->job_q = ring_new<Fabric_Task>();
+				_worker_queue_depth_publish(blocking_worker);
 			}
 
 			{
@@ -259,9 +365,14 @@ namespace mn
 					buf_pop(self->ready_side_workers);
 
 					new_worker->fabric_index = blocking_worker->fabric_index;
-					self->workers[blocking_worker->fabric_index] = new_worker;
-					ring_free(new_worker->job_q);
-					new_worker->job_q = job_q;
+					{
+						mutex_lock(new_worker->mtx);
+						mn_defer{mutex_unlock(new_worker->mtx);};
+						ring_free(new_worker->job_q);
+						new_worker->job_q = job_q;
+						_worker_queue_depth_publish(new_worker);
+					}
+					_fabric_worker_set(self, blocking_worker->fabric_index, new_worker);
 
 					_worker_resume(new_worker);
 				}
@@ -274,7 +385,7 @@ namespace mn
 						job_q
 					);
 
-					self->workers[blocking_worker->fabric_index] = new_worker;
+					_fabric_worker_set(self, blocking_worker->fabric_index, new_worker);
 				}
 			}
 		}
@@ -313,6 +424,8 @@ namespace mn
 		// move the blocking workers out
 		for (auto blocking_worker: blocking_workers)
 		{
+			trace_instant("long running worker replaced", "fabric");
+			self->atomic_long_running_replacements.fetch_add(1, std::memory_order_relaxed);
 			Ring<Fabric_Task> job_q{};
 			{
 				mutex_lock(blocking_worker->mtx);
@@ -320,6 +433,7 @@ namespace mn
 
 				job_q = blocking_worker->job_q;
 				blocking_worker->job_q = ring_new<Fabric_Task>();
+				_worker_queue_depth_publish(blocking_worker);
 			}
 
 			{
@@ -333,9 +447,14 @@ namespace mn
 					buf_pop(self->ready_side_workers);
 
 					new_worker->fabric_index = blocking_worker->fabric_index;
-					self->workers[blocking_worker->fabric_index] = new_worker;
-					ring_free(new_worker->job_q);
-					new_worker->job_q = job_q;
+					{
+						mutex_lock(new_worker->mtx);
+						mn_defer{mutex_unlock(new_worker->mtx);};
+						ring_free(new_worker->job_q);
+						new_worker->job_q = job_q;
+						_worker_queue_depth_publish(new_worker);
+					}
+					_fabric_worker_set(self, blocking_worker->fabric_index, new_worker);
 
 					_worker_resume(new_worker);
 				}
@@ -348,7 +467,7 @@ namespace mn
 						job_q
 					);
 
-					self->workers[blocking_worker->fabric_index] = new_worker;
+					_fabric_worker_set(self, blocking_worker->fabric_index, new_worker);
 				}
 			}
 		}
@@ -368,6 +487,7 @@ namespace mn
 		_disable_profiling_for_this_thread();
 
 		auto self = (Fabric)fabric;
+		trace_thread_name(self->sysmon_name.ptr);
 
 		// workers who exceeded the coop blocking threshold
 		auto blocking_workers = buf_with_capacity<Worker>(self->workers.count);
@@ -430,6 +550,9 @@ namespace mn
 			if (slept_on_cond_var == false)
 				thread_sleep(timeslice);
 
+			if (epoch_pending_count() > 0)
+				epoch_reclaim();
+
 			// get the max/min jobs
 			size_t busiest_worker = 0;
 			size_t max_jobs = 0;
@@ -476,6 +599,7 @@ namespace mn
 
 						buf_push(tmp_jobs, job);
 					}
+					_worker_queue_depth_publish(max_worker);
 				}
 
 				{
@@ -486,6 +610,9 @@ namespace mn
 
 					for (auto job: tmp_jobs)
 						ring_push_back(min_worker->job_q, job);
+					_worker_queue_depth_publish(min_worker);
+					if (min_worker->counters)
+						min_worker->counters->tasks_stolen.fetch_add(tmp_jobs.count, std::memory_order_relaxed);
 					buf_clear(tmp_jobs);
 
 					cond_var_notify(min_worker->cv);
@@ -513,6 +640,10 @@ namespace mn
 
 			_sysmon_detect_blocking_workers(self, blocking_workers);
 			_sysmon_detect_long_running_workers(self, long_running_workers);
+
+			// the side workers lists are only touched by sysmon so their sizes are published for fabric_stats
+			self->atomic_sleepy_side_workers_count.store(self->sleepy_side_workers.count, std::memory_order_relaxed);
+			self->atomic_ready_side_workers_count.store(self->ready_side_workers.count, std::memory_order_relaxed);
 		}
 	}
 
@@ -534,22 +665,33 @@ namespace mn
 	void
 	worker_task_do(Worker self, const Fabric_Task& task)
 	{
+		auto job = task;
+		job.queued_time_in_ns = _fabric_now_in_ns();
+
 		mutex_lock(self->mtx);
 		mn_defer{mutex_unlock(self->mtx);};
 
-		ring_push_back(self->job_q, task);
+		ring_push_back(self->job_q, job);
+		_worker_queue_depth_publish(self);
 		cond_var_notify(self->cv);
 	}
 
 	void
 	worker_task_batch_do(Worker self, const Fabric_Task* ptr, size_t count)
 	{
+		auto queued_time = _fabric_now_in_ns();
+
 		mutex_lock(self->mtx);
 		mn_defer{mutex_unlock(self->mtx);};
 
 		ring_reserve(self->job_q, count);
 		for (size_t i = 0; i < count; ++i)
-			ring_push_back(self->job_q, ptr[i]);
+		{
+			auto job = ptr[i];
+			job.queued_time_in_ns = queued_time;
+			ring_push_back(self->job_q, job);
+		}
+		_worker_queue_depth_publish(self);
 		cond_var_notify(self->cv);
 	}
 
@@ -619,20 +761,28 @@ namespace mn
 		self->workers = buf_with_count<Worker>(self->settings.workers_count);
 		self->sleepy_side_workers = buf_new<Worker>();
 		self->ready_side_workers = buf_new<Worker>();
-		self->mtx = mn_mutex_new_with_srcloc(self->name.ptr);
+		self->mtx = mn_mutex_new_with_srcloc("fabric mutex");
 		self->cv = cond_var_new();
 		self->is_running = true;
 		self->atomic_available_jobs = 0;
 		self->next_worker = 0;
 		self->worker_id_generator = 0;
+		self->atomic_index_counters = (std::atomic<Fabric_Worker_Counters*>*)alloc_from(
+			memory::clib(),
+			sizeof(std::atomic<Fabric_Worker_Counters*>) * self->workers.count,
+			alignof(std::atomic<Fabric_Worker_Counters*>)
+		).ptr;
+		for (size_t i = 0; i < self->workers.count; ++i)
+			new (&self->atomic_index_counters[i]) std::atomic<Fabric_Worker_Counters*>(nullptr);
 
 		for (size_t i = 0; i < self->workers.count; ++i)
 		{
-			self->workers[i] = _worker_new(
+			auto worker = _worker_new(
 				strf("{} worker #{}", self->name, self->worker_id_generator++),
 				self,
 				i
 			);
+			_fabric_worker_set(self, i, worker);
 		}
 
 		self->sysmon = thread_new(_sysmon_main, self, self->sysmon_name.ptr);
@@ -675,6 +825,14 @@ namespace mn
 			_worker_free(worker);
 		buf_free(self->ready_side_workers);
 
+		for (auto counters = self->atomic_worker_counters.load(); counters != nullptr;)
+		{
+			auto next = counters->next;
+			free_from(memory::clib(), counters);
+			counters = next;
+		}
+		free_from(memory::clib(), Block{self->atomic_index_counters, sizeof(std::atomic<Fabric_Worker_Counters*>) * self->workers.count});
+
 		cond_var_free(self->cv);
 		mutex_free(self->mtx);
 		str_free(self->name);
@@ -744,6 +902,49 @@ namespace mn
 		return self->workers.count;
 	}
 
+	Fabric_Stats
+	fabric_stats(Fabric self, Allocator allocator)
+	{
+		Fabric_Stats res{};
+		res.workers = buf_with_allocator<Fabric_Worker_Stats>(allocator);
+		res.available_jobs = self->atomic_available_jobs.load(std::memory_order_relaxed);
+		res.blocking_replacements = self->atomic_blocking_replacements.load(std::memory_order_relaxed);
+		res.long_running_replacements = self->atomic_long_running_replacements.load(std::memory_order_relaxed);
+		res.sleepy_side_workers_count = self->atomic_sleepy_side_workers_count.load(std::memory_order_relaxed);
+		res.ready_side_workers_count = self->atomic_ready_side_workers_count.load(std::memory_order_relaxed);
+
+		// the workers count doesn't change after creation, and the counters are only freed with the fabric
+		buf_reserve(res.workers, self->workers.count);
+		for (size_t i = 0; i < self->workers.count; ++i)
+		{
+			auto counters = self->atomic_index_counters[i].load(std::memory_order_acquire);
+
+			Fabric_Worker_Stats stats{};
+			stats.index = i;
+			stats.queue_depth = counters->queue_depth.load(std::memory_order_relaxed);
+			stats.tasks_executed = counters->tasks_executed.load(std::memory_order_relaxed);
+			stats.tasks_stolen = counters->tasks_stolen.load(std::memory_order_relaxed);
+			stats.busy_time_in_ns = counters->busy_time_in_ns.load(std::memory_order_relaxed);
+			stats.idle_time_in_ns = counters->idle_time_in_ns.load(std::memory_order_relaxed);
+			buf_push(res.workers, stats);
+		}
+
+		for (auto counters = self->atomic_worker_counters.load(std::memory_order_acquire); counters != nullptr; counters = counters->next)
+		{
+			res.tasks_executed += counters->tasks_executed.load(std::memory_order_relaxed);
+			res.tasks_stolen += counters->tasks_stolen.load(std::memory_order_relaxed);
+			histogram_merge(res.queue_wait_time_in_ns, counters->queue_wait_time_in_ns);
+			histogram_merge(res.execution_time_in_ns, counters->execution_time_in_ns);
+		}
+		return res;
+	}
+
+	void
+	fabric_stats_free(Fabric_Stats& self)
+	{
+		buf_free(self.workers);
+	}
+
 	// channel stream
 	void
 	IChan_Stream::dispose()
@@ -0,0 +1,173 @@
+#include "mn/Growth.h"
+#include "mn/Debug.h"
+#include "mn/Map.h"
+#include "mn/Fmt.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <string.h>
+
+namespace mn
+{
+	// frames of the growth tracker which are skipped from the captured callstacks
+	constexpr size_t GROWTH_SKIP_FRAMES = 2;
+
+	struct Growth_Tracker
+	{
+		std::mutex mtx;
+		Buf<Growth_Site> sites;
+		Map<uint64_t, size_t> sites_index;
+	};
+
+	inline static Growth_Tracker*
+	_growth_tracker()
+	{
+		static Growth_Tracker self{};
+		return &self;
+	}
+
+	// set while the thread is inside the tracker to ignore the growths of the tracker's own containers
+	thread_local bool _growth_busy;
+
+	// API
+#if MN_GROWTH_TRACKING
+	void
+	_growth_track(GROWTH_KIND kind, size_t element_size, size_t new_cap, size_t copied_bytes)
+	{
+		if (_growth_busy)
+			return;
+		_growth_busy = true;
+
+		void* frames[GROWTH_MAX_FRAMES + GROWTH_SKIP_FRAMES];
+		auto frames_count = callstack_capture(frames, GROWTH_MAX_FRAMES + GROWTH_SKIP_FRAMES);
+		auto skip = frames_count > GROWTH_SKIP_FRAMES ? GROWTH_SKIP_FRAMES : 0;
+		frames_count -= skip;
+
+		auto hash = murmur_hash(frames + skip, frames_count * sizeof(void*));
+		hash = hash_mix(hash, uint64_t(kind));
+		hash = hash_mix(hash, uint64_t(element_size));
+
+		auto self = _growth_tracker();
+		{
+			std::lock_guard<std::mutex> lock(self->mtx);
+			if (self->sites.allocator == nullptr)
+			{
+				self->sites = buf_with_allocator<Growth_Site>(memory::clib());
+				self->sites_index = map_with_allocator<uint64_t, size_t>(memory::clib());
+			}
+
+			size_t site_index = SIZE_MAX;
+			if (auto it = map_lookup(self->sites_index, hash))
+			{
+				auto& site = self->sites[it->value];
+				if (site.kind == kind &&
+					site.element_size == element_size &&
+					site.frames_count == frames_count &&
+					::memcmp(site.frames, frames + skip, frames_count * sizeof(void*)) == 0)
+				{
+					site_index = it->value;
+				}
+			}
+			if (site_index == SIZE_MAX)
+			{
+				Growth_Site site{};
+				site.kind = kind;
+				site.element_size = element_size;
+				::memcpy(site.frames, frames + skip, frames_count * sizeof(void*));
+				site.frames_count = frames_count;
+				site_index = self->sites.count;
+				buf_push(self->sites, site);
+				map_insert(self->sites_index, hash, site_index);
+			}
+
+			auto& site = self->sites[site_index];
+			++site.growths_count;
+			site.copied_bytes += copied_bytes;
+			if (new_cap > site.peak_capacity)
+				site.peak_capacity = new_cap;
+		}
+
+		_growth_busy = false;
+	}
+#endif
+
+	bool
+	growth_tracking_enabled()
+	{
+		#if MN_GROWTH_TRACKING
+		return true;
+		#else
+		return false;
+		#endif
+	}
+
+	const char*
+	growth_kind_name(GROWTH_KIND kind)
+	{
+		switch (kind)
+		{
+		case GROWTH_KIND_BUF: return "buf";
+		case GROWTH_KIND_STR: return "str";
+		case GROWTH_KIND_SET: return "set";
+		case GROWTH_KIND_MAP: return "map";
+		default: return "<unknown>";
+		}
+	}
+
+	Buf<Growth_Site>
+	growth_report(Allocator allocator)
+	{
+		auto res = buf_with_allocator<Growth_Site>(allocator);
+
+		auto self = _growth_tracker();
+		{
+			std::lock_guard<std::mutex> lock(self->mtx);
+			_growth_busy = true;
+			if (self->sites.count > 0)
+				buf_concat(res, self->sites);
+			_growth_busy = false;
+		}
+
+		std::stable_sort(begin(res), end(res), [](const Growth_Site& a, const Growth_Site& b) {
+			return a.copied_bytes > b.copied_bytes;
+		});
+		return res;
+	}
+
+	void
+	growth_report_print(Stream out, size_t max_sites)
+	{
+		auto sites = growth_report(memory::tmp());
+		if (max_sites == 0 || max_sites > sites.count)
+			max_sites = sites.count;
+
+		if (growth_tracking_enabled() == false)
+			print_to(out, "growth tracking is disabled, build mn with MN_GROWTH_TRACKING=ON to enable it\n");
+
+		for (size_t i = 0; i < max_sites; ++i)
+		{
+			const auto& site = sites[i];
+			print_to(
+				out,
+				"#{} {}: {} growths, {} bytes copied, peak capacity {} ({} bytes)\n",
+				i,
+				growth_kind_name(site.kind),
+				site.growths_count,
+				site.copied_bytes,
+				site.peak_capacity,
+				site.peak_capacity * site.element_size
+			);
+			callstack_print_to((void**)site.frames, site.frames_count, out);
+		}
+	}
+
+	void
+	growth_reset()
+	{
+		auto self = _growth_tracker();
+		std::lock_guard<std::mutex> lock(self->mtx);
+		buf_clear(self->sites);
+		map_clear(self->sites_index);
+	}
+}
@@ -0,0 +1,579 @@
+#include "mn/Heap_Profile.h"
+#include "mn/Context.h"
+#include "mn/Debug.h"
+#include "mn/Memory.h"
+#include "mn/Buf.h"
+#include "mn/Map.h"
+#include "mn/Str.h"
+#include "mn/Thread_State.h"
+
+#include <atomic>
+#include <mutex>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace mn
+{
+	constexpr size_t HEAP_PROFILE_DEFAULT_SAMPLE_PERIOD = 512ULL * 1024ULL;
+	constexpr size_t HEAP_PROFILE_DEFAULT_MAX_FRAMES = 32;
+	constexpr size_t HEAP_PROFILE_MAX_FRAMES = 64;
+	// frames of the profiler and the allocator which are skipped from the captured callstacks
+	constexpr size_t HEAP_PROFILE_SKIP_FRAMES = 4;
+	// the size of the counting filter of the sampled pointers, it's used to skip the samples lookup for most frees
+	constexpr size_t HEAP_PROFILE_FILTER_SIZE_LOG2 = 12;
+	constexpr size_t HEAP_PROFILE_FILTER_SIZE = 1ULL << HEAP_PROFILE_FILTER_SIZE_LOG2;
+
+	enum HEAP_PROFILE_COUNTER
+	{
+		HEAP_PROFILE_COUNTER_ALLOC_COUNT,
+		HEAP_PROFILE_COUNTER_ALLOC_BYTES,
+		HEAP_PROFILE_COUNTER_FREE_COUNT,
+		HEAP_PROFILE_COUNTER_FREE_BYTES,
+		HEAP_PROFILE_COUNTER_COUNT,
+	};
+
+	// per thread counters, only the owning thread writes to them so they're updated without atomic read modify
+	// write instructions
+	struct Heap_Profile_Thread_Counters
+	{
+		std::atomic<uint64_t> values[HEAP_PROFILE_SIZE_CLASSES_COUNT][HEAP_PROFILE_COUNTER_COUNT];
+		bool alive;
+	};
+
+	struct Heap_Profile_Stack
+	{
+		void* frames[HEAP_PROFILE_MAX_FRAMES];
+		size_t frames_count;
+		// the estimated values of the whole heap, sampled values are scaled by their sampling probability
+		double alloc_objects;
+		double alloc_space;
+		double inuse_objects;
+		double inuse_space;
+	};
+
+	struct Heap_Profile_Sample
+	{
+		size_t stack;
+		size_t size;
+		double weight;
+	};
+
+	struct Heap_Profile
+	{
+		// its mutex protects the rest of the profiler too
+		Thread_State_Registry<Heap_Profile_Thread_Counters> threads;
+		bool running;
+		Heap_Profile_Settings settings;
+		Memory_Profile_Interface previous;
+		// every start takes a new epoch which makes the threads draw a new sampling distance
+		std::atomic<uint64_t> epoch;
+
+		// counters which are used by threads after their thread local storage is destroyed
+		Heap_Profile_Thread_Counters orphan;
+		Heap_Profile_Stats baseline;
+
+		Buf<Heap_Profile_Stack> stacks;
+		Map<uint64_t, size_t> stacks_index;
+		Map<void*, Heap_Profile_Sample> samples;
+		std::atomic<uint32_t> samples_filter[HEAP_PROFILE_FILTER_SIZE];
+		uint64_t samples_count;
+	};
+
+	inline static Heap_Profile*
+	_heap_profile()
+	{
+		static Heap_Profile self{};
+		return &self;
+	}
+
+	// set while the thread is inside the profiler to ignore the profiler's own allocations
+	thread_local bool _heap_profile_busy;
+	thread_local int64_t _heap_profile_bytes_until_sample;
+	thread_local uint64_t _heap_profile_thread_epoch;
+	thread_local uint64_t _heap_profile_rng;
+
+	inline static Heap_Profile_Thread_Counters*
+	_heap_profile_thread_counters_get(Heap_Profile* self)
+	{
+		auto counters = thread_state_get(self->threads,
+			[](Heap_Profile_Thread_Counters*) { return true; },
+			[] { return alloc_zerod_from<Heap_Profile_Thread_Counters>(memory::clib()); }
+		);
+		if (counters == nullptr)
+			return &self->orphan;
+		return counters;
+	}
+
+	inline static void
+	_heap_profile_counters_add(Heap_Profile* self, size_t size_class, HEAP_PROFILE_COUNTER count, HEAP_PROFILE_COUNTER bytes, size_t size)
+	{
+		auto counters = _heap_profile_thread_counters_get(self);
+		auto& values = counters->values[size_class];
+		if (counters == &self->orphan)
+		{
+			values[count].fetch_add(1, std::memory_order_relaxed);
+			values[bytes].fetch_add(size, std::memory_order_relaxed);
+		}
+		else
+		{
+			values[count].store(values[count].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			values[bytes].store(values[bytes].load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+		}
+	}
+
+	inline static void
+	_heap_profile_counters_sum(const Heap_Profile_Thread_Counters* counters, Heap_Profile_Stats& stats)
+	{
+		for (size_t i = 0; i < HEAP_PROFILE_SIZE_CLASSES_COUNT; ++i)
+		{
+			auto& size_class = stats.size_classes[i];
+			size_class.alloc_count += counters->values[i][HEAP_PROFILE_COUNTER_ALLOC_COUNT].load(std::memory_order_relaxed);
+			size_class.alloc_bytes += counters->values[i][HEAP_PROFILE_COUNTER_ALLOC_BYTES].load(std::memory_order_relaxed);
+			size_class.free_count += counters->values[i][HEAP_PROFILE_COUNTER_FREE_COUNT].load(std::memory_order_relaxed);
+			size_class.free_bytes += counters->values[i][HEAP_PROFILE_COUNTER_FREE_BYTES].load(std::memory_order_relaxed);
+		}
+	}
+
+	// sums all the thread counters, it should be called while holding the profiler mutex
+	inline static Heap_Profile_Stats
+	_heap_profile_counters_total(Heap_Profile* self)
+	{
+		Heap_Profile_Stats stats{};
+		_heap_profile_counters_sum(&self->orphan, stats);
+		for (auto it: self->threads.states)
+			_heap_profile_counters_sum(it, stats);
+		return stats;
+	}
+
+	inline static size_t
+	_heap_profile_filter_index(void* ptr)
+	{
+		return size_t((uint64_t(uintptr_t(ptr)) * 0x9E3779B97F4A7C15ULL) >> (64 - HEAP_PROFILE_FILTER_SIZE_LOG2));
+	}
+
+	// returns the number of bytes until the next sample, the distance between samples is exponentially distributed
+	// with the sample period as its mean which makes the sampling a poisson process over the allocated bytes
+	inline static int64_t
+	_heap_profile_next_sample_distance(size_t sample_period)
+	{
+		if (_heap_profile_rng == 0)
+			_heap_profile_rng = uint64_t(uintptr_t(&_heap_profile_rng)) ^ 0x2545F4914F6CDD1DULL;
+
+		// xorshift64*
+		_heap_profile_rng ^= _heap_profile_rng >> 12;
+		_heap_profile_rng ^= _heap_profile_rng << 25;
+		_heap_profile_rng ^= _heap_profile_rng >> 27;
+		auto r = _heap_profile_rng * 0x2545F4914F6CDD1DULL;
+
+		// uniform number in (0, 1]
+		auto u = (double(r >> 11) + 1.0) / 9007199254740992.0;
+		return int64_t(-::log(u) * double(sample_period));
+	}
+
+	inline static void
+	_heap_profile_sample(Heap_Profile* self, void* ptr, size_t size)
+	{
+		void* frames[HEAP_PROFILE_MAX_FRAMES + HEAP_PROFILE_SKIP_FRAMES];
+		auto frames_count = callstack_capture(frames, self->settings.max_frames + HEAP_PROFILE_SKIP_FRAMES);
+		auto skip = frames_count > HEAP_PROFILE_SKIP_FRAMES ? HEAP_PROFILE_SKIP_FRAMES : 0;
+		frames_count -= skip;
+
+		// the probability of sampling an allocation of this size is 1 - exp(-size / sample_period)
+		auto probability = 1.0 - ::exp(-double(size) / double(self->settings.sample_period));
+		auto weight = probability > 0 ? 1.0 / probability : 1.0;
+
+		std::lock_guard<std::mutex> lock(self->threads.mtx);
+		if (self->running == false)
+			return;
+
+		auto hash = murmur_hash(frames + skip, frames_count * sizeof(void*));
+		size_t stack_index = SIZE_MAX;
+		if (auto it = map_lookup(self->stacks_index, hash))
+		{
+			auto& stack = self->stacks[it->value];
+			if (stack.frames_count == frames_count && ::memcmp(stack.frames, frames + skip, frames_count * sizeof(void*)) == 0)
+				stack_index = it->value;
+		}
+		if (stack_index == SIZE_MAX)
+		{
+			Heap_Profile_Stack stack{};
+			::memcpy(stack.frames, frames + skip, frames_count * sizeof(void*));
+			stack.frames_count = frames_count;
+			stack_index = self->stacks.count;
+			buf_push(self->stacks, stack);
+			map_insert(self->stacks_index, hash, stack_index);
+		}
+
+		auto& stack = self->stacks[stack_index];
+		stack.alloc_objects += weight;
+		stack.alloc_space += weight * double(size);
+		stack.inuse_objects += weight;
+		stack.inuse_space += weight * double(size);
+
+		map_insert(self->samples, ptr, Heap_Profile_Sample{stack_index, size, weight});
+		self->samples_filter[_heap_profile_filter_index(ptr)].fetch_add(1, std::memory_order_relaxed);
+		++self->samples_count;
+	}
+
+	inline static void
+	_heap_profile_alloc(void* user_data, void* ptr, size_t size)
+	{
+		auto self = (Heap_Profile*)user_data;
+		if (self->previous.profile_alloc)
+			self->previous.profile_alloc(self->previous.self, ptr, size);
+
+		if (_heap_profile_busy || ptr == nullptr)
+			return;
+		_heap_profile_busy = true;
+
+		_heap_profile_counters_add(self, heap_profile_size_class(size), HEAP_PROFILE_COUNTER_ALLOC_COUNT, HEAP_PROFILE_COUNTER_ALLOC_BYTES, size);
+
+		auto epoch = self->epoch.load(std::memory_order_relaxed);
+		if (_heap_profile_thread_epoch != epoch)
+		{
+			_heap_profile_thread_epoch = epoch;
+			_heap_profile_bytes_until_sample = _heap_profile_next_sample_distance(self->settings.sample_period);
+		}
+
+		_heap_profile_bytes_until_sample -= int64_t(size);
+		if (_heap_profile_bytes_until_sample < 0)
+		{
+			_heap_profile_bytes_until_sample = _heap_profile_next_sample_distance(self->settings.sample_period);
+			_heap_profile_sample(self, ptr, size);
+		}
+
+		_heap_profile_busy = false;
+	}
+
+	inline static void
+	_heap_profile_free(void* user_data, void* ptr, size_t size)
+	{
+		auto self = (Heap_Profile*)user_data;
+		if (self->previous.profile_free)
+			self->previous.profile_free(self->previous.self, ptr, size);
+
+		if (_heap_profile_busy || ptr == nullptr)
+			return;
+		_heap_profile_busy = true;
+
+		_heap_profile_counters_add(self, heap_profile_size_class(size), HEAP_PROFILE_COUNTER_FREE_COUNT, HEAP_PROFILE_COUNTER_FREE_BYTES, size);
+
+		auto& filter = self->samples_filter[_heap_profile_filter_index(ptr)];
+		if (filter.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			if (auto it = map_lookup(self->samples, ptr))
+			{
+				auto& stack = self->stacks[it->value.stack];
+				stack.inuse_objects -= it->value.weight;
+				stack.inuse_space -= it->value.weight * double(it->value.size);
+				map_remove(self->samples, ptr);
+				filter.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		_heap_profile_busy = false;
+	}
+
+	// pprof protobuf encoding
+	enum PPROF_WIRE
+	{
+		PPROF_WIRE_VARINT = 0,
+		PPROF_WIRE_BYTES = 2,
+	};
+
+	inline static void
+	_pprof_varint(Str& out, uint64_t value)
+	{
+		uint8_t bytes[10];
+		size_t count = 0;
+		while (value >= 0x80)
+		{
+			bytes[count++] = uint8_t((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		bytes[count++] = uint8_t(value);
+		str_block_push(out, Block{bytes, count});
+	}
+
+	inline static void
+	_pprof_uint(Str& out, uint32_t field, uint64_t value)
+	{
+		_pprof_varint(out, (uint64_t(field) << 3) | PPROF_WIRE_VARINT);
+		_pprof_varint(out, value);
+	}
+
+	inline static void
+	_pprof_bytes(Str& out, uint32_t field, const char* ptr, size_t size)
+	{
+		_pprof_varint(out, (uint64_t(field) << 3) | PPROF_WIRE_BYTES);
+		_pprof_varint(out, size);
+		str_block_push(out, Block{(void*)ptr, size});
+	}
+
+	inline static void
+	_pprof_message(Str& out, uint32_t field, const Str& message)
+	{
+		_pprof_bytes(out, field, message.ptr, message.count);
+	}
+
+	inline static void
+	_pprof_value_type(Str& out, uint32_t field, int64_t type, int64_t unit)
+	{
+		auto message = str_tmp();
+		_pprof_uint(message, 1, uint64_t(type));
+		_pprof_uint(message, 2, uint64_t(unit));
+		_pprof_message(out, field, message);
+	}
+
+	struct Pprof_Mapping
+	{
+		uint64_t start;
+		uint64_t limit;
+		uint64_t offset;
+		int64_t filename;
+	};
+
+	inline static int64_t
+	_pprof_string(Buf<Str>& strings, Map<Str, int64_t>& strings_index, const Str& str)
+	{
+		if (auto it = map_lookup(strings_index, str))
+			return it->value;
+		auto index = int64_t(strings.count);
+		auto copy = str_from_substr(str.ptr, str.ptr + str.count, memory::tmp());
+		buf_push(strings, copy);
+		map_insert(strings_index, copy, index);
+		return index;
+	}
+
+	inline static void
+	_pprof_mappings_load([[maybe_unused]] Buf<Pprof_Mapping>& mappings, [[maybe_unused]] Buf<Str>& strings, [[maybe_unused]] Map<Str, int64_t>& strings_index)
+	{
+		#if OS_LINUX
+		// executable mappings let pprof symbolize the addresses using the binaries
+		auto file = ::fopen("/proc/self/maps", "r");
+		if (file == nullptr)
+			return;
+
+		char line[4096];
+		while (::fgets(line, sizeof(line), file))
+		{
+			unsigned long long start = 0, limit = 0, offset = 0;
+			char perms[8] = {};
+			int path_offset = 0;
+			if (::sscanf(line, "%llx-%llx %7s %llx %*s %*s %n", &start, &limit, perms, &offset, &path_offset) < 4)
+				continue;
+			if (perms[2] != 'x' || path_offset <= 0)
+				continue;
+
+			auto path = str_lit(line + path_offset);
+			path = str_from_substr(path.ptr, path.ptr + path.count, memory::tmp());
+			str_trim(path, "\r\n\t ");
+			if (path.count == 0 || path[0] != '/')
+				continue;
+
+			buf_push(mappings, Pprof_Mapping{start, limit, offset, _pprof_string(strings, strings_index, path)});
+		}
+		::fclose(file);
+		#endif
+	}
+
+	// API
+	void
+	heap_profile_start(const Heap_Profile_Settings& settings)
+	{
+		auto self = _heap_profile();
+		_heap_profile_busy = true;
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			self->settings = settings;
+			if (self->settings.sample_period == 0)
+				self->settings.sample_period = HEAP_PROFILE_DEFAULT_SAMPLE_PERIOD;
+			if (self->settings.max_frames == 0)
+				self->settings.max_frames = HEAP_PROFILE_DEFAULT_MAX_FRAMES;
+			if (self->settings.max_frames > HEAP_PROFILE_MAX_FRAMES)
+				self->settings.max_frames = HEAP_PROFILE_MAX_FRAMES;
+
+			if (self->stacks.allocator == nullptr)
+			{
+				self->stacks = buf_with_allocator<Heap_Profile_Stack>(memory::clib());
+				self->stacks_index = map_with_allocator<uint64_t, size_t>(memory::clib());
+				self->samples = map_with_allocator<void*, Heap_Profile_Sample>(memory::clib());
+			}
+			buf_clear(self->stacks);
+			map_clear(self->stacks_index);
+			map_clear(self->samples);
+			for (auto& filter: self->samples_filter)
+				filter.store(0, std::memory_order_relaxed);
+			self->samples_count = 0;
+			self->baseline = _heap_profile_counters_total(self);
+			self->epoch.fetch_add(1);
+
+			if (self->running == false)
+			{
+				self->running = true;
+				Memory_Profile_Interface interface{};
+				interface.self = self;
+				interface.profile_alloc = _heap_profile_alloc;
+				interface.profile_free = _heap_profile_free;
+				self->previous = memory_profile_interface_set(interface);
+			}
+		}
+		_heap_profile_busy = false;
+	}
+
+	void
+	heap_profile_stop()
+	{
+		auto self = _heap_profile();
+		_heap_profile_busy = true;
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			if (self->running)
+			{
+				self->running = false;
+				memory_profile_interface_set(self->previous);
+				self->previous = Memory_Profile_Interface{};
+			}
+		}
+		_heap_profile_busy = false;
+	}
+
+	Heap_Profile_Stats
+	heap_profile_stats()
+	{
+		auto self = _heap_profile();
+		_heap_profile_busy = true;
+		Heap_Profile_Stats stats{};
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			stats = _heap_profile_counters_total(self);
+			for (size_t i = 0; i < HEAP_PROFILE_SIZE_CLASSES_COUNT; ++i)
+			{
+				auto& size_class = stats.size_classes[i];
+				auto& baseline = self->baseline.size_classes[i];
+				size_class.alloc_count -= baseline.alloc_count;
+				size_class.alloc_bytes -= baseline.alloc_bytes;
+				size_class.free_count -= baseline.free_count;
+				size_class.free_bytes -= baseline.free_bytes;
+
+				stats.total.alloc_count += size_class.alloc_count;
+				stats.total.alloc_bytes += size_class.alloc_bytes;
+				stats.total.free_count += size_class.free_count;
+				stats.total.free_bytes += size_class.free_bytes;
+			}
+			stats.samples_count = self->samples_count;
+			stats.live_samples_count = self->samples.count;
+		}
+		_heap_profile_busy = false;
+		return stats;
+	}
+
+	Err
+	heap_profile_dump(Stream out)
+	{
+		auto self = _heap_profile();
+		_heap_profile_busy = true;
+
+		auto strings = buf_with_allocator<Str>(memory::tmp());
+		auto strings_index = map_with_allocator<Str, int64_t>(memory::tmp());
+		_pprof_string(strings, strings_index, str_lit(""));
+		auto alloc_objects = _pprof_string(strings, strings_index, str_lit("alloc_objects"));
+		auto alloc_space = _pprof_string(strings, strings_index, str_lit("alloc_space"));
+		auto inuse_objects = _pprof_string(strings, strings_index, str_lit("inuse_objects"));
+		auto inuse_space = _pprof_string(strings, strings_index, str_lit("inuse_space"));
+		auto count = _pprof_string(strings, strings_index, str_lit("count"));
+		auto bytes = _pprof_string(strings, strings_index, str_lit("bytes"));
+		auto space = _pprof_string(strings, strings_index, str_lit("space"));
+
+		auto mappings = buf_with_allocator<Pprof_Mapping>(memory::tmp());
+		_pprof_mappings_load(mappings, strings, strings_index);
+
+		auto profile = str_tmp();
+		_pprof_value_type(profile, 1, alloc_objects, count);
+		_pprof_value_type(profile, 1, alloc_space, bytes);
+		_pprof_value_type(profile, 1, inuse_objects, count);
+		_pprof_value_type(profile, 1, inuse_space, bytes);
+
+		auto locations_index = map_with_allocator<void*, uint64_t>(memory::tmp());
+		auto locations = buf_with_allocator<void*>(memory::tmp());
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			for (const auto& stack: self->stacks)
+			{
+				auto location_ids = str_tmp();
+				for (size_t i = 0; i < stack.frames_count; ++i)
+				{
+					auto frame = stack.frames[i];
+					uint64_t id = 0;
+					if (auto it = map_lookup(locations_index, frame))
+					{
+						id = it->value;
+					}
+					else
+					{
+						buf_push(locations, frame);
+						id = locations.count;
+						map_insert(locations_index, frame, id);
+					}
+					_pprof_varint(location_ids, id);
+				}
+
+				auto values = str_tmp();
+				_pprof_varint(values, uint64_t(int64_t(::llround(stack.alloc_objects))));
+				_pprof_varint(values, uint64_t(int64_t(::llround(stack.alloc_space))));
+				_pprof_varint(values, uint64_t(int64_t(::llround(stack.inuse_objects))));
+				_pprof_varint(values, uint64_t(int64_t(::llround(stack.inuse_space))));
+
+				auto sample = str_tmp();
+				_pprof_message(sample, 1, location_ids);
+				_pprof_message(sample, 2, values);
+				_pprof_message(profile, 2, sample);
+			}
+		}
+
+		for (size_t i = 0; i < mappings.count; ++i)
+		{
+			auto mapping = str_tmp();
+			_pprof_uint(mapping, 1, i + 1);
+			_pprof_uint(mapping, 2, mappings[i].start);
+			_pprof_uint(mapping, 3, mappings[i].limit);
+			_pprof_uint(mapping, 4, mappings[i].offset);
+			_pprof_uint(mapping, 5, uint64_t(mappings[i].filename));
+			_pprof_message(profile, 3, mapping);
+		}
+
+		for (size_t i = 0; i < locations.count; ++i)
+		{
+			// the frames are return addresses so we point to the call instruction instead
+			auto address = uint64_t(uintptr_t(locations[i])) - 1;
+			auto location = str_tmp();
+			_pprof_uint(location, 1, i + 1);
+			for (size_t j = 0; j < mappings.count; ++j)
+			{
+				if (address >= mappings[j].start && address < mappings[j].limit)
+				{
+					_pprof_uint(location, 2, j + 1);
+					break;
+				}
+			}
+			_pprof_uint(location, 3, address);
+			_pprof_message(profile, 4, location);
+		}
+
+		for (const auto& str: strings)
+			_pprof_bytes(profile, 6, str.ptr, str.count);
+
+		_pprof_value_type(profile, 11, space, bytes);
+		_pprof_uint(profile, 12, self->settings.sample_period);
+
+		_heap_profile_busy = false;
+
+		auto written = stream_write(out, block_from(profile));
+		if (written != profile.count)
+			return Err{"failed to write heap profile, only {} bytes out of {} were written", written, profile.count};
+		return Err{};
+	}
+}
@@ -0,0 +1,400 @@
+#include "mn/Ingest.h"
+#include "mn/File.h"
+#include "mn/Thread.h"
+#include "mn/Defer.h"
+#include "mn/Assert.h"
+
+#include <atomic>
+
+#include <string.h>
+
+namespace mn
+{
+	constexpr size_t INGEST_DEFAULT_CHUNK_SIZE = 4ULL * 1024ULL * 1024ULL;
+
+	struct IIngest
+	{
+		Ingest_Settings settings;
+		Fabric fabric;
+		File file;
+		Mapped_File* mapped;
+		// the content of the mapped file
+		const char* content;
+		size_t content_size;
+
+		// all the batches which this ingest owns
+		Buf<Ingest_Batch*> batches;
+		// free batches which the producer takes and fills with the next chunk, it limits the batches in flight
+		Chan<Ingest_Batch*> free_batches;
+		// parsed batches which are delivered to the user
+		Chan<Ingest_Batch*> parsed_batches;
+		// tracks the chunks which are scheduled but not delivered yet
+		Waitgroup pending;
+		std::atomic<bool> stopped;
+
+		// ordered delivery state, parsed batches wait in their slot (index % slots count) until all the batches
+		// before them are delivered
+		Mutex order_mtx;
+		Buf<Ingest_Batch*> order_slots;
+		size_t order_next;
+
+		Thread producer;
+	};
+
+	// finds the end of the chunk which starts at the given offset, chunks end after a new line and csv chunks
+	// should not end inside a quoted field
+	inline static size_t
+	_ingest_chunk_end(IIngest* self, size_t start)
+	{
+		auto target = start + self->settings.chunk_size;
+		if (target >= self->content_size)
+			return self->content_size;
+
+		if (self->settings.format == INGEST_FORMAT_JSON_LINES)
+		{
+			// new lines can't appear inside json strings so every new line is a record boundary
+			auto it = (const char*)::memchr(self->content + target, '\n', self->content_size - target);
+			if (it == nullptr)
+				return self->content_size;
+			return size_t(it - self->content) + 1;
+		}
+
+		// count the quotes up to the target to know whether it's inside a quoted field
+		bool in_quotes = false;
+		auto it = self->content + start;
+		auto end = self->content + target;
+		while (true)
+		{
+			auto quote = (const char*)::memchr(it, '"', end - it);
+			if (quote == nullptr)
+				break;
+			in_quotes = !in_quotes;
+			it = quote + 1;
+		}
+
+		for (auto i = target; i < self->content_size; ++i)
+		{
+			auto c = self->content[i];
+			if (c == '"')
+				in_quotes = !in_quotes;
+			else if (c == '\n' && in_quotes == false)
+				return i + 1;
+		}
+		return self->content_size;
+	}
+
+	inline static Err
+	_ingest_parse_json_lines(Ingest_Batch* batch, Str chunk, Buf<Ingest_Record>& records)
+	{
+		auto values = buf_with_allocator<json::Node>(memory::tmp());
+		auto offsets = buf_with_allocator<size_t>(memory::tmp());
+		auto err = json::node_parse_lines(chunk, batch->arena, values, offsets);
+		buf_reserve(records, values.count);
+		for (size_t i = 0; i < values.count; ++i)
+		{
+			Ingest_Record record{};
+			record.offset = batch->offset + offsets[i];
+			record.json = values[i];
+			buf_push(records, record);
+		}
+		if (err)
+			return Err{"{}, in chunk at offset {}", err, batch->offset};
+		return Err{};
+	}
+
+	inline static Err
+	_ingest_parse_csv(IIngest* self, Ingest_Batch* batch, Str chunk, Buf<Ingest_Record>& records)
+	{
+		auto separator = self->settings.csv_separator;
+		auto fields = buf_with_allocator<Str>(memory::tmp());
+		const char* it = chunk.ptr;
+		const char* end = chunk.ptr + chunk.count;
+		while (it < end)
+		{
+			auto record_begin = it;
+
+			// skip empty lines
+			if (*it == '\n' || (*it == '\r' && it + 1 < end && it[1] == '\n'))
+			{
+				it += (*it == '\r') ? 2 : 1;
+				continue;
+			}
+
+			buf_clear(fields);
+			while (true)
+			{
+				Str field{};
+				if (it < end && *it == '"')
+				{
+					// quoted field, "" is an escaped quote
+					auto field_begin = ++it;
+					bool escaped = false;
+					while (true)
+					{
+						auto quote = (const char*)::memchr(it, '"', end - it);
+						if (quote == nullptr)
+							return Err{"unterminated quoted field at offset {}", batch->offset + size_t(field_begin - 1 - chunk.ptr)};
+						it = quote + 1;
+						if (it < end && *it == '"')
+						{
+							escaped = true;
+							++it;
+							continue;
+						}
+						break;
+					}
+
+					auto field_end = it - 1;
+					if (escaped)
+					{
+						auto size = size_t(field_end - field_begin);
+						auto out = (char*)batch->arena->alloc((size + 8) & ~size_t(7), alignof(char)).ptr;
+						auto out_it = out;
+						for (auto c = field_begin; c < field_end; ++c)
+						{
+							*out_it++ = *c;
+							if (*c == '"')
+								++c;
+						}
+						*out_it = '\0';
+						field.ptr = out;
+						field.count = size_t(out_it - out);
+					}
+					else
+					{
+						field.ptr = (char*)field_begin;
+						field.count = size_t(field_end - field_begin);
+					}
+					field.cap = field.count;
+
+					if (it < end && *it != separator && *it != '\n' && *it != '\r')
+						return Err{"unexpected character after quoted field at offset {}", batch->offset + size_t(it - chunk.ptr)};
+					if (it < end && *it == '\r')
+						++it;
+				}
+				else
+				{
+					auto field_begin = it;
+					while (it < end && *it != separator && *it != '\n')
+						++it;
+					auto field_end = it;
+					if (field_end > field_begin && field_end[-1] == '\r' && (it == end || *it == '\n'))
+						--field_end;
+					field.ptr = (char*)field_begin;
+					field.count = size_t(field_end - field_begin);
+					field.cap = field.count;
+				}
+				buf_push(fields, field);
+
+				if (it < end && *it == separator)
+				{
+					++it;
+					continue;
+				}
+
+				// end of the record
+				if (it < end)
+					++it;
+				break;
+			}
+
+			Ingest_Record record{};
+			record.offset = batch->offset + size_t(record_begin - chunk.ptr);
+			record.fields_count = fields.count;
+			record.fields = (Str*)batch->arena->alloc(fields.count * sizeof(Str), alignof(Str)).ptr;
+			::memcpy(record.fields, fields.ptr, fields.count * sizeof(Str));
+			buf_push(records, record);
+		}
+		return Err{};
+	}
+
+	inline static void
+	_ingest_deliver(IIngest* self, Ingest_Batch* batch)
+	{
+		if (self->settings.unordered)
+		{
+			chan_send(self->parsed_batches, batch);
+			return;
+		}
+
+		mutex_lock(self->order_mtx);
+		mn_defer{mutex_unlock(self->order_mtx);};
+
+		auto slots_count = self->order_slots.count;
+		self->order_slots[batch->index % slots_count] = batch;
+		while (true)
+		{
+			auto& slot = self->order_slots[self->order_next % slots_count];
+			if (slot == nullptr)
+				break;
+			// the channel can hold all the batches so this never blocks
+			chan_send(self->parsed_batches, slot);
+			slot = nullptr;
+			++self->order_next;
+		}
+	}
+
+	inline static void
+	_ingest_parse_chunk(IIngest* self, Ingest_Batch* batch, size_t end_offset)
+	{
+		Str chunk{};
+		chunk.ptr = (char*)self->content + batch->offset;
+		chunk.count = end_offset - batch->offset;
+
+		if (self->stopped.load() == false)
+		{
+			auto records = buf_with_allocator<Ingest_Record>(memory::tmp());
+			if (self->settings.format == INGEST_FORMAT_JSON_LINES)
+				batch->err = _ingest_parse_json_lines(batch, chunk, records);
+			else
+				batch->err = _ingest_parse_csv(self, batch, chunk, records);
+
+			batch->records_count = records.count;
+			batch->records = (Ingest_Record*)batch->arena->alloc(records.count * sizeof(Ingest_Record), alignof(Ingest_Record)).ptr;
+			if (records.count > 0)
+				::memcpy(batch->records, records.ptr, records.count * sizeof(Ingest_Record));
+		}
+
+		_ingest_deliver(self, batch);
+		waitgroup_done(self->pending);
+	}
+
+	static void
+	_ingest_producer_main(void* arg)
+	{
+		auto self = (IIngest*)arg;
+
+		size_t index = 0;
+		size_t offset = 0;
+		while (offset < self->content_size && self->stopped.load() == false)
+		{
+			auto [batch, more] = chan_recv(self->free_batches);
+			if (more == false)
+				break;
+
+			auto end_offset = _ingest_chunk_end(self, offset);
+			batch->index = index++;
+			batch->offset = offset;
+			batch->records = nullptr;
+			batch->records_count = 0;
+			batch->err = Err{};
+			offset = end_offset;
+
+			waitgroup_add(self->pending, 1);
+			go(self->fabric, [self, batch, end_offset] {
+				_ingest_parse_chunk(self, batch, end_offset);
+			});
+		}
+
+		waitgroup_wait(self->pending);
+		chan_close(self->parsed_batches);
+	}
+
+	// API
+	Result<Ingest>
+	ingest_new(const Str& filename, Fabric fabric, const Ingest_Settings& settings)
+	{
+		if (fabric == nullptr)
+			fabric = fabric_local();
+		mn_assert_msg(fabric != nullptr, "ingest needs a fabric to parse the chunks on");
+
+		auto file = file_open(filename, IO_MODE_READ, OPEN_MODE_OPEN_ONLY);
+		if (file == nullptr)
+			return Err{"failed to open file '{}'", filename};
+
+		auto size = file_size(file);
+		Mapped_File* mapped = nullptr;
+		// empty files can't be mapped
+		if (size > 0)
+		{
+			mapped = file_mmap(file, 0, 0, IO_MODE_READ);
+			if (mapped == nullptr)
+			{
+				file_close(file);
+				return Err{"failed to map file '{}'", filename};
+			}
+		}
+
+		auto self = alloc_construct<IIngest>();
+		self->settings = settings;
+		if (self->settings.chunk_size == 0)
+			self->settings.chunk_size = INGEST_DEFAULT_CHUNK_SIZE;
+		if (self->settings.max_batches_in_flight == 0)
+			self->settings.max_batches_in_flight = 2 * fabric_workers_count(fabric);
+		if (self->settings.csv_separator == '\0')
+			self->settings.csv_separator = ',';
+		self->fabric = fabric;
+		self->file = file;
+		self->mapped = mapped;
+		self->content = mapped ? (const char*)mapped->data.ptr : nullptr;
+		self->content_size = mapped ? mapped->data.size : 0;
+
+		auto batches_count = self->settings.max_batches_in_flight;
+		self->batches = buf_new<Ingest_Batch*>();
+		self->free_batches = chan_new<Ingest_Batch*>(int32_t(batches_count));
+		self->parsed_batches = chan_new<Ingest_Batch*>(int32_t(batches_count));
+		for (size_t i = 0; i < batches_count; ++i)
+		{
+			auto batch = alloc_construct<Ingest_Batch>();
+			batch->arena = alloc_construct<memory::Arena>(self->settings.chunk_size + self->settings.chunk_size / 2, memory::clib());
+			buf_push(self->batches, batch);
+			chan_send(self->free_batches, batch);
+		}
+
+		self->pending = waitgroup_new();
+		self->stopped = false;
+		self->order_mtx = mutex_new("Ingest Order Mutex");
+		self->order_slots = buf_new<Ingest_Batch*>();
+		buf_resize_fill(self->order_slots, batches_count, nullptr);
+		self->order_next = 0;
+
+		self->producer = thread_new(_ingest_producer_main, self, "Ingest Producer");
+		return self;
+	}
+
+	void
+	ingest_free(Ingest self)
+	{
+		// stop the producer and drain the batches which are still being parsed
+		self->stopped.store(true);
+		chan_close(self->free_batches);
+		for (auto batch: self->parsed_batches)
+			(void)batch;
+		thread_join(self->producer);
+		thread_free(self->producer);
+
+		chan_free(self->free_batches);
+		chan_free(self->parsed_batches);
+		for (auto batch: self->batches)
+		{
+			free_destruct(batch->arena);
+			free_destruct(batch);
+		}
+		buf_free(self->batches);
+		waitgroup_free(self->pending);
+		mutex_free(self->order_mtx);
+		buf_free(self->order_slots);
+
+		if (self->mapped)
+			file_unmap(self->mapped);
+		file_close(self->file);
+		free_destruct(self);
+	}
+
+	Chan<Ingest_Batch*>
+	ingest_batches(Ingest self)
+	{
+		return self->parsed_batches;
+	}
+
+	void
+	ingest_batch_free(Ingest self, Ingest_Batch* batch)
+	{
+		batch->arena->clear_all();
+		batch->records = nullptr;
+		batch->records_count = 0;
+		batch->err = Err{};
+		if (chan_closed(self->free_batches) == false)
+			chan_send(self->free_batches, batch);
+	}
+}
@@ -1,430 +1,2038 @@
 #include "mn/Json.h"
+#include "mn/Rune.h"
+#include "mn/SIMD.h"
+#include "mn/Defer.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
 
 namespace mn::json
 {
-	struct Token
-	{
-		enum KIND
-		{
-			KIND_NONE,
-			KIND_OPEN_CURLY,
-			KIND_CLOSE_CURLY,
-			KIND_OPEN_BRACKET,
-			KIND_CLOSE_BRACKET,
-			KIND_COMMA,
-			KIND_COLON,
-			KIND_BOOL,
-			KIND_NUMBER,
-			KIND_STRING,
-			KIND_NULL,
-		};
-
-		inline operator bool() const { return kind != KIND_NONE; }
-
-		KIND kind;
-		const char *begin, *end;
-		union
-		{
-			bool val_bool;
-			double val_num;
-		};
-	};
-
-	inline static const char *
-	_json_token_kind_str(Token::KIND kind)
-	{
-		switch (kind)
-		{
-		case Token::KIND_OPEN_CURLY:
-			return "{";
-		case Token::KIND_CLOSE_CURLY:
-			return "}";
-		case Token::KIND_OPEN_BRACKET:
-			return "[";
-		case Token::KIND_CLOSE_BRACKET:
-			return "]";
-		case Token::KIND_COMMA:
-			return ":";
-		case Token::KIND_COLON:
-			return ",";
-		case Token::KIND_BOOL:
-			return "bool";
-		case Token::KIND_NUMBER:
-			return "number";
-		case Token::KIND_STRING:
-			return "string";
-		case Token::KIND_NULL:
-			return "null";
-		case Token::KIND_NONE:
-		default:
-			return "unidentified";
-		}
-	}
-
-	struct Lexer
+	inline static bool
+	_json_is_ws(char c)
 	{
-		const char *it = nullptr;
-		char c = '\0';
-
-		Err err;
-	};
+		return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+	}
 
 	inline static bool
-	_lexer_eof(Lexer &self)
+	_json_is_digit(char c)
 	{
-		return self.c == 0;
+		return (c >= '0' && c <= '9');
 	}
 
 	inline static bool
-	_lexer_is_ws(char c)
+	_json_is_op(char c)
 	{
-		return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+		return (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',');
 	}
 
+	// scalar chars are the chars of numbers and keywords, which are all the chars outside of strings that are not
+	// whitespace, operators or quotes
 	inline static bool
-	_lexer_read_rune(Lexer &self)
+	_json_is_scalar_char(char c)
 	{
-		if (_lexer_eof(self))
-			return false;
-
-		++self.it;
-		self.c = *self.it;
-
-		return true;
+		return _json_is_ws(c) == false && _json_is_op(c) == false && c != '"';
 	}
 
-	inline static void
-	_lexer_skip_ws(Lexer &self)
+	inline static int
+	_json_ctz64(uint64_t mask)
 	{
-		while (_lexer_is_ws(self.c))
-			if (_lexer_read_rune(self) == false)
-				break;
+		auto low = uint32_t(mask);
+		if (low != 0)
+			return mn_simd_ctz(low);
+		return 32 + mn_simd_ctz(uint32_t(mask >> 32));
 	}
 
-	inline static bool
-	_lexer_is_letter(char c)
+	// structural index (stage 1)
+	// the input is processed in blocks of 64 bytes, each block is classified into bitmasks (1 bit per byte) which
+	// are combined using bitwise operations to find the positions of the structural chars outside of strings,
+	// the quotes, and the first char of every number/keyword, the parser then only visits these positions
+	struct Json_Block_Masks
 	{
-		// 0x80 because all the keywords in json is ascii not utf-8
-		// if you have utf-8 runes then you'll have to provide a utf-8 is letter function
-		// in the else branch
-		return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
-	}
+		uint64_t backslash;
+		uint64_t quote;
+		uint64_t op;
+		uint64_t ws;
+	};
 
-	inline static bool
-	_lexer_is_digit(char c)
+	inline static Json_Block_Masks
+	_json_block_classify(const char* block)
 	{
-		return (c >= '0' && c <= '9');
+		Json_Block_Masks masks{};
+	#if MN_SIMD_SSE2
+		auto backslash = _mm_set1_epi8('\\');
+		auto quote = _mm_set1_epi8('"');
+		auto lower_bit = _mm_set1_epi8(0x20);
+		// '[' | 0x20 == '{' and ']' | 0x20 == '}'
+		auto open_curly = _mm_set1_epi8('{');
+		auto close_curly = _mm_set1_epi8('}');
+		auto colon = _mm_set1_epi8(':');
+		auto comma = _mm_set1_epi8(',');
+		auto space = _mm_set1_epi8(' ');
+		auto tab = _mm_set1_epi8('\t');
+		auto new_line = _mm_set1_epi8('\n');
+		auto carriage_return = _mm_set1_epi8('\r');
+		for (int i = 0; i < 4; ++i)
+		{
+			auto v = _mm_loadu_si128((const __m128i*)(block + i * 16));
+			auto lower = _mm_or_si128(v, lower_bit);
+			auto op = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(lower, open_curly), _mm_cmpeq_epi8(lower, close_curly)),
+				_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma))
+			);
+			auto ws = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+				_mm_or_si128(_mm_cmpeq_epi8(v, new_line), _mm_cmpeq_epi8(v, carriage_return))
+			);
+			auto shift = i * 16;
+			masks.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))) << shift;
+			masks.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << shift;
+			masks.op |= uint64_t(uint16_t(_mm_movemask_epi8(op))) << shift;
+			masks.ws |= uint64_t(uint16_t(_mm_movemask_epi8(ws))) << shift;
+		}
+	#else
+		for (int i = 0; i < 64; ++i)
+		{
+			auto c = block[i];
+			auto bit = uint64_t(1) << i;
+			if (c == '\\')
+				masks.backslash |= bit;
+			else if (c == '"')
+				masks.quote |= bit;
+			else if (_json_is_op(c))
+				masks.op |= bit;
+			else if (_json_is_ws(c))
+				masks.ws |= bit;
+		}
+	#endif
+		return masks;
 	}
 
-	inline static void
-	_lexer_scan_id(Lexer &self, Token &tkn)
+	// each bit in the result is the xor of all the bits before it (inclusive), this turns the quotes mask into
+	// the inside string mask
+	inline static uint64_t
+	_json_prefix_xor(uint64_t mask)
 	{
-		const char *old_it = self.it;
-		while (_lexer_is_letter(self.c))
-			if (_lexer_read_rune(self) == false)
-				break;
-		tkn.begin = old_it;
-		tkn.end	  = self.it;
+		mask ^= mask << 1;
+		mask ^= mask << 2;
+		mask ^= mask << 4;
+		mask ^= mask << 8;
+		mask ^= mask << 16;
+		mask ^= mask << 32;
+		return mask;
 	}
 
-	inline static void
-	_lexer_scan_str(Lexer &self, Token &tkn)
+	inline static Err
+	_json_structural_index(const char* begin, size_t size, Buf<uint32_t>& index)
 	{
-		tkn.begin = self.it;
+		if (size > UINT32_MAX)
+			return Err{"json document is too large, maximum size is 4GB"};
 
-		char prev = self.c;
-		// eat all runes even those escaped by \ like \"
-		while (self.c != '"' || prev == '\\')
+		// state carried between blocks
+		uint64_t prev_in_string = 0;
+		uint64_t prev_escaped = 0;
+		uint64_t prev_scalar = 0;
+
+		char tail[64];
+		for (size_t offset = 0; offset < size; offset += 64)
 		{
-			prev = self.c;
-			if (_lexer_read_rune(self) == false)
+			auto block = begin + offset;
+			if (size - offset < 64)
 			{
-				self.err = Err{"unexpected end of string '{:.{}s}'", tkn.begin, self.it - tkn.begin};
-				break;
+				::memset(tail, ' ', sizeof(tail));
+				::memcpy(tail, block, size - offset);
+				block = tail;
 			}
+
+			auto masks = _json_block_classify(block);
+
+			// find the escaped chars, backslashes are rare so we go over them one by one
+			uint64_t escaped = prev_escaped;
+			prev_escaped = 0;
+			for (auto bits = masks.backslash; bits != 0; bits &= bits - 1)
+			{
+				auto i = _json_ctz64(bits);
+				// an escaped backslash doesn't escape the next char
+				if ((escaped >> i) & 1)
+					continue;
+				if (i == 63)
+					prev_escaped = 1;
+				else
+					escaped |= uint64_t(1) << (i + 1);
+			}
+
+			auto quotes = masks.quote & ~escaped;
+			// the inside string mask includes the opening quote and excludes the closing quote
+			auto in_string = _json_prefix_xor(quotes) ^ prev_in_string;
+			prev_in_string = uint64_t(int64_t(in_string) >> 63);
+
+			auto scalar = ~(masks.op | masks.ws | masks.quote) & ~in_string;
+			auto scalar_starts = scalar & ~((scalar << 1) | prev_scalar);
+			prev_scalar = scalar >> 63;
+
+			auto structurals = (masks.op & ~in_string) | quotes | scalar_starts;
+
+			buf_reserve(index, 64);
+			for (; structurals != 0; structurals &= structurals - 1)
+				index.ptr[index.count++] = uint32_t(offset + size_t(_json_ctz64(structurals)));
 		}
 
-		tkn.end = self.it;
-		_lexer_read_rune(self); // for the "
+		if (prev_in_string)
+			return Err{"unterminated string"};
+		return Err{};
 	}
 
-	inline static Token
-	_lexer_lex(Lexer &self)
-	{
-		_lexer_skip_ws(self);
+	// number parsing
+	// powers of ten which are exactly representable in double
+	constexpr double JSON_EXACT_POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
 
-		Token tkn{};
+	enum JSON_NUMBER: uint8_t
+	{
+		JSON_NUMBER_OK,
+		JSON_NUMBER_INVALID,
+		// numbers which overflow a double are rejected, the ones which underflow are rounded to 0
+		JSON_NUMBER_OUT_OF_RANGE,
+	};
 
-		if (_lexer_eof(self))
-			return tkn;
+	// parses the json number at the given position, integers which fit in int64 are parsed exactly, and doubles
+	// which have at most 19 significant digits, a mantissa that fits in 53 bits and a small exponent are computed
+	// with a single multiplication or division (which is correctly rounded because both operands are exact), the
+	// rest falls back to strtod
+	inline static JSON_NUMBER
+	_json_number_parse(const char*& it, const char* end, Node& node)
+	{
+		auto number_begin = it;
+		bool negative = false;
+		if (it < end && *it == '-')
+		{
+			negative = true;
+			++it;
+		}
 
-		tkn.begin = self.it;
+		if (it >= end || _json_is_digit(*it) == false)
+			return JSON_NUMBER_INVALID;
 
-		if (_lexer_is_letter(self.c))
-		{
-			_lexer_scan_id(self, tkn);
+		uint64_t mantissa = 0;
+		int64_t exponent = 0;
+		int significant_digits = 0;
+		bool truncated = false;
 
-			switch(tkn.end - tkn.begin)
+		auto push_digit = [&](char c, bool fraction) {
+			auto digit = uint64_t(c - '0');
+			if (significant_digits < 19)
 			{
-			case 4:
-				if (strncmp(tkn.begin, "null", 4) == 0)
-				{
-					tkn.kind = Token::KIND_NULL;
-				}
-				else if (strncmp(tkn.begin, "true", 4) == 0)
-				{
-					tkn.kind = Token::KIND_BOOL;
-					tkn.val_bool = true;
-				}
-				break;
-			case 5:
-				if (strncmp(tkn.begin, "false", 5) == 0)
-				{
-					tkn.kind = Token::KIND_BOOL;
-					tkn.val_bool = false;
-				}
-				break;
-			default:
-				self.err = Err{"unidentified keyword '{:.{}s}'", tkn.begin, tkn.end - tkn.begin};
-				break;
+				mantissa = mantissa * 10 + digit;
+				if (mantissa != 0)
+					++significant_digits;
+				if (fraction)
+					--exponent;
 			}
-		}
-		else if (_lexer_is_digit(self.c) || self.c == '-' || self.c == '+')
-		{
-			char *end	= nullptr;
-			tkn.kind	= Token::KIND_NUMBER;
-			tkn.val_num = ::strtod(self.it, &end);
-			if (errno == ERANGE)
+			else
 			{
-				self.err = Err{"number out of range '{:.{}s}'", tkn.begin, end - tkn.begin};
+				if (digit != 0)
+					truncated = true;
+				if (fraction == false)
+					++exponent;
 			}
+		};
 
-			self.it = end;
-			self.c	= *self.it;
+		// integer part, leading zeros are not allowed
+		if (*it == '0')
+		{
+			++it;
 		}
 		else
 		{
-			int32_t c = self.c;
-			_lexer_read_rune(self);
+			while (it < end && _json_is_digit(*it))
+				push_digit(*it++, false);
+		}
+
+		bool is_integer = true;
+		if (it < end && *it == '.')
+		{
+			is_integer = false;
+			++it;
+			if (it >= end || _json_is_digit(*it) == false)
+				return JSON_NUMBER_INVALID;
+			while (it < end && _json_is_digit(*it))
+				push_digit(*it++, true);
+		}
 
-			switch (c)
+		if (it < end && (*it == 'e' || *it == 'E'))
+		{
+			is_integer = false;
+			++it;
+			bool exponent_negative = false;
+			if (it < end && (*it == '+' || *it == '-'))
 			{
-			case '"':
-				tkn.kind = Token::KIND_STRING;
-				_lexer_scan_str(self, tkn);
-				break;
+				exponent_negative = *it == '-';
+				++it;
+			}
+			if (it >= end || _json_is_digit(*it) == false)
+				return JSON_NUMBER_INVALID;
 
-			case ':':
-				tkn.kind = Token::KIND_COLON;
-				tkn.end	 = self.it;
-				break;
+			int64_t explicit_exponent = 0;
+			while (it < end && _json_is_digit(*it))
+			{
+				// anything beyond this will overflow/underflow anyway
+				if (explicit_exponent < 100000)
+					explicit_exponent = explicit_exponent * 10 + (*it - '0');
+				++it;
+			}
+			exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+		}
 
-			case ',':
-				tkn.kind = Token::KIND_COMMA;
-				tkn.end	 = self.it;
-				break;
+		// -0 has no int representation, so it's parsed as a double to keep its sign
+		if (is_integer && truncated == false && exponent == 0 && (mantissa != 0 || negative == false))
+		{
+			if (mantissa <= uint64_t(INT64_MAX) + (negative ? 1 : 0))
+			{
+				node.kind = Node::KIND_INT;
+				node.as_int = negative ? int64_t(0 - mantissa) : int64_t(mantissa);
+				return JSON_NUMBER_OK;
+			}
+		}
 
-			case '{':
-				tkn.kind = Token::KIND_OPEN_CURLY;
-				tkn.end	 = self.it;
-				break;
+		node.kind = Node::KIND_DOUBLE;
+		if (truncated == false && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			auto value = double(mantissa);
+			if (exponent < 0)
+				value /= JSON_EXACT_POWERS_OF_TEN[-exponent];
+			else
+				value *= JSON_EXACT_POWERS_OF_TEN[exponent];
+			node.as_double = negative ? -value : value;
+			return JSON_NUMBER_OK;
+		}
 
-			case '}':
-				tkn.kind = Token::KIND_CLOSE_CURLY;
-				tkn.end	 = self.it;
-				break;
+		// strtod needs a null terminated string and the content might not be null terminated
+		char small_buffer[64];
+		auto size = size_t(it - number_begin);
+		auto buffer = small_buffer;
+		if (size >= sizeof(small_buffer))
+			buffer = (char*)alloc_from(memory::tmp(), size + 1, alignof(char)).ptr;
+		::memcpy(buffer, number_begin, size);
+		buffer[size] = '\0';
 
-			case '[':
-				tkn.kind = Token::KIND_OPEN_BRACKET;
-				tkn.end	 = self.it;
-				break;
+		errno = 0;
+		node.as_double = ::strtod(buffer, nullptr);
+		if (errno == ERANGE && (node.as_double == HUGE_VAL || node.as_double == -HUGE_VAL))
+			return JSON_NUMBER_OUT_OF_RANGE;
+		return JSON_NUMBER_OK;
+	}
 
-			case ']':
-				tkn.kind = Token::KIND_CLOSE_BRACKET;
-				tkn.end	 = self.it;
-				break;
+	// strings
+	inline static int
+	_json_hex_digit(char c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
 
-			default:
-				self.err = Err{"unidentified rune '{:c}'", c};
+	inline static bool
+	_json_parse_hex4(const char* it, const char* end, uint32_t& code)
+	{
+		if (end - it < 4)
+			return false;
+		code = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			auto digit = _json_hex_digit(it[i]);
+			if (digit < 0)
+				return false;
+			code = (code << 4) | uint32_t(digit);
+		}
+		return true;
+	}
+
+	// unescapes the raw string [it, end) into out which must have at least (end - it) bytes because the unescaped
+	// string is never longer than the escaped one, returns the end of the written data, on error it returns
+	// nullptr and sets the error message with the iterator pointing to the invalid escape sequence
+	inline static char*
+	_json_string_unescape(const char*& it, const char* end, char* out, const char*& error)
+	{
+		auto out_it = out;
+		for (; it < end; ++it)
+		{
+			if (*it != '\\')
+			{
+				*out_it++ = *it;
+				continue;
+			}
+
+			++it;
+			switch (*it)
+			{
+			case '"': *out_it++ = '"'; break;
+			case '\\': *out_it++ = '\\'; break;
+			case '/': *out_it++ = '/'; break;
+			case 'b': *out_it++ = '\b'; break;
+			case 'f': *out_it++ = '\f'; break;
+			case 'n': *out_it++ = '\n'; break;
+			case 'r': *out_it++ = '\r'; break;
+			case 't': *out_it++ = '\t'; break;
+			case 'u':
+			{
+				uint32_t code = 0;
+				if (_json_parse_hex4(it + 1, end, code) == false)
+				{
+					error = "invalid unicode escape";
+					return nullptr;
+				}
+				it += 4;
+				// utf-16 surrogate pair
+				if (code >= 0xD800 && code <= 0xDBFF)
+				{
+					uint32_t low = 0;
+					if (end - it < 7 || it[1] != '\\' || it[2] != 'u' ||
+						_json_parse_hex4(it + 3, end, low) == false ||
+						low < 0xDC00 || low > 0xDFFF)
+					{
+						error = "invalid unicode surrogate pair";
+						return nullptr;
+					}
+					it += 6;
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				else if (code >= 0xDC00 && code <= 0xDFFF)
+				{
+					error = "invalid unicode surrogate pair";
+					return nullptr;
+				}
+				// the escape sequence is at least 6 bytes and the encoded rune is at most 4 bytes
+				out_it += rune_encode(Rune(code), Block{out_it, 4});
 				break;
 			}
+			default:
+				error = "invalid escape sequence";
+				return nullptr;
+			}
 		}
-		return tkn;
+		return out_it;
 	}
 
-	struct Parser
+	// stage 2
+	// walks the structural index and validates the json grammar, the value builders use it to build the nodes
+	constexpr size_t JSON_MAX_DEPTH = 1024;
+
+	struct Json_Walker
 	{
-		Lexer lexer;
-		Token current;
+		const char* begin;
+		size_t size;
+		const uint32_t* index;
+		size_t index_count;
+		size_t cursor;
+		size_t depth;
 		Err err;
 	};
 
-	inline static Token
-	_parser_look(Parser& self)
+	inline static bool
+	_json_walker_done(const Json_Walker& self)
 	{
-		return self.current;
+		return self.cursor >= self.index_count;
 	}
 
-	inline static Token
-	_parser_look_kind(Parser& self, Token::KIND k)
+	// returns the char at the current structural position or '\0' at the end of the input
+	inline static char
+	_json_walker_peek(const Json_Walker& self)
 	{
-		if (self.current.kind == k)
-			return self.current;
-		return Token{};
+		if (_json_walker_done(self))
+			return '\0';
+		return self.begin[self.index[self.cursor]];
 	}
 
-	inline static Token
-	_parser_eat(Parser& self)
+	inline static size_t
+	_json_walker_position(const Json_Walker& self)
 	{
-		auto res = self.current;
-		self.current = _lexer_lex(self.lexer);
-		return res;
+		if (_json_walker_done(self))
+			return self.size;
+		return self.index[self.cursor];
 	}
 
-	inline static Token
-	_parser_eat_kind(Parser& self, Token::KIND k)
+	inline static void
+	_json_walker_error(Json_Walker& self, const char* message)
 	{
-		auto res = self.current;
-		if (res.kind != k)
-			return Token{};
-		self.current = _lexer_lex(self.lexer);
-		if (self.lexer.err && !self.err)
-			self.err = self.lexer.err;
-		return res;
+		if (self.err)
+			return;
+		auto position = _json_walker_position(self);
+		if (position < self.size)
+			self.err = Err{"{} at offset {}, found '{:c}'", message, position, self.begin[position]};
+		else
+			self.err = Err{"{} at offset {}, found end of input", message, position};
 	}
 
-	inline static Token
-	_parser_eat_must(Parser& self, Token::KIND k)
+	inline static bool
+	_json_walker_expect(Json_Walker& self, char c, const char* message)
 	{
-		if (self.current.kind == Token::KIND_NONE && _lexer_eof(self.lexer))
+		if (_json_walker_peek(self) != c)
 		{
-			self.err = Err{"expected '{}' but found EOF", _json_token_kind_str(self.current.kind)};
-			return Token{};
+			_json_walker_error(self, message);
+			return false;
 		}
+		++self.cursor;
+		return true;
+	}
 
-		auto res = self.current;
-		self.current = _lexer_lex(self.lexer);
-		if (self.lexer.err && !self.err)
-			self.err = self.lexer.err;
-		if (res.kind == k)
-			return res;
+	// checks that the atom (number or keyword) which ends at the given position isn't followed by more scalar chars
+	inline static bool
+	_json_walker_atom_end(Json_Walker& self, size_t atom_end)
+	{
+		if (atom_end < self.size && _json_is_scalar_char(self.begin[atom_end]))
+		{
+			_json_walker_error(self, "invalid literal");
+			return false;
+		}
+		++self.cursor;
+		return true;
+	}
 
-		self.err = Err{
-			"expected '{}' but found '{:.{}s}'",
-			_json_token_kind_str(k),
-			res.begin,
-			res.end - res.begin
-		};
-		return Token{};
+	// returns the raw string (without the quotes) at the current position
+	inline static bool
+	_json_walker_string(Json_Walker& self, const char*& str_begin, const char*& str_end)
+	{
+		if (_json_walker_peek(self) != '"' || self.cursor + 1 >= self.index_count)
+		{
+			_json_walker_error(self, "expected a string");
+			return false;
+		}
+		str_begin = self.begin + self.index[self.cursor] + 1;
+		str_end = self.begin + self.index[self.cursor + 1];
+		self.cursor += 2;
+		return true;
 	}
 
-	inline static Value
-	_parser_parse_value(Parser &self)
+	inline static bool
+	_json_walker_keyword(Json_Walker& self, const char* keyword, size_t size)
 	{
-		if (auto null_tkn = _parser_eat_kind(self, Token::KIND_NULL))
+		auto position = _json_walker_position(self);
+		if (self.size - position < size || ::memcmp(self.begin + position, keyword, size) != 0)
 		{
-			return Value{};
+			_json_walker_error(self, "unidentified keyword");
+			return false;
+		}
+		return _json_walker_atom_end(self, position + size);
+	}
+
+	inline static bool
+	_json_walker_number(Json_Walker& self, Node& node)
+	{
+		auto it = self.begin + _json_walker_position(self);
+		auto res = _json_number_parse(it, self.begin + self.size, node);
+		if (res != JSON_NUMBER_OK)
+		{
+			_json_walker_error(self, res == JSON_NUMBER_OUT_OF_RANGE ? "number out of range" : "invalid number");
+			return false;
+		}
+		return _json_walker_atom_end(self, size_t(it - self.begin));
+	}
+
+	inline static bool
+	_json_walker_enter(Json_Walker& self)
+	{
+		if (self.depth >= JSON_MAX_DEPTH)
+		{
+			_json_walker_error(self, "maximum nesting depth exceeded");
+			return false;
+		}
+		++self.depth;
+		++self.cursor;
+		return true;
+	}
+
+	// after a container element, returns true if there's another element, false if the container ended (or on error)
+	inline static bool
+	_json_walker_next_element(Json_Walker& self, char close, const char* message)
+	{
+		auto c = _json_walker_peek(self);
+		++self.cursor;
+		if (c == ',')
+			return true;
+		if (c != close)
+		{
+			--self.cursor;
+			_json_walker_error(self, message);
+		}
+		return false;
+	}
+
+	inline static bool
+	_json_walker_finish(Json_Walker& self)
+	{
+		if (_json_walker_done(self) == false)
+		{
+			_json_walker_error(self, "unexpected trailing characters");
+			return false;
 		}
-		else if (auto bool_tkn = _parser_eat_kind(self, Token::KIND_BOOL))
+		return true;
+	}
+
+	// document parser
+	struct Document_Parser
+	{
+		Json_Walker walker;
+		memory::Arena* arena;
+		// the values of the arrays and objects which are being parsed, once the array or object is finished its
+		// values are copied into the arena and popped from these stacks
+		Buf<Node> values;
+		Buf<Node_Member> members;
+	};
+
+	inline static void*
+	_document_alloc(memory::Arena* arena, size_t size, size_t alignment)
+	{
+		return arena->alloc(size, alignment).ptr;
+	}
+
+	// unescapes the given raw string into a null terminated string which is allocated in the arena
+	inline static bool
+	_document_parser_string(Document_Parser& self, Node& node)
+	{
+		const char* str_begin = nullptr;
+		const char* str_end = nullptr;
+		if (_json_walker_string(self.walker, str_begin, str_end) == false)
+			return false;
+
+		auto raw_size = size_t(str_end - str_begin);
+		auto out = (char*)_document_alloc(self.arena, raw_size + 1, alignof(char));
+		node.kind = Node::KIND_STRING;
+		node.as_string = out;
+
+		if (::memchr(str_begin, '\\', raw_size) == nullptr)
 		{
-			return value_bool_new(bool_tkn.val_bool);
+			::memcpy(out, str_begin, raw_size);
+			out[raw_size] = '\0';
+			node.count = uint32_t(raw_size);
+			return true;
 		}
-		else if (auto number_tkn = _parser_eat_kind(self, Token::KIND_NUMBER))
+
+		const char* error = nullptr;
+		auto out_end = _json_string_unescape(str_begin, str_end, out, error);
+		if (out_end == nullptr)
 		{
-			return value_number_new((float)number_tkn.val_num);
+			self.walker.err = Err{"{} at offset {}", error, str_begin - self.walker.begin};
+			return false;
 		}
-		else if (auto string_tkn = _parser_eat_kind(self, Token::KIND_STRING))
+		*out_end = '\0';
+		node.count = uint32_t(out_end - out);
+		return true;
+	}
+
+	inline static bool
+	_document_parser_value(Document_Parser& self, Node& node);
+
+	inline static bool
+	_document_parser_array(Document_Parser& self, Node& node)
+	{
+		auto& walker = self.walker;
+		if (_json_walker_enter(walker) == false)
+			return false;
+
+		auto values_begin = self.values.count;
+		if (_json_walker_peek(walker) == ']')
 		{
-			Value res{};
-			res.kind = Value::KIND_STRING;
-			res.as_string = alloc<Str>();
-			*res.as_string = str_from_substr(string_tkn.begin, string_tkn.end);
-			return res;
+			++walker.cursor;
 		}
-		else if (auto bracket_tkn = _parser_eat_kind(self, Token::KIND_OPEN_BRACKET))
+		else
 		{
-			auto array = value_array_new();
-			while (_parser_look_kind(self, Token::KIND_CLOSE_BRACKET) == false)
+			while (true)
 			{
-				if (auto value = _parser_parse_value(self); !self.err)
-				{
-					value_array_push(array, value);
-				}
-				else
-				{
-					value_free(array);
-					return Value{};
-				}
+				Node value{};
+				if (_document_parser_value(self, value) == false)
+					return false;
+				buf_push(self.values, value);
 
-				if (_parser_eat_kind(self, Token::KIND_COMMA) == false)
+				if (_json_walker_next_element(walker, ']', "expected ',' or ']'") == false)
 					break;
 			}
-			_parser_eat_must(self, Token::KIND_CLOSE_BRACKET);
-			return array;
+			if (walker.err)
+				return false;
 		}
-		else if (auto open_curly_tkn = _parser_eat_kind(self, Token::KIND_OPEN_CURLY))
+		--walker.depth;
+
+		auto count = self.values.count - values_begin;
+		node.kind = Node::KIND_ARRAY;
+		node.count = uint32_t(count);
+		node.as_array = nullptr;
+		if (count > 0)
 		{
-			auto object = value_object_new();
+			node.as_array = (Node*)_document_alloc(self.arena, count * sizeof(Node), alignof(Node));
+			::memcpy(node.as_array, self.values.ptr + values_begin, count * sizeof(Node));
+		}
+		buf_resize(self.values, values_begin);
+		return true;
+	}
 
-			while (_parser_look_kind(self, Token::KIND_CLOSE_CURLY) == false)
-			{
-				auto key = _parser_eat_must(self, Token::KIND_STRING);
-				_parser_eat_must(self, Token::KIND_COLON);
+	inline static void
+	_document_object_index_build(memory::Arena* arena, Node_Object* object, uint32_t count)
+	{
+		uint32_t capacity = 32;
+		while (capacity < count * 2)
+			capacity *= 2;
 
-				if (auto value = _parser_parse_value(self); !self.err)
-				{
-					auto key_str = str_from_substr(key.begin, key.end);
-					if (auto it = map_lookup(*object.as_object, key_str))
-					{
-						str_free(key_str);
-						value_free(it->value);
-						it->value = value;
-					}
-					else
-					{
-						map_insert(*object.as_object, key_str, value);
-					}
-				}
-				else
+		object->index_capacity = capacity;
+		object->index = (uint32_t*)_document_alloc(arena, capacity * sizeof(uint32_t), alignof(uint32_t));
+		::memset(object->index, 0, capacity * sizeof(uint32_t));
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const auto& key = object->members[i].key;
+			auto slot = Hash<Str>{}(key) & (capacity - 1);
+			while (true)
+			{
+				auto entry = object->index[slot];
+				// the later duplicate keys replace the earlier ones
+				if (entry == 0 || object->members[entry - 1].key == key)
 				{
-					value_free(object);
-					return Value{};
+					object->index[slot] = i + 1;
+					break;
 				}
+				slot = (slot + 1) & (capacity - 1);
+			}
+		}
+	}
+
+	inline static bool
+	_document_parser_object(Document_Parser& self, Node& node)
+	{
+		auto& walker = self.walker;
+		if (_json_walker_enter(walker) == false)
+			return false;
+
+		auto members_begin = self.members.count;
+		if (_json_walker_peek(walker) == '}')
+		{
+			++walker.cursor;
+		}
+		else
+		{
+			while (true)
+			{
+				Node_Member member{};
+				Node key{};
+				if (_document_parser_string(self, key) == false)
+					return false;
+				member.key.ptr = (char*)key.as_string;
+				member.key.count = key.count;
+				member.key.cap = key.count;
+
+				if (_json_walker_expect(walker, ':', "expected ':'") == false)
+					return false;
 
-				if (_parser_eat_kind(self, Token::KIND_COMMA) == false)
+				if (_document_parser_value(self, member.value) == false)
+					return false;
+				buf_push(self.members, member);
+
+				if (_json_walker_next_element(walker, '}', "expected ',' or '}'") == false)
 					break;
 			}
-			_parser_eat_must(self, Token::KIND_CLOSE_CURLY);
-			return object;
+			if (walker.err)
+				return false;
 		}
-		else if (auto unknown_tkn = _parser_eat(self))
+		--walker.depth;
+
+		auto count = self.members.count - members_begin;
+		auto object = (Node_Object*)_document_alloc(self.arena, sizeof(Node_Object), alignof(Node_Object));
+		::memset(object, 0, sizeof(*object));
+		if (count > 0)
 		{
-			self.err = Err{
-				"unidentified token '{:.{}s}' of kind '{}'",
-				unknown_tkn.begin,
-				unknown_tkn.end - unknown_tkn.begin,
-				_json_token_kind_str(unknown_tkn.kind)
-			};
+			object->members = (Node_Member*)_document_alloc(self.arena, count * sizeof(Node_Member), alignof(Node_Member));
+			::memcpy(object->members, self.members.ptr + members_begin, count * sizeof(Node_Member));
 		}
+		if (count >= NODE_OBJECT_INDEX_THRESHOLD)
+			_document_object_index_build(self.arena, object, uint32_t(count));
 
-		return Value{};
+		node.kind = Node::KIND_OBJECT;
+		node.count = uint32_t(count);
+		node.as_object = object;
+		buf_resize(self.members, members_begin);
+		return true;
 	}
 
-	// API
-	Result<Value>
-	parse(const Str& content)
+	inline static bool
+	_document_parser_value(Document_Parser& self, Node& node)
 	{
-		Lexer lexer;
-		lexer.it = content.ptr;
-		lexer.c	= *lexer.it;
-
-		Parser parser;
-		parser.lexer = lexer;
-		parser.current = _lexer_lex(parser.lexer);
+		auto& walker = self.walker;
+		switch (_json_walker_peek(walker))
+		{
+		case 'n':
+			node.kind = Node::KIND_NULL;
+			return _json_walker_keyword(walker, "null", 4);
+		case 't':
+			node.kind = Node::KIND_BOOL;
+			node.as_bool = true;
+			return _json_walker_keyword(walker, "true", 4);
+		case 'f':
+			node.kind = Node::KIND_BOOL;
+			node.as_bool = false;
+			return _json_walker_keyword(walker, "false", 5);
+		case '"':
+			return _document_parser_string(self, node);
+		case '[':
+			return _document_parser_array(self, node);
+		case '{':
+			return _document_parser_object(self, node);
+		case '\0':
+			_json_walker_error(walker, "expected a value");
+			return false;
+		default:
+			return _json_walker_number(walker, node);
+		}
+	}
 
-		auto res = _parser_parse_value(parser);
-		if (parser.err)
-			return parser.err;
-		return res;
+	// value parser
+	// builds the heap allocated json::Value tree, strings are kept as is (escape sequences are not decoded)
+	inline static bool
+	_value_parser_value(Json_Walker& self, Value& value)
+	{
+		switch (_json_walker_peek(self))
+		{
+		case 'n':
+			value = Value{};
+			return _json_walker_keyword(self, "null", 4);
+		case 't':
+			value = value_bool_new(true);
+			return _json_walker_keyword(self, "true", 4);
+		case 'f':
+			value = value_bool_new(false);
+			return _json_walker_keyword(self, "false", 5);
+		case '"':
+		{
+			const char* str_begin = nullptr;
+			const char* str_end = nullptr;
+			if (_json_walker_string(self, str_begin, str_end) == false)
+				return false;
+			value.kind = Value::KIND_STRING;
+			value.as_string = alloc<Str>();
+			*value.as_string = str_from_substr(str_begin, str_end);
+			return true;
+		}
+		case '[':
+		{
+			if (_json_walker_enter(self) == false)
+				return false;
+			value = value_array_new();
+			if (_json_walker_peek(self) == ']')
+			{
+				++self.cursor;
+			}
+			else
+			{
+				while (true)
+				{
+					Value element{};
+					if (_value_parser_value(self, element) == false)
+					{
+						value_free(element);
+						return false;
+					}
+					value_array_push(value, element);
+
+					if (_json_walker_next_element(self, ']', "expected ',' or ']'") == false)
+						break;
+				}
+				if (self.err)
+					return false;
+			}
+			--self.depth;
+			return true;
+		}
+		case '{':
+		{
+			if (_json_walker_enter(self) == false)
+				return false;
+			value = value_object_new();
+			if (_json_walker_peek(self) == '}')
+			{
+				++self.cursor;
+			}
+			else
+			{
+				while (true)
+				{
+					const char* key_begin = nullptr;
+					const char* key_end = nullptr;
+					if (_json_walker_string(self, key_begin, key_end) == false)
+						return false;
+					if (_json_walker_expect(self, ':', "expected ':'") == false)
+						return false;
+
+					Value member{};
+					if (_value_parser_value(self, member) == false)
+					{
+						value_free(member);
+						return false;
+					}
+
+					auto key = str_from_substr(key_begin, key_end);
+					if (auto it = map_lookup(*value.as_object, key))
+					{
+						str_free(key);
+						value_free(it->value);
+						it->value = member;
+					}
+					else
+					{
+						map_insert(*value.as_object, key, member);
+					}
+
+					if (_json_walker_next_element(self, '}', "expected ',' or '}'") == false)
+						break;
+				}
+				if (self.err)
+					return false;
+			}
+			--self.depth;
+			return true;
+		}
+		case '\0':
+			_json_walker_error(self, "expected a value");
+			return false;
+		default:
+		{
+			Node number{};
+			if (_json_walker_number(self, number) == false)
+				return false;
+			value = value_number_new(float(node_as_double(number)));
+			return true;
+		}
+		}
+	}
+
+	// pull reader
+	constexpr size_t JSON_READER_CHUNK_SIZE = 64ULL * 1024ULL;
+
+	enum JSON_READER_EXPECT: uint8_t
+	{
+		// a root value or the end of the input
+		JSON_READER_EXPECT_ROOT,
+		JSON_READER_EXPECT_VALUE,
+		// the first value of an array or the end of the array
+		JSON_READER_EXPECT_VALUE_OR_END,
+		// the first key of an object or the end of the object
+		JSON_READER_EXPECT_KEY_OR_END,
+		JSON_READER_EXPECT_KEY,
+		JSON_READER_EXPECT_COMMA_OR_END,
+	};
+
+	struct IJson_Reader
+	{
+		Allocator allocator;
+		Reader reader;
+		Stream stream;
+		// the window of the input which is not consumed yet starts at cursor
+		Str buffer;
+		size_t cursor;
+		size_t consumed;
+		bool eof;
+		// the buffer is a view of the whole input which the reader doesn't own
+		bool is_view;
+		// the containers which are open, '[' or '{'
+		Buf<char> containers;
+		JSON_READER_EXPECT expect;
+		Json_Event::KIND last_kind;
+		// the unescaped string of the last key/string event
+		Str scratch;
+		Err err;
+	};
+
+	// reads more input into the buffer after dropping the consumed part, the offsets relative to the cursor stay
+	// valid, returns false if there's no more input
+	inline static bool
+	_json_reader_fill(IJson_Reader* self)
+	{
+		if (self->is_view)
+			return false;
+
+		if (self->cursor > 0)
+		{
+			auto remaining = self->buffer.count - self->cursor;
+			::memmove(self->buffer.ptr, self->buffer.ptr + self->cursor, remaining);
+			buf_resize(self->buffer, remaining);
+			self->consumed += self->cursor;
+			self->cursor = 0;
+		}
+
+		if (self->eof)
+			return false;
+
+		auto old_count = self->buffer.count;
+		buf_resize(self->buffer, old_count + JSON_READER_CHUNK_SIZE);
+		auto data = Block{self->buffer.ptr + old_count, JSON_READER_CHUNK_SIZE};
+		size_t read_size = 0;
+		if (self->reader)
+			read_size = reader_read(self->reader, data);
+		else
+			read_size = stream_read(self->stream, data);
+		buf_resize(self->buffer, old_count + read_size);
+
+		if (read_size == 0)
+			self->eof = true;
+		return read_size > 0;
+	}
+
+	// returns the char at the given offset from the cursor, or '\0' at the end of the input
+	inline static char
+	_json_reader_char(IJson_Reader* self, size_t offset)
+	{
+		while (self->cursor + offset >= self->buffer.count)
+		{
+			if (_json_reader_fill(self) == false)
+				return '\0';
+		}
+		return self->buffer.ptr[self->cursor + offset];
+	}
+
+	inline static void
+	_json_reader_advance(IJson_Reader* self, size_t size)
+	{
+		self->cursor += size;
+	}
+
+	inline static char
+	_json_reader_skip_ws(IJson_Reader* self)
+	{
+		while (true)
+		{
+			auto c = _json_reader_char(self, 0);
+			if (_json_is_ws(c) == false)
+				return c;
+			_json_reader_advance(self, 1);
+		}
+	}
+
+	inline static Err
+	_json_reader_error(IJson_Reader* self, const char* message)
+	{
+		auto offset = self->consumed + self->cursor;
+		if (self->cursor < self->buffer.count)
+			self->err = Err{"{} at offset {}, found '{:c}'", message, offset, self->buffer.ptr[self->cursor]};
+		else
+			self->err = Err{"{} at offset {}, found end of input", message, offset};
+		return self->err;
+	}
+
+	// finds the size of the string which starts at the cursor (including both quotes), returns 0 if the string
+	// is not terminated
+	inline static size_t
+	_json_reader_string_size(IJson_Reader* self)
+	{
+		size_t offset = 1;
+		while (true)
+		{
+			if (_json_reader_char(self, offset) == '\0' && self->cursor + offset >= self->buffer.count)
+				return 0;
+
+			auto it = self->buffer.ptr + self->cursor + offset;
+			auto end = self->buffer.ptr + self->buffer.count;
+			auto quote = (const char*)::memchr(it, '"', end - it);
+			if (quote == nullptr)
+			{
+				offset = self->buffer.count - self->cursor;
+				continue;
+			}
+
+			// the quote is escaped if it's preceded by an odd number of backslashes
+			size_t backslashes = 0;
+			for (auto back = quote; back > self->buffer.ptr + self->cursor + 1 && back[-1] == '\\'; --back)
+				++backslashes;
+			offset = size_t(quote - (self->buffer.ptr + self->cursor)) + 1;
+			if (backslashes % 2 == 0)
+				return offset;
+		}
+	}
+
+	// finds the size of the number/keyword which starts at the cursor
+	inline static size_t
+	_json_reader_atom_size(IJson_Reader* self)
+	{
+		size_t offset = 0;
+		while (true)
+		{
+			auto c = _json_reader_char(self, offset);
+			if (c == '\0' || _json_is_scalar_char(c) == false)
+				return offset;
+			++offset;
+		}
+	}
+
+	inline static Err
+	_json_reader_string(IJson_Reader* self, Json_Event& event)
+	{
+		auto size = _json_reader_string_size(self);
+		if (size == 0)
+			return _json_reader_error(self, "unterminated string");
+
+		auto it = (const char*)self->buffer.ptr + self->cursor + 1;
+		auto end = it + (size - 2);
+		buf_resize(self->scratch, size - 1);
+		const char* error = nullptr;
+		auto out_end = _json_string_unescape(it, end, self->scratch.ptr, error);
+		if (out_end == nullptr)
+		{
+			self->cursor = size_t(it - self->buffer.ptr);
+			return _json_reader_error(self, error);
+		}
+		buf_resize(self->scratch, size_t(out_end - self->scratch.ptr));
+		str_null_terminate(self->scratch);
+		_json_reader_advance(self, size);
+
+		event.as_string = self->scratch;
+		event.as_string.allocator = nullptr;
+		return Err{};
+	}
+
+	inline static void
+	_json_reader_after_value(IJson_Reader* self)
+	{
+		if (self->containers.count == 0)
+			self->expect = JSON_READER_EXPECT_ROOT;
+		else
+			self->expect = JSON_READER_EXPECT_COMMA_OR_END;
+	}
+
+	inline static Err
+	_json_reader_value(IJson_Reader* self, char c, Json_Event& event)
+	{
+		event.depth = uint32_t(self->containers.count);
+		if (c == '{' || c == '[')
+		{
+			if (self->containers.count >= JSON_MAX_DEPTH)
+				return _json_reader_error(self, "maximum nesting depth exceeded");
+			buf_push(self->containers, c);
+			_json_reader_advance(self, 1);
+			if (c == '{')
+			{
+				event.kind = Json_Event::KIND_BEGIN_OBJECT;
+				self->expect = JSON_READER_EXPECT_KEY_OR_END;
+			}
+			else
+			{
+				event.kind = Json_Event::KIND_BEGIN_ARRAY;
+				self->expect = JSON_READER_EXPECT_VALUE_OR_END;
+			}
+			return Err{};
+		}
+
+		if (c == '"')
+		{
+			event.kind = Json_Event::KIND_STRING;
+			if (auto err = _json_reader_string(self, event))
+				return err;
+			_json_reader_after_value(self);
+			return Err{};
+		}
+
+		auto size = _json_reader_atom_size(self);
+		if (size == 0)
+			return _json_reader_error(self, "expected a value");
+
+		auto atom = self->buffer.ptr + self->cursor;
+		if (size == 4 && ::memcmp(atom, "null", 4) == 0)
+		{
+			event.kind = Json_Event::KIND_NULL;
+		}
+		else if (size == 4 && ::memcmp(atom, "true", 4) == 0)
+		{
+			event.kind = Json_Event::KIND_BOOL;
+			event.as_bool = true;
+		}
+		else if (size == 5 && ::memcmp(atom, "false", 5) == 0)
+		{
+			event.kind = Json_Event::KIND_BOOL;
+			event.as_bool = false;
+		}
+		else
+		{
+			Node number{};
+			const char* it = atom;
+			auto res = _json_number_parse(it, atom + size, number);
+			if (res == JSON_NUMBER_OUT_OF_RANGE && it == atom + size)
+				return _json_reader_error(self, "number out of range");
+			if (res != JSON_NUMBER_OK || it != atom + size)
+				return _json_reader_error(self, "invalid literal");
+
+			if (number.kind == Node::KIND_INT)
+			{
+				event.kind = Json_Event::KIND_INT;
+				event.as_int = number.as_int;
+			}
+			else
+			{
+				event.kind = Json_Event::KIND_DOUBLE;
+				event.as_double = number.as_double;
+			}
+		}
+		_json_reader_advance(self, size);
+		_json_reader_after_value(self);
+		return Err{};
+	}
+
+	inline static Err
+	_json_reader_end_container(IJson_Reader* self, Json_Event& event)
+	{
+		auto open = buf_top(self->containers);
+		buf_pop(self->containers);
+		_json_reader_advance(self, 1);
+		event.kind = open == '{' ? Json_Event::KIND_END_OBJECT : Json_Event::KIND_END_ARRAY;
+		event.depth = uint32_t(self->containers.count);
+		_json_reader_after_value(self);
+		return Err{};
+	}
+
+	inline static Err
+	_json_reader_next(IJson_Reader* self, Json_Event& event)
+	{
+		event.as_string = Str{};
+		while (true)
+		{
+			auto c = _json_reader_skip_ws(self);
+			switch (self->expect)
+			{
+			case JSON_READER_EXPECT_ROOT:
+				if (c == '\0' && self->cursor >= self->buffer.count)
+				{
+					event.kind = Json_Event::KIND_END;
+					event.depth = 0;
+					return Err{};
+				}
+				return _json_reader_value(self, c, event);
+			case JSON_READER_EXPECT_VALUE:
+				return _json_reader_value(self, c, event);
+			case JSON_READER_EXPECT_VALUE_OR_END:
+				if (c == ']')
+					return _json_reader_end_container(self, event);
+				return _json_reader_value(self, c, event);
+			case JSON_READER_EXPECT_KEY_OR_END:
+				if (c == '}')
+					return _json_reader_end_container(self, event);
+				// fallthrough
+			case JSON_READER_EXPECT_KEY:
+			{
+				if (c != '"')
+					return _json_reader_error(self, "expected a string key");
+				event.kind = Json_Event::KIND_KEY;
+				event.depth = uint32_t(self->containers.count);
+				if (auto err = _json_reader_string(self, event))
+					return err;
+				// the key is unescaped into the scratch string so it stays valid even if the buffer moves here
+				if (_json_reader_skip_ws(self) != ':')
+					return _json_reader_error(self, "expected ':'");
+				_json_reader_advance(self, 1);
+				self->expect = JSON_READER_EXPECT_VALUE;
+				return Err{};
+			}
+			case JSON_READER_EXPECT_COMMA_OR_END:
+			{
+				auto close = buf_top(self->containers) == '{' ? '}' : ']';
+				if (c == close)
+					return _json_reader_end_container(self, event);
+				if (c != ',')
+					return _json_reader_error(self, close == '}' ? "expected ',' or '}'" : "expected ',' or ']'");
+				_json_reader_advance(self, 1);
+				self->expect = buf_top(self->containers) == '{' ? JSON_READER_EXPECT_KEY : JSON_READER_EXPECT_VALUE;
+				break;
+			}
+			default:
+				mn_unreachable();
+				return Err{};
+			}
+		}
+	}
+
+	// skips the content of the innermost open container including its end
+	inline static Err
+	_json_reader_skip_container(IJson_Reader* self)
+	{
+		size_t depth = 1;
+		while (depth > 0)
+		{
+			auto it = self->buffer.ptr + self->cursor;
+			auto end = self->buffer.ptr + self->buffer.count;
+			for (; it < end; ++it)
+			{
+				auto c = *it;
+				if (c == '"')
+					break;
+				if (c == '{' || c == '[')
+				{
+					++depth;
+				}
+				else if (c == '}' || c == ']')
+				{
+					if (--depth == 0)
+						break;
+				}
+			}
+			self->cursor = size_t(it - self->buffer.ptr);
+
+			if (it == end)
+			{
+				if (_json_reader_fill(self) == false)
+					return _json_reader_error(self, "unterminated container");
+				continue;
+			}
+
+			if (*it == '"')
+			{
+				auto size = _json_reader_string_size(self);
+				if (size == 0)
+					return _json_reader_error(self, "unterminated string");
+				_json_reader_advance(self, size);
+			}
+		}
+
+		auto open = buf_top(self->containers);
+		auto close = self->buffer.ptr[self->cursor];
+		if ((open == '{' && close != '}') || (open == '[' && close != ']'))
+			return _json_reader_error(self, "mismatched brackets");
+
+		Json_Event event{};
+		return _json_reader_end_container(self, event);
+	}
+
+	// writer
+	constexpr size_t JSON_WRITER_FLUSH_SIZE = 64ULL * 1024ULL;
+
+	struct IJson_Writer
+	{
+		Allocator allocator;
+		// the output string, it points to the user string or to the buffer in case of stream writers
+		Str* out;
+		Str buffer;
+		Stream stream;
+		// the containers which are open, '[' or '{'
+		Buf<char> containers;
+		// whether the next value is the first one inside the current container (or at the root)
+		bool first;
+		bool after_key;
+	};
+
+	// makes sure that the output has space for the given size plus the null terminator and returns the write position
+	inline static char*
+	_json_writer_reserve(IJson_Writer* self, size_t size)
+	{
+		auto& out = *self->out;
+		buf_reserve(out, size + 1);
+		return out.ptr + out.count;
+	}
+
+	inline static void
+	_json_writer_commit(IJson_Writer* self, char* end)
+	{
+		auto& out = *self->out;
+		out.count = size_t(end - out.ptr);
+		out.ptr[out.count] = '\0';
+	}
+
+	inline static void
+	_json_writer_push(IJson_Writer* self, const char* data, size_t size)
+	{
+		auto it = _json_writer_reserve(self, size);
+		::memcpy(it, data, size);
+		_json_writer_commit(self, it + size);
+	}
+
+	inline static void
+	_json_writer_push(IJson_Writer* self, char c)
+	{
+		auto it = _json_writer_reserve(self, 1);
+		*it++ = c;
+		_json_writer_commit(self, it);
+	}
+
+	inline static void
+	_json_writer_maybe_flush(IJson_Writer* self)
+	{
+		if (self->stream && self->buffer.count >= JSON_WRITER_FLUSH_SIZE)
+			json_writer_flush(self);
+	}
+
+	// writes the comma before the value if needed
+	inline static void
+	_json_writer_before_value(IJson_Writer* self)
+	{
+		if (self->containers.count == 0)
+		{
+			// multiple root values are separated by new lines like json lines files
+			if (self->first == false)
+				_json_writer_push(self, '\n');
+		}
+		else if (buf_top(self->containers) == '{')
+		{
+			mn_assert_msg(self->after_key, "json object values should be preceded by a key");
+		}
+		else if (self->first == false)
+		{
+			_json_writer_push(self, ',');
+		}
+		self->first = false;
+		self->after_key = false;
+	}
+
+	inline static char*
+	_json_writer_escape_char(char* it, char c)
+	{
+		constexpr const char* HEX = "0123456789abcdef";
+		*it++ = '\\';
+		switch (c)
+		{
+		case '"': *it++ = '"'; break;
+		case '\\': *it++ = '\\'; break;
+		case '\b': *it++ = 'b'; break;
+		case '\f': *it++ = 'f'; break;
+		case '\n': *it++ = 'n'; break;
+		case '\r': *it++ = 'r'; break;
+		case '\t': *it++ = 't'; break;
+		default:
+			*it++ = 'u';
+			*it++ = '0';
+			*it++ = '0';
+			*it++ = HEX[(uint8_t(c) >> 4) & 0xF];
+			*it++ = HEX[uint8_t(c) & 0xF];
+			break;
+		}
+		return it;
+	}
+
+	// writes the quoted string escaping the quotes, backslashes and control chars, the chars which need escaping
+	// are rare so we search for them 16 bytes at a time and copy the chunks in between as is
+	inline static void
+	_json_writer_escaped_string(IJson_Writer* self, const Str& value)
+	{
+		// every char is at most escaped into 6 chars
+		auto out = _json_writer_reserve(self, value.count * 6 + 2);
+		*out++ = '"';
+
+		auto it = value.ptr;
+		auto end = value.ptr + value.count;
+	#if MN_SIMD_SSE2
+		auto quote = _mm_set1_epi8('"');
+		auto backslash = _mm_set1_epi8('\\');
+		auto control_max = _mm_set1_epi8(0x1F);
+		while (end - it >= 16)
+		{
+			auto v = _mm_loadu_si128((const __m128i*)it);
+			// unsigned v <= 0x1F is the same as max(v, 0x1F) == 0x1F
+			auto needs_escape = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+				_mm_cmpeq_epi8(_mm_max_epu8(v, control_max), control_max)
+			);
+			auto mask = uint32_t(_mm_movemask_epi8(needs_escape));
+			_mm_storeu_si128((__m128i*)out, v);
+			if (mask == 0)
+			{
+				it += 16;
+				out += 16;
+				continue;
+			}
+
+			auto index = mn_simd_ctz(mask);
+			out = _json_writer_escape_char(out + index, it[index]);
+			it += index + 1;
+		}
+	#endif
+		for (; it < end; ++it)
+		{
+			auto c = *it;
+			if (c == '"' || c == '\\' || uint8_t(c) < 0x20)
+				out = _json_writer_escape_char(out, c);
+			else
+				*out++ = c;
+		}
+
+		*out++ = '"';
+		_json_writer_commit(self, out);
+	}
+
+	inline static void
+	_json_writer_int(IJson_Writer* self, int64_t value)
+	{
+		char digits[24];
+		auto it = digits + sizeof(digits);
+		auto magnitude = value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value);
+		do
+		{
+			*--it = char('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude != 0);
+		if (value < 0)
+			*--it = '-';
+		_json_writer_push(self, it, size_t(digits + sizeof(digits) - it));
+	}
+
+	inline static void
+	_json_writer_double(IJson_Writer* self, double value)
+	{
+		if (isfinite(value) == false)
+		{
+			_json_writer_push(self, "null", 4);
+			return;
+		}
+
+		// fmt formats doubles with the shortest representation which round trips
+		char digits[32];
+		auto res = fmt::format_to_n(digits, sizeof(digits) - 2, "{}", value);
+		auto size = res.size;
+		// integral doubles are formatted without a fraction which would be parsed back as integers
+		if (::memchr(digits, '.', size) == nullptr && ::memchr(digits, 'e', size) == nullptr)
+		{
+			digits[size++] = '.';
+			digits[size++] = '0';
+		}
+		_json_writer_push(self, digits, size);
+	}
+
+	inline static void
+	_json_writer_begin(IJson_Writer* self, char c)
+	{
+		_json_writer_before_value(self);
+		buf_push(self->containers, c);
+		_json_writer_push(self, c);
+		self->first = true;
+	}
+
+	inline static void
+	_json_writer_end(IJson_Writer* self, [[maybe_unused]] char open, char close)
+	{
+		mn_assert_msg(self->containers.count > 0 && buf_top(self->containers) == open, "unbalanced json writer end");
+		mn_assert_msg(self->after_key == false, "json object key without a value");
+		buf_pop(self->containers);
+		_json_writer_push(self, close);
+		self->first = false;
+		_json_writer_maybe_flush(self);
+	}
+
+	// value writers walk the value tree using an explicit stack instead of recursion
+	struct Json_Writer_Value_Frame
+	{
+		const Value* value;
+		size_t index;
+	};
+
+	inline static bool
+	_json_writer_value_scalar(IJson_Writer* self, const Value& value)
+	{
+		switch (value.kind)
+		{
+		case Value::KIND_NULL:
+			json_writer_null(self);
+			return true;
+		case Value::KIND_BOOL:
+			json_writer_bool(self, value.as_bool);
+			return true;
+		case Value::KIND_NUMBER:
+		{
+			_json_writer_before_value(self);
+			// floats are formatted as floats to get their shortest form instead of the double one
+			char digits[32];
+			auto res = fmt::format_to_n(digits, sizeof(digits), "{}", value.as_number);
+			if (isfinite(value.as_number))
+				_json_writer_push(self, digits, res.size);
+			else
+				_json_writer_push(self, "null", 4);
+			_json_writer_maybe_flush(self);
+			return true;
+		}
+		case Value::KIND_STRING:
+			_json_writer_before_value(self);
+			_json_writer_push(self, '"');
+			_json_writer_push(self, value.as_string->ptr, value.as_string->count);
+			_json_writer_push(self, '"');
+			_json_writer_maybe_flush(self);
+			return true;
+		case Value::KIND_ARRAY:
+			json_writer_begin_array(self);
+			return false;
+		case Value::KIND_OBJECT:
+			json_writer_begin_object(self);
+			return false;
+		default:
+			mn_unreachable();
+			return true;
+		}
+	}
+
+	struct Json_Writer_Node_Frame
+	{
+		const Node* node;
+		size_t index;
+	};
+
+	inline static bool
+	_json_writer_node_scalar(IJson_Writer* self, const Node& node)
+	{
+		switch (node.kind)
+		{
+		case Node::KIND_NULL:
+			json_writer_null(self);
+			return true;
+		case Node::KIND_BOOL:
+			json_writer_bool(self, node.as_bool);
+			return true;
+		case Node::KIND_INT:
+			json_writer_int(self, node.as_int);
+			return true;
+		case Node::KIND_DOUBLE:
+			json_writer_double(self, node.as_double);
+			return true;
+		case Node::KIND_STRING:
+			json_writer_string(self, node_as_str(node));
+			return true;
+		case Node::KIND_ARRAY:
+			json_writer_begin_array(self);
+			return false;
+		case Node::KIND_OBJECT:
+			json_writer_begin_object(self);
+			return false;
+		default:
+			mn_unreachable();
+			return true;
+		}
+	}
+
+	// API
+	Result<Value>
+	parse(const Str& content)
+	{
+		auto index = buf_new<uint32_t>();
+		mn_defer{buf_free(index);};
+		if (auto err = _json_structural_index(content.ptr, content.count, index))
+			return err;
+
+		// empty content is parsed as null
+		if (index.count == 0)
+			return Value{};
+
+		Json_Walker walker{};
+		walker.begin = content.ptr;
+		walker.size = content.count;
+		walker.index = index.ptr;
+		walker.index_count = index.count;
+
+		Value res{};
+		if (_value_parser_value(walker, res))
+			_json_walker_finish(walker);
+
+		if (walker.err)
+		{
+			value_free(res);
+			return walker.err;
+		}
+		return res;
+	}
+
+	Result<Document>
+	document_parse(const Str& content, Allocator allocator)
+	{
+		auto index = buf_new<uint32_t>();
+		mn_defer{buf_free(index);};
+		if (auto err = _json_structural_index(content.ptr, content.count, index))
+			return err;
+
+		Document self{};
+		self.allocator = allocator;
+		// the document is usually around the size of the input so we try to fit it in a single block
+		auto block_size = content.count + content.count / 2;
+		if (block_size < 4ULL * 1024ULL)
+			block_size = 4ULL * 1024ULL;
+		self.arena = alloc_construct_from<memory::Arena>(allocator, block_size, allocator);
+
+		Document_Parser parser{};
+		parser.walker.begin = content.ptr;
+		parser.walker.size = content.count;
+		parser.walker.index = index.ptr;
+		parser.walker.index_count = index.count;
+		parser.arena = self.arena;
+		parser.values = buf_with_allocator<Node>(memory::tmp());
+		parser.members = buf_with_allocator<Node_Member>(memory::tmp());
+
+		if (_document_parser_value(parser, self.root))
+			_json_walker_finish(parser.walker);
+
+		if (parser.walker.err)
+		{
+			document_free(self);
+			return parser.walker.err;
+		}
+		return self;
+	}
+
+	Err
+	node_parse_lines(const Str& content, memory::Arena* arena, Buf<Node>& values, Buf<size_t>& offsets)
+	{
+		auto index = buf_new<uint32_t>();
+		mn_defer{buf_free(index);};
+		if (auto err = _json_structural_index(content.ptr, content.count, index))
+			return err;
+
+		Document_Parser parser{};
+		parser.walker.begin = content.ptr;
+		parser.walker.size = content.count;
+		parser.walker.index = index.ptr;
+		parser.walker.index_count = index.count;
+		parser.arena = arena;
+		parser.values = buf_with_allocator<Node>(memory::tmp());
+		parser.members = buf_with_allocator<Node_Member>(memory::tmp());
+
+		while (_json_walker_done(parser.walker) == false)
+		{
+			auto offset = _json_walker_position(parser.walker);
+			Node node{};
+			if (_document_parser_value(parser, node) == false)
+				return parser.walker.err;
+			buf_push(values, node);
+			buf_push(offsets, offset);
+		}
+		return Err{};
+	}
+
+	void
+	document_free(Document& self)
+	{
+		if (self.arena)
+			free_destruct_from(self.allocator, self.arena);
+		self.arena = nullptr;
+		self.root = Node{};
+	}
+
+	const Node*
+	node_object_lookup(const Node& self, const Str& key)
+	{
+		mn_assert(self.kind == Node::KIND_OBJECT);
+		auto object = self.as_object;
+		if (object->index)
+		{
+			auto mask = object->index_capacity - 1;
+			auto slot = Hash<Str>{}(key) & mask;
+			while (auto entry = object->index[slot])
+			{
+				const auto& member = object->members[entry - 1];
+				if (member.key == key)
+					return &member.value;
+				slot = (slot + 1) & mask;
+			}
+			return nullptr;
+		}
+
+		for (size_t i = self.count; i > 0; --i)
+		{
+			const auto& member = object->members[i - 1];
+			if (member.key == key)
+				return &member.value;
+		}
+		return nullptr;
+	}
+
+	Json_Reader
+	json_reader_new(Reader reader, Allocator allocator)
+	{
+		auto self = alloc_construct_from<IJson_Reader>(allocator);
+		self->allocator = allocator;
+		self->reader = reader;
+		self->buffer = str_with_allocator(allocator);
+		self->containers = buf_with_allocator<char>(allocator);
+		self->expect = JSON_READER_EXPECT_ROOT;
+		self->last_kind = Json_Event::KIND_END;
+		self->scratch = str_with_allocator(allocator);
+		return self;
+	}
+
+	Json_Reader
+	json_reader_new(Stream stream, Allocator allocator)
+	{
+		auto self = json_reader_new(Reader{}, allocator);
+		self->stream = stream;
+		return self;
+	}
+
+	Json_Reader
+	json_reader_new(const Str& content, Allocator allocator)
+	{
+		auto self = json_reader_new(Reader{}, allocator);
+		str_free(self->buffer);
+		self->buffer = content;
+		self->eof = true;
+		self->is_view = true;
+		return self;
+	}
+
+	void
+	json_reader_free(Json_Reader self)
+	{
+		if (self->is_view == false)
+			str_free(self->buffer);
+		buf_free(self->containers);
+		str_free(self->scratch);
+		free_destruct_from(self->allocator, self);
+	}
+
+	Err
+	json_reader_next(Json_Reader self, Json_Event& event)
+	{
+		if (self->err)
+			return self->err;
+
+		if (auto err = _json_reader_next(self, event))
+			return err;
+		self->last_kind = event.kind;
+		return Err{};
+	}
+
+	Err
+	json_reader_skip(Json_Reader self)
+	{
+		if (self->err)
+			return self->err;
+
+		switch (self->last_kind)
+		{
+		case Json_Event::KIND_BEGIN_OBJECT:
+			self->last_kind = Json_Event::KIND_END_OBJECT;
+			return _json_reader_skip_container(self);
+		case Json_Event::KIND_BEGIN_ARRAY:
+			self->last_kind = Json_Event::KIND_END_ARRAY;
+			return _json_reader_skip_container(self);
+		case Json_Event::KIND_KEY:
+		{
+			Json_Event event{};
+			if (auto err = json_reader_next(self, event))
+				return err;
+			if (event.kind == Json_Event::KIND_BEGIN_OBJECT || event.kind == Json_Event::KIND_BEGIN_ARRAY)
+				return json_reader_skip(self);
+			return Err{};
+		}
+		default:
+			return Err{};
+		}
+	}
+
+	Json_Writer
+	json_writer_new(Str* out, Allocator allocator)
+	{
+		auto self = alloc_zerod_from<IJson_Writer>(allocator);
+		self->allocator = allocator;
+		self->out = out;
+		self->buffer = str_with_allocator(allocator);
+		self->containers = buf_with_allocator<char>(allocator);
+		self->first = true;
+		return self;
+	}
+
+	Json_Writer
+	json_writer_new(Stream stream, Allocator allocator)
+	{
+		auto self = json_writer_new((Str*)nullptr, allocator);
+		self->out = &self->buffer;
+		self->stream = stream;
+		return self;
+	}
+
+	void
+	json_writer_free(Json_Writer self)
+	{
+		json_writer_flush(self);
+		str_free(self->buffer);
+		buf_free(self->containers);
+		free_from(self->allocator, self);
+	}
+
+	void
+	json_writer_flush(Json_Writer self)
+	{
+		if (self->stream == nullptr || self->buffer.count == 0)
+			return;
+		stream_write(self->stream, Block{self->buffer.ptr, self->buffer.count});
+		str_clear(self->buffer);
+	}
+
+	void
+	json_writer_begin_object(Json_Writer self)
+	{
+		_json_writer_begin(self, '{');
+	}
+
+	void
+	json_writer_end_object(Json_Writer self)
+	{
+		_json_writer_end(self, '{', '}');
+	}
+
+	void
+	json_writer_begin_array(Json_Writer self)
+	{
+		_json_writer_begin(self, '[');
+	}
+
+	void
+	json_writer_end_array(Json_Writer self)
+	{
+		_json_writer_end(self, '[', ']');
+	}
+
+	// writes an object key, the keys of json::Value are already escaped (just like its strings) so they're written as is
+	inline static void
+	_json_writer_key(IJson_Writer* self, const Str& key, bool escape)
+	{
+		mn_assert_msg(self->containers.count > 0 && buf_top(self->containers) == '{', "json keys are only allowed inside objects");
+		mn_assert_msg(self->after_key == false, "json object key without a value");
+		if (self->first == false)
+			_json_writer_push(self, ',');
+		self->first = false;
+		if (escape)
+		{
+			_json_writer_escaped_string(self, key);
+		}
+		else
+		{
+			_json_writer_push(self, '"');
+			_json_writer_push(self, key.ptr, key.count);
+			_json_writer_push(self, '"');
+		}
+		_json_writer_push(self, ':');
+		self->after_key = true;
+	}
+
+	void
+	json_writer_key(Json_Writer self, const Str& key)
+	{
+		_json_writer_key(self, key, true);
+	}
+
+	void
+	json_writer_null(Json_Writer self)
+	{
+		_json_writer_before_value(self);
+		_json_writer_push(self, "null", 4);
+		_json_writer_maybe_flush(self);
+	}
+
+	void
+	json_writer_bool(Json_Writer self, bool value)
+	{
+		_json_writer_before_value(self);
+		if (value)
+			_json_writer_push(self, "true", 4);
+		else
+			_json_writer_push(self, "false", 5);
+		_json_writer_maybe_flush(self);
+	}
+
+	void
+	json_writer_int(Json_Writer self, int64_t value)
+	{
+		_json_writer_before_value(self);
+		_json_writer_int(self, value);
+		_json_writer_maybe_flush(self);
+	}
+
+	void
+	json_writer_double(Json_Writer self, double value)
+	{
+		_json_writer_before_value(self);
+		_json_writer_double(self, value);
+		_json_writer_maybe_flush(self);
+	}
+
+	void
+	json_writer_string(Json_Writer self, const Str& value)
+	{
+		_json_writer_before_value(self);
+		_json_writer_escaped_string(self, value);
+		_json_writer_maybe_flush(self);
+	}
+
+	void
+	json_writer_value(Json_Writer self, const Value& value)
+	{
+		if (_json_writer_value_scalar(self, value))
+			return;
+
+		auto stack = buf_with_allocator<Json_Writer_Value_Frame>(memory::tmp());
+		buf_push(stack, Json_Writer_Value_Frame{&value, 0});
+		while (stack.count > 0)
+		{
+			auto& frame = buf_top(stack);
+			const Value* next = nullptr;
+			if (frame.value->kind == Value::KIND_ARRAY)
+			{
+				if (frame.index < frame.value->as_array->count)
+					next = &(*frame.value->as_array)[frame.index];
+				else
+					json_writer_end_array(self);
+			}
+			else
+			{
+				auto entries = map_begin(*frame.value->as_object);
+				if (frame.index < frame.value->as_object->count)
+				{
+					_json_writer_key(self, entries[frame.index].key, false);
+					next = &entries[frame.index].value;
+				}
+				else
+				{
+					json_writer_end_object(self);
+				}
+			}
+
+			if (next == nullptr)
+			{
+				buf_pop(stack);
+				continue;
+			}
+
+			++frame.index;
+			if (_json_writer_value_scalar(self, *next) == false)
+				buf_push(stack, Json_Writer_Value_Frame{next, 0});
+		}
+	}
+
+	void
+	json_writer_node(Json_Writer self, const Node& node)
+	{
+		if (_json_writer_node_scalar(self, node))
+			return;
+
+		auto stack = buf_with_allocator<Json_Writer_Node_Frame>(memory::tmp());
+		buf_push(stack, Json_Writer_Node_Frame{&node, 0});
+		while (stack.count > 0)
+		{
+			auto& frame = buf_top(stack);
+			const Node* next = nullptr;
+			if (frame.index < frame.node->count)
+			{
+				if (frame.node->kind == Node::KIND_ARRAY)
+				{
+					next = &frame.node->as_array[frame.index];
+				}
+				else
+				{
+					const auto& member = frame.node->as_object->members[frame.index];
+					json_writer_key(self, member.key);
+					next = &member.value;
+				}
+			}
+			else
+			{
+				if (frame.node->kind == Node::KIND_ARRAY)
+					json_writer_end_array(self);
+				else
+					json_writer_end_object(self);
+				buf_pop(stack);
+				continue;
+			}
+
+			++frame.index;
+			if (_json_writer_node_scalar(self, *next) == false)
+				buf_push(stack, Json_Writer_Node_Frame{next, 0});
+		}
 	}
-}
\ No newline at end of file
+}
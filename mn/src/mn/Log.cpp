@@ -0,0 +1,529 @@
+#include "mn/Log.h"
+#include "mn/Thread.h"
+#include "mn/Memory.h"
+#include "mn/Buf.h"
+#include "mn/File.h"
+#include "mn/Str.h"
+#include "mn/Thread_State.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if OS_WINDOWS
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <signal.h>
+#endif
+
+namespace mn
+{
+	constexpr size_t LOG_ASYNC_DEFAULT_RING_SIZE = 64 * 1024;
+	constexpr uint32_t LOG_ASYNC_DEFAULT_FLUSH_INTERVAL_IN_MS = 10;
+	// the formatted messages are written once the batch reaches this size
+	constexpr size_t LOG_ASYNC_BATCH_SIZE = 64 * 1024;
+	// the time the crash handler waits for the thread which is writing the messages before it gives up
+	constexpr int LOG_ASYNC_CRASH_WAIT_IN_MS = 100;
+	// the crash handler formats the messages into buffers which are allocated up front, messages which don't fit in
+	// this size still allocate
+	constexpr size_t LOG_ASYNC_CRASH_MESSAGE_SIZE = 4 * 1024;
+
+	struct Log_Levels
+	{
+		// protects the categories list, checking the levels doesn't touch it
+		std::mutex mtx;
+		std::atomic<uint8_t> global;
+		Buf<Log_Category*> categories;
+	};
+
+	static Log_Levels LOG_LEVELS;
+
+	struct Log_Async_Record
+	{
+		// the size of the record including its arguments, it's a multiple of the record alignment
+		uint32_t size;
+		LOG_LEVEL level;
+		const char* fmt;
+		// it's null for the padding records which fill the end of the ring buffer
+		_Log_Async_Format format;
+	};
+
+	struct Log_Async_Ring
+	{
+		// the number of bytes which were ever written to the ring buffer, only the owning thread writes it
+		std::atomic<uint64_t> head;
+		// the number of bytes which were ever consumed, it's only written while the async logger mutex is held
+		std::atomic<uint64_t> tail;
+		char* data;
+		size_t capacity;
+		// the ring buffers of the exited threads are reused once they're empty
+		bool alive;
+	};
+
+	struct Log_Async
+	{
+		// its mutex protects the ring buffers list, it's also held while the messages are written so only one thread
+		// consumes the ring buffers at a time
+		Thread_State_Registry<Log_Async_Ring> rings;
+		std::condition_variable cv;
+		std::atomic<bool> running;
+		std::atomic<bool> wake_requested;
+		std::atomic<uint64_t> dropped_count;
+		bool stop_requested;
+		bool initialized;
+		Log_Async_Settings settings;
+		Thread thread;
+		// the buffers which the crash handler uses, so it doesn't allocate while the program is crashing, they're
+		// created with the crash handlers and live as long as them
+		fmt::memory_buffer* crash_batch;
+		fmt::memory_buffer* crash_msg;
+	};
+
+	inline static Log_Async*
+	_log_async()
+	{
+		static Log_Async self{};
+		return &self;
+	}
+
+	// the thread which writes the messages logs synchronously, so the log hooks can log too
+	thread_local bool _log_async_writing;
+
+	// returns the ring buffer of the calling thread, or nullptr if the thread is exiting
+	inline static Log_Async_Ring*
+	_log_async_ring_get(Log_Async* self)
+	{
+		return thread_state_get(self->rings,
+			[](Log_Async_Ring* ring) {
+				return ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_relaxed);
+			},
+			[self] {
+				auto ring = alloc_zerod_from<Log_Async_Ring>(memory::clib());
+				ring->capacity = self->settings.ring_size;
+				ring->data = (char*)alloc_from(memory::clib(), ring->capacity, alignof(Log_Async_Record)).ptr;
+				return ring;
+			}
+		);
+	}
+
+	inline static void
+	_log_async_wake(Log_Async* self)
+	{
+		if (self->wake_requested.exchange(true) == false)
+			self->cv.notify_one();
+	}
+
+	inline static void
+	_log_async_batch_write(fmt::memory_buffer& batch)
+	{
+		if (batch.size() == 0)
+			return;
+		stream_write(file_stderr(), Block{batch.data(), batch.size()});
+		batch.clear();
+	}
+
+	inline static void
+	_log_async_message_write(const Log_Interface& hooks, LOG_LEVEL level, fmt::memory_buffer& msg, fmt::memory_buffer& batch)
+	{
+		void (*hook)(void*, const char*) = nullptr;
+		const char* prefix = "";
+		switch (level)
+		{
+		case LOG_LEVEL_DEBUG:
+			hook = hooks.debug;
+			prefix = "[debug]: ";
+			break;
+		case LOG_LEVEL_INFO:
+			hook = hooks.info;
+			prefix = "[info]: ";
+			break;
+		case LOG_LEVEL_WARNING:
+			hook = hooks.warning;
+			prefix = "[warning]: ";
+			break;
+		case LOG_LEVEL_ERROR:
+			hook = hooks.error;
+			prefix = "[error]: ";
+			break;
+		case LOG_LEVEL_CRITICAL:
+			hook = hooks.critical;
+			prefix = "[critical]: ";
+			break;
+		default:
+			break;
+		}
+
+		if (hook)
+		{
+			msg.push_back('\0');
+			hook(hooks.self, msg.data());
+			return;
+		}
+
+		batch.append(prefix, prefix + ::strlen(prefix));
+		batch.append(msg.data(), msg.data() + msg.size());
+		batch.push_back('\n');
+		if (batch.size() >= LOG_ASYNC_BATCH_SIZE)
+			_log_async_batch_write(batch);
+	}
+
+	// formats and writes the messages of all the ring buffers, the async logger mutex must be held
+	inline static void
+	_log_async_drain(Log_Async* self, fmt::memory_buffer& batch, fmt::memory_buffer& msg)
+	{
+		_log_async_writing = true;
+		auto hooks = _log_interface();
+		for (auto ring: self->rings.states)
+		{
+			auto tail = ring->tail.load(std::memory_order_relaxed);
+			auto head = ring->head.load(std::memory_order_acquire);
+			while (tail < head)
+			{
+				auto offset = tail & (ring->capacity - 1);
+				auto remaining = ring->capacity - offset;
+				// the end of the ring buffer which can't fit a record header is skipped without a padding record
+				if (remaining < sizeof(Log_Async_Record))
+				{
+					tail += remaining;
+					continue;
+				}
+
+				Log_Async_Record record{};
+				::memcpy(&record, ring->data + offset, sizeof(record));
+				if (record.format)
+				{
+					msg.clear();
+					try
+					{
+						record.format(record.fmt, ring->data + offset + sizeof(record), msg);
+					}
+					catch (const fmt::format_error& e)
+					{
+						// the format string is only checked here, a bad one replaces its own message and the rest
+						// of the messages are still written
+						msg.clear();
+						fmt::format_to(std::back_inserter(msg), "[format error: {}]", e.what());
+					}
+					_log_async_message_write(hooks, record.level, msg, batch);
+				}
+				tail += record.size;
+			}
+			ring->tail.store(tail, std::memory_order_release);
+		}
+		_log_async_batch_write(batch);
+		_log_async_writing = false;
+	}
+
+	static void
+	_log_async_main(void* arg)
+	{
+		_disable_profiling_for_this_thread();
+
+		auto self = (Log_Async*)arg;
+		fmt::memory_buffer batch;
+		fmt::memory_buffer msg;
+		std::unique_lock<std::mutex> lock(self->rings.mtx);
+		while (true)
+		{
+			self->cv.wait_for(lock, std::chrono::milliseconds(self->settings.flush_interval_in_ms), [self] {
+				return self->wake_requested.load() || self->stop_requested;
+			});
+			self->wake_requested.store(false);
+			_log_async_drain(self, batch, msg);
+			if (self->stop_requested)
+				break;
+		}
+	}
+
+	// writes the pending messages when the program crashes, it waits a little for the thread which is writing the
+	// messages and gives up if it doesn't finish, reading the ring buffers while it's consuming them would write
+	// the messages twice or read torn records
+	static void
+	_log_async_crash_flush()
+	{
+		auto self = _log_async();
+		if (_log_async_writing || self->initialized == false)
+			return;
+
+		bool locked = false;
+		for (int i = 0; i < LOG_ASYNC_CRASH_WAIT_IN_MS && locked == false; ++i)
+		{
+			locked = self->rings.mtx.try_lock();
+			if (locked == false)
+				thread_sleep(1);
+		}
+		if (locked == false)
+			return;
+
+		self->crash_batch->clear();
+		self->crash_msg->clear();
+		_log_async_drain(self, *self->crash_batch, *self->crash_msg);
+		self->rings.mtx.unlock();
+	}
+
+	#if OS_WINDOWS
+	static LPTOP_LEVEL_EXCEPTION_FILTER LOG_ASYNC_PREVIOUS_EXCEPTION_FILTER;
+
+	static LONG WINAPI
+	_log_async_exception_filter(EXCEPTION_POINTERS* info)
+	{
+		_log_async_crash_flush();
+		if (LOG_ASYNC_PREVIOUS_EXCEPTION_FILTER)
+			return LOG_ASYNC_PREVIOUS_EXCEPTION_FILTER(info);
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	inline static void
+	_log_async_crash_handlers_install()
+	{
+		LOG_ASYNC_PREVIOUS_EXCEPTION_FILTER = SetUnhandledExceptionFilter(_log_async_exception_filter);
+	}
+	#else
+	constexpr int LOG_ASYNC_CRASH_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+	constexpr size_t LOG_ASYNC_CRASH_SIGNALS_COUNT = sizeof(LOG_ASYNC_CRASH_SIGNALS) / sizeof(*LOG_ASYNC_CRASH_SIGNALS);
+	static struct sigaction LOG_ASYNC_PREVIOUS_ACTIONS[LOG_ASYNC_CRASH_SIGNALS_COUNT];
+
+	static void
+	_log_async_signal_handler(int sig)
+	{
+		_log_async_crash_flush();
+
+		// the previous handler runs when the signal is raised again after this handler returns
+		for (size_t i = 0; i < LOG_ASYNC_CRASH_SIGNALS_COUNT; ++i)
+			if (LOG_ASYNC_CRASH_SIGNALS[i] == sig)
+				::sigaction(sig, &LOG_ASYNC_PREVIOUS_ACTIONS[i], nullptr);
+		::raise(sig);
+	}
+
+	inline static void
+	_log_async_crash_handlers_install()
+	{
+		struct sigaction action{};
+		action.sa_handler = _log_async_signal_handler;
+		sigemptyset(&action.sa_mask);
+		for (size_t i = 0; i < LOG_ASYNC_CRASH_SIGNALS_COUNT; ++i)
+			::sigaction(LOG_ASYNC_CRASH_SIGNALS[i], &action, &LOG_ASYNC_PREVIOUS_ACTIONS[i]);
+	}
+	#endif
+
+	static void
+	_log_async_exit()
+	{
+		log_async_stop();
+		log_async_flush();
+	}
+
+	// API
+	void
+	log_level_set(LOG_LEVEL level)
+	{
+		LOG_LEVELS.global.store(level, std::memory_order_relaxed);
+	}
+
+	LOG_LEVEL
+	log_level()
+	{
+		return LOG_LEVEL(LOG_LEVELS.global.load(std::memory_order_relaxed));
+	}
+
+	Log_Category*
+	log_category(const char* name)
+	{
+		auto self = &LOG_LEVELS;
+		std::lock_guard<std::mutex> lock(self->mtx);
+		for (auto category: self->categories)
+			if (::strcmp(category->name, name) == 0)
+				return category;
+
+		if (self->categories.allocator == nullptr)
+			self->categories = buf_with_allocator<Log_Category*>(memory::clib());
+		auto category = alloc_zerod_from<Log_Category>(memory::clib());
+		category->name = str_from_c(name, memory::clib()).ptr;
+		category->level.store(LOG_CATEGORY_LEVEL_GLOBAL, std::memory_order_relaxed);
+		buf_push(self->categories, category);
+		return category;
+	}
+
+	void
+	log_category_level_set(Log_Category* category, LOG_LEVEL level)
+	{
+		category->level.store(level, std::memory_order_relaxed);
+	}
+
+	void
+	log_category_level_reset(Log_Category* category)
+	{
+		category->level.store(LOG_CATEGORY_LEVEL_GLOBAL, std::memory_order_relaxed);
+	}
+
+	bool
+	log_level_enabled(LOG_LEVEL level, const Log_Category* category)
+	{
+		if (level == LOG_LEVEL_CRITICAL)
+			return true;
+
+		auto min_level = LOG_CATEGORY_LEVEL_GLOBAL;
+		if (category)
+			min_level = category->level.load(std::memory_order_relaxed);
+		if (min_level == LOG_CATEGORY_LEVEL_GLOBAL)
+			min_level = LOG_LEVELS.global.load(std::memory_order_relaxed);
+		return level >= min_level;
+	}
+
+	void
+	log_async_start(const Log_Async_Settings& settings)
+	{
+		auto self = _log_async();
+		std::lock_guard<std::mutex> lock(self->rings.mtx);
+		if (self->running)
+			return;
+
+		self->settings = settings;
+		if (self->settings.ring_size == 0)
+			self->settings.ring_size = LOG_ASYNC_DEFAULT_RING_SIZE;
+		if (self->settings.flush_interval_in_ms == 0)
+			self->settings.flush_interval_in_ms = LOG_ASYNC_DEFAULT_FLUSH_INTERVAL_IN_MS;
+		size_t ring_size = 256;
+		while (ring_size < self->settings.ring_size)
+			ring_size <<= 1;
+		self->settings.ring_size = ring_size;
+
+		if (self->initialized == false)
+		{
+			self->crash_batch = alloc_construct_from<fmt::memory_buffer>(memory::clib());
+			self->crash_batch->reserve(LOG_ASYNC_BATCH_SIZE + LOG_ASYNC_CRASH_MESSAGE_SIZE);
+			self->crash_msg = alloc_construct_from<fmt::memory_buffer>(memory::clib());
+			self->crash_msg->reserve(LOG_ASYNC_CRASH_MESSAGE_SIZE);
+			_log_async_crash_handlers_install();
+			::atexit(_log_async_exit);
+			self->initialized = true;
+		}
+
+		self->stop_requested = false;
+		self->thread = thread_new(_log_async_main, self, "log async thread");
+		self->running = true;
+	}
+
+	void
+	log_async_stop()
+	{
+		auto self = _log_async();
+		Thread thread = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(self->rings.mtx);
+			if (self->running == false)
+				return;
+			self->running = false;
+			self->stop_requested = true;
+			thread = self->thread;
+			self->thread = nullptr;
+		}
+		self->cv.notify_one();
+		thread_join(thread);
+		thread_free(thread);
+
+		// the messages which were pushed while the thread was stopping
+		log_async_flush();
+	}
+
+	void
+	log_async_flush()
+	{
+		if (_log_async_writing)
+			return;
+
+		auto self = _log_async();
+		std::lock_guard<std::mutex> lock(self->rings.mtx);
+		if (self->initialized == false)
+			return;
+		fmt::memory_buffer batch;
+		fmt::memory_buffer msg;
+		_log_async_drain(self, batch, msg);
+	}
+
+	uint64_t
+	log_async_dropped_count()
+	{
+		return _log_async()->dropped_count.load(std::memory_order_relaxed);
+	}
+
+	bool
+	_log_async_enabled()
+	{
+		return _log_async()->running.load(std::memory_order_relaxed);
+	}
+
+	bool
+	_log_async_push(LOG_LEVEL level, const char* fmt, _Log_Async_Format format, const void* args, size_t args_size)
+	{
+		if (_log_async_writing)
+			return false;
+
+		auto self = _log_async();
+		auto ring = _log_async_ring_get(self);
+		if (ring == nullptr)
+			return false;
+
+		constexpr size_t alignment = alignof(Log_Async_Record);
+		auto size = (sizeof(Log_Async_Record) + args_size + alignment - 1) & ~(alignment - 1);
+		// big messages are logged synchronously so they don't starve the other messages
+		if (size > ring->capacity / 2)
+			return false;
+
+		auto head = ring->head.load(std::memory_order_relaxed);
+		auto offset = head & (ring->capacity - 1);
+		auto remaining = ring->capacity - offset;
+		// the record must be contiguous so it skips the end of the ring buffer if it doesn't fit there
+		size_t skip = remaining < size ? remaining : 0;
+		uint64_t tail = 0;
+		while (true)
+		{
+			tail = ring->tail.load(std::memory_order_acquire);
+			if (head + skip + size - tail <= ring->capacity)
+				break;
+
+			if (self->settings.full_policy == LOG_ASYNC_FULL_POLICY_DROP)
+			{
+				self->dropped_count.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+
+			if (self->running.load(std::memory_order_relaxed) == false)
+				return false;
+			_log_async_wake(self);
+			thread_sleep(1);
+		}
+
+		if (skip > 0)
+		{
+			if (skip >= sizeof(Log_Async_Record))
+			{
+				Log_Async_Record padding{};
+				padding.size = uint32_t(skip);
+				::memcpy(ring->data + offset, &padding, sizeof(padding));
+			}
+			offset = 0;
+		}
+
+		Log_Async_Record record{};
+		record.size = uint32_t(size);
+		record.level = level;
+		record.fmt = fmt;
+		record.format = format;
+		::memcpy(ring->data + offset, &record, sizeof(record));
+		if (args_size > 0)
+			::memcpy(ring->data + offset + sizeof(record), args, args_size);
+		ring->head.store(head + skip + size, std::memory_order_release);
+
+		// the thread which writes the messages is woken up early when the ring buffer is half full
+		if ((head + skip + size - tail) * 2 >= ring->capacity)
+			_log_async_wake(self);
+		return true;
+	}
+}
@@ -0,0 +1,380 @@
+#include "mn/Thread.h"
+#include "mn/Fabric.h"
+#include "mn/Buf.h"
+#include "mn/Map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#if ARCH_X86
+#include <emmintrin.h>
+#endif
+
+namespace mn
+{
+	// the number of spins a contended mutex does when it has no history
+	constexpr uint32_t MUTEX_SPIN_MIN = 16;
+	// the maximum number of spins a contended mutex does before it parks the thread
+	constexpr uint32_t MUTEX_SPIN_MAX = 100;
+	// the maximum number of pause instructions between two spins
+	constexpr uint32_t MUTEX_SPIN_BACKOFF_MAX = 8;
+	// the maximum number of reader slots of a distributed read-write mutex
+	constexpr size_t MUTEX_RW_MAX_SLOTS = 64;
+	constexpr size_t MUTEX_RW_CACHE_LINE = 64;
+	// the maximum number of distributed read-write mutexes which a thread can hold in read mode at once and still lock
+	// them recursively while a writer waits
+	constexpr size_t MUTEX_RW_MAX_HELD = 8;
+
+	struct Mutex_Location_Entry
+	{
+		size_t mutexes_count;
+		// the accumulated statistics of the freed mutexes
+		Mutex_Stats freed;
+		Buf<_Mutex_Contention*> live;
+	};
+
+	struct Mutex_Stats_Registry
+	{
+		std::mutex mtx;
+		bool initialized;
+		Map<const Source_Location*, Mutex_Location_Entry> locations;
+	};
+
+	static Mutex_Stats_Registry MUTEX_STATS_REGISTRY;
+
+	// Distributed read-write mutex
+	// readers increment the reader count of their slot then check the writer flag, a writer sets the flag then waits
+	// for the reader counts of all the slots to drop to zero, both sides use sequentially consistent operations so
+	// at least one of them sees the other, a reader which finds the flag set backs off and takes the slow path which
+	// parks the thread in a regular read-write mutex that the writer holds in write mode until it's done, the slot
+	// is incremented while holding the slow path read lock so that the next writer waits for it as well
+	struct alignas(MUTEX_RW_CACHE_LINE) Mutex_RW_Reader_Slot
+	{
+		std::atomic<uint32_t> readers;
+	};
+
+	struct _Mutex_RW_Distributed
+	{
+		// read by every reader, it only changes when a writer comes in
+		std::atomic<bool> writer;
+		// allocated from the clib allocator because it respects the cache line alignment
+		Mutex_RW_Reader_Slot* slots;
+		size_t slots_mask;
+		// serializes the writers and parks the readers which come in while a writer holds the lock
+		std::shared_mutex mtx;
+	};
+
+	// threads are assigned reader slots in round robin order, the same slot index is used for all the mutexes
+	static std::atomic<uint32_t> MUTEX_RW_NEXT_SLOT;
+	// the reader slot of the calling thread plus one, zero means that the thread doesn't have a slot yet
+	thread_local uint32_t _mutex_rw_thread_slot;
+
+	struct Mutex_RW_Held_Read
+	{
+		_Mutex_RW_Distributed* mtx;
+		uint32_t count;
+	};
+
+	// the distributed mutexes which the calling thread holds in read mode, a recursive read lock must not back off for
+	// a writer because the writer waits for the outer read lock to be released
+	thread_local Mutex_RW_Held_Read _mutex_rw_thread_held[MUTEX_RW_MAX_HELD];
+
+	inline static Mutex_RW_Held_Read*
+	_mutex_rw_distributed_held(_Mutex_RW_Distributed* self)
+	{
+		for (auto& held: _mutex_rw_thread_held)
+			if (held.mtx == self)
+				return &held;
+		return nullptr;
+	}
+
+	inline static Mutex_RW_Reader_Slot&
+	_mutex_rw_distributed_slot(_Mutex_RW_Distributed* self)
+	{
+		auto slot = _mutex_rw_thread_slot;
+		if (slot == 0)
+		{
+			slot = MUTEX_RW_NEXT_SLOT.fetch_add(1, std::memory_order_relaxed) % MUTEX_RW_MAX_SLOTS + 1;
+			_mutex_rw_thread_slot = slot;
+		}
+		return self->slots[(slot - 1) & self->slots_mask];
+	}
+
+	inline static void
+	_mutex_cpu_relax()
+	{
+		#if ARCH_X86
+		_mm_pause();
+		#elif ARCH_ARM && (MN_COMPILER_GNU || MN_COMPILER_CLANG)
+		__asm__ __volatile__("yield");
+		#endif
+	}
+
+	inline static Mutex_Stats
+	_mutex_contention_load(const _Mutex_Contention& self)
+	{
+		Mutex_Stats res{};
+		res.acquisitions = self.acquisitions.load(std::memory_order_relaxed);
+		res.contended_acquisitions = self.contended_acquisitions.load(std::memory_order_relaxed);
+		res.spin_acquisitions = self.spin_acquisitions.load(std::memory_order_relaxed);
+		res.wait_time_ns = self.wait_time_ns.load(std::memory_order_relaxed);
+		return res;
+	}
+
+	inline static void
+	_mutex_stats_add(Mutex_Stats& self, const Mutex_Stats& other)
+	{
+		self.acquisitions += other.acquisitions;
+		self.contended_acquisitions += other.contended_acquisitions;
+		self.spin_acquisitions += other.spin_acquisitions;
+		self.wait_time_ns += other.wait_time_ns;
+	}
+
+	// API
+	void
+	_mutex_contention_lock(_Mutex_Contention& self, bool (*try_lock)(void*), void (*lock)(void*), void* mutex)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		auto estimate = self.spin_estimate.load(std::memory_order_relaxed);
+		auto spin_limit = std::min(MUTEX_SPIN_MIN + estimate * 2, MUTEX_SPIN_MAX);
+
+		bool spin_acquired = false;
+		uint32_t spins = 0;
+		uint32_t backoff = 1;
+		while (spins < spin_limit)
+		{
+			for (uint32_t i = 0; i < backoff; ++i)
+				_mutex_cpu_relax();
+			if (backoff < MUTEX_SPIN_BACKOFF_MAX)
+				backoff *= 2;
+
+			++spins;
+			if (try_lock(mutex))
+			{
+				spin_acquired = true;
+				break;
+			}
+		}
+
+		if (spin_acquired == false)
+		{
+			worker_block_ahead();
+			lock(mutex);
+			worker_block_clear();
+		}
+
+		// the mutex is held from here on so the counters have a single writer
+		auto wait_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		// successful spins move the estimate towards the spins it took, parking halves it so mutexes which are held for
+		// long stop spinning
+		if (spin_acquired)
+			estimate = estimate + spins / 8 - estimate / 8;
+		else
+			estimate = estimate / 2;
+		self.spin_estimate.store(estimate, std::memory_order_relaxed);
+
+		self.acquisitions.store(self.acquisitions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		self.contended_acquisitions.store(self.contended_acquisitions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (spin_acquired)
+			self.spin_acquisitions.store(self.spin_acquisitions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		self.wait_time_ns.store(self.wait_time_ns.load(std::memory_order_relaxed) + uint64_t(wait_time), std::memory_order_relaxed);
+	}
+
+	void
+	_mutex_contention_init(_Mutex_Contention& self, const Source_Location* srcloc)
+	{
+		self.acquisitions.store(0, std::memory_order_relaxed);
+		self.contended_acquisitions.store(0, std::memory_order_relaxed);
+		self.spin_acquisitions.store(0, std::memory_order_relaxed);
+		self.wait_time_ns.store(0, std::memory_order_relaxed);
+		self.spin_estimate.store(0, std::memory_order_relaxed);
+
+		if (srcloc == nullptr)
+			return;
+
+		auto registry = &MUTEX_STATS_REGISTRY;
+		std::lock_guard<std::mutex> lock(registry->mtx);
+		if (registry->initialized == false)
+		{
+			registry->locations = map_with_allocator<const Source_Location*, Mutex_Location_Entry>(memory::clib());
+			registry->initialized = true;
+		}
+
+		auto it = map_lookup(registry->locations, srcloc);
+		if (it == nullptr)
+		{
+			Mutex_Location_Entry entry{};
+			entry.live = buf_with_allocator<_Mutex_Contention*>(memory::clib());
+			it = map_insert(registry->locations, srcloc, entry);
+		}
+		++it->value.mutexes_count;
+		buf_push(it->value.live, &self);
+	}
+
+	void
+	_mutex_contention_dispose(_Mutex_Contention& self, const Source_Location* srcloc)
+	{
+		if (srcloc == nullptr)
+			return;
+
+		auto registry = &MUTEX_STATS_REGISTRY;
+		std::lock_guard<std::mutex> lock(registry->mtx);
+		auto it = map_lookup(registry->locations, srcloc);
+		if (it == nullptr)
+			return;
+
+		auto& entry = it->value;
+		for (size_t i = 0; i < entry.live.count; ++i)
+		{
+			if (entry.live[i] == &self)
+			{
+				_mutex_stats_add(entry.freed, _mutex_contention_load(self));
+				buf_remove(entry.live, i);
+				break;
+			}
+		}
+	}
+
+	Mutex_Stats
+	_mutex_contention_stats(const _Mutex_Contention& self)
+	{
+		return _mutex_contention_load(self);
+	}
+
+	_Mutex_RW_Distributed*
+	_mutex_rw_distributed_new()
+	{
+		size_t slots_count = 1;
+		size_t cores_count = std::thread::hardware_concurrency();
+		while (slots_count < cores_count && slots_count < MUTEX_RW_MAX_SLOTS)
+			slots_count *= 2;
+
+		auto self = alloc_construct<_Mutex_RW_Distributed>();
+		self->writer.store(false, std::memory_order_relaxed);
+		self->slots = (Mutex_RW_Reader_Slot*)alloc_from(memory::clib(), slots_count * sizeof(Mutex_RW_Reader_Slot), alignof(Mutex_RW_Reader_Slot)).ptr;
+		for (size_t i = 0; i < slots_count; ++i)
+			self->slots[i].readers.store(0, std::memory_order_relaxed);
+		self->slots_mask = slots_count - 1;
+		return self;
+	}
+
+	void
+	_mutex_rw_distributed_free(_Mutex_RW_Distributed* self)
+	{
+		free_from(memory::clib(), Block{self->slots, (self->slots_mask + 1) * sizeof(Mutex_RW_Reader_Slot)});
+		free_destruct(self);
+	}
+
+	void
+	_mutex_rw_distributed_read_lock(_Mutex_RW_Distributed* self)
+	{
+		auto& slot = _mutex_rw_distributed_slot(self);
+		if (auto held = _mutex_rw_distributed_held(self))
+		{
+			// the thread already holds the lock so no writer can get in until it's released
+			slot.readers.fetch_add(1, std::memory_order_relaxed);
+			++held->count;
+			return;
+		}
+
+		slot.readers.fetch_add(1, std::memory_order_seq_cst);
+		if (self->writer.load(std::memory_order_seq_cst))
+		{
+			// a writer is in, back off so it doesn't wait for us, then wait for it in the slow path
+			slot.readers.fetch_sub(1, std::memory_order_relaxed);
+			worker_block_ahead();
+			self->mtx.lock_shared();
+			worker_block_clear();
+			slot.readers.fetch_add(1, std::memory_order_seq_cst);
+			self->mtx.unlock_shared();
+		}
+
+		// the lock is recorded in the first free entry, a thread which holds too many mutexes doesn't record the rest
+		// so locking them recursively can deadlock with a waiting writer
+		if (auto held = _mutex_rw_distributed_held(nullptr))
+			*held = Mutex_RW_Held_Read{self, 1};
+	}
+
+	void
+	_mutex_rw_distributed_read_unlock(_Mutex_RW_Distributed* self)
+	{
+		if (auto held = _mutex_rw_distributed_held(self))
+		{
+			if (--held->count == 0)
+				held->mtx = nullptr;
+		}
+
+		auto& slot = _mutex_rw_distributed_slot(self);
+		slot.readers.fetch_sub(1, std::memory_order_release);
+	}
+
+	void
+	_mutex_rw_distributed_write_lock(_Mutex_RW_Distributed* self)
+	{
+		worker_block_ahead();
+		self->mtx.lock();
+		self->writer.store(true, std::memory_order_seq_cst);
+
+		for (size_t i = 0; i <= self->slots_mask; ++i)
+		{
+			uint32_t spins = 0;
+			while (self->slots[i].readers.load(std::memory_order_seq_cst) != 0)
+			{
+				if (spins < MUTEX_SPIN_MAX)
+				{
+					_mutex_cpu_relax();
+					++spins;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+		worker_block_clear();
+	}
+
+	void
+	_mutex_rw_distributed_write_unlock(_Mutex_RW_Distributed* self)
+	{
+		self->writer.store(false, std::memory_order_seq_cst);
+		self->mtx.unlock();
+	}
+
+	size_t
+	mutex_stats_by_location(Mutex_Location_Stats* stats, size_t stats_count)
+	{
+		auto res = buf_with_allocator<Mutex_Location_Stats>(memory::tmp());
+		{
+			auto registry = &MUTEX_STATS_REGISTRY;
+			std::lock_guard<std::mutex> lock(registry->mtx);
+			if (registry->initialized == false)
+				return 0;
+
+			buf_reserve(res, registry->locations.count);
+			for (const auto& [srcloc, entry]: registry->locations)
+			{
+				Mutex_Location_Stats location{};
+				location.srcloc = srcloc;
+				location.mutexes_count = entry.mutexes_count;
+				location.stats = entry.freed;
+				for (auto contention: entry.live)
+					_mutex_stats_add(location.stats, _mutex_contention_load(*contention));
+				buf_push(res, location);
+			}
+		}
+
+		std::stable_sort(begin(res), end(res), [](const Mutex_Location_Stats& a, const Mutex_Location_Stats& b) {
+			return a.stats.wait_time_ns > b.stats.wait_time_ns;
+		});
+
+		for (size_t i = 0; i < res.count && i < stats_count; ++i)
+			stats[i] = res[i];
+		return res.count;
+	}
+}
@@ -2,6 +2,11 @@
 #include "mn/Defer.h"
 #include "mn/Assert.h"
 
+#include "utf8proc/utf8proc.h"
+
+#include <algorithm>
+#include <mutex>
+
 namespace mn
 {
 	// regex_compiler
@@ -273,6 +278,8 @@ namespace mn
 		case REGEX_OPERATOR_PLUS_NON_GREEDY: return regex_compiler_plus(compiler, false);
 		case REGEX_OPERATOR_OPTIONAL: return regex_compiler_optional(compiler, true);
 		case REGEX_OPERATOR_OPTIONAL_NON_GREEDY: return regex_compiler_optional(compiler, false);
+		// unbalanced parens
+		case REGEX_OPERATOR_OPEN_PAREN: return false;
 		default: mn_unreachable(); return false;
 		}
 	}
@@ -519,278 +526,1858 @@ namespace mn
 	}
 
 
-	// vm part
-	struct Regex_Thread
+	// dfa part
+
+	// a decoded regex instruction, all the targets are indices in the decoded instructions array
+	struct Regex_Inst
 	{
-		size_t id;
-		size_t ip;
+		RGX_OP op;
+		// RUNE: the rune to match, MATCH2: the payload
+		int32_t data;
+		// consuming instructions: the next instruction, SPLIT: the preferred branch, JUMP: the target
+		uint32_t x;
+		// SPLIT: the other branch
+		uint32_t y;
+		// SET, NOT_SET: the options of the set in the ranges array
+		uint32_t ranges_begin;
+		uint32_t ranges_count;
 	};
 
-	inline static size_t
-	thread_depth_level(size_t id)
+	struct Regex_Range
 	{
-		return (size_t)::log2(id);
-	}
+		Rune first, last;
+	};
 
-	inline static size_t
-	thread_parent(size_t id)
+	struct Regex_DFA_State
 	{
-		return (id - 1) / 2;
-	}
+		// forward states: the consuming instructions ordered by their priority
+		// reverse states: the sorted instructions which can reach a match by consuming the already scanned input
+		uint32_t* insts;
+		size_t insts_count;
+		// forward states: whether the unanchored restart thread is still alive, it always has the lowest priority
+		bool restart;
+		// forward states: a match ends here, reverse states: a match can start here
+		bool match;
+		bool with_payload;
+		int32_t payload;
+		// forward states in all matches mode: the sorted match instructions which are reached in this state
+		uint32_t* matches;
+		size_t matches_count;
+		// the last scan which reported this state matches, this is used to avoid reporting the same matches twice
+		size_t reported_scan;
+		// cached transitions, nullptr means it's not computed yet
+		Regex_DFA_State* next_ascii[128];
+		Map<Rune, Regex_DFA_State*> next_unicode;
+	};
+
+	struct Regex_DFA_Cache
+	{
+		memory::Arena* arena;
+		Map<Str, Regex_DFA_State*> states;
+		// incremented every time the cache is flushed, which invalidates all the states
+		size_t generation;
+		// forward cache: start_anchored is used in match, and start_unanchored is used in search
+		// reverse cache: start_anchored is the state at the end of the match
+		Regex_DFA_State* start_anchored;
+		Regex_DFA_State* start_unanchored;
+	};
+
+	// the maximum count of states a single cache holds before it gets flushed
+	constexpr size_t REGEX_DFA_MAX_STATES = 4096;
+	// the maximum size of the extracted literals in bytes
+	constexpr size_t REGEX_DFA_MAX_LITERAL = 64;
+
+	struct IRegex_DFA
+	{
+		Allocator allocator;
+		Buf<Regex_Inst> insts;
+		Buf<Regex_Range> ranges;
+		// predecessors in compressed form, the predecessors of instruction i are in the range
+		// [preds_offsets[i], preds_offsets[i + 1]) of the preds array
+		Buf<uint32_t> eps_preds_offsets;
+		Buf<uint32_t> eps_preds;
+		Buf<uint32_t> consume_preds_offsets;
+		Buf<uint32_t> consume_preds;
+		// literal which every match starts with
+		Str prefix;
+		// longest literal which every match contains
+		Str literal;
+		bool literals_ready;
+		// in all matches mode matches don't cut the lower priority threads, so the DFA tracks all the match
+		// instructions which are reachable, this is used by Regex_Set
+		bool all_matches;
+		size_t scan;
+		Regex_DFA_Cache forward;
+		Regex_DFA_Cache reverse;
+		// scratch memory which is used to compute states
+		Buf<uint32_t> stack;
+		Buf<uint32_t> list;
+		Buf<uint32_t> current;
+		Buf<uint32_t> marks;
+		Buf<uint32_t> matches;
+		uint32_t marks_generation;
+		Str key;
+	};
+
+	struct Regex_DFA_Builder
+	{
+		bool restart;
+		// forward states: none of the threads which were alive in the previous state survived, so all the threads
+		// in this state started at the current position, this is used to know how much input the streaming
+		// matcher should keep
+		bool fresh;
+		bool match;
+		bool with_payload;
+		int32_t payload;
+	};
 
 	inline static bool
-	thread_should_update_result(size_t new_res_thread_id, size_t old_res_thread_id)
+	_regex_read_int(const Regex& program, size_t ip, int32_t& value)
 	{
-		if (old_res_thread_id == SIZE_MAX)
-			return true;
+		if (ip + sizeof(int32_t) > program.bytes.count)
+			return false;
+		::memcpy(&value, program.bytes.ptr + ip, sizeof(value));
+		return true;
+	}
 
-		auto new_res_thread_depth_level = thread_depth_level(new_res_thread_id);
-		auto old_res_thread_depth_level = thread_depth_level(old_res_thread_id);
+	// decodes the program bytes into instructions which makes it easier to walk the program graph
+	inline static bool
+	_regex_dfa_decode(IRegex_DFA* self, const Regex& program)
+	{
+		auto inst_index = buf_with_allocator<uint32_t>(memory::tmp());
+		buf_resize_fill(inst_index, program.bytes.count + 1, UINT32_MAX);
 
-		while (new_res_thread_depth_level < old_res_thread_depth_level)
+		// targets are first decoded as byte offsets then patched into instruction indices
+		size_t ip = 0;
+		while (ip < program.bytes.count)
 		{
-			old_res_thread_id = thread_parent(old_res_thread_id);
-			--old_res_thread_depth_level;
+			inst_index[ip] = uint32_t(self->insts.count);
+			Regex_Inst inst{};
+			inst.op = RGX_OP(program.bytes[ip]);
+			switch (inst.op)
+			{
+			case RGX_OP_RUNE:
+				if (_regex_read_int(program, ip + 1, inst.data) == false)
+					return false;
+				ip += 5;
+				inst.x = uint32_t(ip);
+				break;
+			case RGX_OP_ANY:
+				ip += 1;
+				inst.x = uint32_t(ip);
+				break;
+			case RGX_OP_SPLIT:
+			{
+				int32_t offset_1 = 0, offset_2 = 0;
+				if (_regex_read_int(program, ip + 1, offset_1) == false ||
+					_regex_read_int(program, ip + 5, offset_2) == false)
+					return false;
+				ip += 9;
+				inst.x = uint32_t(int64_t(ip) + offset_1);
+				inst.y = uint32_t(int64_t(ip) + offset_2);
+				break;
+			}
+			case RGX_OP_JUMP:
+			{
+				int32_t offset = 0;
+				if (_regex_read_int(program, ip + 1, offset) == false)
+					return false;
+				ip += 5;
+				inst.x = uint32_t(int64_t(ip) + offset);
+				break;
+			}
+			case RGX_OP_SET:
+			case RGX_OP_NOT_SET:
+			{
+				int32_t options_size = 0;
+				if (_regex_read_int(program, ip + 1, options_size) == false || options_size < 0)
+					return false;
+				ip += 5;
+				auto options_end = ip + size_t(options_size);
+				if (options_end > program.bytes.count)
+					return false;
+				inst.ranges_begin = uint32_t(self->ranges.count);
+				while (ip < options_end)
+				{
+					Regex_Range range{};
+					if (program.bytes[ip] == RGX_OP_RANGE)
+					{
+						if (_regex_read_int(program, ip + 1, range.first) == false ||
+							_regex_read_int(program, ip + 5, range.last) == false)
+							return false;
+						ip += 9;
+					}
+					else if (program.bytes[ip] == RGX_OP_RUNE)
+					{
+						if (_regex_read_int(program, ip + 1, range.first) == false)
+							return false;
+						range.last = range.first;
+						ip += 5;
+					}
+					else
+					{
+						return false;
+					}
+					buf_push(self->ranges, range);
+				}
+				inst.ranges_count = uint32_t(self->ranges.count - inst.ranges_begin);
+				inst.x = uint32_t(ip);
+				break;
+			}
+			case RGX_OP_MATCH:
+				ip += 1;
+				break;
+			case RGX_OP_MATCH2:
+				if (_regex_read_int(program, ip + 1, inst.data) == false)
+					return false;
+				ip += 5;
+				break;
+			default:
+				return false;
+			}
+			buf_push(self->insts, inst);
 		}
 
-		while (new_res_thread_depth_level > old_res_thread_depth_level)
+		if (self->insts.count == 0)
+			return false;
+
+		for (auto& inst: self->insts)
 		{
-			new_res_thread_id = thread_parent(new_res_thread_id);
-			--new_res_thread_depth_level;
+			switch (inst.op)
+			{
+			case RGX_OP_SPLIT:
+				if (inst.y >= inst_index.count || inst_index[inst.y] == UINT32_MAX)
+					return false;
+				inst.y = inst_index[inst.y];
+				// fallthrough
+			case RGX_OP_RUNE:
+			case RGX_OP_ANY:
+			case RGX_OP_SET:
+			case RGX_OP_NOT_SET:
+			case RGX_OP_JUMP:
+				if (inst.x >= inst_index.count || inst_index[inst.x] == UINT32_MAX)
+					return false;
+				inst.x = inst_index[inst.x];
+				break;
+			default:
+				break;
+			}
 		}
-
-		mn_assert(new_res_thread_depth_level == old_res_thread_depth_level);
-		return new_res_thread_id < old_res_thread_id;
+		return true;
 	}
 
-	inline static RGX_OP
-	pop_op(const Regex& program, Regex_Thread& thread)
+	inline static void
+	_regex_dfa_preds_build(const IRegex_DFA* self, bool consuming, Buf<uint32_t>& offsets, Buf<uint32_t>& preds)
 	{
-		auto res = program.bytes[thread.ip];
-		++thread.ip;
-		return (RGX_OP)res;
-	}
+		buf_resize_fill(offsets, self->insts.count + 1, 0U);
 
-	inline static int
-	pop_int(const Regex& program, Regex_Thread& thread)
-	{
-		mn_assert(thread.ip + sizeof(int) <= program.bytes.count);
-		int res = *(int*)(program.bytes.ptr + thread.ip);
-		thread.ip += sizeof(int);
-		return res;
+		auto for_each_edge = [&](auto&& f) {
+			for (size_t i = 0; i < self->insts.count; ++i)
+			{
+				const auto& inst = self->insts[i];
+				switch (inst.op)
+				{
+				case RGX_OP_SPLIT:
+					if (consuming == false)
+					{
+						f(uint32_t(i), inst.x);
+						f(uint32_t(i), inst.y);
+					}
+					break;
+				case RGX_OP_JUMP:
+					if (consuming == false)
+						f(uint32_t(i), inst.x);
+					break;
+				case RGX_OP_RUNE:
+				case RGX_OP_ANY:
+				case RGX_OP_SET:
+				case RGX_OP_NOT_SET:
+					if (consuming)
+						f(uint32_t(i), inst.x);
+					break;
+				default:
+					break;
+				}
+			}
+		};
+
+		for_each_edge([&](uint32_t, uint32_t to) { ++offsets[to + 1]; });
+		for (size_t i = 1; i < offsets.count; ++i)
+			offsets[i] += offsets[i - 1];
+
+		buf_resize(preds, offsets[offsets.count - 1]);
+		auto cursor = buf_memcpy_clone(offsets, memory::tmp());
+		for_each_edge([&](uint32_t from, uint32_t to) { preds[cursor[to]++] = from; });
 	}
 
-	inline static mn::Rune
-	pop_rune(const Regex& program, Regex_Thread& thread)
+	// follows the chain of runes starting from the given instruction and encodes them into the given string
+	inline static void
+	_regex_dfa_literal_chain(const IRegex_DFA* self, uint32_t index, Str& literal)
 	{
-		return pop_int(program, thread);
+		str_clear(literal);
+		for (size_t steps = 0; steps < self->insts.count; ++steps)
+		{
+			const auto& inst = self->insts[index];
+			if (inst.op == RGX_OP_JUMP)
+			{
+				index = inst.x;
+			}
+			else if (inst.op == RGX_OP_RUNE && inst.data > 0 && literal.count + 4 <= REGEX_DFA_MAX_LITERAL)
+			{
+				str_push(literal, inst.data);
+				index = inst.x;
+			}
+			else
+			{
+				break;
+			}
+		}
 	}
 
-	// API
-	Result<Regex>
-	regex_compile(Regex_Compile_Unit unit)
+	// extracts the literal prefix of all the matches, and the longest literal which all the matches must contain, the
+	// required literal is found by computing the dominators of the match instructions (the instructions which every path
+	// from the start to a match must pass through), using the Cooper, Harvey, Kennedy iterative algorithm
+	inline static void
+	_regex_dfa_literals_extract(IRegex_DFA* self)
 	{
-		auto compiler = regex_compiler_new(unit.str);
-		mn_defer{regex_compiler_free(compiler);};
+		self->literals_ready = true;
+		_regex_dfa_literal_chain(self, 0, self->prefix);
+
+		auto count = self->insts.count;
+		// we add a virtual sink node which all the match instructions flow into
+		auto sink = uint32_t(count);
+		auto undefined = UINT32_MAX;
+
+		// compute the reverse post order of the reachable nodes
+		auto order = buf_with_allocator<uint32_t>(memory::tmp());
+		auto order_index = buf_with_allocator<uint32_t>(memory::tmp());
+		buf_resize_fill(order_index, count + 1, undefined);
+		auto visited = buf_with_allocator<uint8_t>(memory::tmp());
+		buf_resize_fill(visited, count + 1, uint8_t(0));
+
+		struct Frame { uint32_t node; uint32_t edge; };
+		auto stack = buf_with_allocator<Frame>(memory::tmp());
+		auto successor = [&](uint32_t node, uint32_t edge) -> uint32_t {
+			if (node == sink)
+				return undefined;
+			const auto& inst = self->insts[node];
+			switch (inst.op)
+			{
+			case RGX_OP_SPLIT: return edge == 0 ? inst.x : (edge == 1 ? inst.y : undefined);
+			case RGX_OP_MATCH:
+			case RGX_OP_MATCH2: return edge == 0 ? sink : undefined;
+			default: return edge == 0 ? inst.x : undefined;
+			}
+		};
 
-		while (regex_compiler_eof(compiler) == false)
+		buf_push(stack, Frame{0, 0});
+		visited[0] = 1;
+		while (stack.count > 0)
 		{
-			auto ok = regex_compiler_process_rune(compiler);
-			if (ok == false)
-				return Err{ "can't process rune at offset {}", compiler.it - begin(compiler.str) };
+			auto& frame = buf_top(stack);
+			auto next = successor(frame.node, frame.edge++);
+			if (next == undefined)
+			{
+				buf_push(order, frame.node);
+				buf_pop(stack);
+			}
+			else if (visited[next] == 0)
+			{
+				visited[next] = 1;
+				buf_push(stack, Frame{next, 0});
+			}
 		}
+		// post order to reverse post order
+		for (size_t i = 0; i < order.count / 2; ++i)
+			std::swap(order[i], order[order.count - i - 1]);
+		for (size_t i = 0; i < order.count; ++i)
+			order_index[order[i]] = uint32_t(i);
 
-		while (compiler.operators_stack.count > 0)
-			if (regex_compiler_eval(compiler) == false)
-				return Err{ "failed to process regex operator" };
+		if (order_index[sink] == undefined)
+			return;
 
-		if (compiler.operands_stack.count != 1)
-			return Err { "no operands in the stack!" };
+		auto idom = buf_with_allocator<uint32_t>(memory::tmp());
+		buf_resize_fill(idom, count + 1, undefined);
+		idom[0] = 0;
 
-		auto last_fragment = buf_top(compiler.operands_stack);
-		buf_pop(compiler.operands_stack);
-		mn_defer{regex_free(last_fragment);};
-		if (unit.enable_payload)
+		auto intersect = [&](uint32_t a, uint32_t b) {
+			while (a != b)
+			{
+				while (order_index[a] > order_index[b])
+					a = idom[a];
+				while (order_index[b] > order_index[a])
+					b = idom[b];
+			}
+			return a;
+		};
+
+		auto for_each_pred = [&](uint32_t node, auto&& f) {
+			if (node == sink)
+			{
+				for (size_t i = 0; i < count; ++i)
+					if (self->insts[i].op == RGX_OP_MATCH || self->insts[i].op == RGX_OP_MATCH2)
+						f(uint32_t(i));
+				return;
+			}
+			for (auto i = self->eps_preds_offsets[node]; i < self->eps_preds_offsets[node + 1]; ++i)
+				f(self->eps_preds[i]);
+			for (auto i = self->consume_preds_offsets[node]; i < self->consume_preds_offsets[node + 1]; ++i)
+				f(self->consume_preds[i]);
+		};
+
+		bool changed = true;
+		while (changed)
 		{
-			push_op(last_fragment, RGX_OP_MATCH2);
-			push_int(last_fragment, unit.payload);
+			changed = false;
+			for (size_t i = 1; i < order.count; ++i)
+			{
+				auto node = order[i];
+				auto new_idom = undefined;
+				for_each_pred(node, [&](uint32_t pred) {
+					if (order_index[pred] == undefined || idom[pred] == undefined)
+						return;
+					new_idom = new_idom == undefined ? pred : intersect(pred, new_idom);
+				});
+				if (new_idom != idom[node])
+				{
+					idom[node] = new_idom;
+					changed = true;
+				}
+			}
 		}
-		else
+
+		// the dominators of the sink are the instructions which every match must pass through
+		auto candidate = str_with_allocator(memory::tmp());
+		for (auto node = idom[sink]; ; node = idom[node])
 		{
-			push_op(last_fragment, RGX_OP_MATCH);
+			if (self->insts[node].op == RGX_OP_RUNE)
+			{
+				_regex_dfa_literal_chain(self, node, candidate);
+				if (candidate.count > self->literal.count)
+				{
+					str_clear(self->literal);
+					str_push(self->literal, candidate);
+				}
+			}
+			if (node == 0)
+				break;
 		}
-
-		Regex res{};
-		res.bytes = buf_memcpy_clone(last_fragment.bytes, unit.program_allocator);
-		return res;
 	}
 
-	Match_Result
-	regex_match(const Regex& program, const char* str)
+	inline static void*
+	_regex_dfa_cache_alloc(Regex_DFA_Cache& cache, size_t size, size_t alignment)
 	{
-		auto current_threads = mn::buf_with_allocator<Regex_Thread>(mn::memory::tmp());
-		auto new_threads = mn::buf_with_allocator<Regex_Thread>(mn::memory::tmp());
-		auto new_thread_set = mn::set_with_allocator<size_t>(mn::memory::tmp());
-		Match_Result res{str, str, false, false, 0};
-		size_t res_thread_id = SIZE_MAX;
-
-		mn::buf_push(current_threads, Regex_Thread{});
+		return alloc_from(cache.arena, size, alignment).ptr;
+	}
 
-		auto it = str;
-		for (it = str;; it = mn::rune_next(it))
+	inline static bool
+	_regex_inst_matches(const IRegex_DFA* self, const Regex_Inst& inst, Rune c)
+	{
+		switch (inst.op)
 		{
-			if (current_threads.count == 0)
-				break;
-
-			auto str_c = mn::rune_read(it);
-
-			for (size_t i = 0; i < current_threads.count; ++i)
+		case RGX_OP_RUNE:
+			return inst.data == c;
+		case RGX_OP_ANY:
+			return true;
+		case RGX_OP_SET:
+		case RGX_OP_NOT_SET:
+		{
+			bool inside_set = false;
+			for (size_t i = 0; i < inst.ranges_count; ++i)
 			{
-				auto& thread = current_threads[i];
-				auto op = pop_op(program, thread);
-				switch(op)
+				const auto& range = self->ranges[inst.ranges_begin + i];
+				if (c >= range.first && c <= range.last)
 				{
-				case RGX_OP_RUNE:
-				{
-					auto c = pop_rune(program, thread);
-					if(str_c != c)
-						break;
-					if (mn::set_lookup(new_thread_set, thread.ip) == nullptr)
-					{
-						mn::buf_push(new_threads, thread);
-						mn::set_insert(new_thread_set, thread.ip);
-					}
-					break;
-				}
-				case RGX_OP_ANY:
-				{
-					if (str_c == 0)
-						break;
-					if (mn::set_lookup(new_thread_set, thread.ip) == nullptr)
-					{
-						mn::buf_push(new_threads, thread);
-						mn::set_insert(new_thread_set, thread.ip);
-					}
-					break;
-				}
-				case RGX_OP_SPLIT:
-				{
-					auto offset_1 = pop_int(program, thread);
-					auto offset_2 = pop_int(program, thread);
-					mn::buf_push(current_threads, Regex_Thread{ thread.id * 2 + 1, thread.ip + offset_1 });
-					mn::buf_push(current_threads, Regex_Thread{ thread.id * 2 + 2, thread.ip + offset_2 });
-					break;
-				}
-				case RGX_OP_JUMP:
-				{
-					auto offset = pop_int(program, thread);
-					thread.ip += offset;
-					mn::buf_push(current_threads, thread);
+					inside_set = true;
 					break;
 				}
-				case RGX_OP_SET:
-				case RGX_OP_NOT_SET:
-				{
-					auto options_end_offset = pop_int(program, thread);
-					auto options_end = thread.ip + options_end_offset;
-					bool inside_set = false;
-					while (thread.ip < options_end)
-					{
-						if (inside_set == true)
-						{
-							thread.ip = options_end;
-							break;
-						}
-
-						auto local_op = pop_op(program, thread);
-						switch (local_op)
-						{
-						case RGX_OP_RANGE:
-						{
-							auto a = pop_rune(program, thread);
-							auto z = pop_rune(program, thread);
-							inside_set |= (str_c >= a && str_c <= z);
-							break;
-						}
-						case RGX_OP_RUNE:
-						{
-							auto c = pop_rune(program, thread);
-							inside_set |= str_c == c;
-							break;
-						}
-						default:
-							mn_unreachable();
-							break;
-						}
-					}
+			}
+			return inside_set == (inst.op == RGX_OP_SET);
+		}
+		default:
+			return false;
+		}
+	}
 
-					if ((op == RGX_OP_SET && inside_set) ||
-						(op == RGX_OP_NOT_SET && inside_set == false))
-					{
-						if (mn::set_lookup(new_thread_set, thread.ip) == nullptr)
-						{
-							mn::buf_push(new_threads, thread);
-							mn::set_insert(new_thread_set, thread.ip);
-						}
-					}
-					break;
-				}
-				case RGX_OP_MATCH:
-					if (thread_should_update_result(thread.id, res_thread_id))
-					{
-						res = Match_Result { str, it, true, false, 0 };
-						res_thread_id = thread.id;
-					}
-					break;
-				case RGX_OP_MATCH2:
+	inline static void
+	_regex_dfa_marks_reset(IRegex_DFA* self)
+	{
+		++self->marks_generation;
+		if (self->marks_generation == 0)
+		{
+			buf_fill(self->marks, 0U);
+			self->marks_generation = 1;
+		}
+		buf_clear(self->list);
+		buf_clear(self->matches);
+	}
+
+	// adds the epsilon closure of the given instruction in priority order to the list of consuming instructions
+	// returns true if it reached a match, which means that all the lower priority threads should be cut
+	inline static bool
+	_regex_dfa_forward_closure(IRegex_DFA* self, uint32_t index, Regex_DFA_Builder& builder)
+	{
+		buf_clear(self->stack);
+		buf_push(self->stack, index);
+		while (self->stack.count > 0)
+		{
+			auto i = buf_top(self->stack);
+			buf_pop(self->stack);
+			if (self->marks[i] == self->marks_generation)
+				continue;
+			self->marks[i] = self->marks_generation;
+
+			const auto& inst = self->insts[i];
+			switch (inst.op)
+			{
+			case RGX_OP_SPLIT:
+				buf_push(self->stack, inst.y);
+				buf_push(self->stack, inst.x);
+				break;
+			case RGX_OP_JUMP:
+				buf_push(self->stack, inst.x);
+				break;
+			case RGX_OP_MATCH:
+			case RGX_OP_MATCH2:
+				if (self->all_matches)
 				{
-					auto payload = pop_int(program, thread);
-					if (thread_should_update_result(thread.id, res_thread_id))
-					{
-						res = Match_Result {};
-						res.begin = str;
-						res.end = it;
-						res.match = true;
-						res.with_payload = true;
-						res.payload = payload;
-						res_thread_id = thread.id;
-					}
+					builder.match = true;
+					buf_push(self->matches, i);
 					break;
 				}
-				default:
-					mn_unreachable_msg("unknown opcode");
-					return Match_Result { str, it, false, false, 0};
-				}
-			}
-			auto tmp = new_threads;
-			new_threads = current_threads;
-			current_threads = tmp;
-			mn::buf_clear(new_threads);
-			mn::set_clear(new_thread_set);
-			if (str_c == '\0')
+				builder.match = true;
+				builder.with_payload = inst.op == RGX_OP_MATCH2;
+				builder.payload = inst.data;
+				return true;
+			default:
+				buf_push(self->list, i);
 				break;
+			}
 		}
+		return false;
+	}
 
-		if (res.match == false)
-			res.end = it;
+	// expands the list of instructions with all the instructions which reach them using epsilon transitions then
+	// sorts the list so that it can be used as a key
+	inline static void
+	_regex_dfa_reverse_closure(IRegex_DFA* self, Regex_DFA_Builder& builder)
+	{
+		for (size_t cursor = 0; cursor < self->list.count; ++cursor)
+		{
+			auto i = self->list[cursor];
+			for (auto j = self->eps_preds_offsets[i]; j < self->eps_preds_offsets[i + 1]; ++j)
+			{
+				auto pred = self->eps_preds[j];
+				if (self->marks[pred] == self->marks_generation)
+					continue;
+				self->marks[pred] = self->marks_generation;
+				buf_push(self->list, pred);
+			}
+		}
+		std::sort(begin(self->list), end(self->list));
+		builder.match = self->marks[0] == self->marks_generation;
+	}
 
-		return res;
+	inline static Regex_DFA_State*
+	_regex_dfa_intern(IRegex_DFA* self, Regex_DFA_Cache& cache, const Regex_DFA_Builder& builder)
+	{
+		uint32_t flags = (builder.restart ? 1 : 0) | (builder.match ? 2 : 0) | (builder.with_payload ? 4 : 0) | (builder.fresh ? 8 : 0);
+		str_clear(self->key);
+		str_block_push(self->key, block_from(flags));
+		if (builder.with_payload)
+			str_block_push(self->key, block_from(builder.payload));
+		str_block_push(self->key, block_from(self->list));
+		if (self->matches.count > 0)
+		{
+			std::sort(begin(self->matches), end(self->matches));
+			auto count = uint32_t(self->matches.count);
+			str_block_push(self->key, block_from(count));
+			str_block_push(self->key, block_from(self->matches));
+		}
+
+		if (auto it = map_lookup(cache.states, self->key))
+			return it->value;
+
+		auto state = (Regex_DFA_State*)_regex_dfa_cache_alloc(cache, sizeof(Regex_DFA_State), alignof(Regex_DFA_State));
+		::memset(state, 0, sizeof(*state));
+		state->insts_count = self->list.count;
+		if (self->list.count > 0)
+		{
+			state->insts = (uint32_t*)_regex_dfa_cache_alloc(cache, self->list.count * sizeof(uint32_t), alignof(uint32_t));
+			::memcpy(state->insts, self->list.ptr, self->list.count * sizeof(uint32_t));
+		}
+		state->matches_count = self->matches.count;
+		if (self->matches.count > 0)
+		{
+			state->matches = (uint32_t*)_regex_dfa_cache_alloc(cache, self->matches.count * sizeof(uint32_t), alignof(uint32_t));
+			::memcpy(state->matches, self->matches.ptr, self->matches.count * sizeof(uint32_t));
+		}
+		state->restart = builder.restart;
+		state->match = builder.match;
+		state->with_payload = builder.with_payload;
+		state->payload = builder.payload;
+		state->next_unicode = map_with_allocator<Rune, Regex_DFA_State*>(cache.arena);
+
+		Str key{};
+		key.ptr = (char*)_regex_dfa_cache_alloc(cache, self->key.count + 1, alignof(char));
+		key.count = self->key.count;
+		key.cap = self->key.count + 1;
+		::memcpy(key.ptr, self->key.ptr, self->key.count);
+		map_insert(cache.states, key, state);
+		return state;
 	}
 
-	Match_Result
-	regex_search(const Regex& program, const char* str)
+	inline static void
+	_regex_dfa_forward_starts(IRegex_DFA* self)
 	{
-		auto it = str;
-		while(*it)
+		Regex_DFA_Builder builder{};
+		builder.fresh = true;
+		_regex_dfa_marks_reset(self);
+		_regex_dfa_forward_closure(self, 0, builder);
+		self->forward.start_anchored = _regex_dfa_intern(self, self->forward, builder);
+
+		builder.restart = builder.match == false || self->all_matches;
+		self->forward.start_unanchored = _regex_dfa_intern(self, self->forward, builder);
+	}
+
+	inline static void
+	_regex_dfa_reverse_starts(IRegex_DFA* self)
+	{
+		Regex_DFA_Builder builder{};
+		_regex_dfa_marks_reset(self);
+		for (size_t i = 0; i < self->insts.count; ++i)
 		{
-			auto res = regex_match(program, it);
-			if (res.match)
-				return res;
-			if (res.end != it)
-				it = res.end;
-			else
-				it = mn::rune_next(it);
+			if (self->insts[i].op == RGX_OP_MATCH || self->insts[i].op == RGX_OP_MATCH2)
+			{
+				self->marks[i] = self->marks_generation;
+				buf_push(self->list, uint32_t(i));
+			}
 		}
-		return Match_Result{str, it, false, false, 0};
+		_regex_dfa_reverse_closure(self, builder);
+		self->reverse.start_anchored = _regex_dfa_intern(self, self->reverse, builder);
+	}
+
+	inline static void
+	_regex_dfa_cache_init(Regex_DFA_Cache& cache, Allocator allocator)
+	{
+		cache.arena = alloc_construct_from<memory::Arena>(allocator, 16ULL * 1024ULL, allocator);
+		cache.states = map_with_allocator<Str, Regex_DFA_State*>(allocator);
+	}
+
+	inline static void
+	_regex_dfa_cache_free(Regex_DFA_Cache& cache, Allocator allocator)
+	{
+		map_free(cache.states);
+		free_destruct_from(allocator, cache.arena);
+	}
+
+	inline static void
+	_regex_dfa_cache_flush(IRegex_DFA* self, Regex_DFA_Cache& cache)
+	{
+		map_clear(cache.states);
+		cache.arena->free_all();
+		++cache.generation;
+		if (&cache == &self->forward)
+			_regex_dfa_forward_starts(self);
+		else
+			_regex_dfa_reverse_starts(self);
+	}
+
+	// returns the reverse state which starts from the given match instruction only, this is used to find the start
+	// of a specific pattern match in all matches mode
+	inline static Regex_DFA_State*
+	_regex_dfa_reverse_start_from(IRegex_DFA* self, uint32_t match_inst)
+	{
+		if (self->reverse.states.count >= REGEX_DFA_MAX_STATES)
+			_regex_dfa_cache_flush(self, self->reverse);
+
+		Regex_DFA_Builder builder{};
+		_regex_dfa_marks_reset(self);
+		self->marks[match_inst] = self->marks_generation;
+		buf_push(self->list, match_inst);
+		_regex_dfa_reverse_closure(self, builder);
+		return _regex_dfa_intern(self, self->reverse, builder);
+	}
+
+	inline static Regex_DFA_State*
+	_regex_dfa_compute(IRegex_DFA* self, Regex_DFA_Cache& cache, const Regex_DFA_State* state, Rune c)
+	{
+		// copy the state instructions first because flushing the cache frees the state
+		buf_clear(self->current);
+		buf_concat(self->current, state->insts, state->insts + state->insts_count);
+		bool restart = state->restart;
+
+		if (cache.states.count >= REGEX_DFA_MAX_STATES)
+			_regex_dfa_cache_flush(self, cache);
+
+		Regex_DFA_Builder builder{};
+		_regex_dfa_marks_reset(self);
+
+		if (&cache == &self->forward)
+		{
+			bool cut = false;
+			builder.fresh = true;
+			for (auto i: self->current)
+			{
+				const auto& inst = self->insts[i];
+				if (_regex_inst_matches(self, inst, c) == false)
+					continue;
+				builder.fresh = false;
+				if (_regex_dfa_forward_closure(self, inst.x, builder))
+				{
+					cut = true;
+					break;
+				}
+			}
+
+			// the unanchored restart thread is equivalent to a non greedy any loop at the start of the program
+			// which has the lowest priority, so we restart the program after all the other threads
+			if (cut == false && restart)
+				cut = _regex_dfa_forward_closure(self, 0, builder);
+			builder.restart = restart && cut == false;
+		}
+		else
+		{
+			for (auto i: self->current)
+			{
+				for (auto j = self->consume_preds_offsets[i]; j < self->consume_preds_offsets[i + 1]; ++j)
+				{
+					auto pred = self->consume_preds[j];
+					if (self->marks[pred] == self->marks_generation)
+						continue;
+					if (_regex_inst_matches(self, self->insts[pred], c) == false)
+						continue;
+					self->marks[pred] = self->marks_generation;
+					buf_push(self->list, pred);
+				}
+			}
+			_regex_dfa_reverse_closure(self, builder);
+		}
+
+		return _regex_dfa_intern(self, cache, builder);
+	}
+
+	inline static Regex_DFA_State*
+	_regex_dfa_next(IRegex_DFA* self, Regex_DFA_Cache& cache, Regex_DFA_State* state, Rune c)
+	{
+		if (c >= 0 && c < 128)
+		{
+			if (auto next = state->next_ascii[c])
+				return next;
+		}
+		else if (auto it = map_lookup(state->next_unicode, c))
+		{
+			return it->value;
+		}
+
+		auto generation = cache.generation;
+		auto next = _regex_dfa_compute(self, cache, state, c);
+		// if the cache was flushed then the given state is no longer valid
+		if (generation == cache.generation)
+		{
+			if (c >= 0 && c < 128)
+				state->next_ascii[c] = next;
+			else
+				map_insert(state->next_unicode, c, next);
+		}
+		return next;
+	}
+
+	inline static bool
+	_regex_dfa_init(IRegex_DFA* self, const Regex& program, bool all_matches, Allocator allocator)
+	{
+		self->allocator = allocator;
+		self->all_matches = all_matches;
+		self->insts = buf_with_allocator<Regex_Inst>(allocator);
+		self->ranges = buf_with_allocator<Regex_Range>(allocator);
+		self->eps_preds_offsets = buf_with_allocator<uint32_t>(allocator);
+		self->eps_preds = buf_with_allocator<uint32_t>(allocator);
+		self->consume_preds_offsets = buf_with_allocator<uint32_t>(allocator);
+		self->consume_preds = buf_with_allocator<uint32_t>(allocator);
+		self->prefix = str_with_allocator(allocator);
+		self->literal = str_with_allocator(allocator);
+		self->stack = buf_with_allocator<uint32_t>(allocator);
+		self->list = buf_with_allocator<uint32_t>(allocator);
+		self->current = buf_with_allocator<uint32_t>(allocator);
+		self->marks = buf_with_allocator<uint32_t>(allocator);
+		self->matches = buf_with_allocator<uint32_t>(allocator);
+		self->key = str_with_allocator(allocator);
+		_regex_dfa_cache_init(self->forward, allocator);
+		_regex_dfa_cache_init(self->reverse, allocator);
+
+		if (_regex_dfa_decode(self, program) == false)
+			return false;
+
+		_regex_dfa_preds_build(self, false, self->eps_preds_offsets, self->eps_preds);
+		_regex_dfa_preds_build(self, true, self->consume_preds_offsets, self->consume_preds);
+		buf_resize_fill(self->marks, self->insts.count, 0U);
+		_regex_dfa_forward_starts(self);
+		_regex_dfa_reverse_starts(self);
+		return true;
+	}
+
+	inline static void
+	_regex_dfa_free(IRegex_DFA* self)
+	{
+		buf_free(self->insts);
+		buf_free(self->ranges);
+		buf_free(self->eps_preds_offsets);
+		buf_free(self->eps_preds);
+		buf_free(self->consume_preds_offsets);
+		buf_free(self->consume_preds);
+		str_free(self->prefix);
+		str_free(self->literal);
+		buf_free(self->stack);
+		buf_free(self->list);
+		buf_free(self->current);
+		buf_free(self->marks);
+		buf_free(self->matches);
+		str_free(self->key);
+		_regex_dfa_cache_free(self->forward, self->allocator);
+		_regex_dfa_cache_free(self->reverse, self->allocator);
+	}
+
+	// reads a rune from the given position, it returns false at the end of the input which is the end pointer or
+	// the null terminator if the end pointer is null, invalid utf-8 sequences are read as -1
+	inline static bool
+	_regex_rune_read(const char* it, const char* end, Rune& r, size_t& size)
+	{
+		if (end ? it >= end : *it == '\0')
+			return false;
+
+		auto c = uint8_t(*it);
+		if (c < 0x80)
+		{
+			r = c;
+			size = 1;
+			return true;
+		}
+
+		size = 1;
+		while (size < 4 && (end == nullptr || it + size < end) && (uint8_t(it[size]) & 0xC0) == 0x80)
+			++size;
+
+		utf8proc_int32_t res = -1;
+		if (utf8proc_iterate((const utf8proc_uint8_t*)it, utf8proc_ssize_t(size), &res) != utf8proc_ssize_t(size))
+			res = -1;
+		r = res;
+		return true;
+	}
+
+	// reads the rune which ends at the given position, it returns false if it reached the begin pointer
+	inline static bool
+	_regex_rune_read_backward(const char* begin, const char* it, Rune& r, size_t& size)
+	{
+		if (it <= begin)
+			return false;
+
+		auto c = uint8_t(it[-1]);
+		if (c < 0x80)
+		{
+			r = c;
+			size = 1;
+			return true;
+		}
+
+		auto start = it - 1;
+		while (start > begin && it - start < 4 && (uint8_t(*start) & 0xC0) == 0x80)
+			--start;
+		size = size_t(it - start);
+
+		utf8proc_int32_t res = -1;
+		if (utf8proc_iterate((const utf8proc_uint8_t*)start, utf8proc_ssize_t(size), &res) != utf8proc_ssize_t(size))
+			res = -1;
+		r = res;
+		return true;
+	}
+
+	// finds the first occurrence of the given literal, it uses strchr/memchr (which are vectorized in all the libc
+	// implementations we care about) to find the first byte of the literal then compares the rest
+	inline static const char*
+	_regex_literal_find(const char* it, const char* end, const Str& literal)
+	{
+		while (true)
+		{
+			const char* candidate = nullptr;
+			if (end)
+				candidate = (const char*)::memchr(it, literal.ptr[0], size_t(end - it));
+			else
+				candidate = ::strchr(it, literal.ptr[0]);
+
+			if (candidate == nullptr)
+				return nullptr;
+
+			if (end)
+			{
+				if (size_t(end - candidate) < literal.count)
+					return nullptr;
+				if (::memcmp(candidate, literal.ptr, literal.count) == 0)
+					return candidate;
+			}
+			else if (::strncmp(candidate, literal.ptr, literal.count) == 0)
+			{
+				return candidate;
+			}
+			it = candidate + 1;
+		}
+	}
+
+	inline static const char*
+	_regex_end_of_input(const char* it, const char* end)
+	{
+		return end ? end : it + ::strlen(it);
+	}
+
+	struct Regex_DFA_Scan
+	{
+		// where the scan stopped
+		const char* it;
+		const char* match_end;
+		bool match;
+		bool with_payload;
+		int32_t payload;
+	};
+
+	inline static void
+	_regex_dfa_scan_record(Regex_DFA_Scan& scan, const Regex_DFA_State* state, const char* it)
+	{
+		if (state->match == false)
+			return;
+		scan.match = true;
+		scan.match_end = it;
+		scan.with_payload = state->with_payload;
+		scan.payload = state->payload;
+	}
+
+	// runs the forward DFA over the input and returns the end of the highest priority match, in unanchored mode this
+	// is the end of the leftmost-first match
+	inline static Regex_DFA_Scan
+	_regex_dfa_scan_forward(IRegex_DFA* self, const char* it, const char* end, bool anchored)
+	{
+		Regex_DFA_Scan scan{};
+		auto state = anchored ? self->forward.start_anchored : self->forward.start_unanchored;
+		bool accelerate = anchored == false && self->prefix.count > 0;
+
+		_regex_dfa_scan_record(scan, state, it);
+		while (state->insts_count > 0 || state->restart)
+		{
+			// the start state doesn't make any progress until we find the prefix literal, so we skip directly to it
+			if (accelerate && state == self->forward.start_unanchored)
+			{
+				auto candidate = _regex_literal_find(it, end, self->prefix);
+				if (candidate == nullptr)
+				{
+					it = _regex_end_of_input(it, end);
+					break;
+				}
+				it = candidate;
+			}
+
+			Rune c = 0;
+			size_t size = 0;
+			if (_regex_rune_read(it, end, c, size) == false)
+				break;
+
+			state = _regex_dfa_next(self, self->forward, state, c);
+			it += size;
+			_regex_dfa_scan_record(scan, state, it);
+		}
+		scan.it = it;
+		return scan;
+	}
+
+	// runs the reverse DFA backwards from the end of the match and returns the leftmost position a match can start at
+	inline static const char*
+	_regex_dfa_scan_reverse(IRegex_DFA* self, Regex_DFA_State* state, const char* begin, const char* match_end)
+	{
+		auto it = match_end;
+		auto match_begin = state->match ? it : nullptr;
+		while (state->insts_count > 0)
+		{
+			Rune c = 0;
+			size_t size = 0;
+			if (_regex_rune_read_backward(begin, it, c, size) == false)
+				break;
+
+			state = _regex_dfa_next(self, self->reverse, state, c);
+			it -= size;
+			if (state->match)
+				match_begin = it;
+		}
+		mn_assert(match_begin != nullptr);
+		return match_begin;
+	}
+
+	inline static Match_Result
+	_regex_dfa_match(IRegex_DFA* self, const char* str, const char* end)
+	{
+		auto scan = _regex_dfa_scan_forward(self, str, end, true);
+
+		Match_Result res{};
+		res.begin = str;
+		res.end = scan.match ? scan.match_end : scan.it;
+		res.match = scan.match;
+		res.with_payload = scan.with_payload;
+		res.payload = scan.payload;
+		return res;
+	}
+
+	inline static Match_Result
+	_regex_dfa_search(IRegex_DFA* self, const char* str, const char* end)
+	{
+		if (self->literals_ready == false)
+			_regex_dfa_literals_extract(self);
+
+		// if the required literal doesn't exist in the input then there's no need to run the DFA
+		if (self->literal.count > self->prefix.count && _regex_literal_find(str, end, self->literal) == nullptr)
+			return Match_Result{str, _regex_end_of_input(str, end), false, false, 0};
+
+		auto scan = _regex_dfa_scan_forward(self, str, end, false);
+		if (scan.match == false)
+			return Match_Result{str, _regex_end_of_input(scan.it, end), false, false, 0};
+
+		Match_Result res{};
+		res.begin = _regex_dfa_scan_reverse(self, self->reverse.start_anchored, str, scan.match_end);
+		res.end = scan.match_end;
+		res.match = true;
+		res.with_payload = scan.with_payload;
+		res.payload = scan.payload;
+		return res;
+	}
+
+	// runs the forward DFA in all matches mode and calls the given function with every state which has matches that
+	// weren't reported in this scan, the scan stops when the function returns false
+	template<typename TFunc>
+	inline static void
+	_regex_dfa_scan_matches(IRegex_DFA* self, const char* it, const char* end, TFunc&& on_match)
+	{
+		mn_assert(self->all_matches);
+		++self->scan;
+		auto state = self->forward.start_unanchored;
+		while (true)
+		{
+			if (state->matches_count > 0 && state->reported_scan != self->scan)
+			{
+				state->reported_scan = self->scan;
+				if (on_match(state, it) == false)
+					break;
+			}
+
+			Rune c = 0;
+			size_t size = 0;
+			if (_regex_rune_read(it, end, c, size) == false)
+				break;
+
+			state = _regex_dfa_next(self, self->forward, state, c);
+			it += size;
+		}
+	}
+
+	struct IRegex_Set
+	{
+		Allocator allocator;
+		Buf<Regex> programs;
+		Buf<int32_t> payloads;
+		// the DFA of all the programs combined, it's built on the first search after adding patterns
+		Regex_DFA dfa;
+		Buf<uint8_t> found;
+	};
+
+	inline static Regex_DFA
+	_regex_set_dfa(Regex_Set self)
+	{
+		if (self->dfa != nullptr || self->programs.count == 0)
+			return self->dfa;
+
+		// the combined program is an alternation of all the programs in the order they were added
+		// [SPLIT, 0, program_0 size], program_0, [SPLIT, 0, program_1 size], program_1, ..., program_n
+		auto program = regex_new();
+		program.bytes = buf_with_allocator<uint8_t>(memory::tmp());
+		for (size_t i = 0; i < self->programs.count; ++i)
+		{
+			const auto& other = self->programs[i];
+			if (i + 1 < self->programs.count)
+			{
+				push_op(program, RGX_OP_SPLIT);
+				push_int(program, 0);
+				push_int(program, int(other.bytes.count));
+			}
+			push_program(program, other);
+		}
+
+		self->dfa = alloc_zerod_from<IRegex_DFA>(self->allocator);
+		if (_regex_dfa_init(self->dfa, program, true, self->allocator) == false)
+			mn_unreachable_msg("invalid regex program");
+		return self->dfa;
+	}
+
+	inline static bool
+	_regex_set_search_all(Regex_Set self, const char* str, const char* end, Buf<int32_t>& payloads)
+	{
+		buf_clear(payloads);
+		auto dfa = _regex_set_dfa(self);
+		if (dfa == nullptr)
+			return false;
+
+		buf_resize(self->found, self->programs.count);
+		buf_fill(self->found, uint8_t(0));
+		size_t found_count = 0;
+		_regex_dfa_scan_matches(dfa, str, end, [&](const Regex_DFA_State* state, const char*) {
+			for (size_t i = 0; i < state->matches_count; ++i)
+			{
+				auto index = size_t(dfa->insts[state->matches[i]].data);
+				if (self->found[index] == 0)
+				{
+					self->found[index] = 1;
+					++found_count;
+				}
+			}
+			// no need to continue scanning if all the patterns did match
+			return found_count < self->programs.count;
+		});
+
+		for (size_t i = 0; i < self->found.count; ++i)
+			if (self->found[i])
+				buf_push(payloads, self->payloads[i]);
+		return found_count > 0;
+	}
+
+	inline static Match_Result
+	_regex_set_search_first(Regex_Set self, const char* str, const char* end)
+	{
+		Match_Result res{};
+		res.begin = str;
+		res.end = str;
+
+		auto dfa = _regex_set_dfa(self);
+		if (dfa == nullptr)
+			return res;
+
+		uint32_t match_inst = 0;
+		_regex_dfa_scan_matches(dfa, str, end, [&](const Regex_DFA_State* state, const char* it) {
+			// the matches are sorted by their instruction index, which is the order the patterns were added in
+			match_inst = state->matches[0];
+			res.end = it;
+			res.match = true;
+			return false;
+		});
+
+		if (res.match == false)
+		{
+			res.end = _regex_end_of_input(str, end);
+			return res;
+		}
+
+		res.begin = _regex_dfa_scan_reverse(dfa, _regex_dfa_reverse_start_from(dfa, match_inst), str, res.end);
+		res.with_payload = true;
+		res.payload = self->payloads[dfa->insts[match_inst].data];
+		return res;
+	}
+
+	// inputs up to this size are matched by simulating the program directly instead of building a DFA
+	constexpr size_t REGEX_VM_MAX_INPUT = 256;
+
+	// guards the DFA which is cached in the programs, it's only held while taking and returning the DFA
+	static std::mutex REGEX_PROGRAM_DFA_MUTEX;
+
+	struct Regex_VM_Thread
+	{
+		size_t ip;
+		const char* begin;
+	};
+
+	inline static int32_t
+	_regex_vm_int(const Regex& program, size_t ip)
+	{
+		int32_t value = 0;
+		mn_assert(ip + sizeof(value) <= program.bytes.count);
+		::memcpy(&value, program.bytes.ptr + ip, sizeof(value));
+		return value;
+	}
+
+	inline static bool
+	_regex_vm_set_matches(const Regex& program, size_t ip, Rune c)
+	{
+		auto op = RGX_OP(program.bytes[ip]);
+		auto options_end = ip + 5 + size_t(_regex_vm_int(program, ip + 1));
+		bool inside_set = false;
+		for (ip += 5; ip < options_end && inside_set == false;)
+		{
+			if (program.bytes[ip] == RGX_OP_RANGE)
+			{
+				inside_set = c >= _regex_vm_int(program, ip + 1) && c <= _regex_vm_int(program, ip + 5);
+				ip += 9;
+			}
+			else
+			{
+				inside_set = c == _regex_vm_int(program, ip + 1);
+				ip += 5;
+			}
+		}
+		return inside_set == (op == RGX_OP_SET);
+	}
+
+	// adds the thread to the list after following its split and jump instructions, threads are added in priority
+	// order and marks holds the list generation of the instructions which are already in the list
+	inline static void
+	_regex_vm_add(const Regex& program, Buf<Regex_VM_Thread>& list, Buf<size_t>& marks, size_t generation, Buf<Regex_VM_Thread>& stack, Regex_VM_Thread thread)
+	{
+		buf_push(stack, thread);
+		while (stack.count > 0)
+		{
+			auto t = buf_top(stack);
+			buf_pop(stack);
+			if (marks[t.ip] == generation)
+				continue;
+			marks[t.ip] = generation;
+
+			switch (RGX_OP(program.bytes[t.ip]))
+			{
+			case RGX_OP_SPLIT:
+			{
+				auto next = t.ip + 9;
+				// the second branch is pushed first so that the first branch is added first
+				buf_push(stack, Regex_VM_Thread{size_t(int64_t(next) + _regex_vm_int(program, t.ip + 5)), t.begin});
+				buf_push(stack, Regex_VM_Thread{size_t(int64_t(next) + _regex_vm_int(program, t.ip + 1)), t.begin});
+				break;
+			}
+			case RGX_OP_JUMP:
+				buf_push(stack, Regex_VM_Thread{size_t(int64_t(t.ip + 5) + _regex_vm_int(program, t.ip + 1)), t.begin});
+				break;
+			default:
+				buf_push(list, t);
+				break;
+			}
+		}
+	}
+
+	// simulates the program over the input with a thread per program position, it has the same leftmost-first
+	// semantics as the DFA and doesn't allocate anything which outlives the call, which makes it cheaper than building
+	// a DFA for short inputs
+	inline static Match_Result
+	_regex_vm_run(const Regex& program, const char* str, const char* end, bool search)
+	{
+		auto current = buf_with_allocator<Regex_VM_Thread>(memory::tmp());
+		auto next = buf_with_allocator<Regex_VM_Thread>(memory::tmp());
+		auto stack = buf_with_allocator<Regex_VM_Thread>(memory::tmp());
+		auto marks = buf_with_allocator<size_t>(memory::tmp());
+		buf_resize_fill(marks, program.bytes.count, size_t(0));
+		size_t generation = 1;
+
+		Match_Result res{str, str, false, false, 0};
+		auto it = str;
+		_regex_vm_add(program, current, marks, generation, stack, Regex_VM_Thread{0, str});
+		while (true)
+		{
+			// in search a new thread starts at every position with the lowest priority until we find a match
+			if (search && res.match == false && it != str)
+				_regex_vm_add(program, current, marks, generation, stack, Regex_VM_Thread{0, it});
+
+			if (current.count == 0)
+				break;
+
+			Rune c = 0;
+			size_t size = 0;
+			bool has_rune = _regex_rune_read(it, end, c, size);
+
+			++generation;
+			buf_clear(next);
+			for (const auto& thread: current)
+			{
+				auto op = RGX_OP(program.bytes[thread.ip]);
+				if (op == RGX_OP_MATCH || op == RGX_OP_MATCH2)
+				{
+					res.begin = thread.begin;
+					res.end = it;
+					res.match = true;
+					res.with_payload = op == RGX_OP_MATCH2;
+					res.payload = op == RGX_OP_MATCH2 ? _regex_vm_int(program, thread.ip + 1) : 0;
+					// the lower priority threads can't override this match
+					break;
+				}
+
+				if (has_rune == false)
+					continue;
+
+				bool matches = false;
+				size_t next_ip = 0;
+				switch (op)
+				{
+				case RGX_OP_RUNE:
+					matches = _regex_vm_int(program, thread.ip + 1) == c;
+					next_ip = thread.ip + 5;
+					break;
+				case RGX_OP_ANY:
+					matches = true;
+					next_ip = thread.ip + 1;
+					break;
+				case RGX_OP_SET:
+				case RGX_OP_NOT_SET:
+					matches = _regex_vm_set_matches(program, thread.ip, c);
+					next_ip = thread.ip + 5 + size_t(_regex_vm_int(program, thread.ip + 1));
+					break;
+				default:
+					mn_unreachable_msg("invalid regex program");
+					break;
+				}
+				if (matches)
+					_regex_vm_add(program, next, marks, generation, stack, Regex_VM_Thread{next_ip, thread.begin});
+			}
+
+			if (has_rune == false)
+				break;
+			it += size;
+			std::swap(current, next);
+		}
+
+		if (res.match == false)
+		{
+			res.begin = str;
+			res.end = search ? _regex_end_of_input(it, end) : it;
+		}
+		return res;
+	}
+
+	// returns whether the input is short enough to be matched without a DFA, it doesn't read past the null terminator
+	inline static bool
+	_regex_vm_input_is_short(const char* str, const char* end)
+	{
+		if (end)
+			return size_t(end - str) <= REGEX_VM_MAX_INPUT;
+		for (size_t i = 0; i <= REGEX_VM_MAX_INPUT; ++i)
+			if (str[i] == '\0')
+				return true;
+		return false;
+	}
+
+	inline static Match_Result
+	_regex_program_run(const Regex& program, const char* str, const char* end, bool search)
+	{
+		// the DFA is taken out of the program while it's in use, so a thread which runs the same program at the same
+		// time doesn't find it and falls back to the vm or builds its own DFA
+		Regex_DFA dfa = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(REGEX_PROGRAM_DFA_MUTEX);
+			std::swap(dfa, program.dfa);
+		}
+
+		if (dfa == nullptr)
+		{
+			if (_regex_vm_input_is_short(str, end))
+				return _regex_vm_run(program, str, end, search);
+
+			auto allocator = program.bytes.allocator ? program.bytes.allocator : allocator_top();
+			dfa = alloc_zerod_from<IRegex_DFA>(allocator);
+			if (_regex_dfa_init(dfa, program, false, allocator) == false)
+				mn_unreachable_msg("invalid regex program");
+		}
+
+		auto res = search ? _regex_dfa_search(dfa, str, end) : _regex_dfa_match(dfa, str, end);
+
+		{
+			std::lock_guard<std::mutex> lock(REGEX_PROGRAM_DFA_MUTEX);
+			if (program.dfa == nullptr)
+				std::swap(dfa, program.dfa);
+		}
+		if (dfa)
+			regex_dfa_free(dfa);
+		return res;
+	}
+
+	// a null end pointer is used internally to mark null terminated strings, and empty ranges might have null
+	// pointers (like empty Str), so empty ranges are matched as the empty null terminated string instead
+	template<typename TFunc>
+	inline static Match_Result
+	_regex_range_run(const char* begin, const char* end, TFunc&& f)
+	{
+		if (begin != end)
+			return f(begin, end);
+
+		auto res = f("", nullptr);
+		res.begin = begin;
+		res.end = begin;
+		return res;
+	}
+
+	// streaming matcher
+	struct IRegex_Matcher
+	{
+		Allocator allocator;
+		IRegex_DFA dfa;
+		Regex_DFA_State* state;
+		// the input which is kept between chunks, it starts at the earliest offset a match can begin at
+		Str buffer;
+		size_t buffer_offset;
+		// the offset of the next rune to be scanned
+		size_t offset;
+		// the earliest offset an unfinished match can begin at
+		size_t anchor;
+		// the highest priority match which is found so far, it's reported once the DFA can't extend it
+		bool pending;
+		size_t match_end;
+		bool with_payload;
+		int32_t payload;
+		// an empty match was reported at the current offset, so we skip a rune before searching again
+		bool skip_rune;
+		bool finished;
+		Buf<Regex_Stream_Match> matches;
+		size_t matches_cursor;
+	};
+
+	// the size of the chunks the matcher reads from readers
+	constexpr size_t REGEX_MATCHER_CHUNK_SIZE = 64ULL * 1024ULL;
+
+	// returns whether the given bytes are the start of a utf-8 sequence which is cut by the end of the chunk
+	inline static bool
+	_regex_rune_incomplete(const char* it, const char* end)
+	{
+		auto c = uint8_t(*it);
+		size_t expected = 1;
+		if ((c & 0xE0) == 0xC0)
+			expected = 2;
+		else if ((c & 0xF0) == 0xE0)
+			expected = 3;
+		else if ((c & 0xF8) == 0xF0)
+			expected = 4;
+
+		auto available = size_t(end - it);
+		if (available >= expected)
+			return false;
+		for (size_t i = 1; i < available; ++i)
+			if ((uint8_t(it[i]) & 0xC0) != 0x80)
+				return false;
+		return true;
+	}
+
+	inline static void
+	_regex_matcher_record(IRegex_Matcher* self)
+	{
+		if (self->state->match == false)
+			return;
+		self->pending = true;
+		self->match_end = self->offset;
+		self->with_payload = self->state->with_payload;
+		self->payload = self->state->payload;
+	}
+
+	// scans the given segment of the input which starts at the given stream offset, the segment should contain all
+	// the input starting from the anchor, and in case of the final segment the pending match is reported at the end
+	inline static void
+	_regex_matcher_run(IRegex_Matcher* self, const char* segment, size_t segment_offset, size_t segment_size, bool final)
+	{
+		auto dfa = &self->dfa;
+		auto segment_end = segment + segment_size;
+		auto ptr = [&](size_t offset) { return segment + (offset - segment_offset); };
+
+		while (true)
+		{
+			auto it = ptr(self->offset);
+
+			if (self->skip_rune)
+			{
+				Rune c = 0;
+				size_t size = 0;
+				if (final == false && it < segment_end && _regex_rune_incomplete(it, segment_end))
+					break;
+				if (_regex_rune_read(it, segment_end, c, size) == false)
+					break;
+				self->offset += size;
+				self->anchor = self->offset;
+				self->skip_rune = false;
+				continue;
+			}
+
+			if (self->state == dfa->forward.start_unanchored)
+			{
+				// all the threads in the start state began at the current offset
+				self->anchor = self->offset;
+				_regex_matcher_record(self);
+
+				// skip to the next occurrence of the prefix, but keep the last bytes of the segment because the
+				// prefix might continue in the next chunk
+				if (dfa->prefix.count > 0 && it < segment_end)
+				{
+					auto candidate = _regex_literal_find(it, segment_end, dfa->prefix);
+					if (candidate == nullptr)
+					{
+						auto keep = final ? 0 : dfa->prefix.count - 1;
+						candidate = size_t(segment_end - it) > keep ? segment_end - keep : it;
+					}
+					self->offset += size_t(candidate - it);
+					self->anchor = self->offset;
+					it = candidate;
+				}
+			}
+
+			Rune c = 0;
+			size_t size = 0;
+			if (final == false && it < segment_end && _regex_rune_incomplete(it, segment_end))
+				break;
+
+			bool terminal = false;
+			if (_regex_rune_read(it, segment_end, c, size))
+			{
+				self->state = _regex_dfa_next(dfa, dfa->forward, self->state, c);
+				self->offset += size;
+				_regex_matcher_record(self);
+				terminal = self->state->insts_count == 0 && self->state->restart == false;
+			}
+			else if (final)
+			{
+				terminal = true;
+			}
+			else
+			{
+				break;
+			}
+
+			if (terminal == false)
+				continue;
+
+			if (self->pending == false)
+			{
+				// nothing can match anymore
+				if (self->offset >= segment_offset + segment_size)
+					break;
+				self->state = dfa->forward.start_unanchored;
+				continue;
+			}
+
+			// the DFA can't extend the pending match anymore so we report it and continue searching after it
+			auto match_end = ptr(self->match_end);
+			auto match_begin = _regex_dfa_scan_reverse(dfa, dfa->reverse.start_anchored, ptr(self->anchor), match_end);
+
+			Regex_Stream_Match match{};
+			match.begin = segment_offset + size_t(match_begin - segment);
+			match.end = self->match_end;
+			match.with_payload = self->with_payload;
+			match.payload = self->payload;
+			buf_push(self->matches, match);
+
+			self->pending = false;
+			self->offset = self->match_end;
+			self->anchor = self->offset;
+			self->state = dfa->forward.start_unanchored;
+			self->skip_rune = match.begin == match.end;
+			if (self->skip_rune && self->offset >= segment_offset + segment_size && final)
+				break;
+		}
+	}
+
+	// scans the given chunk, the input which might be part of a match is kept in the buffer
+	inline static void
+	_regex_matcher_feed(IRegex_Matcher* self, const char* begin, const char* end, bool final)
+	{
+		auto size = size_t(end - begin);
+		if (self->buffer.count == 0 && self->offset == self->buffer_offset)
+		{
+			// nothing is kept from the previous chunks so we scan the chunk in place
+			_regex_matcher_run(self, begin, self->buffer_offset, size, final);
+			auto chunk_end = self->buffer_offset + size;
+			if (self->anchor < chunk_end)
+				str_block_push(self->buffer, Block{(void*)(begin + (self->anchor - self->buffer_offset)), chunk_end - self->anchor});
+			self->buffer_offset = self->anchor;
+		}
+		else
+		{
+			// the DFA state depends on the kept input, so we continue scanning in the buffer
+			if (size > 0)
+				str_block_push(self->buffer, Block{(void*)begin, size});
+			_regex_matcher_run(self, self->buffer.ptr, self->buffer_offset, self->buffer.count, final);
+			auto consumed = self->anchor - self->buffer_offset;
+			if (consumed > 0)
+			{
+				::memmove(self->buffer.ptr, self->buffer.ptr + consumed, self->buffer.count - consumed);
+				str_resize(self->buffer, self->buffer.count - consumed);
+			}
+			self->buffer_offset = self->anchor;
+		}
+	}
+
+	// API
+	Result<Regex>
+	regex_compile(Regex_Compile_Unit unit)
+	{
+		auto compiler = regex_compiler_new(unit.str);
+		mn_defer{regex_compiler_free(compiler);};
+
+		while (regex_compiler_eof(compiler) == false)
+		{
+			auto ok = regex_compiler_process_rune(compiler);
+			if (ok == false)
+				return Err{ "can't process rune at offset {}", compiler.it - begin(compiler.str) };
+		}
+
+		while (compiler.operators_stack.count > 0)
+			if (regex_compiler_eval(compiler) == false)
+				return Err{ "failed to process regex operator" };
+
+		if (compiler.operands_stack.count != 1)
+			return Err { "no operands in the stack!" };
+
+		auto last_fragment = buf_top(compiler.operands_stack);
+		buf_pop(compiler.operands_stack);
+		mn_defer{regex_free(last_fragment);};
+		if (unit.enable_payload)
+		{
+			push_op(last_fragment, RGX_OP_MATCH2);
+			push_int(last_fragment, unit.payload);
+		}
+		else
+		{
+			push_op(last_fragment, RGX_OP_MATCH);
+		}
+
+		Regex res{};
+		res.bytes = buf_memcpy_clone(last_fragment.bytes, unit.program_allocator);
+		return res;
+	}
+
+	void
+	regex_free(Regex& self)
+	{
+		buf_free(self.bytes);
+		if (self.dfa)
+		{
+			regex_dfa_free(self.dfa);
+			self.dfa = nullptr;
+		}
+	}
+
+	Match_Result
+	regex_match(const Regex& program, const char* str)
+	{
+		return _regex_program_run(program, str, nullptr, false);
+	}
+
+	Match_Result
+	regex_match(const Regex& program, const char* begin, const char* end)
+	{
+		return _regex_range_run(begin, end, [&](const char* b, const char* e) {
+			return _regex_program_run(program, b, e, false);
+		});
+	}
+
+	Match_Result
+	regex_search(const Regex& program, const char* str)
+	{
+		return _regex_program_run(program, str, nullptr, true);
+	}
+
+	Match_Result
+	regex_search(const Regex& program, const char* begin, const char* end)
+	{
+		return _regex_range_run(begin, end, [&](const char* b, const char* e) {
+			return _regex_program_run(program, b, e, true);
+		});
+	}
+
+	Regex_DFA
+	regex_dfa_new(const Regex& program, Allocator allocator)
+	{
+		auto self = alloc_zerod_from<IRegex_DFA>(allocator);
+		if (_regex_dfa_init(self, program, false, allocator) == false)
+			mn_unreachable_msg("invalid regex program");
+		return self;
+	}
+
+	void
+	regex_dfa_free(Regex_DFA self)
+	{
+		auto allocator = self->allocator;
+		_regex_dfa_free(self);
+		free_from(allocator, self);
+	}
+
+	Match_Result
+	regex_dfa_match(Regex_DFA self, const char* str)
+	{
+		return _regex_dfa_match(self, str, nullptr);
+	}
+
+	Match_Result
+	regex_dfa_match(Regex_DFA self, const char* begin, const char* end)
+	{
+		return _regex_range_run(begin, end, [&](const char* b, const char* e) {
+			return _regex_dfa_match(self, b, e);
+		});
+	}
+
+	Match_Result
+	regex_dfa_search(Regex_DFA self, const char* str)
+	{
+		return _regex_dfa_search(self, str, nullptr);
+	}
+
+	Match_Result
+	regex_dfa_search(Regex_DFA self, const char* begin, const char* end)
+	{
+		return _regex_range_run(begin, end, [&](const char* b, const char* e) {
+			return _regex_dfa_search(self, b, e);
+		});
+	}
+
+	size_t
+	regex_dfa_states_count(Regex_DFA self)
+	{
+		return self->forward.states.count + self->reverse.states.count;
+	}
+
+	Regex_Set
+	regex_set_new(Allocator allocator)
+	{
+		auto self = alloc_zerod_from<IRegex_Set>(allocator);
+		self->allocator = allocator;
+		self->programs = buf_with_allocator<Regex>(allocator);
+		self->payloads = buf_with_allocator<int32_t>(allocator);
+		self->found = buf_with_allocator<uint8_t>(allocator);
+		return self;
+	}
+
+	void
+	regex_set_free(Regex_Set self)
+	{
+		destruct(self->programs);
+		buf_free(self->payloads);
+		buf_free(self->found);
+		if (self->dfa)
+			regex_dfa_free(self->dfa);
+		free_from(self->allocator, self);
+	}
+
+	Result<size_t>
+	regex_set_add(Regex_Set self, const Str& pattern, int32_t payload)
+	{
+		// the program payload is the index of the pattern, the user payload is kept on the side
+		auto index = self->programs.count;
+		auto [program, err] = regex_compile_with_payload(pattern, int32_t(index), self->allocator);
+		if (err)
+			return err;
+
+		buf_push(self->programs, program);
+		buf_push(self->payloads, payload);
+
+		// the combined DFA is no longer valid
+		if (self->dfa)
+		{
+			regex_dfa_free(self->dfa);
+			self->dfa = nullptr;
+		}
+		return index;
+	}
+
+	size_t
+	regex_set_count(Regex_Set self)
+	{
+		return self->programs.count;
+	}
+
+	bool
+	regex_set_search_all(Regex_Set self, const char* str, Buf<int32_t>& payloads)
+	{
+		return _regex_set_search_all(self, str, nullptr, payloads);
+	}
+
+	bool
+	regex_set_search_all(Regex_Set self, const char* begin, const char* end, Buf<int32_t>& payloads)
+	{
+		if (begin == end)
+			return _regex_set_search_all(self, "", nullptr, payloads);
+		return _regex_set_search_all(self, begin, end, payloads);
+	}
+
+	Match_Result
+	regex_set_search_first(Regex_Set self, const char* str)
+	{
+		return _regex_set_search_first(self, str, nullptr);
+	}
+
+	Match_Result
+	regex_set_search_first(Regex_Set self, const char* begin, const char* end)
+	{
+		return _regex_range_run(begin, end, [&](const char* b, const char* e) {
+			return _regex_set_search_first(self, b, e);
+		});
+	}
+
+	Regex_Matcher
+	regex_matcher_new(const Regex& program, Allocator allocator)
+	{
+		auto self = alloc_zerod_from<IRegex_Matcher>(allocator);
+		self->allocator = allocator;
+		if (_regex_dfa_init(&self->dfa, program, false, allocator) == false)
+			mn_unreachable_msg("invalid regex program");
+		_regex_dfa_literals_extract(&self->dfa);
+		self->state = self->dfa.forward.start_unanchored;
+		self->buffer = str_with_allocator(allocator);
+		self->matches = buf_with_allocator<Regex_Stream_Match>(allocator);
+		return self;
+	}
+
+	void
+	regex_matcher_free(Regex_Matcher self)
+	{
+		_regex_dfa_free(&self->dfa);
+		str_free(self->buffer);
+		buf_free(self->matches);
+		free_from(self->allocator, self);
+	}
+
+	void
+	regex_matcher_feed(Regex_Matcher self, const char* begin, const char* end)
+	{
+		mn_assert_msg(self->finished == false, "regex matcher is already finished");
+		if (begin == end)
+			return;
+		_regex_matcher_feed(self, begin, end, false);
+	}
+
+	void
+	regex_matcher_finish(Regex_Matcher self)
+	{
+		if (self->finished)
+			return;
+		const char* empty = "";
+		_regex_matcher_feed(self, empty, empty, true);
+		self->finished = true;
+	}
+
+	bool
+	regex_matcher_next(Regex_Matcher self, Regex_Stream_Match& match)
+	{
+		if (self->matches_cursor >= self->matches.count)
+		{
+			buf_clear(self->matches);
+			self->matches_cursor = 0;
+			return false;
+		}
+
+		match = self->matches[self->matches_cursor++];
+		return true;
+	}
+
+	bool
+	regex_matcher_next(Regex_Matcher self, Reader reader, Regex_Stream_Match& match)
+	{
+		while (regex_matcher_next(self, match) == false)
+		{
+			if (self->finished)
+				return false;
+
+			auto chunk = reader_peek(reader, 0);
+			if (chunk.size == 0)
+				chunk = reader_peek(reader, REGEX_MATCHER_CHUNK_SIZE);
+
+			if (chunk.size == 0)
+			{
+				regex_matcher_finish(self);
+				continue;
+			}
+
+			auto begin = (const char*)chunk.ptr;
+			regex_matcher_feed(self, begin, begin + chunk.size);
+			reader_skip(reader, chunk.size);
+		}
+		return true;
 	}
-}
\ No newline at end of file
+}
@@ -1,20 +1,157 @@
 #include "mn/Rune.h"
 #include "mn/Assert.h"
+#include "mn/SIMD.h"
 
 #include "utf8proc/utf8proc.h"
 
+#include <string.h>
+
 namespace mn
 {
+	// validates a single multi-byte rune starting at the given index, and returns its size in bytes or 0 if it's not valid
+	// the valid ranges of the second byte are taken from the well-formed utf-8 table in the unicode standard
+	inline static size_t
+	_rune_utf8_validate_multibyte(const uint8_t* str, size_t count)
+	{
+		uint8_t c = str[0];
+		size_t size = 0;
+		uint8_t lo = 0x80, hi = 0xBF;
+		if (c >= 0xC2 && c <= 0xDF)
+		{
+			size = 2;
+		}
+		else if (c == 0xE0)
+		{
+			size = 3;
+			lo = 0xA0;
+		}
+		else if ((c >= 0xE1 && c <= 0xEC) || c == 0xEE || c == 0xEF)
+		{
+			size = 3;
+		}
+		else if (c == 0xED)
+		{
+			// exclude the surrogates
+			size = 3;
+			hi = 0x9F;
+		}
+		else if (c == 0xF0)
+		{
+			size = 4;
+			lo = 0x90;
+		}
+		else if (c >= 0xF1 && c <= 0xF3)
+		{
+			size = 4;
+		}
+		else if (c == 0xF4)
+		{
+			size = 4;
+			hi = 0x8F;
+		}
+		else
+		{
+			return 0;
+		}
+
+		if (count < size)
+			return 0;
+
+		if (str[1] < lo || str[1] > hi)
+			return 0;
+
+		for (size_t i = 2; i < size; ++i)
+			if ((str[i] & 0xC0) != 0x80)
+				return 0;
+
+		return size;
+	}
+
+	// API
 	size_t
 	rune_count(const char* str)
+	{
+		if (str == nullptr)
+			return 0;
+		return rune_count(str, ::strlen(str));
+	}
+
+	size_t
+	rune_count(const char* str, size_t count)
 	{
 		size_t result = 0;
-		while(str != nullptr && *str != '\0')
+		size_t i = 0;
+
+		#if MN_SIMD_SSE2
+			// a rune starts at every byte that's not a continuation byte (0b10xxxxxx), continuation bytes are
+			// the only bytes in the [-128, -65] range when interpreted as signed chars
+			const __m128i continuation_max = _mm_set1_epi8(-65);
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+				int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(v, continuation_max));
+				result += mn_simd_popcount(uint32_t(mask));
+			}
+		#endif
+
+		for (; i < count; ++i)
+			result += ((str[i] & 0xC0) != 0x80);
+		return result;
+	}
+
+	bool
+	rune_utf8_valid(const char* str, size_t count)
+	{
+		auto bytes = (const uint8_t*)str;
+		size_t i = 0;
+		while (i < count)
 		{
-			result += ((*str & 0xC0) != 0x80);
-			++str;
+			#if MN_SIMD_SSE2
+				// skip ascii runs 16 bytes at a time and jump directly to the first non ascii byte
+				if (i + 16 <= count)
+				{
+					__m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+					int mask = _mm_movemask_epi8(v);
+					if (mask == 0)
+					{
+						i += 16;
+						continue;
+					}
+					i += mn_simd_ctz(uint32_t(mask));
+				}
+			#endif
+
+			if (bytes[i] < 0x80)
+			{
+				++i;
+				continue;
+			}
+
+			auto size = _rune_utf8_validate_multibyte(bytes + i, count - i);
+			if (size == 0)
+				return false;
+			i += size;
 		}
-		return result;
+		return true;
+	}
+
+	bool
+	rune_is_ascii(const char* str, size_t count)
+	{
+		size_t i = 0;
+
+		#if MN_SIMD_SSE2
+			__m128i acc = _mm_setzero_si128();
+			for (; i + 16 <= count; i += 16)
+				acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(str + i)));
+			if (_mm_movemask_epi8(acc) != 0)
+				return false;
+		#endif
+
+		uint8_t acc_scalar = 0;
+		for (; i < count; ++i)
+			acc_scalar |= uint8_t(str[i]);
+		return acc_scalar < 0x80;
 	}
 
 	Rune
@@ -86,6 +223,10 @@ namespace mn
 		if(*c == 0)
 			return 0;
 
+		// ascii fast path
+		if (uint8_t(*c) < 0x80)
+			return *c;
+
 		size_t str_count = 1;
 		for(size_t i = 1; i < 4; ++i)
 		{
@@ -1,4 +1,5 @@
 #include "mn/Str.h"
+#include "mn/SIMD.h"
 
 namespace mn
 {
@@ -48,6 +49,96 @@ namespace mn
 		return res;
 	}
 
+	// converts the ascii letters in the given range in place and returns the index of the first non ascii byte
+	// or count if all the bytes are ascii, non ascii bytes are never touched
+	inline static size_t
+	_str_ascii_case_convert(char* ptr, size_t count, bool upper)
+	{
+		char first = upper ? 'a' : 'A';
+		char last = upper ? 'z' : 'Z';
+
+		size_t i = 0;
+		#if MN_SIMD_SSE2
+			// non ascii bytes are negative when treated as signed chars so they never fall in the letters range
+			const __m128i range_begin = _mm_set1_epi8(first - 1);
+			const __m128i range_end = _mm_set1_epi8(last + 1);
+			const __m128i case_bit = _mm_set1_epi8(0x20);
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+				__m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(v, range_begin), _mm_cmplt_epi8(v, range_end));
+				v = _mm_xor_si128(v, _mm_and_si128(is_letter, case_bit));
+				_mm_storeu_si128((__m128i*)(ptr + i), v);
+
+				int non_ascii = _mm_movemask_epi8(v);
+				if (non_ascii != 0)
+					return i + mn_simd_ctz(uint32_t(non_ascii));
+			}
+		#endif
+
+		for (; i < count; ++i)
+		{
+			char c = ptr[i];
+			if (uint8_t(c) >= 0x80)
+				return i;
+			if (c >= first && c <= last)
+				ptr[i] = c ^ 0x20;
+		}
+		return count;
+	}
+
+	inline static void
+	_str_case_convert(Str& self, bool upper)
+	{
+		if (self.count == 0)
+			return;
+
+		// string literals don't own their memory so we can't write into them
+		if (self.allocator == nullptr)
+			self = str_clone(self);
+
+		size_t i = 0;
+		while (i < self.count)
+		{
+			i += _str_ascii_case_convert(self.ptr + i, self.count - i, upper);
+			if (i >= self.count)
+				break;
+
+			const char* it = self.ptr + i;
+			auto next = rune_next(it);
+			auto r = rune_read(it);
+			auto converted = upper ? rune_upper(r) : rune_lower(r);
+			if (converted == r)
+			{
+				i = next - self.ptr;
+				continue;
+			}
+
+			char encoded[4];
+			auto encoded_size = rune_encode(converted, Block{ encoded, sizeof(encoded) });
+			if (encoded_size == size_t(next - it))
+			{
+				::memcpy(self.ptr + i, encoded, encoded_size);
+				i = next - self.ptr;
+				continue;
+			}
+
+			// the converted rune has a different size, so we can't convert in place, we fallback to building a new
+			// string starting from the current rune
+			auto new_str = str_with_allocator(self.allocator);
+			str_reserve(new_str, self.count + 1);
+			str_block_push(new_str, Block{ self.ptr, i });
+			for (; it != end(self); it = rune_next(it))
+			{
+				auto c = rune_read(it);
+				str_push(new_str, upper ? rune_upper(c) : rune_lower(c));
+			}
+			str_free(self);
+			self = new_str;
+			return;
+		}
+	}
+
 	// API
 	Str
 	str_new()
@@ -414,22 +505,12 @@ namespace mn
 	void
 	str_lower(Str& self)
 	{
-		auto new_str = str_with_allocator(self.allocator);
-		str_reserve(new_str, self.count);
-		for(const char* it = begin(self); it != end(self); it = rune_next(it))
-			str_push(new_str, rune_lower(rune_read(it)));
-		str_free(self);
-		self = new_str;
+		_str_case_convert(self, false);
 	}
 
 	void
 	str_upper(Str& self)
 	{
-		auto new_str = str_with_allocator(self.allocator);
-		str_reserve(new_str, self.count);
-		for(const char* it = begin(self); it != end(self); it = rune_next(it))
-			str_push(new_str, rune_upper(rune_read(it)));
-		str_free(self);
-		self = new_str;
+		_str_case_convert(self, true);
 	}
-}
+}
\ No newline at end of file
@@ -0,0 +1,550 @@
+#include "mn/Trace.h"
+#include "mn/Context.h"
+#include "mn/Thread.h"
+#include "mn/Process.h"
+#include "mn/Json.h"
+#include "mn/Buf.h"
+#include "mn/Str.h"
+#include "mn/Str_Intern.h"
+#include "mn/Defer.h"
+#include "mn/Thread_State.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace mn
+{
+	constexpr size_t TRACE_DEFAULT_EVENTS_PER_THREAD = 16384;
+	constexpr uint64_t TRACE_DEFAULT_MUTEX_WAIT_THRESHOLD_NS = 1000;
+	// the maximum nesting of mutex locks inside the thread profile hooks which the tracer keeps track of
+	constexpr size_t TRACE_MAX_MUTEX_WAITS = 8;
+
+	enum TRACE_PHASE: uint8_t
+	{
+		TRACE_PHASE_BEGIN,
+		TRACE_PHASE_END,
+		TRACE_PHASE_COMPLETE,
+		TRACE_PHASE_INSTANT,
+	};
+
+	struct Trace_Event
+	{
+		uint64_t ts_ns;
+		// only used by complete events
+		uint64_t duration_ns;
+		const char* name;
+		const char* category;
+		TRACE_PHASE phase;
+	};
+
+	struct Trace_Mutex_Wait
+	{
+		uint64_t start_ns;
+		// whether the previous thread profile interface asked for its after lock hook
+		bool call_previous;
+	};
+
+	struct Trace_Thread
+	{
+		// the number of events which were ever written to the ring buffer, only the owning thread writes it, the event
+		// at index i lives in events[i & (capacity - 1)]
+		std::atomic<uint64_t> head;
+		Trace_Event* events;
+		size_t capacity;
+		// the trace session which the ring buffer belongs to, the owning thread reallocates it when a new trace starts
+		uint64_t session;
+		uint64_t tid;
+		const char* name;
+		bool alive;
+		Trace_Mutex_Wait mutex_waits[TRACE_MAX_MUTEX_WAITS];
+		size_t mutex_waits_count;
+	};
+
+	struct Tracer
+	{
+		// protects the threads list and the ring buffer allocations, recording events doesn't touch it
+		Thread_State_Registry<Trace_Thread> threads;
+		bool initialized;
+		std::atomic<bool> running;
+		std::atomic<uint64_t> session;
+		std::chrono::steady_clock::time_point start_time;
+		Trace_Settings settings;
+		Thread_Profile_Interface previous;
+		Str_Intern names;
+	};
+
+	inline static Tracer*
+	_tracer()
+	{
+		static Tracer self{};
+		return &self;
+	}
+
+	inline static void
+	_trace_init(Tracer* self)
+	{
+		if (self->initialized)
+			return;
+		self->names = str_intern_with_allocator(memory::clib());
+		self->initialized = true;
+	}
+
+	// returns the state of the calling thread, or nullptr if the thread is exiting
+	inline static Trace_Thread*
+	_trace_thread_get()
+	{
+		auto self = _tracer();
+		return thread_state_get(self->threads,
+			[](Trace_Thread* thread) {
+				// the events of the exited thread are dropped
+				thread->head.store(0, std::memory_order_relaxed);
+				thread->tid = uint64_t(uintptr_t(thread_id()));
+				thread->name = nullptr;
+				thread->mutex_waits_count = 0;
+				return true;
+			},
+			[] {
+				auto thread = alloc_zerod_from<Trace_Thread>(memory::clib());
+				thread->tid = uint64_t(uintptr_t(thread_id()));
+				return thread;
+			}
+		);
+	}
+
+	inline static uint64_t
+	_trace_now(Tracer* self)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - self->start_time).count();
+	}
+
+	inline static void
+	_trace_push(Trace_Thread* thread, const Trace_Event& event)
+	{
+		auto self = _tracer();
+		auto session = self->session.load(std::memory_order_acquire);
+		if (thread->session != session)
+		{
+			// a new trace started, the ring buffer is reallocated with the new settings
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			auto capacity = self->settings.events_per_thread;
+			if (thread->capacity != capacity)
+			{
+				if (thread->events)
+					free_from(memory::clib(), Block{thread->events, thread->capacity * sizeof(Trace_Event)});
+				thread->events = (Trace_Event*)alloc_from(memory::clib(), capacity * sizeof(Trace_Event), alignof(Trace_Event)).ptr;
+				thread->capacity = capacity;
+			}
+			thread->head.store(0, std::memory_order_relaxed);
+			thread->session = session;
+		}
+
+		auto head = thread->head.load(std::memory_order_relaxed);
+		thread->events[head & (thread->capacity - 1)] = event;
+		thread->head.store(head + 1, std::memory_order_release);
+	}
+
+	inline static void
+	_trace_record(TRACE_PHASE phase, const char* name, const char* category, uint64_t ts_ns, uint64_t duration_ns)
+	{
+		auto self = _tracer();
+		if (self->running.load(std::memory_order_relaxed) == false)
+			return;
+
+		auto thread = _trace_thread_get();
+		if (thread == nullptr)
+			return;
+
+		Trace_Event event{};
+		event.ts_ns = ts_ns;
+		event.duration_ns = duration_ns;
+		event.name = name;
+		event.category = category;
+		event.phase = phase;
+		_trace_push(thread, event);
+	}
+
+	inline static const char*
+	_trace_mutex_name(const Source_Location* srcloc)
+	{
+		if (srcloc && srcloc->name)
+			return srcloc->name;
+		return "mutex";
+	}
+
+	inline static bool
+	_trace_mutex_wait_begin(bool call_previous)
+	{
+		auto thread = _trace_thread_get();
+		if (thread == nullptr)
+			return call_previous;
+
+		if (thread->mutex_waits_count < TRACE_MAX_MUTEX_WAITS)
+			thread->mutex_waits[thread->mutex_waits_count] = Trace_Mutex_Wait{_trace_now(_tracer()), call_previous};
+		++thread->mutex_waits_count;
+		return true;
+	}
+
+	// returns whether the after lock hook of the previous thread profile interface should be called
+	inline static bool
+	_trace_mutex_wait_end(const char* name)
+	{
+		auto self = _tracer();
+		auto thread = thread_state_current(self->threads);
+		if (thread == nullptr || thread->mutex_waits_count == 0)
+			return false;
+
+		--thread->mutex_waits_count;
+		if (thread->mutex_waits_count >= TRACE_MAX_MUTEX_WAITS)
+			return false;
+
+		auto wait = thread->mutex_waits[thread->mutex_waits_count];
+		auto now = _trace_now(self);
+		if (now - wait.start_ns >= self->settings.mutex_wait_threshold_ns)
+			_trace_record(TRACE_PHASE_COMPLETE, name, "mutex", wait.start_ns, now - wait.start_ns);
+		return wait.call_previous;
+	}
+
+	// thread profile hooks, they forward everything to the previous interface so the tracer can run alongside other
+	// profilers, the user data belongs to the previous interface
+	static void
+	_trace_hook_thread_new(Thread handle, const char* name)
+	{
+		auto self = _tracer();
+		trace_thread_name(name);
+		if (self->previous.thread_new)
+			self->previous.thread_new(handle, name);
+	}
+
+	static void*
+	_trace_hook_mutex_new(Mutex handle, const char* name)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_new)
+			return self->previous.mutex_new(handle, name);
+		return nullptr;
+	}
+
+	static void
+	_trace_hook_mutex_free(Mutex handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_free)
+			self->previous.mutex_free(handle, user_data);
+	}
+
+	static bool
+	_trace_hook_mutex_before_lock(Mutex handle, void* user_data)
+	{
+		auto self = _tracer();
+		bool call_previous = false;
+		if (self->previous.mutex_before_lock)
+			call_previous = self->previous.mutex_before_lock(handle, user_data);
+		return _trace_mutex_wait_begin(call_previous);
+	}
+
+	static void
+	_trace_hook_mutex_after_lock(Mutex handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (_trace_mutex_wait_end(_trace_mutex_name(mutex_source_location(handle))) && self->previous.mutex_after_lock)
+			self->previous.mutex_after_lock(handle, user_data);
+	}
+
+	static void
+	_trace_hook_mutex_after_unlock(Mutex handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_after_unlock)
+			self->previous.mutex_after_unlock(handle, user_data);
+	}
+
+	static void*
+	_trace_hook_mutex_rw_new(Mutex_RW handle, const char* name)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_rw_new)
+			return self->previous.mutex_rw_new(handle, name);
+		return nullptr;
+	}
+
+	static void
+	_trace_hook_mutex_rw_free(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_rw_free)
+			self->previous.mutex_rw_free(handle, user_data);
+	}
+
+	static bool
+	_trace_hook_mutex_before_read_lock(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		bool call_previous = false;
+		if (self->previous.mutex_before_read_lock)
+			call_previous = self->previous.mutex_before_read_lock(handle, user_data);
+		return _trace_mutex_wait_begin(call_previous);
+	}
+
+	static void
+	_trace_hook_mutex_after_read_lock(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (_trace_mutex_wait_end(_trace_mutex_name(mutex_rw_source_location(handle))) && self->previous.mutex_after_read_lock)
+			self->previous.mutex_after_read_lock(handle, user_data);
+	}
+
+	static bool
+	_trace_hook_mutex_before_write_lock(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		bool call_previous = false;
+		if (self->previous.mutex_before_write_lock)
+			call_previous = self->previous.mutex_before_write_lock(handle, user_data);
+		return _trace_mutex_wait_begin(call_previous);
+	}
+
+	static void
+	_trace_hook_mutex_after_write_lock(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (_trace_mutex_wait_end(_trace_mutex_name(mutex_rw_source_location(handle))) && self->previous.mutex_after_write_lock)
+			self->previous.mutex_after_write_lock(handle, user_data);
+	}
+
+	static void
+	_trace_hook_mutex_after_read_unlock(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_after_read_unlock)
+			self->previous.mutex_after_read_unlock(handle, user_data);
+	}
+
+	static void
+	_trace_hook_mutex_after_write_unlock(Mutex_RW handle, void* user_data)
+	{
+		auto self = _tracer();
+		if (self->previous.mutex_after_write_unlock)
+			self->previous.mutex_after_write_unlock(handle, user_data);
+	}
+
+	inline static const char*
+	_trace_phase_name(TRACE_PHASE phase)
+	{
+		switch (phase)
+		{
+		case TRACE_PHASE_BEGIN: return "B";
+		case TRACE_PHASE_END: return "E";
+		case TRACE_PHASE_COMPLETE: return "X";
+		case TRACE_PHASE_INSTANT: return "i";
+		default: return "i";
+		}
+	}
+
+	// API
+	void
+	trace_start(const Trace_Settings& settings)
+	{
+		auto self = _tracer();
+		std::lock_guard<std::mutex> lock(self->threads.mtx);
+		_trace_init(self);
+
+		self->settings = settings;
+		if (self->settings.events_per_thread == 0)
+			self->settings.events_per_thread = TRACE_DEFAULT_EVENTS_PER_THREAD;
+		size_t capacity = 1;
+		while (capacity < self->settings.events_per_thread)
+			capacity *= 2;
+		self->settings.events_per_thread = capacity;
+		if (self->settings.mutex_wait_threshold_ns == 0)
+			self->settings.mutex_wait_threshold_ns = TRACE_DEFAULT_MUTEX_WAIT_THRESHOLD_NS;
+
+		self->start_time = std::chrono::steady_clock::now();
+		self->session.fetch_add(1, std::memory_order_release);
+
+		if (self->running.load() == false)
+		{
+			Thread_Profile_Interface interface{};
+			interface.thread_new = _trace_hook_thread_new;
+			interface.mutex_new = _trace_hook_mutex_new;
+			interface.mutex_free = _trace_hook_mutex_free;
+			interface.mutex_before_lock = _trace_hook_mutex_before_lock;
+			interface.mutex_after_lock = _trace_hook_mutex_after_lock;
+			interface.mutex_after_unlock = _trace_hook_mutex_after_unlock;
+			interface.mutex_rw_new = _trace_hook_mutex_rw_new;
+			interface.mutex_rw_free = _trace_hook_mutex_rw_free;
+			interface.mutex_before_read_lock = _trace_hook_mutex_before_read_lock;
+			interface.mutex_after_read_lock = _trace_hook_mutex_after_read_lock;
+			interface.mutex_before_write_lock = _trace_hook_mutex_before_write_lock;
+			interface.mutex_after_write_lock = _trace_hook_mutex_after_write_lock;
+			interface.mutex_after_read_unlock = _trace_hook_mutex_after_read_unlock;
+			interface.mutex_after_write_unlock = _trace_hook_mutex_after_write_unlock;
+			self->previous = thread_profile_interface_set(interface);
+			self->running.store(true);
+		}
+	}
+
+	void
+	trace_stop()
+	{
+		auto self = _tracer();
+		std::lock_guard<std::mutex> lock(self->threads.mtx);
+		if (self->running.load() == false)
+			return;
+		self->running.store(false);
+		thread_profile_interface_set(self->previous);
+	}
+
+	bool
+	trace_enabled()
+	{
+		return _tracer()->running.load(std::memory_order_relaxed);
+	}
+
+	uint64_t
+	trace_now()
+	{
+		return _trace_now(_tracer());
+	}
+
+	void
+	trace_thread_name(const char* name)
+	{
+		auto thread = _trace_thread_get();
+		if (thread == nullptr || name == nullptr)
+			return;
+
+		auto self = _tracer();
+		std::lock_guard<std::mutex> lock(self->threads.mtx);
+		_trace_init(self);
+		thread->name = str_intern(self->names, name);
+	}
+
+	void
+	trace_begin(const char* name, const char* category)
+	{
+		_trace_record(TRACE_PHASE_BEGIN, name, category, trace_now(), 0);
+	}
+
+	void
+	trace_end()
+	{
+		_trace_record(TRACE_PHASE_END, nullptr, nullptr, trace_now(), 0);
+	}
+
+	void
+	trace_complete(const char* name, const char* category, uint64_t start_ns)
+	{
+		auto now = trace_now();
+		_trace_record(TRACE_PHASE_COMPLETE, name, category, start_ns, now > start_ns ? now - start_ns : 0);
+	}
+
+	void
+	trace_instant(const char* name, const char* category)
+	{
+		_trace_record(TRACE_PHASE_INSTANT, name, category, trace_now(), 0);
+	}
+
+	Err
+	trace_write_chrome_json(Stream out)
+	{
+		auto self = _tracer();
+		auto pid = int64_t(process_id().id);
+
+		auto json = str_new();
+		mn_defer{str_free(json);};
+		auto events = buf_new<Trace_Event>();
+		mn_defer{buf_free(events);};
+
+		auto writer = json::json_writer_new(&json);
+		json::json_writer_begin_object(writer);
+		json::json_writer_key(writer, "displayTimeUnit");
+		json::json_writer_string(writer, "ns");
+		json::json_writer_key(writer, "traceEvents");
+		json::json_writer_begin_array(writer);
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			auto session = self->session.load();
+			for (auto thread: self->threads.states)
+			{
+				if (thread->session != session || thread->events == nullptr)
+					continue;
+
+				if (thread->name)
+				{
+					json::json_writer_begin_object(writer);
+					json::json_writer_key(writer, "name");
+					json::json_writer_string(writer, "thread_name");
+					json::json_writer_key(writer, "ph");
+					json::json_writer_string(writer, "M");
+					json::json_writer_key(writer, "pid");
+					json::json_writer_int(writer, pid);
+					json::json_writer_key(writer, "tid");
+					json::json_writer_int(writer, int64_t(thread->tid));
+					json::json_writer_key(writer, "args");
+					json::json_writer_begin_object(writer);
+					json::json_writer_key(writer, "name");
+					json::json_writer_string(writer, thread->name);
+					json::json_writer_end_object(writer);
+					json::json_writer_end_object(writer);
+				}
+
+				// the owning thread keeps writing while we copy, so the events which it might have overwritten (and
+				// the one it might be writing right now) are dropped after the copy
+				auto head = thread->head.load(std::memory_order_acquire);
+				auto first = head > thread->capacity ? head - thread->capacity : 0;
+				buf_clear(events);
+				for (auto i = first; i < head; ++i)
+					buf_push(events, thread->events[i & (thread->capacity - 1)]);
+				auto new_head = thread->head.load(std::memory_order_acquire);
+				auto valid_first = new_head >= thread->capacity ? new_head - thread->capacity + 1 : 0;
+
+				for (size_t i = 0; i < events.count; ++i)
+				{
+					if (first + i < valid_first)
+						continue;
+
+					const auto& event = events[i];
+					json::json_writer_begin_object(writer);
+					if (event.name)
+					{
+						json::json_writer_key(writer, "name");
+						json::json_writer_string(writer, event.name);
+					}
+					if (event.category)
+					{
+						json::json_writer_key(writer, "cat");
+						json::json_writer_string(writer, event.category);
+					}
+					json::json_writer_key(writer, "ph");
+					json::json_writer_string(writer, _trace_phase_name(event.phase));
+					json::json_writer_key(writer, "ts");
+					json::json_writer_double(writer, double(event.ts_ns) / 1000.0);
+					if (event.phase == TRACE_PHASE_COMPLETE)
+					{
+						json::json_writer_key(writer, "dur");
+						json::json_writer_double(writer, double(event.duration_ns) / 1000.0);
+					}
+					else if (event.phase == TRACE_PHASE_INSTANT)
+					{
+						json::json_writer_key(writer, "s");
+						json::json_writer_string(writer, "t");
+					}
+					json::json_writer_key(writer, "pid");
+					json::json_writer_int(writer, pid);
+					json::json_writer_key(writer, "tid");
+					json::json_writer_int(writer, int64_t(thread->tid));
+					json::json_writer_end_object(writer);
+				}
+			}
+		}
+		json::json_writer_end_array(writer);
+		json::json_writer_end_object(writer);
+		json::json_writer_free(writer);
+
+		auto written = stream_write(out, block_from(json));
+		if (written != json.count)
+			return Err{"failed to write trace, only {} bytes out of {} were written", written, json.count};
+		return Err{};
+	}
+}
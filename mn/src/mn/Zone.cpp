@@ -0,0 +1,219 @@
+#include "mn/Zone.h"
+#include "mn/Memory.h"
+#include "mn/Thread.h"
+#include "mn/Histogram.h"
+#include "mn/Thread_State.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <string.h>
+
+namespace mn
+{
+	// the id of the sites which were registered after the sites limit was reached
+	constexpr uint32_t ZONE_SITE_DROPPED = UINT32_MAX;
+	// the minimum time between the two timestamps which are used to measure the tick frequency
+	constexpr uint64_t ZONE_CALIBRATION_MIN_NS = 10000000;
+
+	struct Zone_Thread
+	{
+		// the reset generation which the counters belong to
+		std::atomic<uint64_t> generation;
+		// indexed by the site id - 1, the counters of a site are allocated the first time the thread records it, only
+		// the owning thread writes to them
+		std::atomic<Atomic_Histogram*> counters[ZONE_SITES_MAX];
+		// the counters are kept when the state is reused since they accumulate the durations of all the threads anyway
+		bool alive;
+	};
+
+	struct Zone_Profiler
+	{
+		// its mutex protects the sites list too, recording zones doesn't touch it
+		Thread_State_Registry<Zone_Thread> threads;
+		bool initialized;
+		std::atomic<uint64_t> generation;
+		Buf<Zone_Site*> sites;
+		// the first timestamp which is used to measure the tick frequency
+		uint64_t calibration_ticks;
+		std::chrono::steady_clock::time_point calibration_time;
+	};
+
+	static Zone_Profiler ZONE_PROFILER;
+
+	inline static void
+	_zone_profiler_init(Zone_Profiler* self)
+	{
+		if (self->initialized)
+			return;
+		self->sites = buf_with_allocator<Zone_Site*>(memory::clib());
+		self->calibration_ticks = zone_ticks();
+		self->calibration_time = std::chrono::steady_clock::now();
+		self->initialized = true;
+	}
+
+	// returns the id of the given site after registering it, sites which don't fit get ZONE_SITE_DROPPED
+	inline static uint32_t
+	_zone_site_register(Zone_Site* site)
+	{
+		auto self = &ZONE_PROFILER;
+		std::lock_guard<std::mutex> lock(self->threads.mtx);
+		_zone_profiler_init(self);
+
+		auto id = site->id.load(std::memory_order_relaxed);
+		if (id != 0)
+			return id;
+
+		if (self->sites.count < ZONE_SITES_MAX)
+		{
+			buf_push(self->sites, site);
+			id = uint32_t(self->sites.count);
+		}
+		else
+		{
+			id = ZONE_SITE_DROPPED;
+		}
+		site->id.store(id, std::memory_order_release);
+		return id;
+	}
+
+	// returns the state of the calling thread, or nullptr if the thread is exiting
+	inline static Zone_Thread*
+	_zone_thread_get()
+	{
+		auto self = &ZONE_PROFILER;
+		return thread_state_get(self->threads,
+			[](Zone_Thread*) { return true; },
+			[self] {
+				_zone_profiler_init(self);
+				auto thread = alloc_zerod_from<Zone_Thread>(memory::clib());
+				thread->generation.store(self->generation.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				return thread;
+			}
+		);
+	}
+
+	// clears the counters of the calling thread after a reset
+	inline static void
+	_zone_thread_clear(Zone_Thread* thread, uint64_t generation)
+	{
+		for (auto& it: thread->counters)
+		{
+			auto counters = it.load(std::memory_order_relaxed);
+			if (counters == nullptr)
+				continue;
+			atomic_histogram_clear(*counters);
+		}
+		// the report only reads the counters of the threads which are in the current generation
+		thread->generation.store(generation, std::memory_order_release);
+	}
+
+	// returns the nanoseconds per tick, it's measured between the profiler initialization and now
+	inline static double
+	_zone_ns_per_tick(Zone_Profiler* self)
+	{
+		uint64_t start_ticks = 0;
+		std::chrono::steady_clock::time_point start_time{};
+		{
+			std::lock_guard<std::mutex> lock(self->threads.mtx);
+			if (self->initialized == false)
+				return 1;
+			start_ticks = self->calibration_ticks;
+			start_time = self->calibration_time;
+		}
+
+		auto elapsed_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+		if (elapsed_ns < ZONE_CALIBRATION_MIN_NS)
+			thread_sleep(uint32_t((ZONE_CALIBRATION_MIN_NS - elapsed_ns) / 1000000 + 1));
+
+		auto ticks = zone_ticks();
+		elapsed_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+		if (ticks <= start_ticks)
+			return 1;
+		return double(elapsed_ns) / double(ticks - start_ticks);
+	}
+
+	// API
+	void
+	_zone_record(Zone_Site* site, uint64_t ticks)
+	{
+		auto id = site->id.load(std::memory_order_acquire);
+		if (id == 0)
+			id = _zone_site_register(site);
+		if (id == ZONE_SITE_DROPPED)
+			return;
+
+		auto thread = _zone_thread_get();
+		if (thread == nullptr)
+			return;
+
+		auto generation = ZONE_PROFILER.generation.load(std::memory_order_relaxed);
+		if (thread->generation.load(std::memory_order_relaxed) != generation)
+			_zone_thread_clear(thread, generation);
+
+		auto& slot = thread->counters[id - 1];
+		auto counters = slot.load(std::memory_order_relaxed);
+		if (counters == nullptr)
+		{
+			counters = alloc_zerod_from<Atomic_Histogram>(memory::clib());
+			slot.store(counters, std::memory_order_release);
+		}
+
+		atomic_histogram_record(*counters, ticks);
+	}
+
+	Buf<Zone_Stats>
+	zone_report(Allocator allocator)
+	{
+		auto self = &ZONE_PROFILER;
+		auto res = buf_with_allocator<Zone_Stats>(allocator);
+		auto ns_per_tick = _zone_ns_per_tick(self);
+
+		std::lock_guard<std::mutex> lock(self->threads.mtx);
+		if (self->initialized == false)
+			return res;
+
+		auto generation = self->generation.load(std::memory_order_relaxed);
+		// the histogram is too big for the stack of some threads
+		auto merged = alloc_from<Histogram>(memory::clib());
+		mn_defer{free_from(memory::clib(), merged);};
+
+		for (size_t i = 0; i < self->sites.count; ++i)
+		{
+			::memset(merged, 0, sizeof(*merged));
+			for (auto thread: self->threads.states)
+			{
+				if (thread->generation.load(std::memory_order_acquire) != generation)
+					continue;
+				auto counters = thread->counters[i].load(std::memory_order_acquire);
+				if (counters == nullptr)
+					continue;
+				histogram_merge(*merged, *counters);
+			}
+			if (merged->count == 0)
+				continue;
+
+			Zone_Stats stats{};
+			stats.srcloc = &self->sites[i]->srcloc;
+			stats.count = merged->count;
+			stats.total_ns = uint64_t(double(merged->sum) * ns_per_tick);
+			stats.min_ns = uint64_t(double(merged->min) * ns_per_tick);
+			stats.max_ns = uint64_t(double(merged->max) * ns_per_tick);
+			stats.p50_ns = uint64_t(double(histogram_percentile(*merged, 50)) * ns_per_tick);
+			stats.p90_ns = uint64_t(double(histogram_percentile(*merged, 90)) * ns_per_tick);
+			stats.p99_ns = uint64_t(double(histogram_percentile(*merged, 99)) * ns_per_tick);
+			buf_push(res, stats);
+		}
+
+		std::sort(begin(res), end(res), [](const Zone_Stats& a, const Zone_Stats& b) {
+			return a.total_ns > b.total_ns;
+		});
+		return res;
+	}
+
+	void
+	zone_reset()
+	{
+		ZONE_PROFILER.generation.fetch_add(1, std::memory_order_relaxed);
+	}
+}
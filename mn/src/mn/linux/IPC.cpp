@@ -2,13 +2,20 @@
 #include "mn/Str.h"
 #include "mn/Memory.h"
 #include "mn/Fabric.h"
+#include "mn/Thread.h"
+
+#include <atomic>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <linux/futex.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 #include <poll.h>
 
@@ -38,6 +45,480 @@ namespace mn::ipc
 		return fcntl(intptr_t(self), F_SETLK, &fl) != -1;
 	}
 
+	constexpr uint32_t SPUTNIK_SHM_MAGIC = 0x4D534E53;
+	constexpr uint32_t SPUTNIK_SHM_VERSION = 1;
+	constexpr size_t SPUTNIK_SHM_DEFAULT_RING_SIZE = 1024 * 1024;
+	// the number of times a side checks the ring buffer before it goes to sleep
+	constexpr int SPUTNIK_SHM_SPIN_COUNT = 128;
+	// the longest time a side sleeps before it checks whether the other side is still connected
+	constexpr uint64_t SPUTNIK_SHM_POLL_INTERVAL_IN_MS = 100;
+
+	// single producer single consumer ring buffer which lives in the shared memory, the positions only grow and they're
+	// wrapped by the ring size, each side only sleeps after it sets its waiting flag so the other side only makes the
+	// wake system call when it's needed
+	struct Sputnik_Shm_Ring
+	{
+		// written by the producer
+		alignas(64) std::atomic<uint64_t> head;
+		// the futex word which the consumer sleeps on while the ring buffer is empty
+		std::atomic<uint32_t> data_signal;
+		std::atomic<uint32_t> producer_waiting;
+
+		// written by the consumer
+		alignas(64) std::atomic<uint64_t> tail;
+		// the futex word which the producer sleeps on while the ring buffer is full
+		std::atomic<uint32_t> space_signal;
+		std::atomic<uint32_t> consumer_waiting;
+	};
+
+	// the start of the shared memory, it's followed by the data of the two ring buffers
+	struct Sputnik_Shm_Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t ring_size;
+		// set when one of the sides frees its sputnik instance
+		std::atomic<uint32_t> closed;
+		// [0] is written by the connecting side and [1] is written by the accepting side
+		Sputnik_Shm_Ring rings[2];
+	};
+
+	// the request which is sent along with the shared memory file descriptor
+	struct Sputnik_Shm_Request
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t mapping_size;
+	};
+
+	struct Sputnik_Shm
+	{
+		Sputnik_Shm_Header* header;
+		size_t mapping_size;
+		uint64_t ring_size;
+		Sputnik_Shm_Ring* write_ring;
+		char* write_data;
+		Sputnik_Shm_Ring* read_ring;
+		char* read_data;
+	};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free, "shared memory atomics should be lock free");
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words should be 32 bits");
+
+	inline static int
+	_sputnik_timeout_millis(Timeout timeout)
+	{
+		if(timeout == INFINITE_TIMEOUT)
+			return -1;
+		else if(timeout == NO_TIMEOUT)
+			return 0;
+		else
+			return int(timeout.milliseconds);
+	}
+
+	inline static size_t
+	_sputnik_shm_header_size()
+	{
+		auto page_size = size_t(::sysconf(_SC_PAGESIZE));
+		return (sizeof(Sputnik_Shm_Header) + page_size - 1) & ~(page_size - 1);
+	}
+
+	// the ring size is passed by the caller which validated it, it's never read back from the shared memory since the
+	// other process can change it at any time
+	inline static Sputnik_Shm*
+	_sputnik_shm_new(void* ptr, size_t mapping_size, size_t ring_size, bool connected)
+	{
+		auto header = (Sputnik_Shm_Header*)ptr;
+		auto data = (char*)ptr + _sputnik_shm_header_size();
+
+		auto self = mn::alloc_zerod<Sputnik_Shm>();
+		self->header = header;
+		self->mapping_size = mapping_size;
+		self->ring_size = ring_size;
+		if (connected)
+		{
+			self->write_ring = &header->rings[0];
+			self->write_data = data;
+			self->read_ring = &header->rings[1];
+			self->read_data = data + ring_size;
+		}
+		else
+		{
+			self->write_ring = &header->rings[1];
+			self->write_data = data + ring_size;
+			self->read_ring = &header->rings[0];
+			self->read_data = data;
+		}
+		return self;
+	}
+
+	inline static void
+	_sputnik_futex_wait(std::atomic<uint32_t>& word, uint32_t value, uint64_t milliseconds)
+	{
+		timespec ts{};
+		ts.tv_sec = time_t(milliseconds / 1000);
+		ts.tv_nsec = long(milliseconds % 1000) * 1000000;
+		// the memory is shared between processes so the futex can't be private
+		::syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, value, &ts, nullptr, 0);
+	}
+
+	inline static void
+	_sputnik_futex_wake(std::atomic<uint32_t>& word)
+	{
+		::syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+
+	// wakes the other side if it's sleeping on the given signal
+	inline static void
+	_sputnik_shm_signal(std::atomic<uint32_t>& waiting, std::atomic<uint32_t>& signal)
+	{
+		if (waiting.load(std::memory_order_seq_cst) == 0)
+			return;
+		signal.fetch_add(1, std::memory_order_seq_cst);
+		_sputnik_futex_wake(signal);
+	}
+
+	// returns whether the other side is still connected
+	inline static bool
+	_sputnik_shm_peer_alive(Sputnik self)
+	{
+		if (self->shm->header->closed.load(std::memory_order_acquire))
+			return false;
+
+		// the socket isn't used after the negotiation so it only wakes up when the other side closes it
+		pollfd pfd{};
+		pfd.fd = self->linux_domain_socket;
+		pfd.events = POLLRDHUP;
+		if (::poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR)))
+			return false;
+		return true;
+	}
+
+	// waits until the given condition is true, it returns false if the timeout expired or the other side disconnected
+	template<typename TFunc>
+	inline static bool
+	_sputnik_shm_wait(Sputnik self, std::atomic<uint32_t>& waiting, std::atomic<uint32_t>& signal, Timeout timeout, TFunc&& ready)
+	{
+		for (int i = 0; i < SPUTNIK_SHM_SPIN_COUNT; ++i)
+			if (ready())
+				return true;
+		if (timeout == NO_TIMEOUT)
+			return false;
+
+		worker_block_ahead();
+		mn_defer{worker_block_clear();};
+
+		auto start = time_in_millis();
+		waiting.store(1, std::memory_order_seq_cst);
+		mn_defer{waiting.store(0, std::memory_order_relaxed);};
+		while (true)
+		{
+			// the signal is loaded before the condition so a signal which comes after the check fails the futex wait
+			auto value = signal.load(std::memory_order_seq_cst);
+			if (ready())
+				return true;
+			if (_sputnik_shm_peer_alive(self) == false)
+				return false;
+
+			auto sleep = SPUTNIK_SHM_POLL_INTERVAL_IN_MS;
+			if (timeout != INFINITE_TIMEOUT)
+			{
+				auto elapsed = time_in_millis() - start;
+				if (elapsed >= timeout.milliseconds)
+					return ready();
+				if (timeout.milliseconds - elapsed < sleep)
+					sleep = timeout.milliseconds - elapsed;
+			}
+			_sputnik_futex_wait(signal, value, sleep);
+		}
+	}
+
+	inline static size_t
+	_sputnik_shm_read(Sputnik self, Block data, Timeout timeout)
+	{
+		if (data.size == 0)
+			return 0;
+
+		auto shm = self->shm;
+		auto ring = shm->read_ring;
+		auto tail = ring->tail.load(std::memory_order_relaxed);
+		auto has_data = [&]{ return ring->head.load(std::memory_order_seq_cst) != tail; };
+		if (_sputnik_shm_wait(self, ring->consumer_waiting, ring->data_signal, timeout, has_data) == false)
+			return 0;
+
+		// the other side writes the head so it's never trusted beyond the ring size
+		auto size = ring->head.load(std::memory_order_acquire) - tail;
+		if (size > shm->ring_size)
+			size = shm->ring_size;
+		if (size > data.size)
+			size = data.size;
+
+		auto offset = tail & (shm->ring_size - 1);
+		auto first = shm->ring_size - offset;
+		if (first > size)
+			first = size;
+		::memcpy(data.ptr, shm->read_data + offset, first);
+		::memcpy((char*)data.ptr + first, shm->read_data, size - first);
+
+		ring->tail.store(tail + size, std::memory_order_seq_cst);
+		_sputnik_shm_signal(ring->producer_waiting, ring->space_signal);
+		return size;
+	}
+
+	// writes the given blocks as one unit so the reader is woken up at most once
+	inline static size_t
+	_sputnik_shm_write(Sputnik self, const Block* blocks, size_t blocks_count)
+	{
+		auto shm = self->shm;
+		auto ring = shm->write_ring;
+		auto head = ring->head.load(std::memory_order_relaxed);
+
+		size_t res = 0;
+		for (size_t i = 0; i < blocks_count; ++i)
+		{
+			auto it = (const char*)blocks[i].ptr;
+			auto remaining = blocks[i].size;
+			while (remaining > 0)
+			{
+				// the other side writes the tail so the used size is clamped like the read size
+				auto used = head - ring->tail.load(std::memory_order_acquire);
+				auto space = used < shm->ring_size ? shm->ring_size - used : 0;
+				if (space == 0)
+				{
+					// publish what we have so the reader can make room
+					ring->head.store(head, std::memory_order_seq_cst);
+					_sputnik_shm_signal(ring->consumer_waiting, ring->data_signal);
+
+					auto has_space = [&]{ return head - ring->tail.load(std::memory_order_seq_cst) < shm->ring_size; };
+					if (_sputnik_shm_wait(self, ring->producer_waiting, ring->space_signal, INFINITE_TIMEOUT, has_space) == false)
+						return res;
+					continue;
+				}
+
+				auto size = remaining;
+				if (size > space)
+					size = space;
+				auto offset = head & (shm->ring_size - 1);
+				auto first = shm->ring_size - offset;
+				if (first > size)
+					first = size;
+				::memcpy(shm->write_data + offset, it, first);
+				::memcpy(shm->write_data, it + first, size - first);
+
+				head += size;
+				it += size;
+				remaining -= size;
+				res += size;
+			}
+		}
+
+		ring->head.store(head, std::memory_order_seq_cst);
+		_sputnik_shm_signal(ring->consumer_waiting, ring->data_signal);
+		return res;
+	}
+
+	// reads exactly the given size from the socket within the given timeout window
+	inline static bool
+	_sputnik_socket_read_all(Sputnik self, Block data, Timeout timeout)
+	{
+		auto it = (char*)data.ptr;
+		auto remaining = data.size;
+		while (remaining > 0)
+		{
+			auto res = sputnik_read(self, {it, remaining}, timeout);
+			if (res == 0)
+				return false;
+			it += res;
+			remaining -= res;
+		}
+		return true;
+	}
+
+	// marks the shared memory as closed and wakes the other side in case it's waiting for us
+	inline static void
+	_sputnik_shm_close(Sputnik_Shm_Header* header)
+	{
+		header->closed.store(1, std::memory_order_release);
+		for (auto& ring: header->rings)
+		{
+			ring.data_signal.fetch_add(1, std::memory_order_seq_cst);
+			_sputnik_futex_wake(ring.data_signal);
+			ring.space_signal.fetch_add(1, std::memory_order_seq_cst);
+			_sputnik_futex_wake(ring.space_signal);
+		}
+	}
+
+	// the connecting side creates the shared memory and sends it to the accepting side
+	inline static bool
+	_sputnik_shm_offer(Sputnik self, const Sputnik_Shm_Settings& settings, Timeout timeout)
+	{
+		auto page_size = size_t(::sysconf(_SC_PAGESIZE));
+		auto requested_size = settings.ring_size;
+		if (requested_size == 0)
+			requested_size = SPUTNIK_SHM_DEFAULT_RING_SIZE;
+		// the ring size is a power of 2 so the positions can be wrapped with a mask
+		size_t ring_size = page_size;
+		while (ring_size < requested_size)
+			ring_size <<= 1;
+		size_t mapping_size = _sputnik_shm_header_size() + 2 * ring_size;
+
+		int fd = ::memfd_create("mn-sputnik", MFD_CLOEXEC);
+		if (fd == -1)
+			return false;
+		mn_defer{::close(fd);};
+
+		if (::ftruncate(fd, mapping_size) != 0)
+			return false;
+
+		auto ptr = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (ptr == MAP_FAILED)
+			return false;
+
+		auto header = ::new (ptr) Sputnik_Shm_Header{};
+		header->magic = SPUTNIK_SHM_MAGIC;
+		header->version = SPUTNIK_SHM_VERSION;
+		header->ring_size = ring_size;
+
+		Sputnik_Shm_Request request{SPUTNIK_SHM_MAGIC, SPUTNIK_SHM_VERSION, mapping_size};
+		iovec iov{};
+		iov.iov_base = &request;
+		iov.iov_len = sizeof(request);
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+		msghdr msg{};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		auto cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+		worker_block_ahead();
+		auto sent = ::sendmsg(self->linux_domain_socket, &msg, MSG_NOSIGNAL);
+		worker_block_clear();
+
+		if (sent == -1)
+		{
+			::munmap(ptr, mapping_size);
+			return false;
+		}
+
+		uint32_t reply = 0;
+		if (sent != sizeof(request) || _sputnik_socket_read_all(self, block_from(reply), timeout) == false)
+		{
+			// the other side might accept the shared memory after we give up, so the connection is closed for both
+			// sides instead of leaving each side on a different transport
+			_sputnik_shm_close(header);
+			::shutdown(self->linux_domain_socket, SHUT_RDWR);
+			::munmap(ptr, mapping_size);
+			return false;
+		}
+
+		if (reply != SPUTNIK_SHM_MAGIC)
+		{
+			::munmap(ptr, mapping_size);
+			return false;
+		}
+
+		self->shm = _sputnik_shm_new(ptr, mapping_size, ring_size, true);
+		return true;
+	}
+
+	// the accepting side maps the shared memory which the connecting side sent, and replies with whether it accepted it
+	inline static bool
+	_sputnik_shm_answer(Sputnik self, Timeout timeout)
+	{
+		pollfd pfd_read{};
+		pfd_read.fd = self->linux_domain_socket;
+		pfd_read.events = POLLIN;
+		{
+			worker_block_ahead();
+			mn_defer{worker_block_clear();};
+			if (::poll(&pfd_read, 1, _sputnik_timeout_millis(timeout)) <= 0)
+				return false;
+		}
+
+		Sputnik_Shm_Request request{};
+		iovec iov{};
+		iov.iov_base = &request;
+		iov.iov_len = sizeof(request);
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+		msghdr msg{};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		auto received = ::recvmsg(self->linux_domain_socket, &msg, MSG_CMSG_CLOEXEC);
+		if (received <= 0)
+			return false;
+
+		int fd = -1;
+		for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+				::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+		mn_defer{if (fd != -1) ::close(fd);};
+
+		// the file descriptor comes with the first byte, the rest of the request might come later
+		if (size_t(received) < sizeof(request) &&
+			_sputnik_socket_read_all(self, {(char*)&request + received, sizeof(request) - received}, timeout) == false)
+			return false;
+
+		void* ptr = MAP_FAILED;
+		size_t ring_size = 0;
+		struct stat fd_stat{};
+		if (fd != -1 &&
+			request.magic == SPUTNIK_SHM_MAGIC &&
+			request.version == SPUTNIK_SHM_VERSION &&
+			request.mapping_size > _sputnik_shm_header_size() &&
+			::fstat(fd, &fd_stat) == 0 &&
+			uint64_t(fd_stat.st_size) == request.mapping_size)
+		{
+			ptr = ::mmap(nullptr, request.mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+
+		if (ptr != MAP_FAILED)
+		{
+			// the ring size is read once through a volatile load so that the compiler can't read it again from the shared
+			// memory, only this copy is validated and used
+			auto header = (Sputnik_Shm_Header*)ptr;
+			ring_size = *(volatile uint64_t*)&header->ring_size;
+			bool valid =
+				header->magic == SPUTNIK_SHM_MAGIC &&
+				header->closed.load(std::memory_order_acquire) == 0 &&
+				ring_size > 0 && (ring_size & (ring_size - 1)) == 0 &&
+				_sputnik_shm_header_size() + 2 * ring_size == request.mapping_size;
+			if (valid == false)
+			{
+				::munmap(ptr, request.mapping_size);
+				ptr = MAP_FAILED;
+			}
+		}
+
+		// the connecting side might have given up and closed the connection so the reply can't raise SIGPIPE
+		uint32_t reply = ptr != MAP_FAILED ? SPUTNIK_SHM_MAGIC : 0;
+		if (::send(self->linux_domain_socket, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+		{
+			if (ptr != MAP_FAILED)
+				::munmap(ptr, request.mapping_size);
+			return false;
+		}
+
+		if (ptr == MAP_FAILED)
+			return false;
+		self->shm = _sputnik_shm_new(ptr, request.mapping_size, ring_size, false);
+		return true;
+	}
+
+	inline static void
+	_sputnik_shm_free(Sputnik_Shm* self)
+	{
+		_sputnik_shm_close(self->header);
+		::munmap(self->header, self->mapping_size);
+		mn::free(self);
+	}
+
 	// API
 	Mutex
 	mutex_new(const Str& name)
@@ -160,12 +641,15 @@ namespace mn::ipc
 		auto self = mn::alloc_construct<ISputnik>();
 		self->linux_domain_socket = handle;
 		self->name = mn::str_from_substr(name.ptr, name.ptr + name_length);
+		self->connected = true;
 		return self;
 	}
 
 	void
 	sputnik_free(Sputnik self)
 	{
+		if (self->shm)
+			_sputnik_shm_free(self->shm);
 		::close(self->linux_domain_socket);
 		mn::str_free(self->name);
 		mn::free_destruct(self);
@@ -217,6 +701,9 @@ namespace mn::ipc
 	size_t
 	sputnik_read(Sputnik self, Block data, Timeout timeout)
 	{
+		if (self->shm)
+			return _sputnik_shm_read(self, data, timeout);
+
 		pollfd pfd_read{};
 		pfd_read.fd = self->linux_domain_socket;
 		pfd_read.events = POLLIN;
@@ -243,6 +730,9 @@ namespace mn::ipc
 	size_t
 	sputnik_write(Sputnik self, Block data)
 	{
+		if (self->shm)
+			return _sputnik_shm_write(self, &data, 1);
+
 		worker_block_ahead();
 		auto res = ::write(self->linux_domain_socket, data.ptr, data.size);
 		worker_block_clear();
@@ -255,10 +745,30 @@ namespace mn::ipc
 		return ::unlink(self->name.ptr) == 0;
 	}
 
+	bool
+	sputnik_shm_enable(Sputnik self, const Sputnik_Shm_Settings& settings, Timeout timeout)
+	{
+		mn_assert_msg(self->read_msg_size == 0, "sputnik has a partially read message");
+		if (self->shm)
+			return true;
+
+		if (self->connected)
+			return _sputnik_shm_offer(self, settings, timeout);
+		else
+			return _sputnik_shm_answer(self, timeout);
+	}
+
 	bool
 	sputnik_msg_write(Sputnik self, Block data)
 	{
 		uint64_t len = data.size;
+		if (self->shm)
+		{
+			// the length and the message are published together
+			Block blocks[] = {block_from(len), data};
+			return _sputnik_shm_write(self, blocks, 2) == (data.size + sizeof(len));
+		}
+
 		auto res = sputnik_write(self, block_from(len));
 		res += sputnik_write(self, data);
 		return res == (data.size + sizeof(len));
@@ -30,6 +30,7 @@ namespace mn
 		const char* name;
 		const Source_Location* srcloc;
 		void* profile_user_data;
+		_Mutex_Contention contention;
 	};
 
 	struct Leak_Allocator_Mutex
@@ -48,12 +49,14 @@ namespace mn
 			self.srcloc = &srcloc;
 			[[maybe_unused]] int result = pthread_mutex_init(&self.handle, NULL);
 			mn_assert(result == 0);
+			_mutex_contention_init(self.contention, self.srcloc);
 			self.profile_user_data = _mutex_new(&self, self.name);
 		}
 
 		~Leak_Allocator_Mutex()
 		{
 			_mutex_free(&self, self.profile_user_data);
+			_mutex_contention_dispose(self.contention, self.srcloc);
 		}
 	};
 
@@ -72,323 +75,41 @@ namespace mn
 	}
 
 	// Deadlock detector
-	struct Mutex_Thread_Owner
-	{
-		pid_t id;
-		int callstack_count;
-		void* callstack[20];
-	};
-
-	struct Mutex_Deadlock_Reason
-	{
-		void* mtx;
-		Mutex_Thread_Owner* owner;
-	};
-
-	struct Mutex_Ownership
-	{
-		enum KIND
-		{
-			KIND_EXCLUSIVE,
-			KIND_SHARED,
-		};
-
-		KIND kind;
-		union
-		{
-			Mutex_Thread_Owner exclusive;
-			Map<pid_t, Mutex_Thread_Owner> shared;
-		};
-	};
-
-	inline static Mutex_Ownership
-	mutex_ownership_exclusive(pid_t thread_id)
-	{
-		Mutex_Ownership self{};
-		self.kind = Mutex_Ownership::KIND_EXCLUSIVE;
-		self.exclusive.id = thread_id;
-		self.exclusive.callstack_count = callstack_capture(self.exclusive.callstack, 20);
-		return self;
-	}
-
-	inline static Mutex_Ownership
-	mutex_ownership_shared()
-	{
-		Mutex_Ownership self{};
-		self.kind = Mutex_Ownership::KIND_SHARED;
-		self.shared = map_with_allocator<pid_t, Mutex_Thread_Owner>(memory::clib());
-		return self;
-	}
-
-	inline static void
-	mutex_ownership_free(Mutex_Ownership& self)
-	{
-		switch(self.kind)
-		{
-		case Mutex_Ownership::KIND_EXCLUSIVE:
-			// do nothing
-			break;
-		case Mutex_Ownership::KIND_SHARED:
-			map_free(self.shared);
-			break;
-		default:
-			mn_unreachable();
-			break;
-		}
-	}
-
 	inline static void
-	destruct(Mutex_Ownership& self)
-	{
-		mutex_ownership_free(self);
-	}
-
-	inline static void
-	mutex_ownership_shared_add_owner(Mutex_Ownership& self, pid_t thread_id)
-	{
-		Mutex_Thread_Owner owner{};
-		owner.id = thread_id;
-		owner.callstack_count = callstack_capture(owner.callstack, 20);
-		map_insert(self.shared, thread_id, owner);
-	}
-
-	inline static void
-	mutex_ownership_shared_remove_owner(Mutex_Ownership& self, pid_t thread_id)
-	{
-		map_remove(self.shared, thread_id);
-	}
-
-	inline static bool
-	mutex_ownership_check(Mutex_Ownership& self, pid_t thread_id)
-	{
-		switch(self.kind)
-		{
-		case Mutex_Ownership::KIND_EXCLUSIVE:
-			return self.exclusive.id == thread_id;
-		case Mutex_Ownership::KIND_SHARED:
-			return map_lookup(self.shared, thread_id) != nullptr;
-		default:
-			mn_unreachable();
-			return false;
-		}
-	}
-
-	inline static Mutex_Thread_Owner*
-	mutex_ownership_get_owner(Mutex_Ownership& self, pid_t thread_id)
+	_mutex_deadlock_lock([[maybe_unused]] void* mtx, [[maybe_unused]] const char* name, [[maybe_unused]] bool shared)
 	{
-		switch(self.kind)
-		{
-		case Mutex_Ownership::KIND_EXCLUSIVE:
-			return &self.exclusive;
-		case Mutex_Ownership::KIND_SHARED:
-			return &map_lookup(self.shared, thread_id)->value;
-		default:
-			mn_unreachable();
-			return nullptr;
-		}
-	}
-
-	struct Deadlock_Detector
-	{
-		pthread_mutex_t mtx;
-		Map<void*, Mutex_Ownership> mutex_thread_owner;
-		Map<pid_t, void*> thread_mutex_block;
-
-		Deadlock_Detector()
-		{
-			pthread_mutex_init(&mtx, NULL);
-			mutex_thread_owner = map_with_allocator<void*, Mutex_Ownership>(memory::clib());
-			thread_mutex_block = map_with_allocator<pid_t, void*>(memory::clib());
-		}
-
-		~Deadlock_Detector()
-		{
-			pthread_mutex_destroy(&mtx);
-			destruct(mutex_thread_owner);
-			map_free(thread_mutex_block);
-		}
-	};
-
-	inline static Deadlock_Detector*
-	_deadlock_detector()
-	{
-		static Deadlock_Detector _detector;
-		return &_detector;
-	}
-
-	inline static bool
-	_deadlock_detector_has_block_loop(Deadlock_Detector* self, void* mtx, pid_t thread_id, Buf<Mutex_Deadlock_Reason>& reasons)
-	{
-		auto it = map_lookup(self->mutex_thread_owner, mtx);
-		if (it == nullptr)
-			return false;
-
-		bool deadlock_detected = false;
-		auto reason_thread_id = thread_id;
-		if (mutex_ownership_check(it->value, thread_id))
-		{
-			deadlock_detected = true;
-		}
-		else
-		{
-			switch(it->value.kind)
-			{
-			case Mutex_Ownership::KIND_EXCLUSIVE:
-				if (auto block_it = map_lookup(self->thread_mutex_block, it->value.exclusive.id))
-				{
-					deadlock_detected = _deadlock_detector_has_block_loop(self, block_it->value, thread_id, reasons);
-					reason_thread_id = it->value.exclusive.id;
-				}
-				break;
-			case Mutex_Ownership::KIND_SHARED:
-				for (auto [id, owner]: it->value.shared)
-				{
-					if (auto block_it = map_lookup(self->thread_mutex_block, id))
-					{
-						if (_deadlock_detector_has_block_loop(self, block_it->value, thread_id, reasons))
-						{
-							deadlock_detected = true;
-							reason_thread_id = block_it->key;
-							break;
-						}
-					}
-				}
-				break;
-			default:
-				mn_unreachable();
-				break;
-			}
-		}
-
-		if (deadlock_detected)
-		{
-			auto owner = mutex_ownership_get_owner(it->value, reason_thread_id);
-			Mutex_Deadlock_Reason reason{};
-			reason.mtx = it->key;
-			reason.owner = owner;
-			buf_push(reasons, reason);
-			return true;
-		}
-		return false;
+		#ifdef MN_DEADLOCK
+		_deadlock_detector_lock(mtx, name, shared);
+		#endif
 	}
 
 	inline static void
-	_deadlock_detector_mutex_block([[maybe_unused]] void* mtx)
+	_mutex_deadlock_unlock([[maybe_unused]] void* mtx)
 	{
 		#ifdef MN_DEADLOCK
-		auto self = _deadlock_detector();
-		auto thread_id = gettid();
-
-		pthread_mutex_lock(&self->mtx);
-		mn_defer{pthread_mutex_unlock(&self->mtx);};
-
-		map_insert(self->thread_mutex_block, thread_id, mtx);
-
-		Buf<Mutex_Deadlock_Reason> reasons{};
-		if (_deadlock_detector_has_block_loop(self, mtx, thread_id, reasons))
-		{
-			log_error("Deadlock on mutex {} by thread #{} because of #{} reasons are listed below:", mtx, thread_id, reasons.count);
-			void* callstack[20];
-			auto callstack_count = callstack_capture(callstack, 20);
-			callstack_print_to(callstack, callstack_count, file_stderr());
-			printerr("\n");
-
-			for (size_t i = 0; i < reasons.count; ++i)
-			{
-				auto ix = reasons.count - i - 1;
-				auto reason = reasons[ix];
-
-				auto block_it = map_lookup(self->thread_mutex_block, reason.owner->id);
-				log_error(
-					"reason #{}: Mutex {} was locked at the callstack listed below by thread #{} (while it was waiting for mutex {} to be released):",
-					ix + 1,
-					reason.mtx,
-					reason.owner->id,
-					block_it->value
-				);
-				callstack_print_to(reason.owner->callstack, reason.owner->callstack_count, file_stderr());
-				printerr("\n");
-			}
-			::exit(-1);
-		}
-		buf_free(reasons);
-
+		_deadlock_detector_unlock(mtx);
 		#endif
 	}
 
 	inline static void
-	_deadlock_detector_mutex_set_exclusive_owner([[maybe_unused]] void* mtx)
+	_mutex_deadlock_free([[maybe_unused]] void* mtx)
 	{
 		#ifdef MN_DEADLOCK
-		auto self = _deadlock_detector();
-		auto thread_id = gettid();
-
-		pthread_mutex_lock(&self->mtx);
-		mn_defer{pthread_mutex_unlock(&self->mtx);};
-
-		if (auto it = map_lookup(self->mutex_thread_owner, mtx))
-		{
-			panic("Deadlock on mutex {} by thread #{}", mtx, thread_id);
-		}
-
-		map_remove(self->thread_mutex_block, thread_id);
-		map_insert(self->mutex_thread_owner, mtx, mutex_ownership_exclusive(thread_id));
+		_deadlock_detector_free(mtx);
 		#endif
 	}
 
-	inline static void
-	_deadlock_detector_mutex_set_shared_owner([[maybe_unused]] void* mtx)
+	inline static bool
+	_mutex_try_lock(void* mtx)
 	{
-		#ifdef MN_DEADLOCK
-		auto self = _deadlock_detector();
-		auto thread_id = gettid();
-
-		pthread_mutex_lock(&self->mtx);
-		mn_defer{pthread_mutex_unlock(&self->mtx);};
-
-		map_remove(self->thread_mutex_block, thread_id);
-		if (auto it = map_lookup(self->mutex_thread_owner, mtx))
-		{
-			mutex_ownership_shared_add_owner(it->value, thread_id);
-		}
-		else
-		{
-			auto mutex_ownership = mutex_ownership_shared();
-			mutex_ownership_shared_add_owner(mutex_ownership, thread_id);
-			map_insert(self->mutex_thread_owner, mtx, mutex_ownership);
-		}
-		#endif
+		return pthread_mutex_trylock((pthread_mutex_t*)mtx) == 0;
 	}
 
 	inline static void
-	_deadlock_detector_mutex_unset_owner([[maybe_unused]] void* mtx)
+	_mutex_block_lock(void* mtx)
 	{
-		#ifdef MN_DEADLOCK
-		auto self = _deadlock_detector();
-		auto thread_id = gettid();
-
-		pthread_mutex_lock(&self->mtx);
-		mn_defer{pthread_mutex_unlock(&self->mtx);};
-
-		auto it = map_lookup(self->mutex_thread_owner, mtx);
-		switch(it->value.kind)
-		{
-		case Mutex_Ownership::KIND_EXCLUSIVE:
-			map_remove(self->mutex_thread_owner, mtx);
-			break;
-		case Mutex_Ownership::KIND_SHARED:
-			mutex_ownership_shared_remove_owner(it->value, thread_id);
-			if (it->value.shared.count == 0)
-			{
-				mutex_ownership_free(it->value);
-				map_remove(self->mutex_thread_owner, mtx);
-			}
-			break;
-		default:
-			mn_unreachable();
-			break;
-		}
-		#endif
+		[[maybe_unused]] int result = pthread_mutex_lock((pthread_mutex_t*)mtx);
+		mn_assert(result == 0);
 	}
 
 	// API
@@ -400,6 +121,7 @@ namespace mn
 		self->name = srcloc->name;
 		[[maybe_unused]] int result = pthread_mutex_init(&self->handle, NULL);
 		mn_assert(result == 0);
+		_mutex_contention_init(self->contention, self->srcloc);
 
 		self->profile_user_data = _mutex_new(self, self->name);
 
@@ -414,6 +136,7 @@ namespace mn
 		self->name = name;
 		[[maybe_unused]] int result = pthread_mutex_init(&self->handle, NULL);
 		mn_assert(result == 0);
+		_mutex_contention_init(self->contention, self->srcloc);
 
 		self->profile_user_data = _mutex_new(self, self->name);
 
@@ -429,24 +152,20 @@ namespace mn
 				_mutex_after_lock(self, self->profile_user_data);
 		};
 
+		_mutex_deadlock_lock(self, self->name, false);
 		if (pthread_mutex_trylock(&self->handle) == 0)
 		{
-			_deadlock_detector_mutex_set_exclusive_owner(self);
+			_mutex_contention_acquired(self->contention);
 			return;
 		}
 
-		worker_block_ahead();
-		_deadlock_detector_mutex_block(self);
-		[[maybe_unused]] int result = pthread_mutex_lock(&self->handle);
-		mn_assert(result == 0);
-		_deadlock_detector_mutex_set_exclusive_owner(self);
-		worker_block_clear();
+		_mutex_contention_lock(self->contention, _mutex_try_lock, _mutex_block_lock, &self->handle);
 	}
 
 	void
 	mutex_unlock(Mutex self)
 	{
-		_deadlock_detector_mutex_unset_owner(self);
+		_mutex_deadlock_unlock(self);
 		[[maybe_unused]] int result = pthread_mutex_unlock(&self->handle);
 		mn_assert(result == 0);
 		_mutex_after_unlock(self, self->profile_user_data);
@@ -455,7 +174,9 @@ namespace mn
 	void
 	mutex_free(Mutex self)
 	{
+		_mutex_deadlock_free(self);
 		_mutex_free(self, self->profile_user_data);
+		_mutex_contention_dispose(self->contention, self->srcloc);
 		[[maybe_unused]] int result = pthread_mutex_destroy(&self->handle);
 		free(self);
 	}
@@ -466,6 +187,12 @@ namespace mn
 		return self->srcloc;
 	}
 
+	Mutex_Stats
+	mutex_stats(Mutex self)
+	{
+		return _mutex_contention_stats(self->contention);
+	}
+
 
 	//Mutex_RW API
 	struct IMutex_RW
@@ -474,6 +201,8 @@ namespace mn
 		const char* name;
 		const Source_Location* srcloc;
 		void* profile_user_data;
+		// set for the mutexes which are created by mutex_rw_distributed_new, the lock above isn't used in this case
+		_Mutex_RW_Distributed* distributed;
 	};
 
 	Mutex_RW
@@ -483,6 +212,7 @@ namespace mn
 		pthread_rwlock_init(&self->lock, NULL);
 		self->name = srcloc->name;
 		self->srcloc = srcloc;
+		self->distributed = nullptr;
 		self->profile_user_data = _mutex_rw_new(self, self->name);
 		return self;
 	}
@@ -494,6 +224,31 @@ namespace mn
 		pthread_rwlock_init(&self->lock, NULL);
 		self->name = name;
 		self->srcloc = nullptr;
+		self->distributed = nullptr;
+		self->profile_user_data = _mutex_rw_new(self, self->name);
+		return self;
+	}
+
+	Mutex_RW
+	mutex_rw_distributed_new_with_srcloc(const Source_Location* srcloc)
+	{
+		Mutex_RW self = alloc<IMutex_RW>();
+		pthread_rwlock_init(&self->lock, NULL);
+		self->name = srcloc->name;
+		self->srcloc = srcloc;
+		self->distributed = _mutex_rw_distributed_new();
+		self->profile_user_data = _mutex_rw_new(self, self->name);
+		return self;
+	}
+
+	Mutex_RW
+	mutex_rw_distributed_new(const char* name)
+	{
+		Mutex_RW self = alloc<IMutex_RW>();
+		pthread_rwlock_init(&self->lock, NULL);
+		self->name = name;
+		self->srcloc = nullptr;
+		self->distributed = _mutex_rw_distributed_new();
 		self->profile_user_data = _mutex_rw_new(self, self->name);
 		return self;
 	}
@@ -501,7 +256,10 @@ namespace mn
 	void
 	mutex_rw_free(Mutex_RW self)
 	{
+		_mutex_deadlock_free(self);
 		_mutex_rw_free(self, self->profile_user_data);
+		if (self->distributed)
+			_mutex_rw_distributed_free(self->distributed);
 		pthread_rwlock_destroy(&self->lock);
 		free(self);
 	}
@@ -515,24 +273,29 @@ namespace mn
 				_mutex_after_read_lock(self, self->profile_user_data);
 		};
 
-		if (pthread_rwlock_tryrdlock(&self->lock) == 0)
+		_mutex_deadlock_lock(self, self->name, true);
+		if (self->distributed)
 		{
-			_deadlock_detector_mutex_set_shared_owner(self);
+			_mutex_rw_distributed_read_lock(self->distributed);
 			return;
 		}
 
+		if (pthread_rwlock_tryrdlock(&self->lock) == 0)
+			return;
+
 		worker_block_ahead();
-		_deadlock_detector_mutex_block(self);
 		pthread_rwlock_rdlock(&self->lock);
-		_deadlock_detector_mutex_set_shared_owner(self);
 		worker_block_clear();
 	}
 
 	void
 	mutex_read_unlock(Mutex_RW self)
 	{
-		_deadlock_detector_mutex_unset_owner(self);
-		pthread_rwlock_unlock(&self->lock);
+		_mutex_deadlock_unlock(self);
+		if (self->distributed)
+			_mutex_rw_distributed_read_unlock(self->distributed);
+		else
+			pthread_rwlock_unlock(&self->lock);
 		_mutex_after_read_unlock(self, self->profile_user_data);
 	}
 
@@ -545,24 +308,29 @@ namespace mn
 				_mutex_after_write_lock(self, self->profile_user_data);
 		};
 
-		if (pthread_rwlock_trywrlock(&self->lock) == 0)
+		_mutex_deadlock_lock(self, self->name, false);
+		if (self->distributed)
 		{
-			_deadlock_detector_mutex_set_exclusive_owner(self);
+			_mutex_rw_distributed_write_lock(self->distributed);
 			return;
 		}
 
+		if (pthread_rwlock_trywrlock(&self->lock) == 0)
+			return;
+
 		worker_block_ahead();
-		_deadlock_detector_mutex_block(self);
 		pthread_rwlock_wrlock(&self->lock);
-		_deadlock_detector_mutex_set_exclusive_owner(self);
 		worker_block_clear();
 	}
 
 	void
 	mutex_write_unlock(Mutex_RW self)
 	{
-		_deadlock_detector_mutex_unset_owner(self);
-		pthread_rwlock_unlock(&self->lock);
+		_mutex_deadlock_unlock(self);
+		if (self->distributed)
+			_mutex_rw_distributed_write_unlock(self->distributed);
+		else
+			pthread_rwlock_unlock(&self->lock);
 		_mutex_after_write_unlock(self, self->profile_user_data);
 	}
 
@@ -669,9 +437,7 @@ namespace mn
 	cond_var_wait(Cond_Var self, Mutex mtx)
 	{
 		worker_block_ahead();
-		_deadlock_detector_mutex_unset_owner(mtx);
 		pthread_cond_wait(&self->cv, &mtx->handle);
-		_deadlock_detector_mutex_set_exclusive_owner(mtx);
 		worker_block_clear();
 	}
 
@@ -682,9 +448,7 @@ namespace mn
 		ms2ts(&ts, millis);
 
 		worker_block_ahead();
-		_deadlock_detector_mutex_unset_owner(mtx);
 		auto res = pthread_cond_timedwait(&self->cv, &mtx->handle, &ts);
-		_deadlock_detector_mutex_set_exclusive_owner(mtx);
 		worker_block_clear();
 
 		if (res == 0)
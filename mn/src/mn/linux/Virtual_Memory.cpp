@@ -1,17 +1,124 @@
 #include "mn/Virtual_Memory.h"
 
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace mn
 {
+	// MPOL_BIND from linux/mempolicy.h, we call mbind directly so we don't depend on libnuma
+	constexpr int VIRTUAL_MPOL_BIND = 2;
+
+	// the page size is queried once, it's not 4Kb on all the machines (arm64 kernels use 16Kb and 64Kb pages)
+	inline static size_t
+	_virtual_page_size()
+	{
+		static const size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+		return page_size;
+	}
+
+	inline static size_t
+	_virtual_round_up(size_t size, size_t alignment)
+	{
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+
+	inline static void
+	_virtual_numa_bind(void* ptr, size_t size, uint32_t numa_node)
+	{
+		unsigned long nodemask[16]{};
+		constexpr size_t NODEMASK_BITS = sizeof(nodemask) * 8;
+		if (numa_node >= NODEMASK_BITS)
+			return;
+		nodemask[numa_node / (sizeof(unsigned long) * 8)] |= 1UL << (numa_node % (sizeof(unsigned long) * 8));
+		// binding is best effort, it fails on kernels without numa support
+		syscall(SYS_mbind, ptr, size, VIRTUAL_MPOL_BIND, nodemask, NODEMASK_BITS, 0);
+	}
+
+	inline static void
+	_virtual_populate(void* ptr, size_t size)
+	{
+		#ifdef MADV_POPULATE_WRITE
+		if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0)
+			return;
+		#endif
+
+		// touch every page to fault it in
+		auto it = (volatile uint8_t*)ptr;
+		auto page_size = _virtual_page_size();
+		for (size_t i = 0; i < size; i += page_size)
+			it[i] = 0;
+	}
+
+	// applies the flags which should be applied after mapping the memory, populate should come last so that the
+	// pages are faulted in as huge pages and on the right numa node
+	inline static void
+	_virtual_apply_flags(void* ptr, size_t size, uint32_t flags, uint32_t numa_node, bool populated)
+	{
+		if (flags & VIRTUAL_FLAG_HUGE_PAGES)
+			madvise(ptr, size, MADV_HUGEPAGE);
+		if (flags & VIRTUAL_FLAG_NUMA_NODE)
+			_virtual_numa_bind(ptr, size, numa_node);
+		if ((flags & VIRTUAL_FLAG_POPULATE) && (flags & VIRTUAL_FLAG_RESERVE) == 0 && populated == false)
+			_virtual_populate(ptr, size);
+	}
+
 	Block
-	virtual_alloc(void* address_hint, size_t size)
+	virtual_alloc(void* address_hint, size_t size, uint32_t flags, uint32_t numa_node)
 	{
-		Block result{};
-		result.ptr = mmap(address_hint, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-		if(result.ptr)
-			result.size = size;
-		return result;
+		if (size == 0)
+			return {};
+
+		int prot = (flags & VIRTUAL_FLAG_RESERVE) ? PROT_NONE : PROT_READ|PROT_WRITE;
+		int mmap_flags = MAP_PRIVATE|MAP_ANONYMOUS;
+		if (flags & VIRTUAL_FLAG_RESERVE)
+			mmap_flags |= MAP_NORESERVE;
+		// the kernel can only populate the memory in the mmap call if it doesn't need to be bound or advised first
+		bool populate_on_map =
+			(flags & VIRTUAL_FLAG_POPULATE) &&
+			(flags & (VIRTUAL_FLAG_RESERVE|VIRTUAL_FLAG_NUMA_NODE|VIRTUAL_FLAG_HUGE_PAGES)) == 0;
+		if (populate_on_map)
+			mmap_flags |= MAP_POPULATE;
+
+		if (flags & VIRTUAL_FLAG_EXPLICIT_HUGE_PAGES)
+		{
+			auto huge_size = _virtual_round_up(size, VIRTUAL_HUGE_PAGE_SIZE);
+			auto ptr = mmap(address_hint, huge_size, prot, mmap_flags|MAP_HUGETLB, -1, 0);
+			if (ptr != MAP_FAILED)
+			{
+				_virtual_apply_flags(ptr, huge_size, flags & ~VIRTUAL_FLAG_HUGE_PAGES, numa_node, populate_on_map);
+				return Block{ptr, huge_size};
+			}
+
+			// there are no available explicit huge pages so we fall back to transparent huge pages
+			flags |= VIRTUAL_FLAG_HUGE_PAGES;
+			if (populate_on_map)
+			{
+				mmap_flags &= ~MAP_POPULATE;
+				populate_on_map = false;
+			}
+		}
+
+		// over allocate to be able to align the memory to the huge page size then trim the extra memory
+		bool align_to_huge_page = (flags & VIRTUAL_FLAG_HUGE_PAGES) && size >= VIRTUAL_HUGE_PAGE_SIZE;
+		auto map_size = align_to_huge_page ? size + VIRTUAL_HUGE_PAGE_SIZE : size;
+		auto ptr = (uint8_t*)mmap(address_hint, map_size, prot, mmap_flags, -1, 0);
+		if (ptr == MAP_FAILED)
+			return {};
+
+		if (align_to_huge_page)
+		{
+			auto aligned_ptr = (uint8_t*)_virtual_round_up(size_t(ptr), VIRTUAL_HUGE_PAGE_SIZE);
+			if (aligned_ptr > ptr)
+				munmap(ptr, aligned_ptr - ptr);
+			auto tail_ptr = (uint8_t*)_virtual_round_up(size_t(aligned_ptr + size), _virtual_page_size());
+			if (tail_ptr < ptr + map_size)
+				munmap(tail_ptr, (ptr + map_size) - tail_ptr);
+			ptr = aligned_ptr;
+		}
+
+		_virtual_apply_flags(ptr, size, flags, numa_node, populate_on_map);
+		return Block{ptr, size};
 	}
 
 	void
@@ -19,4 +126,23 @@ namespace mn
 	{
 		munmap(block.ptr, block.size);
 	}
+
+	bool
+	virtual_commit(Block block, uint32_t flags, uint32_t)
+	{
+		if (mprotect(block.ptr, block.size, PROT_READ|PROT_WRITE) != 0)
+			return false;
+
+		// the huge pages advice and the numa policy are already applied to the whole range when it was reserved
+		if (flags & VIRTUAL_FLAG_POPULATE)
+			_virtual_populate(block.ptr, block.size);
+		return true;
+	}
+
+	void
+	virtual_decommit(Block block)
+	{
+		madvise(block.ptr, block.size, MADV_DONTNEED);
+		mprotect(block.ptr, block.size, PROT_NONE);
+	}
 }
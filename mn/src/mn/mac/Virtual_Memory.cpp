@@ -1,17 +1,43 @@
 #include "mn/Virtual_Memory.h"
 
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace mn
 {
+	// the page size is queried once, apple silicon uses 16Kb pages
+	inline static size_t
+	_virtual_page_size()
+	{
+		static const size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+		return page_size;
+	}
+
+	inline static void
+	_virtual_populate(void* ptr, size_t size)
+	{
+		// touch every page to fault it in
+		auto it = (volatile uint8_t*)ptr;
+		auto page_size = _virtual_page_size();
+		for (size_t i = 0; i < size; i += page_size)
+			it[i] = 0;
+	}
+
 	Block
-	virtual_alloc(void* address_hint, size_t size)
+	virtual_alloc(void* address_hint, size_t size, uint32_t flags, uint32_t)
 	{
-		Block result{};
-		result.ptr = mmap(address_hint, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-		if(result.ptr)
-			result.size = size;
-		return result;
+		if (size == 0)
+			return {};
+
+		// huge pages and numa binding are not supported so they are ignored
+		int prot = (flags & VIRTUAL_FLAG_RESERVE) ? PROT_NONE : PROT_READ|PROT_WRITE;
+		auto ptr = mmap(address_hint, size, prot, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return {};
+
+		if ((flags & VIRTUAL_FLAG_POPULATE) && (flags & VIRTUAL_FLAG_RESERVE) == 0)
+			_virtual_populate(ptr, size);
+		return Block{ptr, size};
 	}
 
 	void
@@ -19,4 +45,22 @@ namespace mn
 	{
 		munmap(block.ptr, block.size);
 	}
+
+	bool
+	virtual_commit(Block block, uint32_t flags, uint32_t)
+	{
+		if (mprotect(block.ptr, block.size, PROT_READ|PROT_WRITE) != 0)
+			return false;
+
+		if (flags & VIRTUAL_FLAG_POPULATE)
+			_virtual_populate(block.ptr, block.size);
+		return true;
+	}
+
+	void
+	virtual_decommit(Block block)
+	{
+		madvise(block.ptr, block.size, MADV_FREE);
+		mprotect(block.ptr, block.size, PROT_NONE);
+	}
 }
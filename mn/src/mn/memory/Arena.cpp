@@ -7,6 +7,7 @@ namespace mn::memory
 	Arena::Arena(size_t block_size, Interface* meta)
 	{
 		mn_assert(block_size != 0);
+		this->kind = KIND_ARENA;
 		this->meta = meta;
 		this->head = nullptr;
 		this->block_size = block_size;
@@ -18,18 +19,32 @@ namespace mn::memory
 		this->clear_all_previous_highwater = 0;
 	}
 
+	Arena::Arena(size_t block_size, const Virtual& virtual_meta)
+		: Arena(block_size, &this->virtual_meta)
+	{
+		this->virtual_meta.flags = virtual_meta.flags & ~VIRTUAL_FLAG_RESERVE;
+		this->virtual_meta.numa_node = virtual_meta.numa_node;
+	}
+
 	Arena::~Arena()
 	{
 		free_all();
 	}
 
 	Block
-	Arena::alloc(size_t size, uint8_t)
+	Arena::alloc(size_t size, uint8_t alignment)
+	{
+		return bump(size, alignment);
+	}
+
+	Block
+	Arena::alloc_slow(size_t size, uint8_t alignment)
 	{
-		grow(size);
+		// reserve enough memory to align the allocation in the worst case
+		grow(size + (alignment > 0 ? alignment - 1 : 0));
 
-		uint8_t* ptr = this->head->alloc_head;
-		this->head->alloc_head += size;
+		uint8_t* ptr = align_up(this->head->alloc_head, alignment);
+		this->head->alloc_head = ptr + size;
 		this->used_mem += size;
 		this->highwater_mem = this->highwater_mem > this->used_mem ? this->highwater_mem : this->used_mem;
 		this->clear_all_current_highwater = this->clear_all_current_highwater > this->used_mem ? this->clear_all_current_highwater : this->used_mem;
@@ -55,6 +70,10 @@ namespace mn::memory
 
 		size_t request_size = size > this->block_size ? size : this->block_size;
 		request_size += sizeof(Node);
+		// huge page blocks are rounded up so that the block uses all the memory it maps
+		constexpr uint32_t HUGE_PAGES_FLAGS = VIRTUAL_FLAG_HUGE_PAGES|VIRTUAL_FLAG_EXPLICIT_HUGE_PAGES;
+		if (this->meta == &this->virtual_meta && (this->virtual_meta.flags & HUGE_PAGES_FLAGS))
+			request_size = (request_size + VIRTUAL_HUGE_PAGE_SIZE - 1) & ~(VIRTUAL_HUGE_PAGE_SIZE - 1);
 
 		Node* new_node = (Node*)meta->alloc(request_size, alignof(int)).ptr;
 		this->total_mem += request_size - sizeof(Node);
@@ -1,4 +1,5 @@
 #include "mn/memory/Buddy.h"
+#include "mn/OS.h"
 
 #include <math.h>
 #include <string.h>
@@ -8,6 +9,7 @@ namespace mn::memory
 	constexpr size_t BUDDY_HEADER_SIZE = 8;
 	constexpr size_t BUDDY_MIN_ALLOC_LOG2 = 4;
 	constexpr size_t BUDDY_MIN_ALLOC = 16;
+	constexpr size_t BUDDY_COMMIT_GRANULARITY = 64ULL * 1024ULL;
 
 	inline static void
 	node_init(Buddy::Node* n)
@@ -105,6 +107,20 @@ namespace mn::memory
 	{
 		if (new_ptr > self->max_ptr)
 			self->max_ptr = new_ptr;
+
+		// commit the reserved heap in steps as it's used
+		if (new_ptr > self->committed_ptr)
+		{
+			auto heap_end = self->base_ptr + self->max_alloc;
+			auto commit_offset = ((new_ptr - self->base_ptr) + self->commit_granularity - 1) & ~(self->commit_granularity - 1);
+			auto commit_end = self->base_ptr + commit_offset;
+			if (commit_end > heap_end)
+				commit_end = heap_end;
+			Block block{self->committed_ptr, size_t(commit_end - self->committed_ptr)};
+			if (virtual_commit(block, self->virtual_meta.flags, self->virtual_meta.numa_node) == false)
+				mn::panic("buddy allocator failed to commit memory");
+			self->committed_ptr = commit_end;
+		}
 	}
 
 	inline static bool
@@ -154,46 +170,73 @@ namespace mn::memory
 		return true;
 	}
 
-	Buddy::Buddy(size_t heap_size, Interface* meta_)
+	inline static void
+	buddy_init(Buddy* self, size_t heap_size)
 	{
-		meta = meta_;
-
 		heap_size = next_power_of_2(heap_size);
-		max_alloc = heap_size;
-		max_alloc_log2 = (size_t)log2((double)heap_size);
+		self->max_alloc = heap_size;
+		self->max_alloc_log2 = (size_t)log2((double)heap_size);
 
-		bucket_max = max_alloc_log2 - BUDDY_MIN_ALLOC_LOG2 + 1;
-		buckets = nullptr;
+		self->bucket_max = self->max_alloc_log2 - BUDDY_MIN_ALLOC_LOG2 + 1;
+		self->buckets = nullptr;
 
-		bucket_count = bucket_max - 1;
+		self->bucket_count = self->bucket_max - 1;
 
-		node_is_split = nullptr;
+		self->node_is_split = nullptr;
 
-		base_ptr = nullptr;
-		max_ptr = nullptr;
+		self->base_ptr = nullptr;
+		self->max_ptr = nullptr;
 
 		// increase size for buckets
-		size_t buckets_size = sizeof(Node) * bucket_max;
+		size_t buckets_size = sizeof(Buddy::Node) * self->bucket_max;
 		// increase size for node_is_split lookup
-		size_t node_is_split_size = (1 << (bucket_max - 1)) / 8;
+		size_t node_is_split_size = (1 << (self->bucket_max - 1)) / 8;
 		size_t total_size = heap_size + buckets_size + node_is_split_size;
 
-		memory = meta->alloc(total_size, alignof(int));
+		self->memory = self->meta->alloc(total_size, alignof(int));
 
-		base_ptr = (uint8_t*)memory.ptr;
-		max_ptr = (uint8_t*)memory.ptr;
+		self->base_ptr = (uint8_t*)self->memory.ptr;
+		self->max_ptr = (uint8_t*)self->memory.ptr;
+		self->committed_ptr = self->base_ptr + heap_size;
+		self->commit_granularity = BUDDY_COMMIT_GRANULARITY;
+		if (self->meta == &self->virtual_meta && (self->virtual_meta.flags & VIRTUAL_FLAG_RESERVE))
+		{
+			constexpr uint32_t HUGE_PAGES_FLAGS = VIRTUAL_FLAG_HUGE_PAGES|VIRTUAL_FLAG_EXPLICIT_HUGE_PAGES;
+			if (self->virtual_meta.flags & HUGE_PAGES_FLAGS)
+				self->commit_granularity = VIRTUAL_HUGE_PAGE_SIZE;
+
+			// the book keeping data lives after the heap so it's committed upfront
+			self->committed_ptr = self->base_ptr + (heap_size & ~(self->commit_granularity - 1));
+			Block block{self->committed_ptr, size_t(((uint8_t*)self->memory.ptr + self->memory.size) - self->committed_ptr)};
+			if (virtual_commit(block, self->virtual_meta.flags, self->virtual_meta.numa_node) == false)
+				mn::panic("buddy allocator failed to commit memory");
+			self->committed_ptr = self->base_ptr;
+		}
 
-		buckets = (Node*)((uint8_t*)memory.ptr + heap_size);
-		::memset(buckets, 0, buckets_size);
+		self->buckets = (Buddy::Node*)((uint8_t*)self->memory.ptr + heap_size);
+		::memset(self->buckets, 0, buckets_size);
 
-		node_is_split = (uint8_t*)memory.ptr + heap_size + buckets_size;
-		::memset(node_is_split, 0, node_is_split_size);
+		self->node_is_split = (uint8_t*)self->memory.ptr + heap_size + buckets_size;
+		::memset(self->node_is_split, 0, node_is_split_size);
 
 		// init the buckets list with the entire allocation
-		node_init(&buckets[bucket_max - 1]);
-		node_push(&buckets[bucket_max - 1], (Buddy::Node*)base_ptr);
+		node_init(&self->buckets[self->bucket_max - 1]);
+		update_max_ptr(self, self->base_ptr + sizeof(Buddy::Node));
+		node_push(&self->buckets[self->bucket_max - 1], (Buddy::Node*)self->base_ptr);
+	}
+
+	Buddy::Buddy(size_t heap_size, Interface* meta_)
+	{
+		meta = meta_;
+		buddy_init(this, heap_size);
+	}
 
-		update_max_ptr(this, base_ptr + sizeof(Buddy::Node));
+	Buddy::Buddy(size_t heap_size, const Virtual& virtual_meta_)
+	{
+		virtual_meta.flags = virtual_meta_.flags;
+		virtual_meta.numa_node = virtual_meta_.numa_node;
+		meta = &virtual_meta;
+		buddy_init(this, heap_size);
 	}
 
 	Buddy::~Buddy()
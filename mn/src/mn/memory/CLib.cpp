@@ -3,14 +3,27 @@
 #include "mn/OS.h"
 
 #include <stdlib.h>
+#include <stddef.h>
+
+#if OS_WINDOWS
+#include <malloc.h>
+#endif
 
 namespace mn::memory
 {
 	Block
-	CLib::alloc(size_t size, uint8_t)
+	CLib::alloc(size_t size, uint8_t alignment)
 	{
 		Block res{};
-		res.ptr = ::malloc(size);
+	#if OS_WINDOWS
+		// the blocks are always allocated with _aligned_malloc because they must be freed with _aligned_free
+		res.ptr = ::_aligned_malloc(size, alignment > alignof(max_align_t) ? alignment : alignof(max_align_t));
+	#else
+		if (alignment <= alignof(max_align_t))
+			res.ptr = ::malloc(size);
+		else if (::posix_memalign(&res.ptr, alignment, size) != 0)
+			res.ptr = nullptr;
+	#endif
 		if (res.ptr == nullptr && size > 0)
 			mn::panic("system out of memory");
 		res.size = size;
@@ -22,7 +35,11 @@ namespace mn::memory
 	CLib::free(Block block)
 	{
 		_memory_profile_free(block.ptr, block.size);
+	#if OS_WINDOWS
+		::_aligned_free(block.ptr);
+	#else
 		::free(block.ptr);
+	#endif
 	}
 
 	CLib*
@@ -0,0 +1,213 @@
+#include "mn/memory/Shared_Arena.h"
+#include "mn/Assert.h"
+
+#include <new>
+
+namespace mn::memory
+{
+	// the chunk which a thread bump allocates from, it belongs to the arena generation which carved it
+	struct Shared_Arena_Chunk
+	{
+		uint64_t generation;
+		uint8_t* alloc_head;
+		uint8_t* end;
+	};
+
+	// every thread caches a chunk per arena, arenas are mapped to the cache slots by their generation so a thread
+	// can allocate from a few arenas at the same time without evicting their chunks
+	constexpr size_t SHARED_ARENA_CHUNKS_CACHE_SIZE = 8;
+	thread_local Shared_Arena_Chunk _shared_arena_chunks[SHARED_ARENA_CHUNKS_CACHE_SIZE];
+
+	// generations are unique across all the arenas, 0 is never used so the empty cache slots never match
+	static std::atomic<uint64_t> _shared_arena_generation{1};
+
+	inline static uint64_t
+	_shared_arena_generation_new()
+	{
+		return _shared_arena_generation.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline static void
+	_shared_arena_node_free(Shared_Arena* self, Shared_Arena::Node* node)
+	{
+		auto size = node->mem.size + sizeof(Shared_Arena::Node);
+		node->~Node();
+		self->meta->free(Block{ node, size });
+	}
+
+	// carves the given size out of the current block, if the current block is full it allocates a new one
+	inline static uint8_t*
+	_shared_arena_carve(Shared_Arena* self, size_t size)
+	{
+		while (true)
+		{
+			auto node = self->head.load(std::memory_order_acquire);
+			if (node != nullptr)
+			{
+				auto offset = node->cursor.fetch_add(size, std::memory_order_relaxed);
+				if (offset <= node->mem.size && size <= node->mem.size - offset)
+				{
+					self->used_mem.fetch_add(size, std::memory_order_relaxed);
+					return (uint8_t*)node->mem.ptr + offset;
+				}
+			}
+
+			mutex_lock(self->mtx);
+			// only one of the threads which found the block full allocates the new one
+			if (self->head.load(std::memory_order_acquire) == node)
+			{
+				size_t request_size = size > self->block_size ? size : self->block_size;
+				request_size += sizeof(Shared_Arena::Node);
+
+				auto new_node = ::new (self->meta->alloc(request_size, alignof(Shared_Arena::Node)).ptr) Shared_Arena::Node;
+				new_node->mem.ptr = &new_node[1];
+				new_node->mem.size = request_size - sizeof(Shared_Arena::Node);
+				new_node->cursor.store(0, std::memory_order_relaxed);
+				new_node->next = node;
+				self->total_mem.fetch_add(new_node->mem.size, std::memory_order_relaxed);
+				self->head.store(new_node, std::memory_order_release);
+			}
+			mutex_unlock(self->mtx);
+		}
+	}
+
+	Shared_Arena::Shared_Arena(size_t block_size, size_t chunk_size, Interface* meta)
+	{
+		mn_assert(block_size != 0 && chunk_size != 0);
+		this->meta = meta;
+		this->mtx = mutex_new("Shared Arena Mutex");
+		this->head = nullptr;
+		this->generation = _shared_arena_generation_new();
+		this->block_size = block_size;
+		this->chunk_size = chunk_size < block_size ? chunk_size : block_size;
+		this->total_mem = 0;
+		this->used_mem = 0;
+	}
+
+	Shared_Arena::~Shared_Arena()
+	{
+		free_all();
+		mutex_free(this->mtx);
+	}
+
+	Block
+	Shared_Arena::alloc(size_t size, uint8_t alignment)
+	{
+		auto generation = this->generation.load(std::memory_order_acquire);
+		auto& chunk = _shared_arena_chunks[generation % SHARED_ARENA_CHUNKS_CACHE_SIZE];
+		if (chunk.generation == generation)
+		{
+			auto ptr = align_up(chunk.alloc_head, alignment);
+			if (ptr <= chunk.end && size <= size_t(chunk.end - ptr))
+			{
+				chunk.alloc_head = ptr + size;
+				return Block{ ptr, size };
+			}
+		}
+
+		// big allocations bypass the thread chunks so they don't waste the rest of the chunk
+		auto padded_size = size + (alignment > 0 ? alignment - 1 : 0);
+		if (padded_size > this->chunk_size / 4)
+			return Block{ align_up(_shared_arena_carve(this, padded_size), alignment), size };
+
+		auto ptr = _shared_arena_carve(this, this->chunk_size);
+		chunk.generation = generation;
+		chunk.alloc_head = ptr;
+		chunk.end = ptr + this->chunk_size;
+
+		ptr = align_up(chunk.alloc_head, alignment);
+		chunk.alloc_head = ptr + size;
+		return Block{ ptr, size };
+	}
+
+	void
+	Shared_Arena::free(Block)
+	{
+	}
+
+	void
+	Shared_Arena::free_all()
+	{
+		auto it = this->head.load();
+		while (it)
+		{
+			auto next = it->next;
+			_shared_arena_node_free(this, it);
+			it = next;
+		}
+		this->head = nullptr;
+		this->generation = _shared_arena_generation_new();
+		this->total_mem = 0;
+		this->used_mem = 0;
+	}
+
+	void
+	Shared_Arena::clear_all()
+	{
+		auto it = this->head.load();
+		if (it == nullptr)
+			return;
+
+		// free all the blocks except the oldest one
+		while (it->next)
+		{
+			auto next = it->next;
+			_shared_arena_node_free(this, it);
+			it = next;
+		}
+		it->cursor = 0;
+		this->head = it;
+		this->generation = _shared_arena_generation_new();
+		this->total_mem = it->mem.size;
+		this->used_mem = 0;
+	}
+
+	bool
+	Shared_Arena::owns(void* ptr) const
+	{
+		for (auto it = this->head.load(); it != nullptr; it = it->next)
+		{
+			auto begin_ptr = (char*)it->mem.ptr;
+			auto end_ptr = begin_ptr + it->mem.size;
+			if (ptr >= begin_ptr && ptr < end_ptr)
+				return true;
+		}
+		return false;
+	}
+
+	Shared_Arena::State
+	Shared_Arena::checkpoint() const
+	{
+		State s{};
+		s.head = this->head.load();
+		if (s.head)
+		{
+			s.cursor = s.head->cursor.load();
+			if (s.cursor > s.head->mem.size)
+				s.cursor = s.head->mem.size;
+		}
+		s.total_mem = this->total_mem;
+		s.used_mem = this->used_mem;
+		return s;
+	}
+
+	void
+	Shared_Arena::restore(State s)
+	{
+		auto it = this->head.load();
+		while (it != s.head)
+		{
+			mn_assert(it != nullptr);
+			auto next = it->next;
+			_shared_arena_node_free(this, it);
+			it = next;
+		}
+		if (it)
+			it->cursor = s.cursor;
+		this->head = it;
+		// the thread chunks might contain memory after the checkpoint so they are all discarded
+		this->generation = _shared_arena_generation_new();
+		this->total_mem = s.total_mem;
+		this->used_mem = s.used_mem;
+	}
+}
@@ -7,6 +7,7 @@ namespace mn::memory
 	Stack::Stack(size_t stack_size, Interface* meta)
 	{
 		mn_assert(stack_size != 0);
+		this->kind = KIND_STACK;
 		this->meta = meta;
 		this->memory = meta->alloc(stack_size, alignof(uint8_t));
 		this->alloc_head = (uint8_t*)this->memory.ptr;
@@ -19,17 +20,15 @@ namespace mn::memory
 	}
 
 	Block
-	Stack::alloc(size_t size, uint8_t)
+	Stack::alloc(size_t size, uint8_t alignment)
 	{
-		ptrdiff_t used_memory = this->alloc_head - (uint8_t*)this->memory.ptr;
-		[[maybe_unused]] size_t free_memory = this->memory.size - used_memory;
-		if (free_memory < size)
-			mn::panic("stack allocator out of memory");
+		return bump(size, alignment);
+	}
 
-		uint8_t* ptr = this->alloc_head;
-		this->alloc_head = ptr + size;
-		this->allocations_count++;
-		return Block{ ptr, size };
+	void
+	Stack::out_of_memory()
+	{
+		mn::panic("stack allocator out of memory");
 	}
 
 	void
@@ -7,7 +7,7 @@ namespace mn::memory
 	Block
 	Virtual::alloc(size_t size, uint8_t)
 	{
-		Block res = virtual_alloc(nullptr, size);
+		Block res = virtual_alloc(nullptr, size, this->flags, this->numa_node);
 		_memory_profile_alloc(res.ptr, res.size);
 		return res;
 	}
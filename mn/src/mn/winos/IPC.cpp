@@ -263,6 +263,13 @@ namespace mn::ipc
 		return res;
 	}
 
+	bool
+	sputnik_shm_enable(Sputnik, const Sputnik_Shm_Settings&, Timeout)
+	{
+		// the shared memory transport is only implemented on linux
+		return false;
+	}
+
 	bool
 	sputnik_msg_write(Sputnik self, Block data)
 	{
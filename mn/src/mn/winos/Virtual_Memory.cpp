@@ -8,14 +8,52 @@
 
 namespace mn
 {
+	constexpr size_t VIRTUAL_PAGE_SIZE = 4096;
+
+	inline static void
+	_virtual_populate(void* ptr, size_t size)
+	{
+		// touch every page to fault it in
+		auto it = (volatile uint8_t*)ptr;
+		for (size_t i = 0; i < size; i += VIRTUAL_PAGE_SIZE)
+			it[i] = 0;
+	}
+
+	inline static void*
+	_virtual_alloc(void* address, size_t size, DWORD type, uint32_t flags, uint32_t numa_node)
+	{
+		if (flags & VIRTUAL_FLAG_NUMA_NODE)
+			return VirtualAllocExNuma(GetCurrentProcess(), address, size, type, PAGE_READWRITE, numa_node);
+		return VirtualAlloc(address, size, type, PAGE_READWRITE);
+	}
+
 	Block
-	virtual_alloc(void* address_hint, size_t size)
+	virtual_alloc(void* address_hint, size_t size, uint32_t flags, uint32_t numa_node)
 	{
-		Block result{};
-		result.ptr = VirtualAlloc(address_hint, size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-		if(result.ptr)
-			result.size = size;
-		return result;
+		if (size == 0)
+			return {};
+
+		// large pages can't be reserved without being committed, and they need the SeLockMemoryPrivilege, in case
+		// of failure we fall back to normal pages since windows has no transparent huge pages
+		if ((flags & VIRTUAL_FLAG_EXPLICIT_HUGE_PAGES) && (flags & VIRTUAL_FLAG_RESERVE) == 0)
+		{
+			if (auto large_page_size = GetLargePageMinimum(); large_page_size > 0)
+			{
+				auto large_size = (size + large_page_size - 1) & ~(large_page_size - 1);
+				auto ptr = _virtual_alloc(address_hint, large_size, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES, flags, numa_node);
+				if (ptr)
+					return Block{ptr, large_size};
+			}
+		}
+
+		DWORD type = (flags & VIRTUAL_FLAG_RESERVE) ? MEM_RESERVE : MEM_RESERVE|MEM_COMMIT;
+		auto ptr = _virtual_alloc(address_hint, size, type, flags, numa_node);
+		if (ptr == nullptr)
+			return {};
+
+		if ((flags & VIRTUAL_FLAG_POPULATE) && (flags & VIRTUAL_FLAG_RESERVE) == 0)
+			_virtual_populate(ptr, size);
+		return Block{ptr, size};
 	}
 
 	void
@@ -24,4 +62,22 @@ namespace mn
 		[[maybe_unused]] auto result = VirtualFree(block.ptr, 0, MEM_RELEASE);
 		mn_assert(result != NULL);
 	}
+
+	bool
+	virtual_commit(Block block, uint32_t flags, uint32_t numa_node)
+	{
+		if (_virtual_alloc(block.ptr, block.size, MEM_COMMIT, flags, numa_node) == nullptr)
+			return false;
+
+		if (flags & VIRTUAL_FLAG_POPULATE)
+			_virtual_populate(block.ptr, block.size);
+		return true;
+	}
+
+	void
+	virtual_decommit(Block block)
+	{
+		[[maybe_unused]] auto result = VirtualFree(block.ptr, block.size, MEM_DECOMMIT);
+		mn_assert(result != NULL);
+	}
 }
@@ -12,6 +12,7 @@
 #include <mn/Ring.h>
 #include <mn/OS.h>
 #include <mn/memory/Leak.h>
+#include <mn/memory/Shared_Arena.h>
 #include <mn/Task.h>
 #include <mn/Path.h>
 #include <mn/Fmt.h>
@@ -25,11 +26,21 @@
 #include <mn/SIMD.h>
 #include <mn/Json.h>
 #include <mn/Regex.h>
+#include <mn/Ingest.h>
+#include <mn/Heap_Profile.h>
+#include <mn/Growth.h>
+#include <mn/Epoch.h>
+#include <mn/Trace.h>
+#include <mn/Zone.h>
+#include <mn/Histogram.h>
 #include <mn/Log.h>
+#include <mn/IPC.h>
 
 #include <chrono>
+#include <mutex>
 #include <iostream>
 #include <sstream>
+#include <cmath>
 
 #define ANKERL_NANOBENCH_IMPLEMENT 1
 #include <nanobench.h>
@@ -73,6 +84,137 @@ TEST_CASE("arena allocator")
 	mn::allocator_free(arena);
 }
 
+TEST_CASE("bump allocators alignment")
+{
+	auto arena = mn::allocator_arena_new(256);
+	mn_defer{mn::allocator_free(arena);};
+	auto stack = mn::allocator_stack_new(4096);
+	mn_defer{mn::allocator_free(stack);};
+
+	mn::Allocator allocators[] = {arena, stack};
+	for (auto allocator: allocators)
+	{
+		for (uint8_t alignment: {1, 2, 8, 16, 32, 64, 128})
+		{
+			mn::alloc_from(allocator, 1, alignof(char));
+			auto block = mn::alloc_from(allocator, 24, alignment);
+			CHECK(uintptr_t(block.ptr) % alignment == 0);
+			// the virtual path should honor the alignment too
+			auto virtual_block = allocator->alloc(3, alignment);
+			CHECK(uintptr_t(virtual_block.ptr) % alignment == 0);
+		}
+	}
+
+	// allocations bigger than the block size still get aligned
+	auto big = mn::alloc_from(arena, 1000, 64);
+	CHECK(uintptr_t(big.ptr) % 64 == 0);
+	CHECK(mn::allocator_arena_owns(arena, (char*)big.ptr + 999));
+	CHECK(arena->used_mem >= 1000);
+
+	// buf on a tmp arena goes through the inline path
+	auto nums = mn::buf_with_allocator<double>(mn::memory::tmp());
+	for (int i = 0; i < 100; ++i)
+		mn::buf_push(nums, double(i));
+	CHECK(uintptr_t(nums.ptr) % alignof(double) == 0);
+	CHECK(nums[99] == 99.0);
+}
+
+TEST_CASE("clib allocator alignment")
+{
+	for (uint8_t alignment: {1, 8, 16, 32, 64, 128})
+	{
+		auto block = mn::alloc_from(mn::memory::clib(), 100, alignment);
+		CHECK(uintptr_t(block.ptr) % alignment == 0);
+		::memset(block.ptr, 0xAB, block.size);
+		mn::free_from(mn::memory::clib(), block);
+	}
+}
+
+TEST_CASE("heap profile")
+{
+	mn::Heap_Profile_Settings settings{};
+	settings.sample_period = 4096;
+	mn::heap_profile_start(settings);
+
+	auto blocks = mn::buf_with_allocator<mn::Block>(mn::memory::clib());
+	for (size_t i = 0; i < 1000; ++i)
+		mn::buf_push(blocks, mn::alloc_from(mn::memory::clib(), 100 + i % 3, alignof(int)));
+	auto big = mn::alloc_from(mn::memory::clib(), 1024 * 1024, alignof(int));
+
+	auto stats = mn::heap_profile_stats();
+	CHECK(stats.size_classes[mn::heap_profile_size_class(100)].alloc_count >= 1000);
+	CHECK(stats.size_classes[mn::heap_profile_size_class(1024 * 1024)].alloc_count >= 1);
+	CHECK(stats.total.alloc_bytes >= 1000 * 100 + 1024 * 1024);
+	CHECK(stats.samples_count > 0);
+
+	mn::free_from(mn::memory::clib(), big);
+	for (auto block: blocks)
+		mn::free_from(mn::memory::clib(), block);
+	mn::buf_free(blocks);
+
+	auto after_free = mn::heap_profile_stats();
+	CHECK(after_free.size_classes[mn::heap_profile_size_class(100)].free_count >= 1000);
+	CHECK(after_free.live_samples_count < stats.live_samples_count);
+
+	// the dump is a protobuf message which starts with the sample types (field 1, length delimited)
+	auto stream = mn::memory_stream_new();
+	mn_defer{mn::memory_stream_free(stream);};
+	auto err = mn::heap_profile_dump(stream);
+	CHECK(!err);
+	CHECK(stream->str.count > 0);
+	CHECK(uint8_t(stream->str[0]) == 0x0A);
+	CHECK(mn::str_find(stream->str, "inuse_space", 0) != SIZE_MAX);
+
+	mn::heap_profile_stop();
+	CHECK(mn::heap_profile_size_class(0) == 0);
+	CHECK(mn::heap_profile_size_class(1) == 1);
+	CHECK(mn::heap_profile_size_class(SIZE_MAX) == mn::HEAP_PROFILE_SIZE_CLASSES_COUNT - 1);
+}
+
+TEST_CASE("growth tracking")
+{
+	mn::growth_reset();
+
+	auto numbers = mn::buf_new<int>();
+	mn_defer{mn::buf_free(numbers);};
+	for (int i = 0; i < 1000; ++i)
+		mn::buf_push(numbers, i);
+
+	auto table = mn::map_new<int, int>();
+	mn_defer{mn::map_free(table);};
+	for (int i = 0; i < 1000; ++i)
+		mn::map_insert(table, i, i);
+
+	auto sites = mn::growth_report(mn::memory::tmp());
+	if (mn::growth_tracking_enabled() == false)
+	{
+		CHECK(sites.count == 0);
+		return;
+	}
+
+	const mn::Growth_Site* buf_site = nullptr;
+	const mn::Growth_Site* map_site = nullptr;
+	for (const auto& site: sites)
+	{
+		if (site.kind == mn::GROWTH_KIND_BUF && site.element_size == sizeof(int) && site.peak_capacity >= 1000)
+			buf_site = &site;
+		else if (site.kind == mn::GROWTH_KIND_MAP && site.peak_capacity >= 1024)
+			map_site = &site;
+	}
+	REQUIRE(buf_site != nullptr);
+	CHECK(buf_site->growths_count > 1);
+	CHECK(buf_site->copied_bytes >= 500 * sizeof(int));
+	CHECK(buf_site->frames_count > 0);
+	REQUIRE(map_site != nullptr);
+	CHECK(map_site->growths_count > 1);
+
+	for (size_t i = 1; i < sites.count; ++i)
+		CHECK(sites[i - 1].copied_bytes >= sites[i].copied_bytes);
+
+	mn::growth_reset();
+	CHECK(mn::growth_report(mn::memory::tmp()).count == 0);
+}
+
 TEST_CASE("tmp allocator")
 {
 	{
@@ -472,6 +614,61 @@ TEST_CASE("virtual memory allocation")
 	mn::virtual_free(block);
 }
 
+TEST_CASE("virtual memory flags")
+{
+	// huge page allocations are aligned so they can be backed by huge pages
+	auto huge = mn::virtual_alloc(nullptr, 4 * mn::VIRTUAL_HUGE_PAGE_SIZE, mn::VIRTUAL_FLAG_HUGE_PAGES|mn::VIRTUAL_FLAG_POPULATE);
+	CHECK(huge.ptr != nullptr);
+	#if OS_LINUX
+	CHECK(uintptr_t(huge.ptr) % mn::VIRTUAL_HUGE_PAGE_SIZE == 0);
+	#endif
+	::memset(huge.ptr, 1, huge.size);
+	mn::virtual_free(huge);
+
+	// explicit huge pages fall back to normal pages if there are no reserved huge pages
+	auto explicit_huge = mn::virtual_alloc(nullptr, 1000, mn::VIRTUAL_FLAG_EXPLICIT_HUGE_PAGES|mn::VIRTUAL_FLAG_NUMA_NODE, 0);
+	CHECK(explicit_huge.ptr != nullptr);
+	CHECK(explicit_huge.size >= 1000);
+	((char*)explicit_huge.ptr)[999] = 1;
+	mn::virtual_free(explicit_huge);
+
+	// reserve then commit
+	auto reserved = mn::virtual_alloc(nullptr, 1024 * 1024, mn::VIRTUAL_FLAG_RESERVE);
+	CHECK(reserved.ptr != nullptr);
+	auto page = mn::Block{(char*)reserved.ptr + 64 * 1024, 64 * 1024};
+	CHECK(mn::virtual_commit(page, mn::VIRTUAL_FLAG_POPULATE));
+	::memset(page.ptr, 0xAB, page.size);
+	CHECK(((uint8_t*)page.ptr)[page.size - 1] == 0xAB);
+	mn::virtual_decommit(page);
+	CHECK(mn::virtual_commit(page));
+	mn::virtual_free(reserved);
+
+	// arena and buddy allocators on top of virtual memory
+	auto arena = mn::allocator_arena_new(1024 * 1024, mn::memory::Virtual{mn::VIRTUAL_FLAG_HUGE_PAGES});
+	for (int i = 0; i < 100; ++i)
+		::memset(mn::alloc_from(arena, 64 * 1024, 64).ptr, i, 64 * 1024);
+	// huge page blocks are rounded up to use all the mapped memory
+	for (auto it = arena->head; it != nullptr; it = it->next)
+		CHECK((it->mem.size + sizeof(mn::memory::Arena::Node)) % mn::VIRTUAL_HUGE_PAGE_SIZE == 0);
+	mn::allocator_free(arena);
+
+	auto buddy = mn::allocator_buddy_new(64 * 1024 * 1024, mn::memory::Virtual{mn::VIRTUAL_FLAG_RESERVE});
+	auto blocks = mn::buf_new<mn::Block>();
+	for (size_t i = 0; i < 64; ++i)
+	{
+		auto block = mn::alloc_from(buddy, 100 * 1024, alignof(int));
+		CHECK(block.ptr != nullptr);
+		::memset(block.ptr, int(i), block.size);
+		mn::buf_push(blocks, block);
+	}
+	CHECK(buddy->committed_ptr < buddy->base_ptr + buddy->max_alloc);
+	CHECK(buddy->committed_ptr >= buddy->max_ptr);
+	for (auto block: blocks)
+		mn::free_from(buddy, block);
+	mn::buf_free(blocks);
+	mn::allocator_free(buddy);
+}
+
 TEST_CASE("reads")
 {
 	int a, b;
@@ -627,6 +824,55 @@ TEST_CASE("Rune")
 	#endif
 }
 
+TEST_CASE("utf-8 validation and rune count")
+{
+	auto ascii = "the quick brown fox jumps over the lazy dog"_mnstr;
+	CHECK(mn::str_is_ascii(ascii));
+	CHECK(mn::str_utf8_valid(ascii));
+	CHECK(mn::str_rune_count(ascii) == ascii.count);
+
+	auto arabic = mn::str_lit("مصطفى سعد the quick brown fox مصطفى سعد");
+	CHECK(mn::str_is_ascii(arabic) == false);
+	CHECK(mn::str_utf8_valid(arabic));
+	CHECK(mn::str_rune_count(arabic) == 39);
+	CHECK(mn::rune_count(arabic.ptr) == 39);
+
+	// overlong encoding, surrogate, out of range and truncated runes
+	CHECK(mn::rune_utf8_valid("\xC0\xAF", 2) == false);
+	CHECK(mn::rune_utf8_valid("\xED\xA0\x80", 3) == false);
+	CHECK(mn::rune_utf8_valid("\xF4\x90\x80\x80", 4) == false);
+	CHECK(mn::rune_utf8_valid("0123456789abcdef\xE2\x82", 18) == false);
+	CHECK(mn::rune_utf8_valid("0123456789abcdef\xE2\x82\xAC", 19) == true);
+}
+
+TEST_CASE("str lower and upper in place")
+{
+	auto word = mn::str_from_c("The Quick Brown Fox Jumps Over The Lazy Dog");
+	auto ptr = word.ptr;
+	mn::str_lower(word);
+	CHECK(word == "the quick brown fox jumps over the lazy dog");
+	mn::str_upper(word);
+	CHECK(word == "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG");
+	CHECK(word.ptr == ptr);
+	mn::str_free(word);
+
+	auto mixed = mn::str_from_c("Ærø AND ÉCOLE and مصطفى ZZ");
+	mn::str_lower(mixed);
+	CHECK(mixed == "ærø and école and مصطفى zz");
+	mn::str_free(mixed);
+
+	// U+023F grows from 2 bytes to 3 bytes when converted to upper case
+	auto growing = mn::str_from_c("abc\u023F def");
+	mn::str_upper(growing);
+	CHECK(growing == "ABC\u2C7E DEF");
+	mn::str_free(growing);
+
+	auto lit = mn::str_lit("Literal");
+	mn::str_lower(lit);
+	CHECK(lit == "literal");
+	mn::str_free(lit);
+}
+
 TEST_CASE("Task")
 {
 	CHECK(std::is_pod_v<mn::Task<void()>> == true);
@@ -814,6 +1060,64 @@ TEST_CASE("fabric simple function")
 	mn::fabric_free(f);
 }
 
+TEST_CASE("shared arena")
+{
+	mn::Fabric_Settings settings{};
+	settings.workers_count = 4;
+	auto f = mn::fabric_new(settings);
+	mn_defer{mn::fabric_free(f);};
+
+	auto arena = mn::allocator_shared_arena_new(64 * 1024, 4 * 1024);
+	mn_defer{mn::allocator_free(arena);};
+
+	// every invocation allocates a node in the shared arena and links it into a shared result
+	constexpr size_t COUNT = 10000;
+	auto results = mn::buf_with_count<int64_t*>(COUNT);
+	mn_defer{mn::buf_free(results);};
+	mn::compute(f, {COUNT, 1, 1}, {64, 1, 1}, [&](mn::Compute_Args args) {
+		for (uint32_t i = 0; i < args.tile_size.x; ++i)
+		{
+			auto index = args.global_invocation_id.x + i;
+			auto block = mn::alloc_from(arena, (index % 3 + 1) * sizeof(int64_t), alignof(int64_t));
+			auto values = (int64_t*)block.ptr;
+			for (size_t j = 0; j < index % 3 + 1; ++j)
+				values[j] = int64_t(index);
+			// big allocations bypass the thread chunks
+			if (index % 1000 == 0)
+				::memset(mn::alloc_from(arena, 8 * 1024, 64).ptr, 0xFF, 8 * 1024);
+			results[index] = values;
+		}
+	});
+
+	bool all_valid = true;
+	for (size_t i = 0; i < COUNT; ++i)
+	{
+		for (size_t j = 0; j < i % 3 + 1; ++j)
+			all_valid &= results[i][j] == int64_t(i);
+		all_valid &= uintptr_t(results[i]) % alignof(int64_t) == 0;
+		all_valid &= mn::allocator_shared_arena_owns(arena, results[i]);
+	}
+	CHECK(all_valid);
+	CHECK(arena->used_mem >= COUNT * sizeof(int64_t));
+
+	// restoring a checkpoint discards everything allocated after it
+	auto total_mem = arena->total_mem.load();
+	auto checkpoint = mn::allocator_shared_arena_checkpoint(arena);
+	for (int i = 0; i < 100; ++i)
+		mn::alloc_from(arena, 4096, alignof(char));
+	CHECK(arena->total_mem > total_mem);
+	mn::allocator_shared_arena_restore(arena, checkpoint);
+	CHECK(arena->total_mem == total_mem);
+	CHECK(arena->used_mem == checkpoint.used_mem);
+
+	mn::allocator_shared_arena_clear_all(arena);
+	CHECK(arena->used_mem == 0);
+	CHECK(arena->total_mem == 64 * 1024);
+	auto small = mn::alloc_from(arena, 16, 16);
+	CHECK(uintptr_t(small.ptr) % 16 == 0);
+	CHECK(mn::allocator_shared_arena_owns(arena, small.ptr));
+}
+
 TEST_CASE("unbuffered channel with multiple workers")
 {
 	mn::Fabric_Settings settings{};
@@ -993,6 +1297,785 @@ TEST_CASE("stress")
 	mn::chan_free(c);
 }
 
+#ifdef MN_DEADLOCK
+TEST_CASE("deadlock detector lock order")
+{
+	size_t reports_count = 0;
+	mn::Log_Interface hooks{};
+	hooks.self = &reports_count;
+	hooks.error = [](void* self, const char* msg) {
+		if (::strstr(msg, "potential deadlock") != nullptr)
+			++(*(size_t*)self);
+	};
+	auto old_hooks = mn::log_interface_set(hooks);
+	mn_defer{mn::log_interface_set(old_hooks);};
+
+	auto a = mn::mutex_new("deadlock test a");
+	mn_defer{mn::mutex_free(a);};
+	auto b = mn::mutex_new("deadlock test b");
+	mn_defer{mn::mutex_free(b);};
+
+	mn::mutex_lock(a);
+	mn::mutex_lock(b);
+	mn::mutex_unlock(b);
+	mn::mutex_unlock(a);
+	CHECK(reports_count == 0);
+
+	// the inversion is reported once no matter how many times it happens
+	for (int i = 0; i < 3; ++i)
+	{
+		mn::mutex_lock(b);
+		mn::mutex_lock(a);
+		mn::mutex_unlock(a);
+		mn::mutex_unlock(b);
+	}
+	CHECK(reports_count == 1);
+
+	// a freed lock leaves the graph so a new lock at the same address starts with no order, the hooks are called
+	// directly to make sure the address is reused
+	int first = 0, second = 0;
+	mn::_deadlock_detector_lock(&first, "first", false);
+	mn::_deadlock_detector_lock(&second, "second", false);
+	mn::_deadlock_detector_unlock(&second);
+	mn::_deadlock_detector_unlock(&first);
+	mn::_deadlock_detector_free(&first);
+	mn::_deadlock_detector_free(&second);
+
+	mn::_deadlock_detector_lock(&second, "new second", false);
+	mn::_deadlock_detector_lock(&first, "new first", false);
+	mn::_deadlock_detector_unlock(&first);
+	mn::_deadlock_detector_unlock(&second);
+	mn::_deadlock_detector_free(&first);
+	mn::_deadlock_detector_free(&second);
+	CHECK(reports_count == 1);
+}
+#endif
+
+TEST_CASE("mutex stats")
+{
+	auto mtx = mn_mutex_new_with_srcloc("mutex stats test");
+	mn_defer{mn::mutex_free(mtx);};
+
+	for (int i = 0; i < 100; ++i)
+	{
+		mn::mutex_lock(mtx);
+		mn::mutex_unlock(mtx);
+	}
+
+	auto stats = mn::mutex_stats(mtx);
+	CHECK(stats.acquisitions == 100);
+	CHECK(stats.contended_acquisitions == 0);
+	CHECK(stats.spin_acquisitions == 0);
+	CHECK(stats.wait_time_ns == 0);
+
+	mn::Fabric_Settings settings{};
+	settings.workers_count = 4;
+	auto f = mn::fabric_new(settings);
+	mn_defer{mn::fabric_free(f);};
+
+	constexpr size_t COUNT = 40000;
+	size_t counter = 0;
+	mn::compute(f, {COUNT, 1, 1}, {1000, 1, 1}, [&](mn::Compute_Args args) {
+		for (uint32_t i = 0; i < args.tile_size.x; ++i)
+		{
+			mn::mutex_lock(mtx);
+			++counter;
+			mn::mutex_unlock(mtx);
+		}
+	});
+	CHECK(counter == COUNT);
+
+	stats = mn::mutex_stats(mtx);
+	CHECK(stats.acquisitions == COUNT + 100);
+	CHECK(stats.contended_acquisitions <= COUNT);
+	CHECK(stats.spin_acquisitions <= stats.contended_acquisitions);
+
+	mn::Mutex_Location_Stats locations[64];
+	auto locations_count = mn::mutex_stats_by_location(locations, 64);
+	bool found = false;
+	for (size_t i = 0; i < locations_count && i < 64; ++i)
+	{
+		if (locations[i].srcloc == mn::mutex_source_location(mtx))
+		{
+			found = true;
+			CHECK(locations[i].mutexes_count == 1);
+			CHECK(locations[i].stats.acquisitions == stats.acquisitions);
+		}
+		if (i > 0)
+			CHECK(locations[i - 1].stats.wait_time_ns >= locations[i].stats.wait_time_ns);
+	}
+	CHECK(found);
+}
+
+TEST_CASE("distributed read-write mutex")
+{
+	auto mtx = mn_mutex_rw_distributed_new_with_srcloc("distributed mutex test");
+	mn_defer{mn::mutex_rw_free(mtx);};
+	CHECK(mn::mutex_rw_source_location(mtx) != nullptr);
+
+	mn::Fabric_Settings settings{};
+	settings.workers_count = 4;
+	auto f = mn::fabric_new(settings);
+	mn_defer{mn::fabric_free(f);};
+
+	// writers keep the two values equal, readers must never see them differ
+	constexpr size_t COUNT = 100000;
+	size_t a = 0, b = 0;
+	std::atomic<size_t> mismatches = 0;
+	mn::compute(f, {COUNT, 1, 1}, {1000, 1, 1}, [&](mn::Compute_Args args) {
+		for (uint32_t i = 0; i < args.tile_size.x; ++i)
+		{
+			auto index = args.global_invocation_id.x + i;
+			if (index % 100 == 0)
+			{
+				mn::mutex_write_lock(mtx);
+				++a;
+				++b;
+				mn::mutex_write_unlock(mtx);
+			}
+			else
+			{
+				mn::mutex_read_lock(mtx);
+				if (a != b)
+					++mismatches;
+				mn::mutex_read_unlock(mtx);
+			}
+		}
+	});
+	CHECK(mismatches == 0);
+	CHECK(a == COUNT / 100);
+	CHECK(b == COUNT / 100);
+
+	// recursive read locks are fine
+	mn::mutex_read_lock(mtx);
+	mn::mutex_read_lock(mtx);
+	mn::mutex_read_unlock(mtx);
+	mn::mutex_read_unlock(mtx);
+	mn::mutex_write_lock(mtx);
+	mn::mutex_write_unlock(mtx);
+	// even when a writer waits for the outer read lock
+	struct Writer_Args
+	{
+		mn::Mutex_RW mtx;
+		std::atomic<bool> done;
+	};
+	Writer_Args args{mtx, false};
+	mn::mutex_read_lock(mtx);
+	auto writer = mn::thread_new([](void* arg) {
+		auto self = (Writer_Args*)arg;
+		mn::mutex_write_lock(self->mtx);
+		self->done = true;
+		mn::mutex_write_unlock(self->mtx);
+	}, &args, "distributed mutex writer");
+	// give the writer time to raise its flag
+	mn::thread_sleep(50);
+	mn::mutex_read_lock(mtx);
+	CHECK(args.done == false);
+	mn::mutex_read_unlock(mtx);
+	mn::mutex_read_unlock(mtx);
+	mn::thread_join(writer);
+	mn::thread_free(writer);
+	CHECK(args.done);
+}
+
+TEST_CASE("epoch reclamation")
+{
+	struct Snapshot
+	{
+		size_t version;
+		size_t values[16];
+		bool alive;
+	};
+
+	auto snapshot_new = [](size_t version) {
+		auto self = mn::alloc<Snapshot>();
+		self->version = version;
+		for (auto& value: self->values)
+			value = version;
+		self->alive = true;
+		return self;
+	};
+
+	std::atomic<Snapshot*> current = snapshot_new(0);
+	std::atomic<size_t> freed = 0;
+	auto retire = [&](Snapshot* snapshot) {
+		mn::epoch_defer([snapshot, &freed] {
+			snapshot->alive = false;
+			mn::free(snapshot);
+			++freed;
+		});
+	};
+
+	mn::Fabric_Settings settings{};
+	settings.workers_count = 4;
+	auto f = mn::fabric_new(settings);
+
+	// readers use the snapshot without locks while writers keep replacing it
+	constexpr size_t COUNT = 100000;
+	std::atomic<size_t> version = 0;
+	std::atomic<size_t> invalid_reads = 0;
+	mn::compute(f, {COUNT, 1, 1}, {1000, 1, 1}, [&](mn::Compute_Args args) {
+		for (uint32_t i = 0; i < args.tile_size.x; ++i)
+		{
+			auto index = args.global_invocation_id.x + i;
+			if (index % 100 == 0)
+			{
+				auto old = current.exchange(snapshot_new(++version));
+				retire(old);
+			}
+			else
+			{
+				auto snapshot = current.load(std::memory_order_acquire);
+				bool valid = snapshot->alive;
+				for (auto value: snapshot->values)
+					valid &= value == snapshot->version;
+				if (valid == false)
+					++invalid_reads;
+			}
+		}
+	});
+	CHECK(invalid_reads == 0);
+
+	mn::epoch_synchronize();
+	CHECK(mn::epoch_pending_count() == 0);
+	CHECK(freed == COUNT / 100);
+
+	// a reader thread which is online holds up the reclamation until it goes offline
+	mn::epoch_thread_online();
+	auto snapshot = current.load();
+	retire(current.exchange(snapshot_new(++version)));
+	mn::epoch_reclaim();
+	CHECK(mn::epoch_pending_count() == 1);
+	CHECK(snapshot->alive);
+	mn::epoch_thread_offline();
+	mn::epoch_synchronize();
+	CHECK(mn::epoch_pending_count() == 0);
+	CHECK(freed == COUNT / 100 + 1);
+
+	mn::fabric_free(f);
+	mn::free(current.load());
+}
+
+TEST_CASE("trace export")
+{
+	mn::trace_start();
+	CHECK(mn::trace_enabled());
+
+	mn::trace_thread_name("test main");
+	mn::trace_begin("test zone");
+	mn::trace_instant("test instant");
+
+	auto f = mn::fabric_new({});
+	auto c = mn::chan_new<int>();
+	mn::go(f, [c] {
+		mn::thread_sleep(10);
+		mn::chan_send(c, 1);
+	});
+	// the receiver blocks until the worker sends
+	CHECK(mn::chan_recv(c).res == 1);
+	mn::compute(f, {4, 1, 1}, {1, 1, 1}, [](mn::Compute_Args) {});
+	mn::chan_free(c);
+	mn::fabric_free(f);
+	mn::trace_end();
+
+	mn::trace_stop();
+	CHECK(mn::trace_enabled() == false);
+
+	auto stream = mn::memory_stream_new();
+	mn_defer{mn::memory_stream_free(stream);};
+	auto err = mn::trace_write_chrome_json(stream);
+	CHECK(!err);
+
+	auto [value, value_err] = mn::json::parse(stream->str);
+	CHECK(!value_err);
+	mn::json::value_free(value);
+
+	CHECK(mn::str_find(stream->str, "traceEvents", 0) != SIZE_MAX);
+	CHECK(mn::str_find(stream->str, "test main", 0) != SIZE_MAX);
+	CHECK(mn::str_find(stream->str, "test zone", 0) != SIZE_MAX);
+	CHECK(mn::str_find(stream->str, "test instant", 0) != SIZE_MAX);
+	CHECK(mn::str_find(stream->str, "oneshot job", 0) != SIZE_MAX);
+	CHECK(mn::str_find(stream->str, "compute job", 0) != SIZE_MAX);
+	CHECK(mn::str_find(stream->str, "chan recv blocked", 0) != SIZE_MAX);
+}
+
+TEST_CASE("zone profiler")
+{
+	mn::zone_reset();
+
+	auto f = mn::fabric_new({});
+	mn::compute(f, {100, 1, 1}, {1, 1, 1}, [](mn::Compute_Args) {
+		mn_zone("test zone work");
+		mn::thread_sleep(1);
+	});
+	mn::fabric_free(f);
+
+	for (size_t i = 0; i < 10; ++i)
+	{
+		mn_zone("test zone loop");
+	}
+
+	auto report = mn::zone_report();
+	mn_defer{mn::buf_free(report);};
+
+	const mn::Zone_Stats* work = nullptr;
+	const mn::Zone_Stats* loop = nullptr;
+	const mn::Zone_Stats* job = nullptr;
+	for (const auto& stats: report)
+	{
+		if (::strcmp(stats.srcloc->name, "test zone work") == 0)
+			work = &stats;
+		else if (::strcmp(stats.srcloc->name, "test zone loop") == 0)
+			loop = &stats;
+		else if (::strcmp(stats.srcloc->name, "compute job") == 0)
+			job = &stats;
+	}
+	REQUIRE(work != nullptr);
+	REQUIRE(loop != nullptr);
+	REQUIRE(job != nullptr);
+
+	CHECK(work->count == 100);
+	CHECK(loop->count == 10);
+	CHECK(job->count >= 1);
+	CHECK(job->total_ns >= work->total_ns / 2);
+	// every work zone sleeps for at least 1ms
+	CHECK(work->min_ns >= 500000);
+	CHECK(work->min_ns <= work->p50_ns);
+	CHECK(work->p50_ns <= work->p90_ns);
+	CHECK(work->p90_ns <= work->p99_ns);
+	CHECK(work->p99_ns <= work->max_ns);
+	CHECK(work->total_ns >= work->count * work->min_ns);
+
+	mn::zone_reset();
+	auto empty_report = mn::zone_report();
+	CHECK(empty_report.count == 0);
+	mn::buf_free(empty_report);
+}
+
+TEST_CASE("histogram")
+{
+	for (uint64_t v: {uint64_t(0), uint64_t(7), uint64_t(8), uint64_t(1000), uint64_t(123456789), UINT64_MAX})
+	{
+		auto bucket = mn::histogram_bucket(v);
+		CHECK(bucket < mn::HISTOGRAM_BUCKETS_COUNT);
+		CHECK(mn::histogram_bucket_max(bucket) >= v);
+		if (bucket > 0)
+			CHECK(mn::histogram_bucket_max(bucket - 1) < v);
+	}
+
+	auto h = mn::alloc_zerod<mn::Histogram>();
+	mn_defer{mn::free(h);};
+	for (uint64_t i = 1; i <= 1000; ++i)
+		mn::histogram_record(*h, i);
+	CHECK(h->count == 1000);
+	CHECK(h->min == 1);
+	CHECK(h->max == 1000);
+	CHECK(mn::histogram_mean(*h) == 500);
+
+	auto p50 = mn::histogram_percentile(*h, 50);
+	auto p99 = mn::histogram_percentile(*h, 99);
+	CHECK(p50 >= 500);
+	CHECK(p50 <= 500 * 9 / 8);
+	CHECK(p99 >= 990);
+	CHECK(p99 <= 1000);
+	CHECK(mn::histogram_percentile(*h, 100) == 1000);
+	CHECK(mn::histogram_percentile(*h, 0) == 1);
+
+	auto a = mn::alloc_zerod<mn::Atomic_Histogram>();
+	mn_defer{mn::free(a);};
+	mn::atomic_histogram_record(*a, 5000);
+	mn::histogram_merge(*h, *a);
+	CHECK(h->count == 1001);
+	CHECK(h->max == 5000);
+}
+
+TEST_CASE("fabric stats")
+{
+	mn::Fabric_Settings settings{};
+	settings.workers_count = 2;
+	settings.coop_blocking_threshold_in_ms = 10;
+	auto f = mn::fabric_new(settings);
+
+	mn::compute(f, {100, 1, 1}, {1, 1, 1}, [](mn::Compute_Args) {
+		mn::thread_sleep(1);
+	});
+
+	// both workers announce a long block so sysmon replaces them
+	mn::Waitgroup wg = mn::waitgroup_new();
+	mn_defer{mn::waitgroup_free(wg);};
+	for (size_t i = 0; i < 2; ++i)
+	{
+		mn::waitgroup_add(wg, 1);
+		mn::go(f, [wg] {
+			mn::worker_block_ahead();
+			mn::thread_sleep(200);
+			mn::worker_block_clear();
+			mn::waitgroup_done(wg);
+		});
+	}
+	mn::waitgroup_wait(wg);
+
+	// the workers update their counters after the tasks signal the waitgroup
+	auto stats = mn::fabric_stats(f);
+	mn_defer{mn::fabric_stats_free(stats);};
+	for (size_t i = 0; i < 100 && stats.tasks_executed < 102; ++i)
+	{
+		mn::thread_sleep(10);
+		mn::fabric_stats_free(stats);
+		stats = mn::fabric_stats(f);
+	}
+	CHECK(stats.workers.count == 2);
+	CHECK(stats.tasks_executed >= 102);
+	CHECK(stats.blocking_replacements >= 1);
+	CHECK(stats.execution_time_in_ns.count == stats.tasks_executed);
+	CHECK(stats.queue_wait_time_in_ns.count == stats.tasks_executed);
+	// every compute task sleeps for at least 1ms
+	CHECK(mn::histogram_percentile(stats.execution_time_in_ns, 50) >= 500000);
+	CHECK(stats.execution_time_in_ns.max >= 100000000);
+
+	uint64_t busy_time = 0;
+	for (size_t i = 0; i < stats.workers.count; ++i)
+	{
+		CHECK(stats.workers[i].index == i);
+		// all the tasks are done so the published queue depths are back to 0
+		CHECK(stats.workers[i].queue_depth == 0);
+		busy_time += stats.workers[i].busy_time_in_ns;
+	}
+	CHECK(busy_time <= stats.execution_time_in_ns.sum);
+
+	mn::fabric_free(f);
+}
+
+struct Async_Log_Capture
+{
+	std::mutex mtx;
+	mn::Buf<mn::Str> messages;
+};
+
+TEST_CASE("async log")
+{
+	Async_Log_Capture capture{};
+	capture.messages = mn::buf_new<mn::Str>();
+	mn_defer{mn::destruct(capture.messages);};
+
+	mn::Log_Interface hooks{};
+	hooks.self = &capture;
+	hooks.info = [](void* self, const char* msg) {
+		auto capture = (Async_Log_Capture*)self;
+		std::lock_guard<std::mutex> lock(capture->mtx);
+		mn::buf_push(capture->messages, mn::str_from_c(msg));
+	};
+	hooks.warning = hooks.info;
+	auto old_hooks = mn::log_interface_set(hooks);
+	mn_defer{mn::log_interface_set(old_hooks);};
+
+	mn::Log_Async_Settings settings{};
+	settings.ring_size = 1024;
+	settings.full_policy = mn::LOG_ASYNC_FULL_POLICY_BLOCK;
+	mn::log_async_start(settings);
+
+	auto name = mn::str_from_c("mostafa");
+	mn_defer{mn::str_free(name);};
+	auto numbers = mn::buf_lit({1, 2});
+	mn_defer{mn::buf_free(numbers);};
+	{
+		// the arguments must be copied since they don't outlive the call
+		auto tmp = mn::str_from_c("temporary");
+		mn::log_info("{} {} {} {:.1f} {} {}", 1, "literal", name, 2.5, tmp, numbers);
+		mn::str_free(tmp);
+	}
+	mn::log_warning("no arguments");
+
+	// the ring buffer is small so the workers block until there's room
+	auto f = mn::fabric_new({});
+	mn::compute(f, {1000, 1, 1}, {1, 1, 1}, [](mn::Compute_Args args) {
+		mn::log_info("message #{}", args.global_invocation_id.x);
+	});
+	mn::fabric_free(f);
+
+	mn::log_async_stop();
+	CHECK(mn::log_async_dropped_count() == 0);
+
+	REQUIRE(capture.messages.count == 1002);
+	CHECK(capture.messages[0] == "1 literal mostafa 2.5 temporary [2]{0: 1, 1: 2 }");
+	CHECK(capture.messages[1] == "no arguments");
+	size_t sum = 0;
+	for (size_t i = 2; i < capture.messages.count; ++i)
+	{
+		size_t index = 0;
+		REQUIRE(::sscanf(capture.messages[i].ptr, "message #%zu", &index) == 1);
+		sum += index;
+	}
+	CHECK(sum == 999 * 1000 / 2);
+}
+
+TEST_CASE("async log format error")
+{
+	Async_Log_Capture capture{};
+	capture.messages = mn::buf_new<mn::Str>();
+	mn_defer{mn::destruct(capture.messages);};
+
+	mn::Log_Interface hooks{};
+	hooks.self = &capture;
+	hooks.info = [](void* self, const char* msg) {
+		auto capture = (Async_Log_Capture*)self;
+		std::lock_guard<std::mutex> lock(capture->mtx);
+		mn::buf_push(capture->messages, mn::str_from_c(msg));
+	};
+	auto old_hooks = mn::log_interface_set(hooks);
+	mn_defer{mn::log_interface_set(old_hooks);};
+
+	mn::log_async_start();
+
+	auto numbers = mn::buf_lit({1, 2});
+	mn_defer{mn::buf_free(numbers);};
+	mn::log_info("{} {}", 1);
+	// the buf is formatted on the calling thread and its formatter doesn't support the spec
+	mn::log_info("{:d}", numbers);
+	mn::log_info("after {}", 2);
+
+	mn::log_async_stop();
+
+	REQUIRE(capture.messages.count == 3);
+	CHECK(mn::str_prefix(capture.messages[0], "[format error: "));
+	CHECK(mn::str_prefix(capture.messages[1], "[format error: "));
+	CHECK(capture.messages[2] == "after 2");
+}
+
+struct Log_Hex
+{
+	int value;
+};
+
+template<>
+struct fmt::formatter<Log_Hex>
+{
+	bool hex = false;
+
+	template<typename ParseContext>
+	constexpr auto
+	parse(ParseContext& ctx)
+	{
+		auto it = ctx.begin();
+		if (it != ctx.end() && *it == 'x')
+		{
+			hex = true;
+			++it;
+		}
+		return it;
+	}
+
+	template<typename FormatContext>
+	auto
+	format(const Log_Hex& v, FormatContext& ctx) const
+	{
+		if (hex)
+			return fmt::format_to(ctx.out(), "{:x}", v.value);
+		return fmt::format_to(ctx.out(), "{}", v.value);
+	}
+};
+
+TEST_CASE("async log custom format spec")
+{
+	Async_Log_Capture capture{};
+	capture.messages = mn::buf_new<mn::Str>();
+	mn_defer{mn::destruct(capture.messages);};
+
+	mn::Log_Interface hooks{};
+	hooks.self = &capture;
+	hooks.info = [](void* self, const char* msg) {
+		auto capture = (Async_Log_Capture*)self;
+		std::lock_guard<std::mutex> lock(capture->mtx);
+		mn::buf_push(capture->messages, mn::str_from_c(msg));
+	};
+	auto old_hooks = mn::log_interface_set(hooks);
+	mn_defer{mn::log_interface_set(old_hooks);};
+
+	mn::log_async_start();
+	// the custom type is formatted with its spec like it's in synchronous mode
+	mn::log_info("{:x} {} {:.1f}", Log_Hex{255}, Log_Hex{255}, 2.25);
+	mn::log_async_stop();
+
+	REQUIRE(capture.messages.count == 1);
+	CHECK(capture.messages[0] == "ff 255 2.2");
+}
+
+struct Log_Level_Formatted
+{
+	int* format_count;
+};
+
+template<>
+struct fmt::formatter<Log_Level_Formatted>
+{
+	template<typename ParseContext>
+	constexpr auto
+	parse(ParseContext& ctx)
+	{
+		return ctx.begin();
+	}
+
+	template<typename FormatContext>
+	auto
+	format(const Log_Level_Formatted& v, FormatContext& ctx) const
+	{
+		++(*v.format_count);
+		return fmt::format_to(ctx.out(), "formatted");
+	}
+};
+
+TEST_CASE("log level")
+{
+	auto messages = mn::buf_new<mn::Str>();
+	mn_defer{mn::destruct(messages);};
+
+	mn::Log_Interface hooks{};
+	hooks.self = &messages;
+	hooks.debug = [](void* self, const char* msg) {
+		mn::buf_push(*(mn::Buf<mn::Str>*)self, mn::str_from_c(msg));
+	};
+	hooks.info = hooks.debug;
+	hooks.warning = hooks.debug;
+	hooks.error = hooks.debug;
+	auto old_hooks = mn::log_interface_set(hooks);
+	mn_defer{mn::log_interface_set(old_hooks);};
+
+	auto old_level = mn::log_level();
+	mn_defer{mn::log_level_set(old_level);};
+
+	int format_count = 0;
+	Log_Level_Formatted value{&format_count};
+
+	mn::log_level_set(mn::LOG_LEVEL_WARNING);
+	CHECK(mn::log_level_enabled(mn::LOG_LEVEL_INFO) == false);
+	CHECK(mn::log_level_enabled(mn::LOG_LEVEL_CRITICAL));
+	mn::log_info("info {}", value);
+	mn::log_warning("warning {}", value);
+	mn::log_error("error {}", value);
+	// the filtered message isn't formatted
+	CHECK(format_count == 2);
+	REQUIRE(messages.count == 2);
+	CHECK(messages[0] == "warning formatted");
+	CHECK(messages[1] == "error formatted");
+
+	auto physics = mn::log_category("physics");
+	CHECK(mn::log_category("physics") == physics);
+	CHECK(mn::log_category("render") != physics);
+
+	// the category level overrides the global level in both directions
+	mn::log_category_level_set(physics, mn::LOG_LEVEL_INFO);
+	mn::log_info(physics, "physics {}", value);
+	mn::log_info("info {}", value);
+	mn::log_category_level_set(physics, mn::LOG_LEVEL_ERROR);
+	mn::log_warning(physics, "physics {}", value);
+	mn::log_category_level_reset(physics);
+	mn::log_info(physics, "physics {}", value);
+	mn::log_warning(physics, "physics warning {}", value);
+	CHECK(format_count == 4);
+	REQUIRE(messages.count == 4);
+	CHECK(messages[2] == "physics formatted");
+	CHECK(messages[3] == "physics warning formatted");
+
+	// the debug calls are compiled out below the minimum level whatever the runtime level is
+	mn::log_level_set(mn::LOG_LEVEL_DEBUG);
+	mn::log_debug("debug {}", value);
+	mn::log_debug(physics, "debug {}", value);
+	if constexpr (mn::LOG_LEVEL_DEBUG >= mn::LOG_LEVEL_MIN)
+		CHECK(messages.count == 6);
+	else
+		CHECK(messages.count == 4);
+}
+
+TEST_CASE("sputnik shared memory transport")
+{
+	auto server = mn::ipc::sputnik_new("mn-sputnik-shm-test");
+	REQUIRE(server != nullptr);
+	REQUIRE(mn::ipc::sputnik_listen(server));
+
+	auto f = mn::fabric_new({});
+	mn::Auto_Waitgroup g;
+
+	// the client echoes the messages back until the server closes the connection
+	g.add(1);
+	mn::go(f, [&g] {
+		auto client = mn::ipc::sputnik_connect("mn-sputnik-shm-test");
+		mn_defer{g.done();};
+		if (client == nullptr)
+			return;
+		mn::ipc::sputnik_shm_enable(client, {4096});
+		while (true)
+		{
+			auto msg = mn::ipc::sputnik_msg_read_alloc(client, mn::INFINITE_TIMEOUT);
+			mn_defer{mn::str_free(msg);};
+			if (msg.count == 0)
+				break;
+			mn::ipc::sputnik_msg_write(client, mn::block_from(msg));
+		}
+		mn::ipc::sputnik_free(client);
+	});
+
+	auto conn = mn::ipc::sputnik_accept(server, mn::INFINITE_TIMEOUT);
+	REQUIRE(conn != nullptr);
+	[[maybe_unused]] auto enabled = mn::ipc::sputnik_shm_enable(conn);
+	#if OS_LINUX
+	CHECK(enabled);
+	CHECK(conn->shm != nullptr);
+	#endif
+
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		auto msg = mn::str_tmpf("message #{}", i);
+		CHECK(mn::ipc::sputnik_msg_write(conn, mn::block_from(msg)));
+		auto echo = mn::ipc::sputnik_msg_read_alloc(conn, mn::INFINITE_TIMEOUT);
+		CHECK(echo == msg);
+		mn::str_free(echo);
+	}
+
+	// the message is bigger than the ring buffers so it's written in chunks while the other side reads it
+	auto big = mn::str_new();
+	mn_defer{mn::str_free(big);};
+	for (size_t i = 0; i < 100000; ++i)
+		mn::str_push(big, char('a' + i % 26));
+	CHECK(mn::ipc::sputnik_msg_write(conn, mn::block_from(big)));
+	auto big_echo = mn::ipc::sputnik_msg_read_alloc(conn, mn::INFINITE_TIMEOUT);
+	CHECK(big_echo == big);
+	mn::str_free(big_echo);
+
+	// the reader wakes up when the other side disconnects
+	mn::ipc::sputnik_free(conn);
+	g.wait();
+
+	mn::fabric_free(f);
+	mn::ipc::sputnik_disconnect(server);
+	mn::ipc::sputnik_free(server);
+}
+
+#if OS_LINUX
+TEST_CASE("sputnik shared memory negotiation timeout")
+{
+	auto server = mn::ipc::sputnik_new("mn-sputnik-shm-timeout-test");
+	REQUIRE(server != nullptr);
+	REQUIRE(mn::ipc::sputnik_listen(server));
+	mn_defer{
+		mn::ipc::sputnik_disconnect(server);
+		mn::ipc::sputnik_free(server);
+	};
+
+	auto client = mn::ipc::sputnik_connect("mn-sputnik-shm-timeout-test");
+	REQUIRE(client != nullptr);
+	mn_defer{mn::ipc::sputnik_free(client);};
+	auto conn = mn::ipc::sputnik_accept(server, mn::INFINITE_TIMEOUT);
+	REQUIRE(conn != nullptr);
+	mn_defer{mn::ipc::sputnik_free(conn);};
+
+	// the accepting side answers too late, so the connection is closed whatever transport it ends up on
+	CHECK(mn::ipc::sputnik_shm_enable(client, {}, mn::Timeout{50}) == false);
+	mn::ipc::sputnik_shm_enable(conn, {}, mn::Timeout{1000});
+	char c = 0;
+	CHECK(mn::ipc::sputnik_read(conn, mn::block_from(c), mn::Timeout{1000}) == 0);
+}
+#endif
+
 TEST_CASE("future")
 {
 	auto f = mn::fabric_new({});
@@ -1237,6 +2320,552 @@ TEST_CASE("json support")
 	mn::json::value_free(v);
 }
 
+TEST_CASE("json document")
+{
+	auto json = R"""(
+	{
+		"id": 9007199254740993,
+		"ratio": -0.25e2,
+		"name": "tab\there \"quoted\" \u00e9 \ud83d\ude00",
+		"ok": true,
+		"nothing": null,
+		"list": [1, 2.5, "three", [], {}],
+		"id": -9223372036854775808
+	}
+	)""";
+
+	auto [doc, err] = mn::json::document_parse(json);
+	CHECK(!err);
+	mn_defer{mn::json::document_free(doc);};
+
+	CHECK(doc.root.kind == mn::json::Node::KIND_OBJECT);
+	CHECK(doc.root.count == 7);
+	CHECK(mn::json::node_object_at(doc.root, 0).key == "id");
+	CHECK(mn::json::node_object_at(doc.root, 0).value.as_int == 9007199254740993);
+
+	// duplicate keys return the last value
+	auto id = mn::json::node_object_lookup(doc.root, "id");
+	CHECK(id->kind == mn::json::Node::KIND_INT);
+	CHECK(id->as_int == INT64_MIN);
+
+	auto ratio = mn::json::node_object_lookup(doc.root, "ratio");
+	CHECK(ratio->kind == mn::json::Node::KIND_DOUBLE);
+	CHECK(mn::json::node_as_double(*ratio) == -25.0);
+
+	auto name = mn::json::node_object_lookup(doc.root, "name");
+	CHECK(mn::json::node_as_str(*name) == "tab\there \"quoted\" é 😀");
+
+	CHECK(mn::json::node_object_lookup(doc.root, "ok")->as_bool == true);
+	CHECK(mn::json::node_object_lookup(doc.root, "nothing")->kind == mn::json::Node::KIND_NULL);
+	CHECK(mn::json::node_object_lookup(doc.root, "missing") == nullptr);
+
+	auto list = mn::json::node_object_lookup(doc.root, "list");
+	CHECK(list->count == 5);
+	CHECK(mn::json::node_as_int(mn::json::node_array_at(*list, 0)) == 1);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(*list, 1)) == 2.5);
+	CHECK(mn::json::node_as_str(mn::json::node_array_at(*list, 2)) == "three");
+	CHECK(mn::json::node_array_at(*list, 3).count == 0);
+	CHECK(mn::json::node_array_at(*list, 4).kind == mn::json::Node::KIND_OBJECT);
+
+	// large objects are indexed
+	auto big = mn::str_tmpf("{{");
+	for (size_t i = 0; i < 100; ++i)
+		big = mn::strf(big, "{}\"key{}\": {}", i == 0 ? "" : ",", i, i);
+	big = mn::strf(big, "}}");
+	auto [big_doc, big_err] = mn::json::document_parse(big);
+	CHECK(!big_err);
+	CHECK(big_doc.root.as_object->index != nullptr);
+	for (size_t i = 0; i < 100; ++i)
+		CHECK(mn::json::node_object_lookup(big_doc.root, mn::str_tmpf("key{}", i))->as_int == int64_t(i));
+	mn::json::document_free(big_doc);
+
+	CHECK(mn::json::document_parse("[1, 2").err);
+	CHECK(mn::json::document_parse("{\"a\" 1}").err);
+	CHECK(mn::json::document_parse("01").err);
+	CHECK(mn::json::document_parse("[1] x").err);
+}
+
+TEST_CASE("json structural parser")
+{
+	// escapes and structural chars inside strings which cross the 64 bytes block boundaries
+	for (size_t padding = 0; padding < 70; ++padding)
+	{
+		auto pad = mn::str_tmp();
+		for (size_t i = 0; i < padding; ++i)
+			mn::str_push(pad, ' ');
+		auto json = mn::str_tmpf("{}[\"{}\\\\\", \"a\\\"{{],:\\\\\\\"b\", 1.5, true]", pad, pad);
+		auto [doc, err] = mn::json::document_parse(json);
+		CHECK(!err);
+		CHECK(doc.root.count == 4);
+		CHECK(mn::json::node_as_str(mn::json::node_array_at(doc.root, 0)) == mn::str_tmpf("{}\\", pad));
+		CHECK(mn::json::node_as_str(mn::json::node_array_at(doc.root, 1)) == "a\"{],:\\\"b");
+		CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 2)) == 1.5);
+		CHECK(mn::json::node_array_at(doc.root, 3).as_bool == true);
+		mn::json::document_free(doc);
+	}
+
+	// numbers
+	auto [doc, err] = mn::json::document_parse(
+		"[0, -0.0, 1e22, 123456789012345678, 0.1, 2.2250738585072014e-308, 1.7976931348623157e308, "
+		"12345678901234567890, 3.141592653589793238462643383279, 1E-5, -1e+2]"
+	);
+	CHECK(!err);
+	mn_defer{mn::json::document_free(doc);};
+	CHECK(mn::json::node_array_at(doc.root, 0).kind == mn::json::Node::KIND_INT);
+	CHECK(mn::json::node_array_at(doc.root, 1).kind == mn::json::Node::KIND_DOUBLE);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 2)) == 1e22);
+	CHECK(mn::json::node_as_int(mn::json::node_array_at(doc.root, 3)) == 123456789012345678);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 4)) == 0.1);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 5)) == 2.2250738585072014e-308);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 6)) == 1.7976931348623157e308);
+	CHECK(mn::json::node_array_at(doc.root, 7).kind == mn::json::Node::KIND_DOUBLE);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 7)) == 12345678901234567890.0);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 8)) == 3.141592653589793);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 9)) == 1e-5);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(doc.root, 10)) == -100.0);
+
+	// negative zeros keep their sign
+	auto [zeros, zeros_err] = mn::json::document_parse("[-0, -0.0, -0e5, 0]");
+	CHECK(!zeros_err);
+	mn_defer{mn::json::document_free(zeros);};
+	for (size_t i = 0; i < 3; ++i)
+	{
+		CHECK(mn::json::node_array_at(zeros.root, i).kind == mn::json::Node::KIND_DOUBLE);
+		CHECK(std::signbit(mn::json::node_as_double(mn::json::node_array_at(zeros.root, i))));
+	}
+	CHECK(mn::json::node_array_at(zeros.root, 3).kind == mn::json::Node::KIND_INT);
+	auto [zero_value, zero_value_err] = mn::json::parse("-0");
+	CHECK(!zero_value_err);
+	CHECK(std::signbit(zero_value.as_number));
+
+	CHECK(mn::json::document_parse("[\"abc]").err);
+	CHECK(mn::json::document_parse("[1 2]").err);
+	CHECK(mn::json::document_parse("[truex]").err);
+	CHECK(mn::json::document_parse("[1.]").err);
+	CHECK(mn::json::document_parse("[-]").err);
+	CHECK(mn::json::document_parse("{\"a\":1,}").err);
+
+	// numbers which overflow a double are errors, and the ones which underflow are rounded to 0
+	for (auto json: {"[1e999]", "[5e324]", "[-1e999]"})
+	{
+		auto [overflow, overflow_err] = mn::json::document_parse(json);
+		CHECK(mn::str_prefix(overflow_err.msg, "number out of range"));
+	}
+	auto [underflow, underflow_err] = mn::json::document_parse("[1e-999]");
+	CHECK(!underflow_err);
+	CHECK(mn::json::node_as_double(mn::json::node_array_at(underflow.root, 0)) == 0.0);
+	mn::json::document_free(underflow);
+	CHECK(mn::json::document_parse("").err);
+
+	// the value parser uses the same structural index
+	auto [value, value_err] = mn::json::parse(R"({"a": [1, 2.5, "x\"y"], "a": false, "b": {}})");
+	CHECK(!value_err);
+	mn_defer{mn::json::value_free(value);};
+	CHECK(mn::json::value_object_lookup(value, "a")->kind == mn::json::Value::KIND_BOOL);
+	CHECK(mn::json::value_object_lookup(value, "b")->kind == mn::json::Value::KIND_OBJECT);
+	CHECK(mn::json::parse("[1, 2").err);
+}
+
+TEST_CASE("json pull reader")
+{
+	auto reader = mn::reader_str(mn::str_lit(R"({"a": [1, -2.5, "x\ny", null], "b": {"c": true}, "d": false} [])"));
+	mn_defer{mn::reader_free(reader);};
+	auto json = mn::json::json_reader_new(reader);
+	mn_defer{mn::json::json_reader_free(json);};
+
+	auto kinds = mn::buf_with_allocator<mn::json::Json_Event::KIND>(mn::memory::tmp());
+	auto strings = mn::buf_with_allocator<mn::Str>(mn::memory::tmp());
+	while (true)
+	{
+		mn::json::Json_Event event{};
+		auto err = mn::json::json_reader_next(json, event);
+		CHECK(!err);
+		if (event.kind == mn::json::Json_Event::KIND_END)
+			break;
+		mn::buf_push(kinds, event.kind);
+		if (event.kind == mn::json::Json_Event::KIND_KEY || event.kind == mn::json::Json_Event::KIND_STRING)
+			mn::buf_push(strings, mn::str_from_substr(event.as_string.ptr, event.as_string.ptr + event.as_string.count, mn::memory::tmp()));
+		if (event.kind == mn::json::Json_Event::KIND_INT)
+			CHECK(event.as_int == 1);
+		if (event.kind == mn::json::Json_Event::KIND_DOUBLE)
+			CHECK(event.as_double == -2.5);
+	}
+
+	using K = mn::json::Json_Event;
+	K::KIND expected[] = {
+		K::KIND_BEGIN_OBJECT,
+		K::KIND_KEY, K::KIND_BEGIN_ARRAY, K::KIND_INT, K::KIND_DOUBLE, K::KIND_STRING, K::KIND_NULL, K::KIND_END_ARRAY,
+		K::KIND_KEY, K::KIND_BEGIN_OBJECT, K::KIND_KEY, K::KIND_BOOL, K::KIND_END_OBJECT,
+		K::KIND_KEY, K::KIND_BOOL,
+		K::KIND_END_OBJECT,
+		K::KIND_BEGIN_ARRAY, K::KIND_END_ARRAY,
+	};
+	CHECK(kinds.count == sizeof(expected) / sizeof(*expected));
+	for (size_t i = 0; i < kinds.count && i < sizeof(expected) / sizeof(*expected); ++i)
+		CHECK(kinds[i] == expected[i]);
+	CHECK(strings.count == 5);
+	CHECK(strings[0] == "a");
+	CHECK(strings[1] == "x\ny");
+	CHECK(strings[4] == "d");
+
+	// json lines which are larger than the reader window, skipping the "skip" subtree of every line
+	auto stream = mn::memory_stream_new();
+	mn_defer{mn::memory_stream_free(stream);};
+	auto long_string = mn::str_tmp();
+	for (size_t i = 0; i < 1000; ++i)
+		mn::str_push(long_string, (i % 10 == 0) ? "\\\"" : "x");
+	for (size_t i = 0; i < 500; ++i)
+	{
+		auto line = mn::str_tmpf("{{\"skip\": [{{\"s\": \"{}]}}\"}}, [[]]], \"id\": {}, \"text\": \"{}\"}}\n", long_string, i, long_string);
+		mn::memory_stream_write(stream, mn::block_from(line));
+	}
+	mn::memory_stream_cursor_to_start(stream);
+
+	auto lines = mn::json::json_reader_new(stream);
+	mn_defer{mn::json::json_reader_free(lines);};
+	size_t ids = 0;
+	bool texts_ok = true;
+	while (true)
+	{
+		mn::json::Json_Event event{};
+		auto err = mn::json::json_reader_next(lines, event);
+		CHECK(!err);
+		if (err || event.kind == mn::json::Json_Event::KIND_END)
+			break;
+		if (event.kind == mn::json::Json_Event::KIND_KEY && event.as_string == "skip")
+		{
+			CHECK(!mn::json::json_reader_skip(lines));
+		}
+		else if (event.kind == mn::json::Json_Event::KIND_INT)
+		{
+			CHECK(event.as_int == int64_t(ids));
+			++ids;
+		}
+		else if (event.kind == mn::json::Json_Event::KIND_STRING)
+		{
+			texts_ok &= event.as_string.count == 1000 && event.as_string[0] == '"' && event.as_string[1] == 'x';
+		}
+	}
+	CHECK(ids == 500);
+	CHECK(texts_ok);
+
+	auto bad_reader = mn::reader_str(mn::str_lit("[1, 2 3]"));
+	mn_defer{mn::reader_free(bad_reader);};
+	auto bad = mn::json::json_reader_new(bad_reader);
+	mn_defer{mn::json::json_reader_free(bad);};
+	mn::json::Json_Event event{};
+	CHECK(!mn::json::json_reader_next(bad, event));
+	CHECK(!mn::json::json_reader_next(bad, event));
+	CHECK(!mn::json::json_reader_next(bad, event));
+	CHECK(mn::json::json_reader_next(bad, event));
+	CHECK(mn::json::json_reader_next(bad, event));
+}
+
+TEST_CASE("json writer")
+{
+	auto out = mn::str_tmp();
+	auto writer = mn::json::json_writer_new(&out);
+	mn::json::json_writer_begin_object(writer);
+	mn::json::json_writer_key(writer, "name");
+	mn::json::json_writer_string(writer, "say \"hi\"\n\t\\ \x01");
+	mn::json::json_writer_key(writer, "list");
+	mn::json::json_writer_begin_array(writer);
+	mn::json::json_writer_int(writer, INT64_MIN);
+	mn::json::json_writer_double(writer, 0.1);
+	mn::json::json_writer_double(writer, 1e22);
+	mn::json::json_writer_double(writer, NAN);
+	mn::json::json_writer_bool(writer, false);
+	mn::json::json_writer_null(writer);
+	mn::json::json_writer_begin_object(writer);
+	mn::json::json_writer_end_object(writer);
+	mn::json::json_writer_end_array(writer);
+	mn::json::json_writer_end_object(writer);
+	mn::json::json_writer_int(writer, 2);
+	mn::json::json_writer_free(writer);
+	CHECK(out == R"({"name":"say \"hi\"\n\t\\ \u0001","list":[-9223372036854775808,0.1,1e+22,null,false,null,{}]})" "\n2");
+
+	// long strings go through the simd path, they should parse back to the same content
+	auto text = mn::str_tmp();
+	for (size_t i = 0; i < 300; ++i)
+		mn::str_push(text, (i % 7 == 0) ? '"' : (i % 11 == 0) ? '\\' : (i % 13 == 0) ? '\n' : char('a' + i % 26));
+	double doubles[] = {5e-324, 2.2250738585072014e-308, 1.7976931348623157e308, 3.141592653589793, -123.456, 1e-7};
+
+	auto [doc, err] = mn::json::document_parse(R"({"a": [1, 2.5, "x\"y"], "b": {"c": null, "d": true}})");
+	CHECK(!err);
+	mn_defer{mn::json::document_free(doc);};
+
+	auto stream = mn::memory_stream_new();
+	mn_defer{mn::memory_stream_free(stream);};
+	auto stream_writer = mn::json::json_writer_new(stream);
+	mn::json::json_writer_begin_array(stream_writer);
+	mn::json::json_writer_string(stream_writer, text);
+	for (auto d: doubles)
+		mn::json::json_writer_double(stream_writer, d);
+	mn::json::json_writer_node(stream_writer, doc.root);
+	mn::json::json_writer_end_array(stream_writer);
+	mn::json::json_writer_free(stream_writer);
+
+	auto written = mn::str_from_substr(stream->str.ptr, stream->str.ptr + stream->str.count, mn::memory::tmp());
+	auto [parsed, parsed_err] = mn::json::document_parse(written);
+	CHECK(!parsed_err);
+	mn_defer{mn::json::document_free(parsed);};
+	CHECK(mn::json::node_as_str(mn::json::node_array_at(parsed.root, 0)) == text);
+	for (size_t i = 0; i < sizeof(doubles) / sizeof(*doubles); ++i)
+		CHECK(mn::json::node_as_double(mn::json::node_array_at(parsed.root, i + 1)) == doubles[i]);
+	CHECK(mn::str_find(written, R"({"a":[1,2.5,"x\"y"],"b":{"c":null,"d":true}})", 0) != SIZE_MAX);
+
+	// json values keep their strings escaped so they are written as is
+	auto [value, value_err] = mn::json::parse(R"({"name": "my name is \"mostafa\"", "list": [1, [false]]})");
+	CHECK(!value_err);
+	mn_defer{mn::json::value_free(value);};
+	auto value_out = mn::str_tmp();
+	auto value_writer = mn::json::json_writer_new(&value_out);
+	mn::json::json_writer_value(value_writer, value);
+	mn::json::json_writer_free(value_writer);
+	auto [reparsed, reparsed_err] = mn::json::parse(value_out);
+	CHECK(!reparsed_err);
+	mn_defer{mn::json::value_free(reparsed);};
+	CHECK(mn::str_tmpf("{}", reparsed) == mn::str_tmpf("{}", value));
+
+	// the keys are written as is too
+	auto [escaped_key, escaped_key_err] = mn::json::parse(R"({"a\"b":"c\"d"})");
+	CHECK(!escaped_key_err);
+	mn_defer{mn::json::value_free(escaped_key);};
+	auto escaped_key_out = mn::str_tmp();
+	auto escaped_key_writer = mn::json::json_writer_new(&escaped_key_out);
+	mn::json::json_writer_value(escaped_key_writer, escaped_key);
+	mn::json::json_writer_free(escaped_key_writer);
+	CHECK(escaped_key_out == R"({"a\"b":"c\"d"})");
+}
+
+namespace reflect_test
+{
+	struct Vertex
+	{
+		float x, y;
+		uint8_t tag;
+	};
+
+	inline static auto
+	json_fields(const Vertex*)
+	{
+		return mn::json::reflect_fields(
+			mn_json_field(Vertex, x),
+			mn_json_field(Vertex, y),
+			mn_json_field(Vertex, tag)
+		);
+	}
+
+	struct Mesh
+	{
+		mn::Str name;
+		bool visible;
+		int64_t id;
+		uint64_t hash;
+		mn::Buf<Vertex> vertices;
+		mn::Buf<mn::Str> tags;
+	};
+
+	inline static auto
+	json_fields(const Mesh*)
+	{
+		return mn::json::reflect_fields(
+			mn::json::reflect_field("mesh_name", &Mesh::name),
+			mn_json_field(Mesh, visible),
+			mn_json_field(Mesh, id),
+			mn_json_field(Mesh, hash),
+			mn_json_field(Mesh, vertices),
+			mn_json_field(Mesh, tags)
+		);
+	}
+
+	inline static void
+	mesh_free(Mesh& self)
+	{
+		mn::str_free(self.name);
+		mn::buf_free(self.vertices);
+		mn::destruct(self.tags);
+	}
+}
+
+TEST_CASE("json reflection")
+{
+	reflect_test::Mesh mesh{};
+	mesh.id = -1;
+	mn_defer{reflect_test::mesh_free(mesh);};
+
+	auto err = mn::json::reflect_decode(R"({
+		"mesh_name": "cube \"1\"",
+		"unknown": {"nested": [1, {"deep": null}]},
+		"visible": true,
+		"hash": 9223372036854775808,
+		"vertices": [{"x": 1, "y": 2.5, "tag": 7}, {"y": -1, "extra": "skip me"}],
+		"tags": ["a", "b"]
+	})", mesh);
+	CHECK(!err);
+	CHECK(mesh.name == "cube \"1\"");
+	CHECK(mesh.visible == true);
+	// missing fields keep their values
+	CHECK(mesh.id == -1);
+	CHECK(mesh.hash == 9223372036854775808ULL);
+	CHECK(mesh.vertices.count == 2);
+	CHECK(mesh.vertices[0].x == 1.0f);
+	CHECK(mesh.vertices[0].y == 2.5f);
+	CHECK(mesh.vertices[0].tag == 7);
+	CHECK(mesh.vertices[1].x == 0.0f);
+	CHECK(mesh.vertices[1].y == -1.0f);
+	CHECK(mesh.tags.count == 2);
+	CHECK(mesh.tags[1] == "b");
+
+	// encoding and decoding again gives the same json
+	auto json = mn::json::reflect_encode(mesh, mn::memory::tmp());
+	CHECK(json == R"({"mesh_name":"cube \"1\"","visible":true,"id":-1,"hash":9.223372036854776e+18,"vertices":[{"x":1.0,"y":2.5,"tag":7},{"x":0.0,"y":-1.0,"tag":0}],"tags":["a","b"]})");
+	reflect_test::Mesh copy{};
+	mn_defer{reflect_test::mesh_free(copy);};
+	CHECK(!mn::json::reflect_decode(json, copy));
+	CHECK(mn::json::reflect_encode(copy, mn::memory::tmp()) == json);
+
+	// type mismatches and out of range integers are errors
+	reflect_test::Vertex vertex{};
+	CHECK(mn::json::reflect_decode(R"({"tag": 256})", vertex));
+	CHECK(mn::json::reflect_decode(R"({"tag": 1.5})", vertex));
+	CHECK(mn::json::reflect_decode(R"({"x": "1"})", vertex));
+	CHECK(mn::json::reflect_decode(R"([1, 2])", vertex));
+	CHECK(mn::json::reflect_decode(R"({"x": 1} {})", vertex));
+	CHECK(mn::json::reflect_decode(R"({"x": 1)", vertex));
+	auto mismatch = mn::json::reflect_decode(R"({"vertices": [{"tag": -1}]})", copy);
+	CHECK(mismatch.msg == "field 'vertices': array element #0: field 'tag': integer -1 is out of range");
+}
+
+TEST_CASE("json reflection decode frees the old elements")
+{
+	mn::memory::Leak leak{};
+	mn::allocator_push(&leak);
+	{
+		auto tags = mn::buf_new<mn::Str>();
+		CHECK(!mn::json::reflect_decode(R"(["a", "b", "c"])", tags));
+		CHECK(!mn::json::reflect_decode(R"(["d"])", tags));
+		CHECK(tags.count == 1);
+		CHECK(tags[0] == "d");
+		mn::destruct(tags);
+	}
+	mn::allocator_pop();
+	CHECK(leak.head == nullptr);
+}
+
+inline static mn::Str
+write_tmp_file(const char* name, const mn::Str& content)
+{
+	auto path = mn::path_join(mn::folder_tmp(mn::memory::tmp()), name);
+	auto file = mn::file_open(path, mn::IO_MODE_WRITE, mn::OPEN_MODE_CREATE_OVERWRITE);
+	CHECK(file != nullptr);
+	mn::file_write(file, mn::block_from(content));
+	mn::file_close(file);
+	return path;
+}
+
+TEST_CASE("ingest json lines and csv")
+{
+	mn::Fabric_Settings fabric_settings{};
+	fabric_settings.workers_count = 4;
+	auto f = mn::fabric_new(fabric_settings);
+	mn_defer{mn::fabric_free(f);};
+
+	auto lines = mn::str_tmp();
+	for (size_t i = 0; i < 2000; ++i)
+		lines = mn::strf(lines, "{{\"id\": {}, \"name\": \"record \\\"{}\\\"\"}}\n", i, i);
+	auto json_path = write_tmp_file("mn_ingest_test.jsonl", lines);
+	mn_defer{mn::file_remove(json_path);};
+
+	for (int unordered = 0; unordered < 2; ++unordered)
+	{
+		mn::Ingest_Settings settings{};
+		settings.format = mn::INGEST_FORMAT_JSON_LINES;
+		settings.chunk_size = 1024;
+		settings.max_batches_in_flight = 4;
+		settings.unordered = unordered == 1;
+		auto [ingest, err] = mn::ingest_new(json_path, f, settings);
+		CHECK(!err);
+
+		auto seen = mn::buf_with_allocator<bool>(mn::memory::tmp());
+		mn::buf_resize_fill(seen, 2000, false);
+		int64_t next_id = 0;
+		bool in_order = true;
+		bool names_ok = true;
+		size_t count = 0;
+		size_t next_index = 0;
+		for (auto batch: mn::ingest_batches(ingest))
+		{
+			CHECK(!batch->err);
+			in_order &= unordered == 1 || batch->index == next_index++;
+			for (size_t i = 0; i < batch->records_count; ++i)
+			{
+				const auto& record = batch->records[i];
+				auto id = mn::json::node_as_int(*mn::json::node_object_lookup(record.json, "id"));
+				auto name = mn::json::node_as_str(*mn::json::node_object_lookup(record.json, "name"));
+				names_ok &= name == mn::str_tmpf("record \"{}\"", id);
+				names_ok &= lines[record.offset] == '{';
+				if (unordered == 0)
+					in_order &= id == next_id++;
+				seen[id] = true;
+				++count;
+			}
+			mn::ingest_batch_free(ingest, batch);
+		}
+		CHECK(count == 2000);
+		CHECK(in_order);
+		CHECK(names_ok);
+		for (auto s: seen)
+			CHECK(s);
+		mn::ingest_free(ingest);
+	}
+
+	auto csv = mn::str_tmp();
+	for (size_t i = 0; i < 500; ++i)
+		csv = mn::strf(csv, "{},\"multi\nline, \"\"quoted\"\"\",plain\r\n", i);
+	auto csv_path = write_tmp_file("mn_ingest_test.csv", csv);
+	mn_defer{mn::file_remove(csv_path);};
+
+	mn::Ingest_Settings settings{};
+	settings.format = mn::INGEST_FORMAT_CSV;
+	settings.chunk_size = 100;
+	auto [ingest, err] = mn::ingest_new(csv_path, f, settings);
+	CHECK(!err);
+	size_t count = 0;
+	bool fields_ok = true;
+	for (auto batch: mn::ingest_batches(ingest))
+	{
+		CHECK(!batch->err);
+		for (size_t i = 0; i < batch->records_count; ++i)
+		{
+			const auto& record = batch->records[i];
+			fields_ok &= record.fields_count == 3;
+			if (record.fields_count != 3)
+				continue;
+			fields_ok &= record.fields[0] == mn::str_tmpf("{}", count);
+			fields_ok &= record.fields[1] == "multi\nline, \"quoted\"";
+			fields_ok &= record.fields[2] == "plain";
+			++count;
+		}
+		mn::ingest_batch_free(ingest, batch);
+	}
+	CHECK(count == 500);
+	CHECK(fields_ok);
+	mn::ingest_free(ingest);
+
+	// stopping early drops the remaining chunks
+	settings.chunk_size = 10;
+	auto [early, early_err] = mn::ingest_new(csv_path, f, settings);
+	CHECK(!early_err);
+	auto [first, more] = mn::chan_recv(mn::ingest_batches(early));
+	CHECK(more);
+	CHECK(first->index == 0);
+	mn::ingest_batch_free(early, first);
+	mn::ingest_free(early);
+
+	CHECK(mn::ingest_new("mn_ingest_missing_file.jsonl", f, settings).err);
+}
+
 inline static mn::Regex
 compile(const char* str)
 {
@@ -1355,6 +2984,173 @@ TEST_CASE("arabic set")
 	CHECK(matched(prog, "") == false);
 }
 
+TEST_CASE("regex search")
+{
+	auto prog = compile("a+b");
+	auto text = "xxaaab";
+	auto res = mn::regex_search(prog, text);
+	CHECK(res.match == true);
+	CHECK(res.begin == text + 2);
+	CHECK(res.end == text + 6);
+
+	res = mn::regex_search(prog, "xxaaa");
+	CHECK(res.match == false);
+
+	auto empty = compile("[0-9]*");
+	res = mn::regex_search(empty, "abc");
+	CHECK(res.match == true);
+	CHECK(res.begin == res.end);
+
+	auto arabic = compile("[ء-ي]+");
+	auto arabic_text = "name: مصطفى.";
+	res = mn::regex_search(arabic, arabic_text);
+	CHECK(res.match == true);
+	CHECK(mn::str_from_substr(res.begin, res.end, mn::memory::tmp()) == "مصطفى");
+}
+
+TEST_CASE("regex dfa")
+{
+	auto [prog, err] = mn::regex_compile_with_payload("[a-z]+@[a-z]+\\.com", 42, mn::memory::tmp());
+	CHECK(!err);
+
+	auto dfa = mn::regex_dfa_new(prog);
+	mn_defer{mn::regex_dfa_free(dfa);};
+
+	auto text = "send it to mostafa@mail.com please";
+	auto res = mn::regex_dfa_search(dfa, text);
+	CHECK(res.match == true);
+	CHECK(res.with_payload == true);
+	CHECK(res.payload == 42);
+	CHECK(mn::str_from_substr(res.begin, res.end, mn::memory::tmp()) == "mostafa@mail.com");
+
+	// the states are cached between calls
+	auto states_count = mn::regex_dfa_states_count(dfa);
+	res = mn::regex_dfa_search(dfa, text);
+	CHECK(res.match == true);
+	CHECK(mn::regex_dfa_states_count(dfa) == states_count);
+
+	CHECK(mn::regex_dfa_search(dfa, "mostafa@mail.org").match == false);
+	CHECK(mn::regex_dfa_match(dfa, "mostafa@mail.com").match == true);
+	CHECK(mn::regex_dfa_match(dfa, " mostafa@mail.com").match == false);
+}
+
+TEST_CASE("regex program dfa cache")
+{
+	auto [prog, err] = mn::regex_compile("[a-z]+@[a-z]+\\.com");
+	CHECK(!err);
+	mn_defer{mn::regex_free(prog);};
+
+	// short inputs don't build the DFA, and they match the same as the DFA does
+	const char* inputs[] = {"mostafa@mail.com", "send it to mostafa@mail.com please", "mostafa@mail.org", "@mail.com", ""};
+	auto dfa = mn::regex_dfa_new(prog);
+	mn_defer{mn::regex_dfa_free(dfa);};
+	for (auto input: inputs)
+	{
+		auto expected = mn::regex_dfa_search(dfa, input);
+		auto res = mn::regex_search(prog, input);
+		CHECK(res.match == expected.match);
+		CHECK(res.begin == expected.begin);
+		CHECK(res.end == expected.end);
+
+		expected = mn::regex_dfa_match(dfa, input);
+		res = mn::regex_match(prog, input);
+		CHECK(res.match == expected.match);
+		CHECK(res.end == expected.end);
+	}
+	CHECK(prog.dfa == nullptr);
+
+	// long inputs build the DFA once and later calls reuse it
+	auto text = mn::str_tmp();
+	for (size_t i = 0; i < 100; ++i)
+		mn::str_push(text, "nothing here ");
+	mn::str_push(text, "mostafa@mail.com");
+	auto res = mn::regex_search(prog, text);
+	CHECK(res.match == true);
+	CHECK(mn::str_from_substr(res.begin, res.end, mn::memory::tmp()) == "mostafa@mail.com");
+	CHECK(prog.dfa != nullptr);
+
+	auto cached = prog.dfa;
+	CHECK(mn::regex_match(prog, text).match == false);
+	CHECK(mn::regex_search(prog, "a@b.com").match == true);
+	CHECK(prog.dfa == cached);
+}
+
+TEST_CASE("regex set")
+{
+	auto set = mn::regex_set_new();
+	mn_defer{mn::regex_set_free(set);};
+
+	CHECK(mn::regex_set_add(set, "error", 10).val == 0);
+	CHECK(mn::regex_set_add(set, "[0-9]+ms", 20).val == 1);
+	CHECK(mn::regex_set_add(set, "warn(ing)?", 30).val == 2);
+	CHECK(mn::regex_set_add(set, "(unclosed", 40).err);
+	CHECK(mn::regex_set_count(set) == 3);
+
+	auto payloads = mn::buf_with_allocator<int32_t>(mn::memory::tmp());
+	CHECK(mn::regex_set_search_all(set, "warning: request took 250ms", payloads) == true);
+	CHECK(payloads.count == 2);
+	CHECK(payloads[0] == 20);
+	CHECK(payloads[1] == 30);
+
+	CHECK(mn::regex_set_search_all(set, "all good", payloads) == false);
+	CHECK(payloads.count == 0);
+
+	auto text = "request took 250ms then error";
+	auto res = mn::regex_set_search_first(set, text);
+	CHECK(res.match == true);
+	CHECK(res.payload == 20);
+	CHECK(mn::str_from_substr(res.begin, res.end, mn::memory::tmp()) == "250ms");
+}
+
+TEST_CASE("regex range search")
+{
+	auto prog = compile("[0-9]+");
+	auto text = "id: 1234, next: 56";
+	// the range ends in the middle of the number and isn't null terminated
+	auto res = mn::regex_search(prog, text, text + 6);
+	CHECK(res.match == true);
+	CHECK(res.begin == text + 4);
+	CHECK(res.end == text + 6);
+
+	CHECK(mn::regex_search(prog, text, text + 4).match == false);
+	CHECK(mn::regex_match(prog, mn::str_lit("42abc")).match == true);
+	CHECK(mn::regex_search(prog, mn::str_new()).match == false);
+}
+
+TEST_CASE("regex streaming matcher")
+{
+	auto prog = compile("ab+c");
+	auto matcher = mn::regex_matcher_new(prog);
+	mn_defer{mn::regex_matcher_free(matcher);};
+
+	// the match spans chunk boundaries
+	mn::regex_matcher_feed(matcher, mn::str_lit("xxa"));
+	mn::regex_matcher_feed(matcher, mn::str_lit("bb"));
+	mn::Regex_Stream_Match match{};
+	CHECK(mn::regex_matcher_next(matcher, match) == false);
+	mn::regex_matcher_feed(matcher, mn::str_lit("bcyyabc"));
+	mn::regex_matcher_finish(matcher);
+
+	CHECK(mn::regex_matcher_next(matcher, match) == true);
+	CHECK(match.begin == 2);
+	CHECK(match.end == 7);
+	CHECK(mn::regex_matcher_next(matcher, match) == true);
+	CHECK(match.begin == 9);
+	CHECK(match.end == 12);
+	CHECK(mn::regex_matcher_next(matcher, match) == false);
+
+	auto line_matcher = mn::regex_matcher_new(compile("error [0-9]+"));
+	mn_defer{mn::regex_matcher_free(line_matcher);};
+	auto reader = mn::reader_str(mn::str_lit("ok\nerror 404\nok\nerror 500\n"));
+	mn_defer{mn::reader_free(reader);};
+	size_t count = 0;
+	while (mn::regex_matcher_next(line_matcher, reader, match))
+		++count;
+	CHECK(count == 2);
+	CHECK(match.begin == 16);
+	CHECK(match.end == 25);
+}
+
 TEST_CASE("str runes iterator")
 {
 	mn::Rune runes[] = {'M', 'o', 's', 't', 'a', 'f', 'a'};